@@ -1,11 +1,15 @@
+#include <stdatomic.h>
 #include "system/system.h"
+#include "system/threads.h"
 #include "vulkan/vulkan.h"
 #include "audio/audio.h"
+#include "image/image.h"
 #include "model/bmodel.h"
 #include "loadingscreen.h"
 #include "assetmanager.h"
 
 extern VkuContext_t vkContext;
+extern VkuUploadBatch_t uploadBatch;
 extern LoadingScreen_t loadingScreen;
 
 // Layout is:
@@ -72,46 +76,144 @@ AssetManager_t *AssetManager_GetAsset(AssetManager_t *assets, uint32_t ID)
 	return &assets[assetIndices[ID]];
 }
 
+// Number of worker threads used for decoding asset files
+#define ASSET_LOADER_THREADS 4
+
+typedef enum
+{
+	ASSET_JOB_PENDING=0,
+	ASSET_JOB_DONE,
+	ASSET_JOB_FAILED
+} AssetJobState;
+
+typedef struct
+{
+	AssetManager_t *asset;
+	atomic_int state;
+} AssetJob_t;
+
+// Worker job, loads and decodes the asset file into system memory.
+// Nothing in here touches the GPU, that's done in order on the calling thread.
+static void AssetManager_DecodeJob(void *arg)
+{
+	AssetJob_t *job=(AssetJob_t *)arg;
+	AssetManager_t *asset=job->asset;
+	bool result=false;
+
+	switch(asset->type)
+	{
+		case ASSET_TEXTURE:
+			result=Image_Load(&asset->image, asset->filename, asset->flags);
+			break;
+
+		case ASSET_MODEL:
+			result=LoadBModel(&asset->model, asset->filename);
+			break;
+
+		case ASSET_SOUND:
+			result=Audio_LoadStatic(asset->filename, &asset->sound);
+			break;
+
+		default:
+			DBGPRINTF(DEBUG_ERROR, "Unknown asset type.\n");
+	}
+
+	atomic_store(&job->state, result?ASSET_JOB_DONE:ASSET_JOB_FAILED);
+}
+
+// Frees the system memory copy of an asset that was decoded but never uploaded
+static void AssetManager_FreeDecoded(AssetManager_t *asset)
+{
+	switch(asset->type)
+	{
+		case ASSET_TEXTURE:
+			Zone_Free(zone, asset->image.data);
+			asset->image.data=NULL;
+			break;
+
+		case ASSET_MODEL:
+			FreeBModel(&asset->model);
+			break;
+
+		case ASSET_SOUND:
+			Zone_Free(zone, asset->sound.data);
+			asset->sound.data=NULL;
+			break;
+
+		default:
+			break;
+	}
+}
+
 bool AssetManagerLoad(AssetManager_t *assets, uint32_t numAssets)
 {
+	ThreadWorker_t workers[ASSET_LOADER_THREADS];
+	bool result=true;
+	uint32_t failed=numAssets;
+
+	AssetJob_t *jobs=(AssetJob_t *)Zone_Malloc(zone, sizeof(AssetJob_t)*numAssets);
+
+	if(jobs==NULL)
+	{
+		DBGPRINTF(DEBUG_ERROR, "AssetManagerLoad: Unable to allocate memory for job list.\n");
+		return false;
+	}
+
+	for(uint32_t i=0;i<ASSET_LOADER_THREADS;i++)
+	{
+		Thread_Init(&workers[i]);
+		Thread_Start(&workers[i]);
+	}
+
+	// Kick off all the file loading/decoding, spread over the workers
+	for(uint32_t i=0;i<numAssets;i++)
+	{
+		jobs[i].asset=&assets[i];
+		atomic_init(&jobs[i].state, ASSET_JOB_PENDING);
+
+		if(assets[i].filename==NULL)
+			continue;
+
+		DBGPRINTF(DEBUG_INFO, "Loading %s...\n", assets[i].filename);
+
+		if(!Thread_AddJob(&workers[i%ASSET_LOADER_THREADS], AssetManager_DecodeJob, &jobs[i]))
+			AssetManager_DecodeJob(&jobs[i]);
+	}
+
+	// Consume decoded assets in order, recording GPU uploads into the shared batch as they come in
 	for(uint32_t i=0;i<numAssets;i++)
 	{
 		if(assets[i].filename!=NULL)
 		{
-			DBGPRINTF(DEBUG_INFO, "Loading %s...\n", assets[i].filename);
-			bool result=true;
+			int state;
+
+			while((state=atomic_load(&jobs[i].state))==ASSET_JOB_PENDING)
+				thrd_yield();
 
-			switch(assets[i].type)
+			if(state==ASSET_JOB_DONE)
 			{
-				case ASSET_TEXTURE:
+				switch(assets[i].type)
 				{
-					result=Image_Upload(&vkContext, &assets[i].image, assets[i].filename, assets[i].flags);
-					break;
-				}
+					case ASSET_TEXTURE:
+						result=Image_UploadBatch(&vkContext, &uploadBatch, &assets[i].image, assets[i].flags);
+						break;
 
-				case ASSET_MODEL:
-				{
-					result=LoadBModel(&assets[i].model, assets[i].filename);
+					case ASSET_MODEL:
+						result=BuildMemoryBuffersBModel(&vkContext, &uploadBatch, &assets[i].model);
+						break;
 
-					if(result)
-						BuildMemoryBuffersBModel(&vkContext, &assets[i].model);
-					break;
+					default:
+						break;
 				}
-
-				case ASSET_SOUND:
-				{
-					result=Audio_LoadStatic(assets[i].filename, &assets[i].sound);
-					break;
-				}
-
-				default:
-					DBGPRINTF(DEBUG_ERROR, "Unknown asset type.\n");
 			}
+			else
+				result=false;
 
 			if(!result)
 			{
 				DBGPRINTF(DEBUG_ERROR, "Init: Failed to load %s\n", assets[i].filename);
-				return false;
+				failed=i;
+				break;
 			}
 
 			LoadingScreenAdvance(&loadingScreen);
@@ -120,7 +222,27 @@ bool AssetManagerLoad(AssetManager_t *assets, uint32_t numAssets)
 		assetIndices[assets[i].index]=i;
 	}
 
-	return true;
+	// Waits for any outstanding decode jobs to finish before tearing down
+	for(uint32_t i=0;i<ASSET_LOADER_THREADS;i++)
+		Thread_Destroy(&workers[i]);
+
+	// Everything after a failure was decoded for nothing, none of it got as far as an upload
+	for(uint32_t i=failed+1;i<numAssets;i++)
+	{
+		if(assets[i].filename!=NULL&&atomic_load(&jobs[i].state)==ASSET_JOB_DONE)
+			AssetManager_FreeDecoded(&assets[i]);
+	}
+
+	// Only wait on the GPU once, for everything
+	if(!vkuUploadBatch_Wait(&uploadBatch, vkuUploadBatch_GetTicket(&uploadBatch)))
+	{
+		DBGPRINTF(DEBUG_ERROR, "AssetManagerLoad: Failed to finish asset uploads.\n");
+		result=false;
+	}
+
+	Zone_Free(zone, jobs);
+
+	return result;
 }
 
 void AssetManagerDestroy(AssetManager_t *assets, uint32_t numAssets)
@@ -138,9 +260,7 @@ void AssetManagerDestroy(AssetManager_t *assets, uint32_t numAssets)
 			case ASSET_MODEL:
 			{
 				vkuDestroyBuffer(&vkContext, &assets[i].model.vertexBuffer);
-
-				for(uint32_t j=0;j<assets[i].model.numMesh;j++)
-					vkuDestroyBuffer(&vkContext, &assets[i].model.mesh[j].indexBuffer);
+				vkuDestroyBuffer(&vkContext, &assets[i].model.indexBuffer);
 
 				FreeBModel(&assets[i].model);
 				break;
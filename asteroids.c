@@ -7,7 +7,7 @@
 #include "asteroids.h"
 
 extern EntityList_t entityList;
-matrix AsteroidTransform(const RigidBody_t *body);
+EntityTransform_t AsteroidTransform(void);
 
 uint32_t numAsteroids=1000;
 RigidBody_t asteroids[MAX_ASTEROIDS];
@@ -143,7 +143,7 @@ void AddAsteroid(vec3 position, vec3 velocity, float radius, uint32_t variant)
 	asteroidModels[numAsteroids].tex1ID=TEXTURE_ASTEROID1+(2*variant+1);
  
 	asteroids[numAsteroids]=asteroid;
-	asteroidModels[numAsteroids].entityID=EntityList_Add(&entityList, &asteroids[numAsteroids], false, asteroidModels[numAsteroids].modelID, asteroidModels[numAsteroids].tex0ID, asteroidModels[numAsteroids].tex1ID, ENTITYOBJECTTYPE_FIELD, AsteroidTransform);
+	asteroidModels[numAsteroids].entityID=EntityList_Add(&entityList, &asteroids[numAsteroids], false, asteroidModels[numAsteroids].modelID, asteroidModels[numAsteroids].tex0ID, asteroidModels[numAsteroids].tex1ID, ENTITYOBJECTTYPE_FIELD, AsteroidTransform());
 	numAsteroids++;
 }
 
@@ -9,6 +9,7 @@
 #include "../math/math.h"
 #include "../camera/camera.h"
 #include "../utils/spatialhash.h"
+#include "../utils/archive.h"
 #include "qoa.h"
 #include "dsp.h"
 #include "audio.h"
@@ -690,54 +691,24 @@ bool Audio_LoadStatic(const char *filename, Sample_t *sample)
 		else if(!strcmp(extension, ".qoa"))
 		{
 			QOA_Desc_t qoa;
-			FILE *stream=NULL;
+			ArchiveFile_t file;
 
-			if((stream=fopen(filename, "rb"))==NULL)
-				return false;
-
-			// Seek to end of file to get file size, rescaling to align to 32 bit
-			fseek(stream, 0, SEEK_END);
-
-			int32_t size=ftell(stream);
-
-			if(size==-1)
+			if(!Archive_ReadFile(filename, &file))
 			{
-				fclose(stream);
-				return false;
-			}
-
-			fseek(stream, 0, SEEK_SET);
-
-			uint8_t *data=(uint8_t *)Zone_Malloc(zone, size);
-
-			if(data==NULL)
-			{
-				DBGPRINTF(DEBUG_ERROR, "Unable to allocate memory for file %s.\n", filename);
-				fclose(stream);
-				return false;
-			}
-
-			if(fread(data, 1, size, stream)!=size)
-			{
-				DBGPRINTF(DEBUG_ERROR, "Size read does not match for file %s.\n", filename);
-				Zone_Free(zone, data);
-				fclose(stream);
+				DBGPRINTF(DEBUG_ERROR, "Unable to load file %s.\n", filename);
 				return false;
 			}
 
-			fclose(stream);
+			buffer=(uint8_t *)QOA_Decode(file.data, (uint32_t)file.size, &qoa);
 
-			buffer=(uint8_t *)QOA_Decode(data, size, &qoa);
+			Archive_CloseFile(&file);
 
 			if(buffer==NULL)
 			{
 				DBGPRINTF(DEBUG_ERROR, "QOA decode for file %s failed.\n", filename);
-				Zone_Free(zone, data);
 				return false;
 			}
 
-			Zone_Free(zone, data);
-
 			if(qoa.channels>2)
 			{
 				DBGPRINTF(DEBUG_ERROR, "QOA too many channels (%d) for file %s.\n", qoa.channels, filename);
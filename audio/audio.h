@@ -128,6 +128,7 @@ bool Audio_StopStream(uint32_t stream);
 int Audio_Init(void);
 void Audio_Destroy(void);
 
+void *WavReadMemory(const uint8_t *data, size_t size, WaveFormat_t *format, uint32_t *numSamples);
 void *WavRead(const char *filename, WaveFormat_t *format, uint32_t *numSamples);
 uint32_t WavWrite(const char *filename, int16_t *samples, uint32_t numSamples, uint32_t sampleRate, uint16_t channels);
 
@@ -8,6 +8,8 @@
 #include <string.h>
 #include "../system/system.h"
 #include "../math/math.h"
+#include "../utils/archive.h"
+#include "../utils/memstream.h"
 #include "audio.h"
 
 // Chunk magic markers
@@ -22,42 +24,42 @@ typedef struct RIFFChunk_s
 	uint32_t size;
 } RIFFChunk_t;
 
-void *WavRead(const char *filename, WaveFormat_t *format, uint32_t *numSamples)
+void *WavReadMemory(const uint8_t *data, size_t size, WaveFormat_t *format, uint32_t *numSamples)
 {
-	FILE *stream=NULL;
+	MemStream_t stream;
 	RIFFChunk_t chunk={ 0 };
 	uint32_t waveMagic=0;
 	uint32_t dataSize=0;
 	uint8_t *buffer=NULL;
 	bool foundFormat=false, foundData=false;
 
-	if(filename==NULL||format==NULL||numSamples==NULL)
+	if(data==NULL||format==NULL||numSamples==NULL)
 		return NULL;
 
-	stream=fopen(filename, "rb");
-   
-	if(stream==NULL)
-		return NULL;
+	MemStream_Init(&stream, data, size);
 
 	// RIFF header chunk, check chunk magic marker and make sure file size matches the chunk size
-	if(fread(&chunk, sizeof(RIFFChunk_t), 1, stream)!=1||chunk.magic!=RIFF_MAGIC)
+	if(MemStream_Read(&stream, &chunk, sizeof(RIFFChunk_t), 1)!=1||chunk.magic!=RIFF_MAGIC)
 		goto error;
 
 	// WAVE magic marker ("WAVE") should follow after the RIFF chunk
-	if(fread(&waveMagic, sizeof(uint32_t), 1, stream)!=1&&waveMagic!=WAVE_MAGIC)
+	if(MemStream_Read(&stream, &waveMagic, sizeof(uint32_t), 1)!=1||waveMagic!=WAVE_MAGIC)
 		goto error;
 
 	while(!(foundFormat&&foundData))
 	{
 		// Read in a chunk to process
-		if(!fread(&chunk, sizeof(RIFFChunk_t), 1, stream))
+		if(!MemStream_Read(&stream, &chunk, sizeof(RIFFChunk_t), 1))
 			goto error;
 
+		// RIFF chunks are padded to an even size
+		const size_t chunkEnd=stream.position+chunk.size+(chunk.size&1);
+
 		switch(chunk.magic)
 		{
 			case FMT_MAGIC:
 			{
-				if(fread(format, sizeof(WaveFormat_t), 1, stream)!=1)
+				if(MemStream_Read(&stream, format, sizeof(WaveFormat_t), 1)!=1)
 					goto error;
 
 				// Only support PCM streams and up to 2 channels
@@ -76,7 +78,7 @@ void *WavRead(const char *filename, WaveFormat_t *format, uint32_t *numSamples)
 					goto error;
 
 				// Read in audio data
-				if(fread(buffer, 1, chunk.size, stream)!=chunk.size)
+				if(MemStream_Read(&stream, buffer, 1, chunk.size)!=chunk.size)
 					goto error;
 
 				dataSize=chunk.size;
@@ -85,29 +87,45 @@ void *WavRead(const char *filename, WaveFormat_t *format, uint32_t *numSamples)
 			}
 
 			default:
-				fseek(stream, chunk.size, SEEK_CUR);
 				break;
 		}
+
+		// Move to the next chunk, format chunks may be bigger than what was read (WAVEFORMATEXTENSIBLE)
+		if(chunkEnd>stream.position&&!MemStream_Skip(&stream, chunkEnd-stream.position))
+		{
+			if(!(foundFormat&&foundData))
+				goto error;
+		}
 	}
 
-	if(foundFormat&&foundData)
-	{
-		fclose(stream);
-		*numSamples=dataSize/(format->bitsPerSample>>3)/format->channels;
+	*numSamples=dataSize/(format->bitsPerSample>>3)/format->channels;
 
-		return buffer;
-	}
+	return buffer;
 
 error:
-	if(stream)
-		fclose(stream);
-
 	if(buffer)
 		Zone_Free(zone, buffer);
 
 	return NULL;
 }
 
+void *WavRead(const char *filename, WaveFormat_t *format, uint32_t *numSamples)
+{
+	ArchiveFile_t file;
+
+	if(filename==NULL)
+		return NULL;
+
+	if(!Archive_ReadFile(filename, &file))
+		return NULL;
+
+	void *buffer=WavReadMemory(file.data, file.size, format, numSamples);
+
+	Archive_CloseFile(&file);
+
+	return buffer;
+}
+
 uint32_t WavWrite(const char *filename, int16_t *samples, uint32_t numSamples, uint32_t sampleRate, uint16_t channels)
 {
 	uint32_t dataSize=numSamples*channels*sizeof(int16_t);
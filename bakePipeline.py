@@ -0,0 +1,602 @@
+#!/usr/bin/python
+
+import base64
+import re
+import struct
+import sys
+import argparse
+from pathlib import Path
+
+# Binary pipeline blob, loaded by CreatePipeline in utils/pipeline.c.
+# Everything is little-endian uint32:
+#   header:    magic, version, source hash, flags, numBindings, numVertexBindings, numVertexAttributes, numStates, numStages,
+#              pushConstant offset, size, stageFlags
+#   bindings:  binding, descriptorType, stageFlags
+#   vertex bindings:   binding, stride, inputRate
+#   vertex attributes: location, binding, format, offset
+#   states:    field id, value (raw 32 bits, floats stored as IEEE bits)
+#   stages:    stage, size in bytes, SPIR-V words
+BLOB_MAGIC = 0x42504B56  # 'VKPB'
+BLOB_VERSION = 2
+
+BLOB_DESCRIPTORSET = 0x1
+BLOB_PIPELINE = 0x2
+
+SHADER_STAGES = {
+    "vertex": "VK_SHADER_STAGE_VERTEX_BIT",
+    "tessellationControl": "VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT",
+    "tessellationEvaluation": "VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT",
+    "geometry": "VK_SHADER_STAGE_GEOMETRY_BIT",
+    "fragment": "VK_SHADER_STAGE_FRAGMENT_BIT",
+    "compute": "VK_SHADER_STAGE_COMPUTE_BIT",
+}
+
+DESCRIPTOR_TYPES = {
+    "sampler": "VK_DESCRIPTOR_TYPE_SAMPLER",
+    "combinedSampler": "VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER",
+    "sampledImage": "VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE",
+    "storageImage": "VK_DESCRIPTOR_TYPE_STORAGE_IMAGE",
+    "uniformTexelBuffer": "VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER",
+    "storageTexelBuffer": "VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER",
+    "uniformBuffer": "VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER",
+    "storageBuffer": "VK_DESCRIPTOR_TYPE_STORAGE_BUFFER",
+    "uniformBufferDynamic": "VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC",
+    "storageBufferDynamic": "VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC",
+    "inputAttachment": "VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT",
+}
+
+INPUT_RATES = {
+    "perVertex": "VK_VERTEX_INPUT_RATE_VERTEX",
+    "perInstance": "VK_VERTEX_INPUT_RATE_INSTANCE",
+}
+
+TOPOLOGIES = {
+    "pointList": "VK_PRIMITIVE_TOPOLOGY_POINT_LIST",
+    "lineList": "VK_PRIMITIVE_TOPOLOGY_LINE_LIST",
+    "lineStrip": "VK_PRIMITIVE_TOPOLOGY_LINE_STRIP",
+    "triangleList": "VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST",
+    "triangleStrip": "VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP",
+    "triangleFan": "VK_PRIMITIVE_TOPOLOGY_TRIANGLE_FAN",
+    "listListAdjacency": "VK_PRIMITIVE_TOPOLOGY_LINE_LIST_WITH_ADJACENCY",
+    "listStripAdjacency": "VK_PRIMITIVE_TOPOLOGY_LINE_STRIP_WITH_ADJACENCY",
+    "triangleListAdjacency": "VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST_WITH_ADJACENCY",
+    "triangleStripAdjacency": "VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP_WITH_ADJACENCY",
+    "patchList": "VK_PRIMITIVE_TOPOLOGY_PATCH_LIST",
+}
+
+POLYGON_MODES = {
+    "fill": "VK_POLYGON_MODE_FILL",
+    "line": "VK_POLYGON_MODE_LINE",
+    "point": "VK_POLYGON_MODE_POINT",
+}
+
+CULL_MODES = {
+    "none": "VK_CULL_MODE_NONE",
+    "front": "VK_CULL_MODE_FRONT_BIT",
+    "back": "VK_CULL_MODE_BACK_BIT",
+    "frontAndBack": "VK_CULL_MODE_FRONT_AND_BACK",
+}
+
+FRONT_FACES = {
+    "ccw": "VK_FRONT_FACE_COUNTER_CLOCKWISE",
+    "cw": "VK_FRONT_FACE_CLOCKWISE",
+}
+
+COMPARE_OPS = {
+    "never": "VK_COMPARE_OP_NEVER",
+    "less": "VK_COMPARE_OP_LESS",
+    "equal": "VK_COMPARE_OP_EQUAL",
+    "lessOrEqual": "VK_COMPARE_OP_LESS_OR_EQUAL",
+    "greater": "VK_COMPARE_OP_GREATER",
+    "notEqual": "VK_COMPARE_OP_NOT_EQUAL",
+    "greaterOrEqual": "VK_COMPARE_OP_GREATER_OR_EQUAL",
+    "always": "VK_COMPARE_OP_ALWAYS",
+}
+
+STENCIL_OPS = {
+    "keep": "VK_STENCIL_OP_KEEP",
+    "zero": "VK_STENCIL_OP_ZERO",
+    "replace": "VK_STENCIL_OP_REPLACE",
+    "incrementAndClamp": "VK_STENCIL_OP_INCREMENT_AND_CLAMP",
+    "decrementAndClamp": "VK_STENCIL_OP_DECREMENT_AND_CLAMP",
+    "invert": "VK_STENCIL_OP_INVERT",
+    "invcrementAndWrap": "VK_STENCIL_OP_INCREMENT_AND_WRAP",
+    "decrementAndWrap": "VK_STENCIL_OP_DECREMENT_AND_WRAP",
+}
+
+LOGIC_OPS = {
+    "clear": "VK_LOGIC_OP_CLEAR",
+    "and": "VK_LOGIC_OP_AND",
+    "andReverse": "VK_LOGIC_OP_AND_REVERSE",
+    "copy": "VK_LOGIC_OP_COPY",
+    "andInverted": "VK_LOGIC_OP_AND_INVERTED",
+    "nop": "VK_LOGIC_OP_NO_OP",
+    "or": "VK_LOGIC_OP_OR",
+    "nor": "VK_LOGIC_OP_NOR",
+    "equivalent": "VK_LOGIC_OP_EQUIVALENT",
+    "invert": "VK_LOGIC_OP_INVERT",
+    "orReverse": "VK_LOGIC_OP_OR_REVERSE",
+    "copyInverted": "VK_LOGIC_OP_COPY_INVERTED",
+    "orInverted": "VK_LOGIC_OP_OR_INVERTED",
+    "nand": "VK_LOGIC_OP_NAND",
+    "set": "VK_LOGIC_OP_SET",
+}
+
+BLEND_FACTORS = {
+    "zero": "VK_BLEND_FACTOR_ZERO",
+    "one": "VK_BLEND_FACTOR_ONE",
+    "srcColor": "VK_BLEND_FACTOR_SRC_COLOR",
+    "oneMinusSrcColor": "VK_BLEND_FACTOR_ONE_MINUS_SRC_COLOR",
+    "dstColor": "VK_BLEND_FACTOR_DST_COLOR",
+    "oneMinusDstColor": "VK_BLEND_FACTOR_ONE_MINUS_DST_COLOR",
+    "srcAlpha": "VK_BLEND_FACTOR_SRC_ALPHA",
+    "oneMinusSrcAlpha": "VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA",
+    "dstAlpha": "VK_BLEND_FACTOR_DST_ALPHA",
+    "oneMinusDstAlpha": "VK_BLEND_FACTOR_ONE_MINUS_DST_ALPHA",
+    "constantColor": "VK_BLEND_FACTOR_CONSTANT_COLOR",
+    "oneMinusConstantColor": "VK_BLEND_FACTOR_ONE_MINUS_CONSTANT_COLOR",
+    "constantAlpha": "VK_BLEND_FACTOR_CONSTANT_ALPHA",
+    "oneMinusConstantAlpha": "VK_BLEND_FACTOR_ONE_MINUS_CONSTANT_ALPHA",
+    "srcAlphaSaturate": "VK_BLEND_FACTOR_SRC_ALPHA_SATURATE",
+    "src1Color": "VK_BLEND_FACTOR_SRC1_COLOR",
+    "oneMinusSrc1Color": "VK_BLEND_FACTOR_ONE_MINUS_SRC1_COLOR",
+    "src1Alpha": "VK_BLEND_FACTOR_SRC1_ALPHA",
+    "oneMinusSrc1Alpha": "VK_BLEND_FACTOR_ONE_MINUS_SRC1_ALPHA",
+}
+
+BLEND_OPS = {
+    "add": "VK_BLEND_OP_ADD",
+    "subtract": "VK_BLEND_OP_SUBTRACT",
+    "reverseSubtract": "VK_BLEND_OP_REVERSE_SUBTRACT",
+    "min": "VK_BLEND_OP_MIN",
+    "max": "VK_BLEND_OP_MAX",
+}
+
+COLOR_COMPONENTS = {
+    "colorR": "VK_COLOR_COMPONENT_R_BIT",
+    "colorG": "VK_COLOR_COMPONENT_G_BIT",
+    "colorB": "VK_COLOR_COMPONENT_B_BIT",
+    "colorA": "VK_COLOR_COMPONENT_A_BIT",
+}
+
+SAMPLE_COUNTS = (1, 2, 4, 8, 16, 32, 64)
+
+# Packed vertex formats that don't follow the "<channels><bits>_<type>" naming
+PACKED_FORMATS = {
+    "abgr8": "A8B8G8R8",
+    "a2r10g10b10": "A2R10G10B10",
+    "a2b10g10r10": "A2B10G10R10",
+}
+
+# Pipeline state keywords, the index is the field id stored in the blob.
+# Order must match pipelineStateOffsets[] in utils/pipeline.c.
+# Value kinds: "int", "float", "bool", "samples", "mask" or a name->VK enum table.
+STATE_FIELDS = [
+    ("subpass", "int"),
+    ("topology", TOPOLOGIES),
+    ("primitiveRestart", "bool"),
+    ("depthClamp", "bool"),
+    ("rasterizerDiscard", "bool"),
+    ("polygonMode", POLYGON_MODES),
+    ("cullMode", CULL_MODES),
+    ("frontFace", FRONT_FACES),
+    ("depthBias", "bool"),
+    ("depthBiasConstantFactor", "float"),
+    ("depthBiasClamp", "float"),
+    ("depthBiasSlopeFactor", "float"),
+    ("lineWidth", "float"),
+    ("depthTest", "bool"),
+    ("depthWrite", "bool"),
+    ("depthCompareOp", COMPARE_OPS),
+    ("depthBoundsTest", "bool"),
+    ("stencilTest", "bool"),
+    ("minDepthBounds", "float"),
+    ("maxDepthBounds", "float"),
+    ("frontStencilFailOp", STENCIL_OPS),
+    ("frontStencilPassOp", STENCIL_OPS),
+    ("frontStencilDepthFailOp", STENCIL_OPS),
+    ("frontStencilCompareOp", COMPARE_OPS),
+    ("frontStencilCompareMask", "int"),
+    ("frontStencilWriteMask", "int"),
+    ("frontStencilReference", "int"),
+    ("backStencilFailOp", STENCIL_OPS),
+    ("backStencilPassOp", STENCIL_OPS),
+    ("backStencilDepthFailOp", STENCIL_OPS),
+    ("backStencilCompareOp", COMPARE_OPS),
+    ("backStencilCompareMask", "int"),
+    ("backStencilWriteMask", "int"),
+    ("backStencilReference", "int"),
+    ("rasterizationSamples", "samples"),
+    ("sampleShading", "bool"),
+    ("minSampleShading", "float"),
+    ("alphaToCoverage", "bool"),
+    ("alphaToOne", "bool"),
+    ("blendLogicOp", "bool"),
+    ("blendLogicOpState", LOGIC_OPS),
+    ("blend", "bool"),
+    ("srcColorBlendFactor", BLEND_FACTORS),
+    ("dstColorBlendFactor", BLEND_FACTORS),
+    ("colorBlendOp", BLEND_OPS),
+    ("srcAlphaBlendFactor", BLEND_FACTORS),
+    ("dstAlphaBlendFactor", BLEND_FACTORS),
+    ("alphaBlendOp", BLEND_OPS),
+    ("colorWriteMask", "mask"),
+]
+
+STATE_IDS = {name: index for index, (name, _) in enumerate(STATE_FIELDS)}
+
+
+class BakeError(Exception):
+    pass
+
+
+def source_hash(data):
+    """32bit FNV-1a of the pipeline description, PipelineSourceHash in utils/pipeline.c must match."""
+    value = 0x811C9DC5
+
+    for byte in data:
+        value = ((value ^ byte) * 0x01000193) & 0xFFFFFFFF
+
+    return value
+
+
+def load_vulkan_enums(header_path):
+    """Collects every VK_* enumerant value from vulkan_core.h, resolving aliases."""
+    values = {"VK_FALSE": 0, "VK_TRUE": 1}
+    aliases = {}
+
+    enum_pattern = re.compile(r'^\s*(VK_\w+)\s*=\s*([^,\s]+)\s*,?', re.MULTILINE)
+
+    with open(header_path, 'r') as f:
+        content = f.read()
+
+    for name, value in enum_pattern.findall(content):
+        value = value.rstrip('uUlL')
+
+        try:
+            values[name] = int(value, 0)
+        except ValueError:
+            aliases[name] = value
+
+    for name, target in aliases.items():
+        while target in aliases:
+            target = aliases[target]
+
+        if target in values:
+            values[name] = values[target]
+
+    return values
+
+
+def tokenize(text):
+    """Splits a pipeline description into (type, value) tokens, matching utils/tokenizer.c closely enough for the DSL."""
+    token_pattern = re.compile(r'''
+        (?P<comment>//[^\n]*|\#[^\n]*|/\*.*?\*/)
+        |(?P<space>\s+)
+        |(?P<quoted>"[^"]*")
+        |(?P<number>[-+]?(?:\d+\.\d*|\.\d+|\d+)(?:[eE][-+]?\d+)?f?)
+        |(?P<name>[A-Za-z_][A-Za-z0-9_]*)
+        |(?P<delimiter>[{}(),|])
+        ''', re.VERBOSE | re.DOTALL)
+
+    tokens = []
+    position = 0
+
+    while position < len(text):
+        match = token_pattern.match(text, position)
+
+        if not match:
+            line = text.count('\n', 0, position) + 1
+            raise BakeError(f"line {line}: unexpected character '{text[position]}'")
+
+        position = match.end()
+        kind = match.lastgroup
+
+        if kind in ("comment", "space"):
+            continue
+
+        value = match.group(kind)
+
+        if kind == "quoted":
+            value = value[1:-1]
+        elif kind == "number":
+            number = value.rstrip('f')
+            kind = "float" if any(c in number for c in ".eE") else "int"
+            value = float(number) if kind == "float" else int(number)
+
+        tokens.append((kind, value))
+
+    return tokens
+
+
+class Parser:
+    def __init__(self, tokens, enums, base_path, source_hash):
+        self.tokens = tokens
+        self.source_hash = source_hash
+        self.position = 0
+        self.enums = enums
+        self.base_path = base_path
+
+        self.flags = 0
+        self.bindings = []
+        self.vertex_bindings = []
+        self.vertex_attributes = []
+        self.states = {}
+        self.stages = []
+        self.push_constant = (0, 0, 0)
+
+    def next(self):
+        if self.position >= len(self.tokens):
+            raise BakeError("unexpected end of file")
+
+        token = self.tokens[self.position]
+        self.position += 1
+        return token
+
+    def peek(self):
+        return self.tokens[self.position] if self.position < len(self.tokens) else (None, None)
+
+    def expect(self, delimiter):
+        kind, value = self.next()
+
+        if kind != "delimiter" or value != delimiter:
+            raise BakeError(f"expected '{delimiter}', got '{value}'")
+
+    def vk(self, name):
+        if name not in self.enums:
+            raise BakeError(f"'{name}' not found in Vulkan header")
+
+        return self.enums[name] & 0xFFFFFFFF
+
+    def lookup(self, table, what):
+        kind, value = self.next()
+
+        if kind != "name" or value not in table:
+            raise BakeError(f"unknown {what} '{value}'")
+
+        return self.vk(table[value])
+
+    def flag_list(self, table, what):
+        """Parses "a|b|c" into OR'd flags."""
+        flags = self.lookup(table, what)
+
+        while self.peek() == ("delimiter", "|"):
+            self.next()
+            flags |= self.lookup(table, what)
+
+        return flags
+
+    def integer(self):
+        kind, value = self.next()
+
+        if kind != "int":
+            raise BakeError(f"expected integer, got '{value}'")
+
+        return value & 0xFFFFFFFF
+
+    def format(self):
+        kind, value = self.next()
+
+        if kind != "name" or '_' not in value:
+            raise BakeError(f"unknown format '{value}'")
+
+        layout, numeric = value.split('_', 1)
+
+        if layout in PACKED_FORMATS:
+            return self.vk(f"VK_FORMAT_{PACKED_FORMATS[layout]}_{numeric.upper()}_PACK32")
+
+        match = re.fullmatch(r'([rgba]+)(\d+)', layout)
+
+        if not match:
+            raise BakeError(f"unknown format '{value}'")
+
+        channels = ''.join(f"{c.upper()}{match.group(2)}" for c in match.group(1))
+        return self.vk(f"VK_FORMAT_{channels}_{numeric.upper()}")
+
+    def parse(self):
+        while self.position < len(self.tokens):
+            kind, value = self.next()
+
+            if kind == "name" and value == "descriptorSet":
+                self.flags |= BLOB_DESCRIPTORSET
+                self.parse_block(self.parse_descriptor_set)
+            elif kind == "name" and value == "pipeline":
+                self.flags |= BLOB_PIPELINE
+                self.parse_block(self.parse_pipeline)
+            else:
+                raise BakeError(f"unexpected token '{value}'")
+
+    def parse_block(self, handler):
+        self.expect('{')
+
+        while self.peek() != ("delimiter", '}'):
+            kind, value = self.next()
+
+            if kind != "name":
+                raise BakeError(f"unexpected token '{value}'")
+
+            self.expect('(')
+            handler(value)
+            self.expect(')')
+
+        self.next()
+
+    def parse_descriptor_set(self, keyword):
+        if keyword != "addBinding":
+            raise BakeError(f"unknown descriptor set keyword '{keyword}'")
+
+        binding = self.integer()
+        self.expect(',')
+        descriptor_type = self.lookup(DESCRIPTOR_TYPES, "descriptor type")
+        self.expect(',')
+        stages = self.flag_list(SHADER_STAGES, "shader stage")
+
+        self.bindings.append((binding, descriptor_type, stages))
+
+    def parse_pipeline(self, keyword):
+        if keyword == "addStage":
+            self.parse_stage()
+        elif keyword == "addVertexBinding":
+            binding = self.integer()
+            self.expect(',')
+            stride = self.integer()
+            self.expect(',')
+            input_rate = self.lookup(INPUT_RATES, "input rate")
+
+            self.vertex_bindings.append((binding, stride, input_rate))
+        elif keyword == "addVertexAttribute":
+            location = self.integer()
+            self.expect(',')
+            binding = self.integer()
+            self.expect(',')
+            vertex_format = self.format()
+            self.expect(',')
+            offset = self.integer()
+
+            self.vertex_attributes.append((location, binding, vertex_format, offset))
+        elif keyword == "pushConstant":
+            offset = self.integer()
+            self.expect(',')
+            size = self.integer()
+            self.expect(',')
+            stages = self.flag_list(SHADER_STAGES, "shader stage")
+
+            self.push_constant = (offset, size, stages)
+        elif keyword == "sampleMask":
+            raise BakeError("sampleMask is not implemented")
+        elif keyword in STATE_IDS:
+            self.parse_state(keyword)
+        else:
+            raise BakeError(f"unknown pipeline keyword '{keyword}'")
+
+    def parse_stage(self):
+        kind, value = self.next()
+
+        if kind == "name" and value == "base64":
+            kind, value = self.next()
+
+            if kind != "quoted":
+                raise BakeError("expected quoted base64 string")
+
+            spirv = base64.b64decode(value)
+        elif kind == "quoted":
+            shader_path = Path(value)
+
+            if not shader_path.is_absolute():
+                shader_path = self.base_path / shader_path
+
+            with open(shader_path, 'rb') as f:
+                spirv = f.read()
+        else:
+            raise BakeError(f"unexpected token '{value}'")
+
+        self.expect(',')
+        stage = self.lookup(SHADER_STAGES, "shader stage")
+
+        # SPIR-V is a stream of 32bit words, pad just like vkuCreateShaderModule does
+        spirv += b'\0' * (-len(spirv) % 4)
+
+        self.stages.append((stage, spirv))
+
+    def parse_state(self, keyword):
+        value_kind = STATE_FIELDS[STATE_IDS[keyword]][1]
+
+        if isinstance(value_kind, dict):
+            value = self.lookup(value_kind, keyword)
+        elif value_kind == "int":
+            value = self.integer()
+        elif value_kind == "float":
+            kind, number = self.next()
+
+            if kind not in ("float", "int"):
+                raise BakeError(f"expected float, got '{number}'")
+
+            value = struct.unpack('<I', struct.pack('<f', float(number)))[0]
+        elif value_kind == "bool":
+            kind, name = self.next()
+
+            if kind != "name" or name not in ("true", "false"):
+                raise BakeError(f"expected boolean, got '{name}'")
+
+            value = self.vk("VK_TRUE" if name == "true" else "VK_FALSE")
+        elif value_kind == "samples":
+            count = self.integer()
+
+            if count not in SAMPLE_COUNTS:
+                raise BakeError(f"invalid sample count {count}")
+
+            value = self.vk(f"VK_SAMPLE_COUNT_{count}_BIT")
+        elif value_kind == "mask":
+            if self.peek() == ("name", "none"):
+                self.next()
+                value = 0
+            else:
+                value = self.flag_list(COLOR_COMPONENTS, "color component")
+
+        # Last assignment wins, same as the text parser
+        self.states[STATE_IDS[keyword]] = value
+
+    def serialize(self):
+        words = [
+            BLOB_MAGIC, BLOB_VERSION, self.source_hash, self.flags,
+            len(self.bindings), len(self.vertex_bindings), len(self.vertex_attributes), len(self.states), len(self.stages),
+            *self.push_constant,
+        ]
+
+        for entry in self.bindings + self.vertex_bindings + self.vertex_attributes:
+            words.extend(entry)
+
+        for field, value in sorted(self.states.items()):
+            words.extend((field, value))
+
+        blob = struct.pack(f'<{len(words)}I', *words)
+
+        for stage, spirv in self.stages:
+            blob += struct.pack('<2I', stage, len(spirv)) + spirv
+
+        return blob
+
+
+def bake_pipeline(input_file, output_file, enums):
+    input_path = Path(input_file)
+
+    # Hashed as raw bytes, the loader hashes the file exactly as it reads it
+    source = input_path.read_bytes()
+    text = source.decode('utf-8')
+
+    # Stage filenames are relative to the working directory at runtime, which is the project root
+    parser = Parser(tokenize(text), enums, Path.cwd(), source_hash(source))
+
+    try:
+        parser.parse()
+    except BakeError as error:
+        raise BakeError(f"{input_file}: {error}") from None
+
+    blob = parser.serialize()
+
+    # Only touch the output if it changed, so dependent steps don't re-run needlessly
+    output_path = Path(output_file)
+
+    if output_path.exists() and output_path.read_bytes() == blob:
+        return
+
+    output_path.write_bytes(blob)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Bake a pipeline description into a binary blob for fast loading.")
+    parser.add_argument("file", help="Path to the pipeline file to bake")
+    parser.add_argument("--output", help="Output blob path (default: <file>.bin)", default=None)
+    parser.add_argument("--vulkan-header", help="Path to vulkan_core.h used to resolve enum values", required=True)
+
+    args = parser.parse_args()
+
+    try:
+        bake_pipeline(args.file, args.output or f"{args.file}.bin", load_vulkan_enums(args.vulkan_header))
+    except (BakeError, OSError) as error:
+        print(f"Error: {error}")
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
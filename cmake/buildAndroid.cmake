@@ -67,6 +67,15 @@ function("buildAndroid")
 	# Collect pipeline file names
 	file(GLOB PIPELINE_FILES "${PROJECT_SOURCE_DIR}/pipelines/*.pipeline")
 
+	# Baked pipeline blobs don't exist yet at configure time, so derive them from the pipeline list
+	if(VULKAN_CORE_HEADER)
+		foreach(PIPELINE_FILE ${PIPELINE_FILES})
+			list(APPEND PIPELINE_BLOB_FILES "${PIPELINE_FILE}.bin")
+		endforeach()
+
+		list(APPEND PIPELINE_FILES ${PIPELINE_BLOB_FILES})
+	endif()
+
 	# Collect shader file names
 	#file(GLOB SHADER_FILES "${PROJECT_SOURCE_DIR}/shaders/*.spv")
 
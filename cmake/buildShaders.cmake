@@ -41,8 +41,27 @@ function(buildShaders)
         )
 
         list(APPEND PROCESSED_FILES ${MARKER_FILE})
+
+        # Bake the final pipeline description into a binary blob, loaded in preference to the text at runtime
+        if(VULKAN_CORE_HEADER)
+            set(BLOB_FILE "${PIPELINE_FILE}.bin")
+
+            add_custom_command(
+                OUTPUT ${BLOB_FILE}
+                COMMAND ${PYTHON_EXECUTABLE} ${PROJECT_SOURCE_DIR}/bakePipeline.py ${PIPELINE_FILE} --output ${BLOB_FILE} --vulkan-header ${VULKAN_CORE_HEADER}
+                DEPENDS ${PROJECT_SOURCE_DIR}/bakePipeline.py ${MARKER_FILE}
+                WORKING_DIRECTORY ${PROJECT_SOURCE_DIR}
+                COMMENT "Baking ${PIPELINE_FILE} -> ${BLOB_FILE}"
+            )
+
+            list(APPEND PROCESSED_FILES ${BLOB_FILE})
+        endif()
     endforeach()
 
+    if(NOT VULKAN_CORE_HEADER)
+        message(WARNING "vulkan_core.h not found, pipelines will be loaded from text descriptions.")
+    endif()
+
     # Add a custom target to process all pipelines
     add_custom_target(ProcessPipelines ALL DEPENDS ${PROCESSED_FILES})
     add_dependencies(${CMAKE_PROJECT_NAME} ProcessPipelines)
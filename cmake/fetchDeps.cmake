@@ -6,6 +6,9 @@ function(fetchDeps)
 	find_package(Vulkan COMPONENTS glslc)
 	find_program(GLSLC NAMES glslc HINTS Vulkan::glslc)
 
+	# Needed to resolve enum values when baking binary pipeline blobs
+	find_file(VULKAN_CORE_HEADER NAMES vulkan_core.h HINTS ${Vulkan_INCLUDE_DIRS} PATH_SUFFIXES vulkan)
+
 	set(BUILD_WITH_SYSTEM_JSONCPP OFF CACHE BOOL "" FORCE)
 
 	message(STATUS "${PROJECT_NAME}: Fetching OpenXR...")
@@ -0,0 +1,16 @@
+function(packAssets)
+    file(GLOB_RECURSE ASSET_FILES "${PROJECT_SOURCE_DIR}/assets/*")
+
+    set(ASSET_ARCHIVE "${CMAKE_BINARY_DIR}/assets.pak")
+
+    # Music is streamed from disk and the HRIR data is read directly, so they stay as loose files
+    add_custom_command(
+        OUTPUT ${ASSET_ARCHIVE}
+        COMMAND ${PYTHON_EXECUTABLE} ${PROJECT_SOURCE_DIR}/packAssets.py ${PROJECT_SOURCE_DIR}/assets --output ${ASSET_ARCHIVE} --lz4 --exclude music --exclude hrir_full.bin
+        DEPENDS ${PROJECT_SOURCE_DIR}/packAssets.py ${ASSET_FILES}
+        COMMENT "Packing assets into ${ASSET_ARCHIVE}..."
+    )
+
+    add_custom_target(PackAssets ALL DEPENDS ${ASSET_ARCHIVE})
+    add_dependencies(${CMAKE_PROJECT_NAME} PackAssets)
+endfunction()
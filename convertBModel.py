@@ -0,0 +1,284 @@
+#!/usr/bin/python
+
+import argparse
+import math
+import struct
+from pathlib import Path
+
+# Must match model/bmodel.c
+BMDL_MAGIC = b"BMDL"
+MESH_MAGIC = b"MESH"
+MATL_MAGIC = b"MATL"
+VERT_MAGIC = b"VERT"
+TEXC_MAGIC = b"TEXC"
+TANG_MAGIC = b"TANG"
+BNRM_MAGIC = b"BNRM"
+NORM_MAGIC = b"NORM"
+GVTX_MAGIC = b"GVTX"
+BNDS_MAGIC = b"BNDS"
+
+# BModel_Vertex_t: position (3 x float), UV (2 x half), normal (2 x snorm16 octahedral),
+# tangent (2 x snorm16 octahedral), binormal sign (snorm16), padding
+VERTEX_FORMAT = "<3f2e2h2hhh"
+
+FLT_MIN = 1.175494351e-38
+FLT_MAX = 3.402823466e+38
+
+class Reader:
+    def __init__(self, data):
+        self.data = data
+        self.position = 0
+
+    def eof(self):
+        return self.position >= len(self.data)
+
+    def read(self, fmt):
+        size = struct.calcsize(fmt)
+        if self.position + size > len(self.data):
+            raise ValueError("Unexpected end of file")
+        values = struct.unpack_from(fmt, self.data, self.position)
+        self.position += size
+        return values
+
+    def read_string(self, max_length=256):
+        end = self.data.find(b"\0", self.position, self.position + max_length)
+        if end == -1:
+            end = min(self.position + max_length, len(self.data)) - 1
+        string = self.data[self.position:end]
+        self.position = end + 1
+        return string
+
+def vec_sub(a, b):
+    return (a[0] - b[0], a[1] - b[1], a[2] - b[2])
+
+def vec_add(a, b):
+    return (a[0] + b[0], a[1] + b[1], a[2] + b[2])
+
+def vec_scale(a, s):
+    return (a[0] * s, a[1] * s, a[2] * s)
+
+def vec_dot(a, b):
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]
+
+def vec_cross(a, b):
+    return (a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0])
+
+def vec_normalize(a):
+    length = math.sqrt(vec_dot(a, a))
+    return vec_scale(a, 1.0 / length) if length else a
+
+def calculate_tangents(model):
+    """Same as CalculateTangent in model/bmodel.c."""
+    count = model["numVertex"]
+    vertex = model["vertex"]
+    uv = model["uv"]
+    tangent = [(0.0, 0.0, 0.0)] * count
+    binormal = [(0.0, 0.0, 0.0)] * count
+    normal = [(0.0, 0.0, 0.0)] * count
+
+    for mesh in model["meshes"]:
+        face = mesh["face"]
+        for i in range(0, len(face), 3):
+            i1, i2, i3 = face[i], face[i + 1], face[i + 2]
+
+            v0 = vec_sub(vertex[i2], vertex[i1])
+            uv0 = (uv[i2][0] - uv[i1][0], uv[i2][1] - uv[i1][1])
+            v1 = vec_sub(vertex[i3], vertex[i1])
+            uv1 = (uv[i3][0] - uv[i1][0], uv[i3][1] - uv[i1][1])
+
+            r = uv0[0] * uv1[1] - uv1[0] * uv0[1]
+            r = 0.0 if abs(r) < 1e-8 else 1.0 / r
+
+            s = vec_normalize(vec_scale(vec_sub(vec_scale(v0, uv1[1]), vec_scale(v1, uv0[1])), r))
+            t = vec_normalize(vec_scale(vec_sub(vec_scale(v1, uv0[0]), vec_scale(v0, uv1[0])), r))
+            n = vec_normalize(vec_cross(v0, v1))
+
+            for index in (i1, i2, i3):
+                tangent[index] = vec_add(tangent[index], s)
+                binormal[index] = vec_add(binormal[index], t)
+                normal[index] = vec_add(normal[index], n)
+
+    for i in range(count):
+        t, b, n = tangent[i], binormal[i], normal[i]
+
+        t = vec_sub(t, vec_scale(n, vec_dot(n, t)))
+
+        t = vec_normalize(t)
+        b = vec_normalize(b)
+        n = vec_normalize(n)
+
+        NxT = vec_cross(n, t)
+
+        if vec_dot(NxT, b) < 0.0:
+            t = vec_scale(t, -1.0)
+
+        tangent[i], binormal[i], normal[i] = t, NxT, n
+
+    model["tangent"], model["binormal"], model["normal"] = tangent, binormal, normal
+
+def calculate_bounds(model):
+    """Same as CalculateBounds in model/bmodel.c."""
+    vertex = model["vertex"]
+    indices = [index for mesh in model["meshes"] for index in mesh["face"]]
+
+    center = (0.0, 0.0, 0.0)
+    for index in indices:
+        center = vec_add(center, vertex[index])
+    center = vec_scale(center, 1.0 / len(indices))
+
+    bbox_min = [FLT_MIN] * 3
+    bbox_max = [-FLT_MAX] * 3
+    radius = 0.0
+
+    for index in indices:
+        v = vertex[index]
+        radius = max(radius, math.sqrt(vec_dot(vec_sub(v, center), vec_sub(v, center))))
+
+        for axis in range(3):
+            bbox_min[axis] = min(bbox_min[axis], v[axis])
+            bbox_max[axis] = max(bbox_max[axis], v[axis])
+
+    return bbox_min + bbox_max + list(center) + [radius]
+
+def octahedral_encode(n):
+    inv_l1 = 1.0 / (abs(n[0]) + abs(n[1]) + abs(n[2]))
+    x, y = n[0] * inv_l1, n[1] * inv_l1
+
+    if n[2] < 0.0:
+        x, y = (1.0 - abs(y)) * (1.0 if x >= 0.0 else -1.0), (1.0 - abs(x)) * (1.0 if y >= 0.0 else -1.0)
+
+    return x, y
+
+def snorm16(v):
+    return int(round(max(-1.0, min(1.0, v)) * 32767.0))
+
+def pack_vertices(model):
+    out = bytearray()
+
+    for i in range(model["numVertex"]):
+        n = model["normal"][i] if model["normal"] else (0.0, 0.0, 1.0)
+        t = model["tangent"][i] if model["tangent"] else (1.0, 0.0, 0.0)
+        b = model["binormal"][i] if model["binormal"] else (0.0, 1.0, 0.0)
+
+        # Degenerate vectors from unused vertices would encode as NaN
+        if vec_dot(n, n) == 0.0:
+            n = (0.0, 0.0, 1.0)
+        if vec_dot(t, t) == 0.0:
+            t = (1.0, 0.0, 0.0)
+
+        n = vec_normalize(n)
+        t = vec_normalize(t)
+
+        uv = model["uv"][i] if model["uv"] else (0.0, 1.0)
+        on = octahedral_encode(n)
+        ot = octahedral_encode(t)
+        sign = -32767 if vec_dot(vec_cross(n, t), b) < 0.0 else 32767
+
+        out += struct.pack(VERTEX_FORMAT, *model["vertex"][i], uv[0], 1.0 - uv[1], snorm16(on[0]), snorm16(on[1]), snorm16(ot[0]), snorm16(ot[1]), sign, 0)
+
+    return bytes(out)
+
+def read_vectors(reader, count, components):
+    values = reader.read(f"<{count * components}f")
+    return [tuple(values[i:i + components]) for i in range(0, len(values), components)]
+
+def load(data):
+    reader = Reader(data)
+
+    if reader.read("<4s")[0] != BMDL_MAGIC:
+        raise ValueError("Not a BModel file")
+
+    model = {"materials": [], "meshes": [], "uv": None, "tangent": None, "binormal": None, "normal": None, "packed": None}
+
+    # Materials and meshes are copied through as is
+    start = reader.position
+    (num_material,) = reader.read("<I")
+    for _ in range(num_material):
+        if reader.read("<4s")[0] != MATL_MAGIC:
+            raise ValueError("Bad material chunk")
+        reader.read_string()
+        reader.read("<13f")
+        reader.read_string()
+
+    (num_mesh,) = reader.read("<I")
+    for _ in range(num_mesh):
+        if reader.read("<4s")[0] != MESH_MAGIC:
+            raise ValueError("Bad mesh chunk")
+        reader.read_string()
+        reader.read_string()
+        (num_face,) = reader.read("<I")
+        model["meshes"].append({"face": reader.read(f"<{num_face * 3}I")})
+
+    model["header"] = data[start:reader.position]
+
+    (model["numVertex"],) = reader.read("<I")
+    count = model["numVertex"]
+
+    while not reader.eof():
+        (magic,) = reader.read("<4s")
+
+        if magic == VERT_MAGIC:
+            model["vertex"] = read_vectors(reader, count, 3)
+        elif magic == TEXC_MAGIC:
+            model["uv"] = read_vectors(reader, count, 2)
+        elif magic == TANG_MAGIC:
+            model["tangent"] = read_vectors(reader, count, 3)
+        elif magic == BNRM_MAGIC:
+            model["binormal"] = read_vectors(reader, count, 3)
+        elif magic == NORM_MAGIC:
+            model["normal"] = read_vectors(reader, count, 3)
+        elif magic == GVTX_MAGIC:
+            (stride,) = reader.read("<I")
+            model["packed"] = (stride, data[reader.position:reader.position + stride * count])
+            reader.position += stride * count
+        elif magic == BNDS_MAGIC:
+            reader.read("<10f")
+        else:
+            raise ValueError(f"Unknown chunk {magic}")
+
+    return model
+
+def convert(input_file, output_file):
+    model = load(Path(input_file).read_bytes())
+
+    if "vertex" not in model:
+        print(f"Error: '{input_file}' has no vertex positions.")
+        return False
+
+    if model["packed"] and model["packed"][0] == struct.calcsize(VERTEX_FORMAT):
+        packed = model["packed"][1]
+    else:
+        if model["uv"]:
+            calculate_tangents(model)
+        packed = pack_vertices(model)
+
+    out = bytearray(BMDL_MAGIC)
+    out += model["header"]
+    out += struct.pack("<I", model["numVertex"])
+
+    # Positions stay for bounds, collision and LOD generation, everything else lives in the packed vertices
+    out += VERT_MAGIC
+    out += struct.pack(f"<{model['numVertex'] * 3}f", *[c for v in model["vertex"] for c in v])
+    out += BNDS_MAGIC
+    out += struct.pack("<10f", *calculate_bounds(model))
+    out += GVTX_MAGIC
+    out += struct.pack("<I", struct.calcsize(VERTEX_FORMAT))
+    out += packed
+
+    Path(output_file).write_bytes(out)
+
+    print(f"Converted '{input_file}' -> '{output_file}', {model['numVertex']} vertices, {struct.calcsize(VERTEX_FORMAT)} bytes per vertex.")
+
+    return True
+
+def main():
+    parser = argparse.ArgumentParser(description="Convert a BModel to carry GPU ready packed vertices and precomputed bounds.")
+    parser.add_argument("input", help="BModel file to convert")
+    parser.add_argument("--output", help="Output file (defaults to overwriting the input)")
+
+    args = parser.parse_args()
+    if not convert(args.input, args.output or args.input):
+        raise SystemExit(1)
+
+if __name__ == "__main__":
+    main()
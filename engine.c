@@ -20,6 +20,7 @@
 #include "physics/physics.h"
 #include "pipelines/composite.h"
 #include "pipelines/lighting.h"
+#include "pipelines/cull.h"
 #include "pipelines/line.h"
 #include "pipelines/linegraph.h"
 #include "pipelines/shadow.h"
@@ -30,9 +31,11 @@
 #include "system/system.h"
 #include "system/threads.h"
 #include "ui/ui.h"
+#include "utils/archive.h"
 #include "utils/bvh.h"
 #include "utils/event.h"
 #include "utils/list.h"
+#include "utils/spatialhash.h"
 #include "input/input.h"
 #include "vr/vr.h"
 #include "vulkan/vulkan.h"
@@ -53,6 +56,10 @@ XruContext_t xrContext;
 VkInstance vkInstance;
 VkuContext_t vkContext;
 
+// Persistent staging ring shared by all uploads, it will grow if a single upload needs more
+#define UPLOAD_STAGING_SIZE (64*1024*1024)
+VkuUploadBatch_t uploadBatch;
+
 // Per-frame data
 PerFrame_t perFrame[FRAMES_IN_FLIGHT];
 
@@ -81,7 +88,15 @@ typedef struct
 
 PhyParticleEmitter_t emitters[MAX_EMITTERS]={ 0 };
 
-BVH_t bvh;
+// Physics builds into one while rendering culls from the other, swapped once both threads meet at the end of the frame
+static BVH_t BVHBuffers[2];
+static BVH_t *physicsBVH=&BVHBuffers[0], *renderBVH=&BVHBuffers[1];
+// Set when a physics step rebuilt physicsBVH, frames without a step (paused, above the step rate, network client) keep the render one
+static bool physicsBVHBuilt=false;
+
+// Grows the camera culling bounds to cover objects that moved since the render BVH was built, about a step at full velocity
+#define CAMERA_CULL_PADDING 10.0f
+static bool cameraVisible[MAX_ENTITY];
 
 LoadingScreen_t loadingScreen;
 
@@ -93,6 +108,10 @@ VkuImage_t colorImage[2];
 VkuImage_t depthImage[2];
 VkFramebuffer framebuffer[2];
 
+// Every pass from shadows to composite and the images between them, built on init and swapchain resize
+VkuRenderGraph_t renderGraph;
+static uint32_t eyeIndex[2]={ 0, 1 };
+
 EntityList_t entityList;
 
 #define NUM_CUBE 30
@@ -100,23 +119,73 @@ RigidBody_t cubeBody[NUM_CUBE];
 RigidBody_t platformBody;
 
 // Thread stuff
+// Secondary command buffers are recorded as jobs. Each frame the passes are split into jobs up front, any free worker records
+//   whichever job is next using its own pools, then the main thread stitches the results together in the order they were added.
+#define MAX_THREADS 8
+#define MAX_PHYSICS_WORKERS 4
+#define MAX_RECORD_JOBS 32
+
+// Fewer batches than this per lighting job isn't worth another command buffer
+#define RECORD_MIN_BATCHES 16
+
+typedef void (*RecordFunction_t)(VkCommandBuffer commandBuffer, uint32_t index, uint32_t eye, VkDescriptorPool descriptorPool, uint32_t first, uint32_t count);
+
+// Jobs that write shared pipeline state while recording (descriptor set scratch, upload buffers) take a lock,
+//   so they never record at the same time as another job with the same lock
+typedef enum
+{
+	RECORD_LOCK_NONE=0,
+	RECORD_LOCK_SKYBOX,
+	RECORD_LOCK_PARTICLES,
+	NUM_RECORD_LOCKS
+} RecordLock_e;
+
+typedef struct
+{
+	RecordFunction_t function;
+	uint32_t eye, first, count;
+	RecordLock_e lock;
+
+	VkCommandBufferInheritanceInfo inheritance;
+	VkExtent2D extent;	// Viewport and scissor to start with, 0 if the job sets its own
+
+	VkCommandBuffer commandBuffer;
+} RecordJob_t;
+
+typedef struct
+{
+	uint32_t index;
+
+	uint32_t numJobs;
+	RecordJob_t jobs[MAX_RECORD_JOBS];
+	atomic_uint nextJob;
+
+	mtx_t locks[NUM_RECORD_LOCKS];
+} RecordQueue_t;
+
+RecordQueue_t recordQueue;
+
 typedef struct
 {
-	uint32_t index, eye;
 	struct
 	{
-		VkDescriptorPool descriptorPool[2];
-		VkCommandPool commandPool[2];
-		VkCommandBuffer secCommandBuffer[2];
+		VkDescriptorPool descriptorPool;
+		VkCommandPool commandPool;
+		VkCommandBuffer secCommandBuffer[MAX_RECORD_JOBS];
 	} perFrame[VKU_MAX_FRAME_COUNT];
 } ThreadData_t;
 
-#define NUM_THREADS 2
-ThreadData_t threadData[NUM_THREADS];
-ThreadWorker_t thread[NUM_THREADS], threadPhysics;
+uint32_t numThreads=2;
+ThreadData_t threadData[MAX_THREADS];
+ThreadWorker_t thread[MAX_THREADS], threadPhysics;
 
 ThreadBarrier_t threadBarrier;
 ThreadBarrier_t physicsThreadBarrier;
+
+// Helpers for the physics thread, they share out the broad phase with it
+uint32_t numPhysicsWorkers=0;
+ThreadWorker_t physicsWorkers[MAX_PHYSICS_WORKERS];
+ThreadBarrier_t physicsWorkerBarrier;
 //////
 
 // UI Stuff
@@ -146,6 +215,10 @@ bool isControlPressed=false;
 
 bool pausePhysics=false;
 
+// Unsimulated time carried between frames, and how far into the next fixed step the frame is (0..1)
+static float physicsAccumulator=0.0f;
+static float physicsAlpha=1.0f;
+
 Camera_t enemy[NUM_ENEMY];
 Enemy_t enemyAI[NUM_ENEMY];
 
@@ -222,7 +295,8 @@ bool PopPoint(vec3 *point, uint32_t *index)
 }
 
 void RecreateSwapchain(void);
-bool CreateFramebuffers(uint32_t eye);
+bool CreateRenderGraph(void);
+void DestroyRenderGraph(void);
 
 bool EntityList_ChangeRender(EntityList_t *list, uint32_t ID, bool noRender)
 {
@@ -243,33 +317,34 @@ bool EntityList_ChangeRender(EntityList_t *list, uint32_t ID, bool noRender)
 	return false;
 }
 
-matrix CubeTransform(const RigidBody_t *body)
+EntityTransform_t CubeTransform(void)
 {
-	matrix local=MatrixScalev(body->size);
-	local=MatrixMult(local, MatrixRotate(PI/2.0f, 0.0f, 1.0f, 0.0));
-	local=MatrixMult(local, MatrixTranslatev(AssetManager_GetAsset(assets, MODEL_CUBE)->model.center));
-	local=MatrixMult(local, QuatToMatrix(body->orientation));
-	return MatrixMult(local, MatrixTranslatev(body->position));
+	return (EntityTransform_t)
+	{
+		.rotation=QuatAngle(PI/2.0f, 0.0f, 1.0f, 0.0f),
+		.offset=AssetManager_GetAsset(assets, MODEL_CUBE)->model.center,
+		.scale=1.0f,
+	};
 }
 
-matrix AsteroidTransform(const RigidBody_t *body)
+EntityTransform_t AsteroidTransform(void)
 {
-	const float radiusScale=body->radius*0.666667f;
-
-	matrix local=MatrixScale(radiusScale, radiusScale, radiusScale);
-	local=MatrixMult(local, QuatToMatrix(body->orientation));
-	return MatrixMult(local, MatrixTranslatev(body->position));
+	return (EntityTransform_t)
+	{
+		.rotation=Vec4(0.0f, 0.0f, 0.0f, 1.0f),
+		.offset=Vec3b(0.0f),
+		.scale=0.666667f,
+	};
 }
 
-matrix FighterTransform(const RigidBody_t *body)
+EntityTransform_t FighterTransform(void)
 {
-	const float scale=(1.0f/AssetManager_GetAsset(assets, MODEL_FIGHTER)->model.radius)*body->radius;
-
-	matrix local=MatrixScale(scale, scale, scale);
-	local=MatrixMult(local, MatrixRotate(PI/2.0f, 0.0f, 1.0f, 0.0));
-	local=MatrixMult(local, MatrixTranslatev(AssetManager_GetAsset(assets, MODEL_FIGHTER)->model.center));
-	local=MatrixMult(local, QuatToMatrix(body->orientation));
-	return MatrixMult(local, MatrixTranslatev(body->position));
+	return (EntityTransform_t)
+	{
+		.rotation=QuatAngle(PI/2.0f, 0.0f, 1.0f, 0.0f),
+		.offset=AssetManager_GetAsset(assets, MODEL_FIGHTER)->model.center,
+		.scale=1.0f/AssetManager_GetAsset(assets, MODEL_FIGHTER)->model.radius,
+	};
 }
 
 void ResetPhysicsCubes(void)
@@ -430,20 +505,20 @@ void GenerateWorld(void)
 		numAsteroids=1000;
 
 		for(uint32_t i=0;i<numAsteroids;i++)
-			EntityList_Add(&entityList, &asteroids[i], false, asteroidModels[i].modelID, asteroidModels[i].tex0ID, asteroidModels[i].tex1ID, ENTITYOBJECTTYPE_FIELD, AsteroidTransform);
+			EntityList_Add(&entityList, &asteroids[i], false, asteroidModels[i].modelID, asteroidModels[i].tex0ID, asteroidModels[i].tex1ID, ENTITYOBJECTTYPE_FIELD, AsteroidTransform());
 	}
 
-	playerID=EntityList_Add(&entityList, &camera.body, !camera.thirdPerson, MODEL_FIGHTER, TEXTURE_FIGHTER1+(2*fighterTexture[NUM_ENEMY]+0), TEXTURE_FIGHTER1+(2*fighterTexture[NUM_ENEMY]+1), ENTITYOBJECTTYPE_PLAYER, FighterTransform);
+	playerID=EntityList_Add(&entityList, &camera.body, !camera.thirdPerson, MODEL_FIGHTER, TEXTURE_FIGHTER1+(2*fighterTexture[NUM_ENEMY]+0), TEXTURE_FIGHTER1+(2*fighterTexture[NUM_ENEMY]+1), ENTITYOBJECTTYPE_PLAYER, FighterTransform());
 
 	if(!ClientNetwork_IsConnected())
 	{
 		for(uint32_t i=0;i<NUM_ENEMY;i++)
-			EntityList_Add(&entityList, &enemy[i].body, false, MODEL_FIGHTER, TEXTURE_FIGHTER1+(2*fighterTexture[i]+0), TEXTURE_FIGHTER1+(2*fighterTexture[i]+1), ENTITYOBJECTTYPE_PLAYER, FighterTransform);
+			EntityList_Add(&entityList, &enemy[i].body, false, MODEL_FIGHTER, TEXTURE_FIGHTER1+(2*fighterTexture[i]+0), TEXTURE_FIGHTER1+(2*fighterTexture[i]+1), ENTITYOBJECTTYPE_PLAYER, FighterTransform());
 
 		for(uint32_t i=0;i<NUM_CUBE;i++)
-			EntityList_Add(&entityList, &cubeBody[i], false, MODEL_CUBE, TEXTURE_CUBE, TEXTURE_CUBE_NORMAL, ENTITYOBJECTTYPE_FIELD, CubeTransform);
+			EntityList_Add(&entityList, &cubeBody[i], false, MODEL_CUBE, TEXTURE_CUBE, TEXTURE_CUBE_NORMAL, ENTITYOBJECTTYPE_FIELD, CubeTransform());
 
-		uint32_t platformID=EntityList_Add(&entityList, &platformBody, false, MODEL_CUBE, TEXTURE_CUBE, TEXTURE_CUBE_NORMAL, ENTITYOBJECTTYPE_FIELD, CubeTransform);
+		uint32_t platformID=EntityList_Add(&entityList, &platformBody, false, MODEL_CUBE, TEXTURE_CUBE, TEXTURE_CUBE_NORMAL, ENTITYOBJECTTYPE_FIELD, CubeTransform());
 		for(uint32_t i=0;i<entityList.entityCount;i++)
 		{
 			Entity_t *entity=&entityList.entities[i];
@@ -496,50 +571,48 @@ void Thread_Constructor(void *arg)
 
 	for(uint32_t Frame=0;Frame<FRAMES_IN_FLIGHT;Frame++)
 	{
-		for(uint32_t eye=0;eye<2;eye++)
+		vkCreateCommandPool(vkContext.device, &(VkCommandPoolCreateInfo)
 		{
-			vkCreateCommandPool(vkContext.device, &(VkCommandPoolCreateInfo)
-			{
-				.sType=VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-				.flags=0,
-				.queueFamilyIndex=vkContext.graphicsQueueIndex,
-			}, VK_NULL_HANDLE, &data->perFrame[Frame].commandPool[eye]);
+			.sType=VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+			.flags=0,
+			.queueFamilyIndex=vkContext.graphicsQueueIndex,
+		}, VK_NULL_HANDLE, &data->perFrame[Frame].commandPool);
 
-			vkAllocateCommandBuffers(vkContext.device, &(VkCommandBufferAllocateInfo)
-			{
-				.sType=VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-				.commandPool=data->perFrame[Frame].commandPool[eye],
-				.level=VK_COMMAND_BUFFER_LEVEL_SECONDARY,
-				.commandBufferCount=1,
-			}, &data->perFrame[Frame].secCommandBuffer[eye]);
-
-			// Create a large descriptor pool, so I don't have to worry about readjusting for exactly what I have
-			vkCreateDescriptorPool(vkContext.device, &(VkDescriptorPoolCreateInfo)
+		// Enough for this thread to end up recording every job in a frame
+		vkAllocateCommandBuffers(vkContext.device, &(VkCommandBufferAllocateInfo)
+		{
+			.sType=VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.commandPool=data->perFrame[Frame].commandPool,
+			.level=VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+			.commandBufferCount=MAX_RECORD_JOBS,
+		}, data->perFrame[Frame].secCommandBuffer);
+
+		// Create a large descriptor pool, so I don't have to worry about readjusting for exactly what I have
+		vkCreateDescriptorPool(vkContext.device, &(VkDescriptorPoolCreateInfo)
+		{
+			.sType=VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+			.maxSets=1024, // Max number of descriptor sets that can be allocated from this pool
+			.poolSizeCount=4,
+			.pPoolSizes=(VkDescriptorPoolSize[])
 			{
-				.sType=VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-				.maxSets=1024, // Max number of descriptor sets that can be allocated from this pool
-				.poolSizeCount=4,
-				.pPoolSizes=(VkDescriptorPoolSize[])
 				{
-					{
-						.type=VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-						.descriptorCount=1024, // Max number of this descriptor type that can be in each descriptor set?
-					},
-					{
-						.type=VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
-						.descriptorCount=1024,
-					},
-					{
-						.type=VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-						.descriptorCount=1024,
-					},
-					{
-						.type=VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-						.descriptorCount=1024,
-					},
+					.type=VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+					.descriptorCount=1024, // Max number of this descriptor type that can be in each descriptor set?
 				},
-			}, VK_NULL_HANDLE, &data->perFrame[Frame].descriptorPool[eye]);
-		}
+				{
+					.type=VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+					.descriptorCount=1024,
+				},
+				{
+					.type=VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+					.descriptorCount=1024,
+				},
+				{
+					.type=VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+					.descriptorCount=1024,
+				},
+			},
+		}, VK_NULL_HANDLE, &data->perFrame[Frame].descriptorPool);
 	}
 }
 
@@ -550,11 +623,8 @@ void Thread_Destructor(void *arg)
 
 	for(uint32_t Frame=0;Frame<FRAMES_IN_FLIGHT;Frame++)
 	{
-		for(uint32_t eye=0;eye<2;eye++)
-		{
-			vkDestroyCommandPool(vkContext.device, data->perFrame[Frame].commandPool[eye], VK_NULL_HANDLE);
-			vkDestroyDescriptorPool(vkContext.device, data->perFrame[Frame].descriptorPool[eye], VK_NULL_HANDLE);
-		}
+		vkDestroyCommandPool(vkContext.device, data->perFrame[Frame].commandPool, VK_NULL_HANDLE);
+		vkDestroyDescriptorPool(vkContext.device, data->perFrame[Frame].descriptorPool, VK_NULL_HANDLE);
 	}
 }
 
@@ -639,37 +709,18 @@ void BVH_DrawDebug(const BVH_t *bvh, VkCommandBuffer commandBuffer, uint32_t ind
     }
 }
 
-void Thread_Main(void *arg)
+void RecordSkybox(VkCommandBuffer commandBuffer, uint32_t index, uint32_t eye, VkDescriptorPool descriptorPool, uint32_t first, uint32_t count)
 {
-	ThreadData_t *data=(ThreadData_t *)arg;
-
-	vkResetDescriptorPool(vkContext.device, data->perFrame[data->index].descriptorPool[data->eye], 0);
-	vkResetCommandPool(vkContext.device, data->perFrame[data->index].commandPool[data->eye], 0);
-
-	vkBeginCommandBuffer(data->perFrame[data->index].secCommandBuffer[data->eye], &(VkCommandBufferBeginInfo)
-	{
-		.sType=VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-		.flags=VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT|VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
-		.pInheritanceInfo=&(VkCommandBufferInheritanceInfo)
-		{
-			.sType=VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
-			.pNext=NULL,
-			.renderPass=renderPass,
-			.framebuffer=framebuffer[data->eye]
-		}
-	});
-
-	vkCmdSetViewport(data->perFrame[data->index].secCommandBuffer[data->eye], 0, 1, &(VkViewport) { 0.0f, 0, (float)config.renderWidth, (float)config.renderHeight, 0.0f, 1.0f });
-	vkCmdSetScissor(data->perFrame[data->index].secCommandBuffer[data->eye], 0, 1, &(VkRect2D) { { 0, 0 }, { config.renderWidth, config.renderHeight } });
-
-	////// Skybox/skysphere
-	DrawSkybox(data->perFrame[data->index].secCommandBuffer[data->eye], data->index, data->eye, data->perFrame[data->index].descriptorPool[data->eye]);
-	//////
+	DrawSkybox(commandBuffer, index, eye, descriptorPool);
+}
 
-	////// Asteroids
-	DrawLighting(data->perFrame[data->index].secCommandBuffer[data->eye], &entityList, data->index, data->eye, data->perFrame[data->index].descriptorPool[data->eye]);
-	//////
+void RecordLighting(VkCommandBuffer commandBuffer, uint32_t index, uint32_t eye, VkDescriptorPool descriptorPool, uint32_t first, uint32_t count)
+{
+	DrawLighting(commandBuffer, &entityList, index, eye, descriptorPool, first, count);
+}
 
+void RecordDebug(VkCommandBuffer commandBuffer, uint32_t index, uint32_t eye, VkDescriptorPool descriptorPool, uint32_t first, uint32_t count)
+{
 #if 1
 	if(isControlPressed)
 	{
@@ -679,12 +730,12 @@ void Thread_Main(void *arg)
 			const float val=0.005f;
 			const vec3 randVec=Vec3(RandFloatRange(-val, val), RandFloatRange(-val, val), RandFloatRange(-val, val));
 
-			DrawLine(data->perFrame[data->index].secCommandBuffer[data->eye], data->index, data->eye,
+			DrawLine(commandBuffer, index, eye,
 						Vec3_Subv(camera.body.position, Vec3_Subv(camera.up, camera.right)),
 						Vec3_Addv(camera.body.position, Vec3_Muls(Vec3_Addv(camera.forward, randVec), distance)),
 						Vec4(1.0f+RandFloatRange(10.0f, 500.0f), 1.0f, 1.0f, 1.0f));
 
-			DrawLine(data->perFrame[data->index].secCommandBuffer[data->eye], data->index, data->eye,
+			DrawLine(commandBuffer, index, eye,
 						Vec3_Subv(camera.body.position, Vec3_Addv(camera.up, camera.right)),
 						Vec3_Addv(camera.body.position, Vec3_Muls(Vec3_Subv(camera.forward, randVec), distance)),
 						Vec4(1.0f+RandFloatRange(10.0f, 500.0f), 1.0f, 1.0f, 1.0f));
@@ -711,18 +762,18 @@ void Thread_Main(void *arg)
 		vec3 leftPos=Vec3(leftHandPosition.x, leftHandPosition.y, leftHandPosition.z);
 		vec4 leftRot=Vec4(leftHandOrientation.x, leftHandOrientation.y, leftHandOrientation.z, leftHandOrientation.w);
 		matrix local=MatrixMult(MatrixMult(QuatToMatrix(leftRot), MatrixScale(0.1f, 0.1f, 0.1f)), MatrixTranslatev(leftPos));
-		local=MatrixMult(local, perFrame[data->index].mainUBO[data->eye]->HMD);
-		spherePC.mvp=MatrixMult(local, perFrame[data->index].mainUBO[data->eye]->projection);
+		local=MatrixMult(local, perFrame[index].mainUBO[eye]->HMD);
+		spherePC.mvp=MatrixMult(local, perFrame[index].mainUBO[eye]->projection);
 
-		DrawSpherePushConstant(data->perFrame[data->index].secCommandBuffer[data->eye], data->index, sizeof(spherePC), &spherePC);
+		DrawSpherePushConstant(commandBuffer, index, sizeof(spherePC), &spherePC);
 
 		vec3 rightPos=Vec3(rightHandPosition.x, rightHandPosition.y, rightHandPosition.z);
 		vec4 rightRot=Vec4(rightHandOrientation.x, rightHandOrientation.y, rightHandOrientation.z, rightHandOrientation.w);
 		local=MatrixMult(MatrixMult(QuatToMatrix(rightRot), MatrixScale(0.1f, 0.1f, 0.1f)), MatrixTranslatev(rightPos));
-		local=MatrixMult(local, perFrame[data->index].mainUBO[data->eye]->HMD);
-		spherePC.mvp=MatrixMult(local, perFrame[data->index].mainUBO[data->eye]->projection);
+		local=MatrixMult(local, perFrame[index].mainUBO[eye]->HMD);
+		spherePC.mvp=MatrixMult(local, perFrame[index].mainUBO[eye]->projection);
 
-		DrawSpherePushConstant(data->perFrame[data->index].secCommandBuffer[data->eye], data->index, sizeof(spherePC), &spherePC);
+		DrawSpherePushConstant(commandBuffer, index, sizeof(spherePC), &spherePC);
 
 		struct
 		{
@@ -737,32 +788,32 @@ void Thread_Main(void *arg)
 		linePC.color=Vec4(leftTrigger*100.0f+1.0f, 1.0f, leftGrip*100.0f+1.0f, 1.0f);
 
 		local=MatrixMult(QuatToMatrix(leftRot), MatrixTranslatev(leftPos));
-		local=MatrixMult(local, perFrame[data->index].mainUBO[data->eye]->HMD);
-		linePC.mvp=MatrixMult(local, perFrame[data->index].mainUBO[data->eye]->projection);
+		local=MatrixMult(local, perFrame[index].mainUBO[eye]->HMD);
+		linePC.mvp=MatrixMult(local, perFrame[index].mainUBO[eye]->projection);
 
-		DrawLinePushConstant(data->perFrame[data->index].secCommandBuffer[data->eye], sizeof(linePC), &linePC);
+		DrawLinePushConstant(commandBuffer, sizeof(linePC), &linePC);
 
 		linePC.color=Vec4(rightTrigger*100.0f+1.0f, 1.0f, rightGrip*100.0f+1.0f, 1.0f);
 
 		local=MatrixMult(QuatToMatrix(rightRot), MatrixTranslatev(rightPos));
-		local=MatrixMult(local, perFrame[data->index].mainUBO[data->eye]->HMD);
-		linePC.mvp=MatrixMult(local, perFrame[data->index].mainUBO[data->eye]->projection);
+		local=MatrixMult(local, perFrame[index].mainUBO[eye]->HMD);
+		linePC.mvp=MatrixMult(local, perFrame[index].mainUBO[eye]->projection);
 
-		DrawLinePushConstant(data->perFrame[data->index].secCommandBuffer[data->eye], sizeof(linePC), &linePC);
+		DrawLinePushConstant(commandBuffer, sizeof(linePC), &linePC);
 	}
 
 #if 0
 	// for(uint32_t i=0;i<numPhysicsObjects;i++)
 	// {
-	// 	DrawAABBCube(data->perFrame[data->index].secCommandBuffer[data->eye], data->index, data->eye, physicsObjects[i].bounds.min, physicsObjects[i].bounds.max, Vec4(1.0f, 1.0f, 0.0f, 1.0f));
+	// 	DrawAABBCube(commandBuffer, index, eye, physicsObjects[i].bounds.min, physicsObjects[i].bounds.max, Vec4(1.0f, 1.0f, 0.0f, 1.0f));
 	// }
 
 	for(uint32_t i=0;i<numPoints;i++)
 	{
 		vec3 point=Vec3b(0.0f);
-		uint32_t index=0;
+		uint32_t triangleIndex=0;
 
-		PopPoint(&point, &index);
+		PopPoint(&point, &triangleIndex);
 
 		struct
 		{
@@ -771,16 +822,16 @@ void Thread_Main(void *arg)
 			vec4 verts[2];
 		} linePC;
 
-		linePC.mvp=perFrame[data->index].mainUBO[data->eye]->projection;
+		linePC.mvp=perFrame[index].mainUBO[eye]->projection;
 		linePC.color=Vec4(1.0f, 0.0f, 0.0f, 1.0f);
 		linePC.verts[0]=Vec4_Vec3(Vec3(0.0f, 0.0f, -1.0), 1.0f);
 		linePC.verts[1]=Vec4_Vec3(point, 1.0f);
 
-		DrawLinePushConstant(data->perFrame[data->index].secCommandBuffer[data->eye], sizeof(linePC), &linePC);
+		DrawLinePushConstant(commandBuffer, sizeof(linePC), &linePC);
 
-		const HRIR_Vertex_t *v0=&HRIRSphere.vertices[HRIRSphere.indices[3*index+0]];
-		const HRIR_Vertex_t *v1=&HRIRSphere.vertices[HRIRSphere.indices[3*index+1]];
-		const HRIR_Vertex_t *v2=&HRIRSphere.vertices[HRIRSphere.indices[3*index+2]];
+		const HRIR_Vertex_t *v0=&HRIRSphere.vertices[HRIRSphere.indices[3*triangleIndex+0]];
+		const HRIR_Vertex_t *v1=&HRIRSphere.vertices[HRIRSphere.indices[3*triangleIndex+1]];
+		const HRIR_Vertex_t *v2=&HRIRSphere.vertices[HRIRSphere.indices[3*triangleIndex+2]];
 
 		struct
 		{
@@ -789,7 +840,7 @@ void Thread_Main(void *arg)
 			vec4 verts[3];
 		} trianglePC;
 
-		trianglePC.mvp=perFrame[data->index].mainUBO[data->eye]->projection;
+		trianglePC.mvp=perFrame[index].mainUBO[eye]->projection;
 
 		trianglePC.color=Vec4(1.0f, 0.0f, 0.0f, 1.0f);
 
@@ -797,52 +848,156 @@ void Thread_Main(void *arg)
 		trianglePC.verts[1]=Vec4_Vec3(v1->vertex, point.y);
 		trianglePC.verts[2]=Vec4_Vec3(v2->vertex, point.z);
 
-		DrawTrianglePushConstant(data->perFrame[data->index].secCommandBuffer[data->eye], sizeof(trianglePC), &trianglePC);
+		DrawTrianglePushConstant(commandBuffer, sizeof(trianglePC), &trianglePC);
 	}
 #endif
 	//DrawCameraAxes(commandBuffer, index, eye, camera);
 	for(uint32_t i=0;i<NUM_ENEMY;i++)
-		DrawCameraAxes( data->perFrame[data->index].secCommandBuffer[data->eye], data->index, data->eye, enemy[i]);
+		DrawCameraAxes( commandBuffer, index, eye, enemy[i]);
 
-	// BVH_DrawDebug(&bvh, data->perFrame[data->index].secCommandBuffer[data->eye], data->index, data->eye);
+	// BVH_DrawDebug(renderBVH, commandBuffer, index, eye);
 
-	vkEndCommandBuffer(data->perFrame[data->index].secCommandBuffer[data->eye]);
+}
 
-	ThreadBarrier_Wait(&threadBarrier);
+void RecordParticles(VkCommandBuffer commandBuffer, uint32_t index, uint32_t eye, VkDescriptorPool descriptorPool, uint32_t first, uint32_t count)
+{
+	ParticleSystem_Draw(&particleSystem, commandBuffer, index, eye);
 }
 
-void Thread_Particles(void *arg)
+void RecordShadowCascade(VkCommandBuffer commandBuffer, uint32_t index, uint32_t eye, VkDescriptorPool descriptorPool, uint32_t first, uint32_t count)
+{
+	ShadowDrawCascade(commandBuffer, index, first);
+}
+
+// Worker side, keeps taking the next job until there are none left
+void Thread_Record(void *arg)
 {
 	ThreadData_t *data=(ThreadData_t *)arg;
+	const uint32_t index=recordQueue.index;
+	uint32_t numUsed=0;
 
-	vkResetDescriptorPool(vkContext.device, data->perFrame[data->index].descriptorPool[data->eye], 0);
-	vkResetCommandPool(vkContext.device, data->perFrame[data->index].commandPool[data->eye], 0);
+	vkResetDescriptorPool(vkContext.device, data->perFrame[index].descriptorPool, 0);
+	vkResetCommandPool(vkContext.device, data->perFrame[index].commandPool, 0);
 
-	vkBeginCommandBuffer(data->perFrame[data->index].secCommandBuffer[data->eye], &(VkCommandBufferBeginInfo)
+	for(;;)
 	{
-		.sType=VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-		.flags=VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT|VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
-		.pInheritanceInfo=&(VkCommandBufferInheritanceInfo)
+		const uint32_t next=atomic_fetch_add(&recordQueue.nextJob, 1);
+
+		if(next>=recordQueue.numJobs)
+			break;
+
+		RecordJob_t *job=&recordQueue.jobs[next];
+		VkCommandBuffer commandBuffer=data->perFrame[index].secCommandBuffer[numUsed++];
+
+		vkBeginCommandBuffer(commandBuffer, &(VkCommandBufferBeginInfo)
+		{
+			.sType=VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			.flags=VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT|VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+			.pInheritanceInfo=&job->inheritance,
+		});
+
+		if(job->extent.width&&job->extent.height)
 		{
-			.sType=VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
-			.pNext=NULL,
-			.renderPass=renderPass,
-			.framebuffer=framebuffer[data->eye]
+			vkCmdSetViewport(commandBuffer, 0, 1, &(VkViewport) { 0.0f, 0, (float)job->extent.width, (float)job->extent.height, 0.0f, 1.0f });
+			vkCmdSetScissor(commandBuffer, 0, 1, &(VkRect2D) { { 0, 0 }, { job->extent.width, job->extent.height } });
 		}
-	});
 
-	vkCmdSetViewport(data->perFrame[data->index].secCommandBuffer[data->eye], 0, 1, &(VkViewport) { 0.0f, 0, (float)config.renderWidth, (float)config.renderHeight, 0.0f, 1.0f });
-	vkCmdSetScissor(data->perFrame[data->index].secCommandBuffer[data->eye], 0, 1, &(VkRect2D) { { 0, 0 }, { config.renderWidth, config.renderHeight } });
+		if(job->lock!=RECORD_LOCK_NONE)
+			mtx_lock(&recordQueue.locks[job->lock]);
+
+		job->function(commandBuffer, index, job->eye, data->perFrame[index].descriptorPool, job->first, job->count);
 
-	ParticleSystem_Draw(&particleSystem, data->perFrame[data->index].secCommandBuffer[data->eye], data->index, data->eye);
+		if(job->lock!=RECORD_LOCK_NONE)
+			mtx_unlock(&recordQueue.locks[job->lock]);
 
-	vkEndCommandBuffer(data->perFrame[data->index].secCommandBuffer[data->eye]);
+		vkEndCommandBuffer(commandBuffer);
+
+		job->commandBuffer=commandBuffer;
+	}
 
 	ThreadBarrier_Wait(&threadBarrier);
 }
 
-// Render everything together, per-eye, per-frame index
-void EyeRender(uint32_t index, uint32_t eye, matrix headPose)
+void RecordBegin(uint32_t index)
+{
+	recordQueue.index=index;
+	recordQueue.numJobs=0;
+	atomic_store(&recordQueue.nextJob, 0);
+}
+
+// Adds a job to the frame, returns its index for getting the command buffer back after RecordWait, or UINT32_MAX if it didn't fit.
+// Jobs come back in the order they're added, so add them in the order they need to execute.
+uint32_t RecordAddJob(RecordFunction_t function, uint32_t eye, uint32_t first, uint32_t count, RecordLock_e lock, VkCommandBufferInheritanceInfo inheritance, VkExtent2D extent)
+{
+	if(recordQueue.numJobs>=MAX_RECORD_JOBS)
+	{
+		DBGPRINTF(DEBUG_WARNING, "RecordAddJob: Out of record jobs.\n");
+		return UINT32_MAX;
+	}
+
+	recordQueue.jobs[recordQueue.numJobs]=(RecordJob_t)
+	{
+		.function=function,
+		.eye=eye,
+		.first=first,
+		.count=count,
+		.lock=lock,
+		.inheritance=inheritance,
+		.extent=extent,
+		.commandBuffer=VK_NULL_HANDLE,
+	};
+
+	return recordQueue.numJobs++;
+}
+
+// Starts every worker on the job list, the main thread is free to record its own commands until RecordWait
+void RecordKick(void)
+{
+	for(uint32_t i=0;i<numThreads;i++)
+		Thread_AddJob(&thread[i], Thread_Record, (void *)&threadData[i]);
+}
+
+void RecordWait(void)
+{
+	ThreadBarrier_Wait(&threadBarrier);
+}
+
+// Main render pass jobs for an eye, the range of jobs they end up in is returned for EyeRender to execute
+void EyeAddRecordJobs(uint32_t index, uint32_t eye, uint32_t *firstJob, uint32_t *numJobs)
+{
+	const VkCommandBufferInheritanceInfo inheritance=
+	{
+		.sType=VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+		.renderPass=renderPass,
+		.subpass=0,
+		.framebuffer=framebuffer[eye],
+	};
+	const VkExtent2D extent={ config.renderWidth, config.renderHeight };
+
+	*firstJob=recordQueue.numJobs;
+
+	////// Skybox/skysphere
+	RecordAddJob(RecordSkybox, eye, 0, 0, RECORD_LOCK_SKYBOX, inheritance, extent);
+	//////
+
+	////// Asteroids, split up so big scenes spread across all the threads
+	const uint32_t batchCount=LightingPrepare(&entityList, index, eye);
+	const uint32_t numChunks=max(1, min(numThreads, (batchCount+RECORD_MIN_BATCHES-1)/RECORD_MIN_BATCHES));
+	const uint32_t chunkSize=(batchCount+numChunks-1)/numChunks;
+
+	for(uint32_t i=0;i<numChunks;i++)
+		RecordAddJob(RecordLighting, eye, i*chunkSize, chunkSize, RECORD_LOCK_NONE, inheritance, extent);
+	//////
+
+	RecordAddJob(RecordDebug, eye, 0, 0, RECORD_LOCK_NONE, inheritance, extent);
+
+	RecordAddJob(RecordParticles, eye, 0, 0, RECORD_LOCK_PARTICLES, inheritance, extent);
+
+	*numJobs=recordQueue.numJobs-*firstJob;
+}
+
+// Copies the per eye UBO data, must happen before recording starts since jobs read it
+void EyeUpdateUBO(uint32_t index, uint32_t eye, matrix headPose)
 {
 	// Copy projection matrix
 	perFrame[index].mainUBO[eye]->projection=projection[eye];
@@ -862,12 +1017,12 @@ void EyeRender(uint32_t index, uint32_t eye, matrix headPose)
 		perFrame[index].mainUBO[eye]->cascadeSplits[i].x=cascadeSplits[i];
 	}
 	perFrame[index].mainUBO[eye]->cascadeSplits[NUM_CASCADES].x=cascadeSplits[NUM_CASCADES];
+}
 
-
-	vkuTransitionLayout(perFrame[index].commandBuffer, colorImage[eye].image, 1, 0, 1, 0, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-	vkuTransitionLayout(perFrame[index].commandBuffer, depthImage[eye].image, 1, 0, 1, 0, VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
-	vkuTransitionLayout(perFrame[index].commandBuffer, colorResolve[eye].image, 1, 0, 1, 0, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-
+// Render everything together, per-eye, per-frame index
+// Attachments are put in the right layouts by the render graph
+void EyeRender(uint32_t index, uint32_t eye, uint32_t firstJob, uint32_t numJobs)
+{
 	// Start a render pass and clear the frame/depth buffer
 	vkCmdBeginRenderPass(perFrame[index].commandBuffer, &(VkRenderPassBeginInfo)
 	{
@@ -879,23 +1034,18 @@ void EyeRender(uint32_t index, uint32_t eye, matrix headPose)
 		.pClearValues=(VkClearValue[]){ {{{ 0.0f, 0.0f, 0.0f, 1.0f }}}, {{{ 0.0f, 0 }}} },
 	}, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 
-	// Set per thread data and add the job to that worker thread
-	threadData[0].index=index;
-	threadData[0].eye=eye;
-	Thread_AddJob(&thread[0], Thread_Main, (void *)&threadData[0]);
-
-	threadData[1].index=index;
-	threadData[1].eye=eye;
-	Thread_AddJob(&thread[1], Thread_Particles, (void *)&threadData[1]);
-
-	ThreadBarrier_Wait(&threadBarrier);
+	// Execute the secondary command buffers recorded for this eye, in the order the jobs were added
+	VkCommandBuffer commandBuffers[MAX_RECORD_JOBS];
+	uint32_t numCommandBuffers=0;
 
-	// Execute the secondary command buffers from the threads
-	vkCmdExecuteCommands(perFrame[index].commandBuffer, 2, (VkCommandBuffer[])
+	for(uint32_t i=firstJob;i<firstJob+numJobs;i++)
 	{
-		threadData[0].perFrame[index].secCommandBuffer[eye],
-		threadData[1].perFrame[index].secCommandBuffer[eye]
-	});
+		if(recordQueue.jobs[i].commandBuffer)
+			commandBuffers[numCommandBuffers++]=recordQueue.jobs[i].commandBuffer;
+	}
+
+	if(numCommandBuffers)
+		vkCmdExecuteCommands(perFrame[index].commandBuffer, numCommandBuffers, commandBuffers);
 
 #if 1
 	vkCmdNextSubpass(perFrame[index].commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
@@ -910,10 +1060,26 @@ void EyeRender(uint32_t index, uint32_t eye, matrix headPose)
 	vkCmdPipelineBarrier(perFrame[index].commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_DEPENDENCY_BY_REGION_BIT, 1, &(VkMemoryBarrier) { .sType=VK_STRUCTURE_TYPE_MEMORY_BARRIER, .srcAccessMask=VK_ACCESS_SHADER_READ_BIT, .dstAccessMask=VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT }, 0, NULL, 0, NULL);
 
 	vkCmdEndRenderPass(perFrame[index].commandBuffer);
+}
+
+// Shadow and main passes for the render graph, their secondary command buffers come from this frame's record jobs
+static VkCommandBuffer shadowCommandBuffers[NUM_CASCADES];
+static uint32_t eyeFirstJob[2], eyeNumJobs[2];
+
+static void ShadowPass(VkCommandBuffer commandBuffer, void *passData, void *frameData)
+{
+	const RenderFrame_t *frame=(const RenderFrame_t *)frameData;
 
-	vkuTransitionLayout(perFrame[index].commandBuffer, colorImage[eye].image, 1, 0, 1, 0, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-	vkuTransitionLayout(perFrame[index].commandBuffer, depthImage[eye].image, 1, 0, 1, 0, VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-	vkuTransitionLayout(perFrame[index].commandBuffer, colorResolve[eye].image, 1, 0, 1, 0, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	// Cascades that didn't get a job are recorded inline
+	ShadowUpdateMap(commandBuffer, frame->index, shadowCommandBuffers);
+}
+
+static void MainPass(VkCommandBuffer commandBuffer, void *passData, void *frameData)
+{
+	const RenderFrame_t *frame=(const RenderFrame_t *)frameData;
+	const uint32_t eye=*(const uint32_t *)passData;
+
+	EyeRender(frame->index, eye, eyeFirstJob[eye], eyeNumJobs[eye]);
 }
 
 void ExplodeEmitterCallback(uint32_t index, uint32_t numParticles, Particle_t *particle)
@@ -927,303 +1093,585 @@ void ExplodeEmitterCallback(uint32_t index, uint32_t numParticles, Particle_t *p
 	particle->life=RandFloat()*0.5f+0.01f;
 }
 
-// Test collision now only builds a list of manfifolds.
-#define MAX_MANIFOLDS 10000
+// Broad phase candidates, and the narrow phase contacts built from them
+static PhysicsPairList_t candidatePairs;
+static PhysicsContactStream_t contactStream;
+// Index of each contact pair's first contact in the solver, UINT32_MAX if it wasn't added
+static uint32_t solverFirstContact[PHYSICS_MAX_PAIRS];
+
+static PhysicsSolver_t solver;
+// Alternative to the BVH for finding broad phase pairs, picked by config.gridBroadphase
+static SpatialHash_t physicsGrid;
+// BVH self test split between the physics thread and its workers, pair buffer 0 is the physics thread's
+#define BROADPHASE_TASKS 64
+static BVHParallelTest_t broadphaseTest;
+static uint32_t broadphaseBuffer[MAX_PHYSICS_WORKERS];
+static PhysicsGravity_t attractorGravity;
+static PhysicsIslands_t islands;
+static uint32_t numSleeping=0;
+
+// Set from the console, runs the solver benchmark on the next physics step's contacts
+static bool physicsBenchRequested=false;
+// Set from the console, runs the narrow phase benchmark on the next physics step's candidates
+static bool narrowPhaseBenchRequested=false;
+
+// Broad phase only collects candidates, they're tested together afterwards sorted by shape pair.
+// Entity indices ride along with the bodies, so contacts can be tied back to entities whichever way round the tests put them.
+void TestCollision(Entity_t *objA, Entity_t *objB)
+{
+	PhysicsPairList_Add(&candidatePairs, objA->body, objB->body, (uint32_t)(objA-entityList.entities), (uint32_t)(objB-entityList.entities));
+}
 
-struct
+void GridTestCollision(uint32_t a, uint32_t b, void *userdata)
 {
-	Entity_t *objA, *objB;
-	CollisionManifold_t manifold;
-} manifoldList[MAX_MANIFOLDS];
+	Entity_t *objA=&entityList.entities[a], *objB=&entityList.entities[b];
 
-uint32_t numManifolds;
+	// Sleeping bodies were already resolved against each other before they went to sleep
+	if(objA->body->asleep&&objB->body->asleep)
+		return;
 
-void TestCollision(Entity_t *objA, Entity_t *objB)
+	TestCollision(objA, objB);
+}
+
+void Thread_Broadphase(void *arg)
 {
-	CollisionManifold_t manifold=PhysicsCollision(objA->body, objB->body);
+	BVH_ParallelTestRun(&broadphaseTest, physicsBVH, *(uint32_t *)arg);
+	ThreadBarrier_Wait(&physicsWorkerBarrier);
+}
+
+// Laser ray candidate from the BVH, userdata is the step's dt
+void LaserHit(Entity_t *entity, void *userdata)
+{
+	const float dt=*(const float *)userdata;
+	float distance=0.0f;
+
+	if(entity->body->type==RIGIDBODY_SPHERE)
+		distance=RaySphereIntersect(camera.body.position, camera.forward, entity->body->position, entity->body->radius);
+	else if(entity->body->type==RIGIDBODY_OBB)
+		distance=RayOBBIntersect(camera.body.position, camera.forward, entity->body->position, entity->body->size, entity->body->orientation);
 
-	if(manifold.contactCount>0&&numManifolds<MAX_MANIFOLDS)
+	if(distance>0.0f)
 	{
-		manifoldList[numManifolds].objA=objA;
-		manifoldList[numManifolds].objB=objB;
-		manifoldList[numManifolds].manifold=manifold;
-		numManifolds++;
+		vec3 hitPoint=Vec3_Addv(camera.body.position, Vec3_Muls(camera.forward, distance));
+
+		// Directional impulse
+		const float impulseStrength=2.0f;
+		vec3 impulse=Vec3_Muls(camera.forward, impulseStrength);
+
+		PhysicsApplyImpulse(entity->body, impulse, hitPoint);
+
+		// Limit particle and sound effects with a simple timer
+		static const float fxCooldownTime=0.1f;
+		static float fxCooldown=fxCooldownTime;
+		fxCooldown-=dt;
+
+		if(fxCooldown<=0.0f)
+		{
+			fxCooldown=fxCooldownTime;
+
+			Audio_PlaySample(&AssetManager_GetAsset(assets, RandRange(SOUND_EXPLODE1, SOUND_EXPLODE3))->sound, false, 1.0f, hitPoint);
+
+			ParticleSystem_AddEmitter(
+				&particleSystem,
+				hitPoint,                  // Position
+				Vec3b(0.0f),               // Initial velocity
+				Vec3(100.0f, 12.0f, 5.0f), // Start color
+				Vec3(0.0f, 0.0f, 0.0f),    // End color
+				5.0f,                      // Radius of particles
+				1000,                      // Number of particles in system
+				PARTICLE_EMITTER_ONCE,     // One time
+				ExplodeEmitterCallback     // Callback for particle generation
+			);
+		}
 	}
 }
 
-static aabb PadAABB(const aabb bounds, float influenceRadius)
+// Re-solves the current step's contacts at increasing iteration counts, cold and warm started,
+// printing solve time and the final residual so the convergence/CPU tradeoff can be judged on a real scene.
+// Runs on the physics thread, bodies are restored afterwards so the simulation is left untouched.
+static void PhysicsSolverBenchmark(const float dt)
 {
-	return (aabb) { Vec3_Subs(bounds.min, influenceRadius), Vec3_Adds(bounds.max, influenceRadius) };
+	static const uint32_t iterationCounts[]={ 1, 2, 4, 8, 16, 32 };
+	PhysicsSolver_t *benchSolver=(PhysicsSolver_t *)Zone_Malloc(zone, sizeof(PhysicsSolver_t));
+	RigidBody_t *saved=(RigidBody_t *)Zone_Malloc(zone, sizeof(RigidBody_t)*max(entityList.entityCount, 1));
+
+	if(benchSolver==NULL||saved==NULL)
+	{
+		ConsolePrint(&console, "Physics bench: out of memory.");
+		Zone_Free(zone, benchSolver);
+		Zone_Free(zone, saved);
+		return;
+	}
+
+	for(uint32_t i=0;i<entityList.entityCount;i++)
+		saved[i]=*entityList.entities[i].body;
+
+	char text[128];
+	snprintf(text, sizeof(text), "Physics bench: %u pairs, %u contacts", contactStream.numPairs, contactStream.numContacts);
+	ConsolePrint(&console, text);
+
+	for(uint32_t i=0;i<sizeof(iterationCounts)/sizeof(iterationCounts[0]);i++)
+	{
+		double time[2]={ 0.0, 0.0 };
+		float residual[2]={ 0.0f, 0.0f };
+
+		PhysicsSolver_Init(benchSolver, iterationCounts[i], config.positionIterations);
+
+		// Second pass is warm started from the cache the first pass left behind
+		for(uint32_t pass=0;pass<2;pass++)
+		{
+			for(uint32_t j=0;j<entityList.entityCount;j++)
+				*entityList.entities[j].body=saved[j];
+
+			// Keep clear of the epochs the live solver has tagged bodies with
+			if(benchSolver->epoch<=solver.epoch)
+				benchSolver->epoch=solver.epoch+1;
+
+			const double startTime=GetClock();
+
+			PhysicsSolver_Begin(benchSolver);
+
+			for(uint32_t j=0;j<contactStream.numPairs;j++)
+				PhysicsSolver_AddContacts(benchSolver, contactStream.bodyA[j], contactStream.bodyB[j], &contactStream.contacts[contactStream.firstContact[j]], contactStream.contactCount[j],
+										  entityList.entities[contactStream.userA[j]].ID, entityList.entities[contactStream.userB[j]].ID);
+
+			PhysicsSolver_Solve(benchSolver, dt);
+
+			time[pass]=GetClock()-startTime;
+			residual[pass]=benchSolver->residual;
+		}
+
+		snprintf(text, sizeof(text), "%2u iterations: cold %.3fms residual %f, warm %.3fms residual %f", iterationCounts[i], time[0]*1000.0, residual[0], time[1]*1000.0, residual[1]);
+		ConsolePrint(&console, text);
+	}
+
+	for(uint32_t i=0;i<entityList.entityCount;i++)
+		*entityList.entities[i].body=saved[i];
+
+	Zone_Free(zone, saved);
+	Zone_Free(zone, benchSolver);
 }
 
-void AttractorQuery(Entity_t *entity, void *userdata)
+// Times the batched narrow phase against the scalar tests on the current step's candidates in pairs per second,
+// and checks the batched contacts match the scalar ones. Swept pairs are left out, as sweeping can move bodies.
+static void NarrowPhaseBenchmark(const float dt)
 {
-	Entity_t *attractor=(Entity_t *)userdata;
+	const uint32_t numRuns=20;
+	PhysicsPairList_t *pairs=(PhysicsPairList_t *)Zone_Malloc(zone, sizeof(PhysicsPairList_t));
+	PhysicsContactStream_t *streams[2]=
+	{
+		(PhysicsContactStream_t *)Zone_Malloc(zone, sizeof(PhysicsContactStream_t)),
+		(PhysicsContactStream_t *)Zone_Malloc(zone, sizeof(PhysicsContactStream_t))
+	};
 
-	// Don't calculate against self
-	if(entity==attractor)
+	if(pairs==NULL||streams[0]==NULL||streams[1]==NULL)
+	{
+		ConsolePrint(&console, "Narrow phase bench: out of memory.");
+		Zone_Free(zone, pairs);
+		Zone_Free(zone, streams[0]);
+		Zone_Free(zone, streams[1]);
 		return;
+	}
 
-	if(attractor->body->type==RIGIDBODY_SPHERE)
+	PhysicsPairList_Reset(pairs);
+
+	for(uint32_t i=0;i<candidatePairs.numPairs;i++)
 	{
-		vec3 gravity=AttractorSphereComputeGravity(entity->body->position, attractor->body->position, attractor->body->radius, attractor->baseGravity, attractor->influenceRadius);
-		entity->body->force=Vec3_Addv(entity->body->force, Vec3_Muls(gravity, fTimeStep));
+		const PhysicsPair_t *pair=&candidatePairs.pairs[i];
+
+		if(!PhysicsNeedsCCD(pair->a, dt)&&!PhysicsNeedsCCD(pair->b, dt))
+			PhysicsPairList_Add(pairs, pair->a, pair->b, pair->userA, pair->userB);
 	}
-	else if(attractor->body->type==RIGIDBODY_OBB)
+
+	// First pass batched, second scalar
+	double time[2]={ 0.0, 0.0 };
+
+	for(uint32_t pass=0;pass<2;pass++)
 	{
-		vec3 gravity=AttractorOBBComputeGravity(entity->body->position, attractor->body->position, attractor->body->size, attractor->body->orientation, attractor->baseGravity, attractor->influenceRadius);
-		entity->body->force=Vec3_Addv(entity->body->force, Vec3_Muls(gravity, fTimeStep));
+		const double startTime=GetClock();
+
+		for(uint32_t i=0;i<numRuns;i++)
+		{
+			PhysicsContactStream_Reset(streams[pass]);
+			PhysicsNarrowPhase(streams[pass], pairs, dt, pass==0);
+		}
+
+		time[pass]=fmax(GetClock()-startTime, 1e-9)/numRuns;
 	}
-	else if(attractor->body->type==RIGIDBODY_CAPSULE)
+
+	// Both passes run pairs in the same order, so the streams should line up pair for pair
+	uint32_t mismatches=0;
+	float maxError=0.0f;
+
+	if(streams[0]->numPairs!=streams[1]->numPairs)
+		mismatches=abs((int32_t)streams[0]->numPairs-(int32_t)streams[1]->numPairs);
+	else
 	{
-		vec3 gravity=AttractorCapsuleComputeGravity(entity->body->position, attractor->body->position, attractor->body->orientation, attractor->body->radiusHeight.x, attractor->body->radiusHeight.y, attractor->baseGravity, attractor->influenceRadius);
-		entity->body->force=Vec3_Addv(entity->body->force, Vec3_Muls(gravity, fTimeStep));
+		for(uint32_t i=0;i<streams[0]->numPairs;i++)
+		{
+			if(streams[0]->bodyA[i]!=streams[1]->bodyA[i]||streams[0]->bodyB[i]!=streams[1]->bodyB[i]||streams[0]->contactCount[i]!=streams[1]->contactCount[i])
+			{
+				mismatches++;
+				continue;
+			}
+
+			for(uint32_t j=0;j<streams[0]->contactCount[i];j++)
+			{
+				const ContactPoint_t *batched=&streams[0]->contacts[streams[0]->firstContact[i]+j];
+				const ContactPoint_t *scalar=&streams[1]->contacts[streams[1]->firstContact[i]+j];
+
+				maxError=fmaxf(maxError, Vec3_Distance(batched->position, scalar->position));
+				maxError=fmaxf(maxError, Vec3_Distance(batched->normal, scalar->normal));
+				maxError=fmaxf(maxError, fabsf(batched->penetration-scalar->penetration));
+			}
+		}
 	}
+
+	char text[128];
+	snprintf(text, sizeof(text), "Narrow phase bench: %u pairs, %u touching", pairs->numPairs, streams[1]->numPairs);
+	ConsolePrint(&console, text);
+	snprintf(text, sizeof(text), "batched %.3fms (%.2fM pairs/s), scalar %.3fms (%.2fM pairs/s)",
+			 time[0]*1000.0, pairs->numPairs/time[0]/1000000.0, time[1]*1000.0, pairs->numPairs/time[1]/1000000.0);
+	ConsolePrint(&console, text);
+	snprintf(text, sizeof(text), "%u mismatched pairs, max contact difference %g", mismatches, maxError);
+	ConsolePrint(&console, text);
+
+	Zone_Free(zone, pairs);
+	Zone_Free(zone, streams[0]);
+	Zone_Free(zone, streams[1]);
 }
 
-// Runs anything physics related
-void Thread_Physics(void *arg)
+// One fixed step of the server simulation: emitter lifetimes, integration, broadphase, narrowphase and response
+static void PhysicsStep(const float dt)
 {
-	const uint32_t index=*((uint32_t *)arg);
-	double startTime=GetClock();
 	static uint32_t frameCounter=0;
 
-	// Server runs physics, if connected
-	if(!ClientNetwork_IsConnected())
+	// Run lifetime check for particle emitter objects
+	for(uint32_t i=0;i<MAX_EMITTERS;i++)
 	{
-		if(!pausePhysics)
+		// If it's alive reduce the life and integrate,
+		// otherwise if it's dead and still has an ID assigned, delete/unassign it.
+		if(emitters[i].life>0.0f)
 		{
-			// Run particle system simlation
-			ParticleSystem_Step(&particleSystem, fTimeStep);
+			emitters[i].life-=dt;
 
-			// Run lifetime check for particle emitter objects
-			for(uint32_t i=0;i<MAX_EMITTERS;i++)
+			for(uint32_t j=0;j<List_GetCount(&particleSystem.emitters);j++)
 			{
-				// If it's alive reduce the life and integrate,
-				// otherwise if it's dead and still has an ID assigned, delete/unassign it.
-				if(emitters[i].life>0.0f)
-				{
-					emitters[i].life-=fTimeStep;
-
-					for(uint32_t j=0;j<List_GetCount(&particleSystem.emitters);j++)
-					{
-						ParticleEmitter_t *emitter=(ParticleEmitter_t *)List_GetPointer(&particleSystem.emitters, j);
+				ParticleEmitter_t *emitter=(ParticleEmitter_t *)List_GetPointer(&particleSystem.emitters, j);
 
-						if(emitter->ID==emitters[i].emitterID)
-						{
-							emitter->position=emitters[i].body.position;
+				if(emitter->ID==emitters[i].emitterID)
+				{
+					emitter->position=emitters[i].body.position;
 
-							if(emitters[i].life<5.0f)
-								emitter->particleSize*=fmaxf(0.0f, fminf(1.0f, emitters[i].life/5.0f));
+					if(emitters[i].life<5.0f)
+						emitter->particleSize*=fmaxf(0.0f, fminf(1.0f, emitters[i].life/5.0f));
 
-							break;
-						}
-					}
-				}
-				else if(emitters[i].emitterID!=UINT32_MAX)
-				{
-					ParticleSystem_DeleteEmitter(&particleSystem, emitters[i].emitterID);
-					EntityList_Remove(&entityList, emitters[i].entityID);
-					emitters[i].emitterID=UINT32_MAX;
+					break;
 				}
 			}
+		}
+		else if(emitters[i].emitterID!=UINT32_MAX)
+		{
+			ParticleSystem_DeleteEmitter(&particleSystem, emitters[i].emitterID);
+			EntityList_Remove(&entityList, emitters[i].entityID);
+			emitters[i].emitterID=UINT32_MAX;
+		}
+	}
 
-			PhysicsRecorder_BeginFrame(frameCounter++);
+	PhysicsRecorder_BeginFrame(frameCounter++);
 
-			// Run through the physics object list, run integration step
-			for(uint32_t i=0;i<entityList.entityCount;i++)
-			{
-				PhysicsRecorder_LogEntity(&entityList.entities[i]);
+	// Run through the physics object list, run integration step
+	for(uint32_t i=0;i<entityList.entityCount;i++)
+	{
+		PhysicsRecorder_LogEntity(&entityList.entities[i]);
+
+		PhysicsIntegrate(entityList.entities[i].body, dt);
+	}
+
+	// Bounds follow the bodies every step, or later substeps would build the BVH around where bodies were.
+	// They go into the BVH buffer rather than the entities, rendering reads those while this runs and gets these with the tree.
+	EntityList_CalculateBounds(&entityList, physicsBVH->bounds);
+
+	// Swept bodies need theirs to cover where they went and where they're going
+	for(uint32_t i=0;i<entityList.entityCount;i++)
+	{
+		if(PhysicsNeedsCCD(entityList.entities[i].body, dt))
+			physicsBVH->bounds[i]=PhysicsSweptBounds(entityList.entities[i].body, dt);
+	}
+
+	// Run broadphase collision with BVH
+	PhysicsPairList_Reset(&candidatePairs);
+	PhysicsContactStream_Reset(&contactStream);
+
+	BVH_Build(physicsBVH, &entityList);
+	BVH_BuildWide(physicsBVH);
+	physicsBVHBuilt=true;
 
-				PhysicsIntegrate(entityList.entities[i].body, fTimeStep);
 #if 1
-				// Fire "laser beam"
-				if(isControlPressed)
-				{
-					float distance=0.0f;
+	// Fire "laser beam"
+	if(isControlPressed)
+		BVH_QueryRay(physicsBVH, &entityList, camera.body.position, camera.forward, INFINITY, 0.0f, LaserHit, (void *)&dt);
+#endif
 
-					if(entityList.entities[i].body->type==RIGIDBODY_SPHERE)
-						distance=RaySphereIntersect(camera.body.position, camera.forward, entityList.entities[i].body->position, entityList.entities[i].body->radius);
-					else if(entityList.entities[i].body->type==RIGIDBODY_OBB)
-						distance=RayOBBIntersect(camera.body.position, camera.forward, entityList.entities[i].body->position, entityList.entities[i].body->size, entityList.entities[i].body->orientation);
+	// Attractor gravity comes after integration is already done, so it's delayed by a frame.
+	PhysicsGravity_Begin(&attractorGravity);
 
-					if(distance>0.0f)
-					{
-						vec3 hitPoint=Vec3_Addv(camera.body.position, Vec3_Muls(camera.forward, distance));
+	for(uint32_t i=0;i<entityList.entityCount;i++)
+	{
+		const Entity_t *entity=&entityList.entities[i];
 
-						// Directional impulse
-						const float impulseStrength=2.0f;
-						vec3 impulse=Vec3_Muls(camera.forward, impulseStrength);
+		if(entity->isAttractor)
+			PhysicsGravity_AddAttractor(&attractorGravity, entity->body, entity->baseGravity, entity->influenceRadius);
+	}
 
-						PhysicsApplyImpulse(entityList.entities[i].body, impulse, hitPoint);
+	if(attractorGravity.numAttractors>0)
+	{
+		PhysicsGravity_Build(&attractorGravity);
 
-						// Limit particle and sound effects with a simple timer
-						static const float fxCooldownTime=0.1f;
-						static float fxCooldown=fxCooldownTime;
-						fxCooldown-=fTimeStep;
+		for(uint32_t i=0;i<entityList.entityCount;i++)
+			PhysicsGravity_Gather(&attractorGravity, entityList.entities[i].body);
 
-						if(fxCooldown<=0.0f)
-						{
-							fxCooldown=fxCooldownTime;
-
-							Audio_PlaySample(&AssetManager_GetAsset(assets, RandRange(SOUND_EXPLODE1, SOUND_EXPLODE3))->sound, false, 1.0f, hitPoint);
-
-							ParticleSystem_AddEmitter(
-								&particleSystem,
-								hitPoint,                  // Position
-								Vec3b(0.0f),               // Initial velocity
-								Vec3(100.0f, 12.0f, 5.0f), // Start color
-								Vec3(0.0f, 0.0f, 0.0f),    // End color
-								5.0f,                      // Radius of particles
-								1000,                      // Number of particles in system
-								PARTICLE_EMITTER_ONCE,     // One time
-								ExplodeEmitterCallback     // Callback for particle generation
-							);
-						}
-					}
-				}
-#endif
-			}
+		PhysicsGravity_Apply(&attractorGravity, dt);
 
-			// Run broadphase collision with BVH
-			memset(manifoldList, 0, sizeof(manifoldList));
-			numManifolds=0;
+		if(attractorGravity.overflow)
+			DBGPRINTF(DEBUG_WARNING, "PhysicsStep: Dropped %u attractors/gravity interactions this step.\n", attractorGravity.overflow);
+	}
 
-			BVH_Build(&bvh, &entityList);
+	// The BVH is built either way, rendering culls against it
+	if(config.gridBroadphase)
+	{
+		SpatialHash_Clear(&physicsGrid);
 
-			// Attractors need to be done after the BVH is built, which means they come after integration is already done. So it's delayed by a frame.
-			for(uint32_t i=0;i<entityList.entityCount;i++)
-			{
-				if(entityList.entities[i].isAttractor)
-					BVH_QueryAABB(&bvh, &entityList, PadAABB(entityList.entities[i].bounds, entityList.entities[i].influenceRadius), AttractorQuery, &entityList.entities[i]);
-			}
+		for(uint32_t i=0;i<entityList.entityCount;i++)
+			SpatialHash_AddObject(&physicsGrid, physicsBVH->bounds[i]);
 
-			BVH_Test(&bvh, &entityList, TestCollision);
+		SpatialHash_Build(&physicsGrid);
+		SpatialHash_TestPairs(&physicsGrid, GridTestCollision, NULL);
+	}
+	else if(numPhysicsWorkers>0)
+	{
+		BVH_ParallelTestBegin(&broadphaseTest, physicsBVH, BROADPHASE_TASKS);
 
-			// From the manifold collection, do narrow phase collision and response
-			for(uint32_t i=0;i<numManifolds;i++)
-			{
-				CollisionManifold_t *manifold=&manifoldList[i].manifold;
-				Entity_t *objA=manifoldList[i].objA, *objB=manifoldList[i].objB;
+		for(uint32_t i=0;i<numPhysicsWorkers;i++)
+			Thread_AddJob(&physicsWorkers[i], Thread_Broadphase, (void *)&broadphaseBuffer[i]);
 
-				for(uint32_t j=0;j<manifold->contactCount;j++)
+		BVH_ParallelTestRun(&broadphaseTest, physicsBVH, 0);
+		ThreadBarrier_Wait(&physicsWorkerBarrier);
+
+		// Merged in task order, so the candidate order doesn't depend on thread timing
+		const uint32_t overflow=BVH_ParallelTestMerge(&broadphaseTest, &entityList, TestCollision);
+
+		if(overflow)
+			DBGPRINTF(DEBUG_WARNING, "PhysicsStep: Dropped %u broad phase pairs this step.\n", overflow);
+	}
+	else
+		BVH_Test(physicsBVH, &entityList, TestCollision);
+
+	if(narrowPhaseBenchRequested)
+	{
+		narrowPhaseBenchRequested=false;
+		NarrowPhaseBenchmark(dt);
+	}
+
+	PhysicsNarrowPhase(&contactStream, &candidatePairs, dt, true);
+
+	if(candidatePairs.overflow||contactStream.overflow)
+		DBGPRINTF(DEBUG_WARNING, "PhysicsStep: Dropped %u candidate pairs and %u contact pairs this step.\n", candidatePairs.overflow, contactStream.overflow);
+
+	// Group bodies by contact, a moving body touching a sleeping one wakes everything that one is resting on
+	PhysicsIslands_Begin(&islands);
+
+	for(uint32_t i=0;i<entityList.entityCount;i++)
+		PhysicsIslands_AddBody(&islands, entityList.entities[i].body);
+
+	for(uint32_t i=0;i<contactStream.numPairs;i++)
+		PhysicsIslands_AddContact(&islands, contactStream.bodyA[i], contactStream.bodyB[i]);
+
+	PhysicsIslands_Wake(&islands);
+
+	if(physicsBenchRequested)
+	{
+		physicsBenchRequested=false;
+		PhysicsSolverBenchmark(dt);
+	}
+
+	// Solve all contacts together, then run game logic off the impact speeds
+	PhysicsSolver_Begin(&solver);
+
+	for(uint32_t i=0;i<contactStream.numPairs;i++)
+	{
+		solverFirstContact[i]=PhysicsSolver_AddContacts(&solver, contactStream.bodyA[i], contactStream.bodyB[i], &contactStream.contacts[contactStream.firstContact[i]], contactStream.contactCount[i],
+													   entityList.entities[contactStream.userA[i]].ID, entityList.entities[contactStream.userB[i]].ID);
+	}
+
+	PhysicsSolver_Solve(&solver, dt);
+
+	for(uint32_t i=0;i<contactStream.numPairs;i++)
+	{
+		ContactPoint_t *contacts=&contactStream.contacts[contactStream.firstContact[i]];
+		Entity_t *objA=&entityList.entities[contactStream.userA[i]], *objB=&entityList.entities[contactStream.userB[i]];
+
+		for(uint32_t j=0;j<contactStream.contactCount[i];j++)
+		{
+			PhysicsRecorder_LogContact(&contacts[j]);
+
+			if(solverFirstContact[i]==UINT32_MAX)
+				continue;
+
+			float impactSpeed=PhysicsSolver_GetImpactSpeed(&solver, solverFirstContact[i]+j);
+
+			// Run "game logic"
+			if(impactSpeed>2.0f)
+			{
+				// If both objects are asteroids
+				if(objA->objectType==ENTITYOBJECTTYPE_FIELD&&objB->objectType==ENTITYOBJECTTYPE_FIELD)
+				{
+					Audio_PlaySample(&AssetManager_GetAsset(assets, RandRange(SOUND_STONE1, SOUND_STONE3))->sound, false, 1.0f, objB->body->position);
+				}
+				// If one is an asteroid and one is a player
+				else if((objA->objectType==ENTITYOBJECTTYPE_FIELD&&objB->objectType==ENTITYOBJECTTYPE_PLAYER)||
+						(objA->objectType==ENTITYOBJECTTYPE_PLAYER&&objB->objectType==ENTITYOBJECTTYPE_FIELD))
 				{
-					PhysicsRecorder_LogContact(&manifold->contacts[j]);
-					float impactSpeed=PhysicsResolveCollision(manifold->a, manifold->b, manifold->contacts[j]);
+					Audio_PlaySample(&AssetManager_GetAsset(assets, SOUND_CRASH)->sound, false, 1.0f, objB->body->position);
+				}
+				// If both objects are players
+				else if(objA->objectType==ENTITYOBJECTTYPE_PLAYER&&objB->objectType==ENTITYOBJECTTYPE_PLAYER)
+				{
+					Audio_PlaySample(&AssetManager_GetAsset(assets, SOUND_CRASH)->sound, false, 1.0f, objB->body->position);
+				}
+				// If it was a projectile colliding with anything
+				else if(objA->objectType==ENTITYOBJECTTYPE_PROJECTILE||objB->objectType==ENTITYOBJECTTYPE_PROJECTILE)
+				{
+					Entity_t *whichProjectile=NULL;
+					Entity_t *otherObject=NULL;
 
-					// Run "game logic"
-					if(impactSpeed>2.0f)
+					if(objB->objectType==ENTITYOBJECTTYPE_PROJECTILE)
 					{
-						// If both objects are asteroids
-						if(objA->objectType==ENTITYOBJECTTYPE_FIELD&&objB->objectType==ENTITYOBJECTTYPE_FIELD)
-						{
-							Audio_PlaySample(&AssetManager_GetAsset(assets, RandRange(SOUND_STONE1, SOUND_STONE3))->sound, false, 1.0f, objB->body->position);
-						}
-						// If one is an asteroid and one is a player
-						else if((objA->objectType==ENTITYOBJECTTYPE_FIELD&&objB->objectType==ENTITYOBJECTTYPE_PLAYER)||
-								(objA->objectType==ENTITYOBJECTTYPE_PLAYER&&objB->objectType==ENTITYOBJECTTYPE_FIELD))
-						{
-							Audio_PlaySample(&AssetManager_GetAsset(assets, SOUND_CRASH)->sound, false, 1.0f, objB->body->position);
-						}
-						// If both objects are players
-						else if(objA->objectType==ENTITYOBJECTTYPE_PLAYER&&objB->objectType==ENTITYOBJECTTYPE_PLAYER)
-						{
-							Audio_PlaySample(&AssetManager_GetAsset(assets, SOUND_CRASH)->sound, false, 1.0f, objB->body->position);
-						}
-						// If it was a projectile colliding with anything
-						else if(objA->objectType==ENTITYOBJECTTYPE_PROJECTILE||objB->objectType==ENTITYOBJECTTYPE_PROJECTILE)
-						{
-							Entity_t *whichProjectile=NULL;
-							Entity_t *otherObject=NULL;
+						whichProjectile=objB;
+						otherObject=objA;
+					}
+					else if(objA->objectType==ENTITYOBJECTTYPE_PROJECTILE)
+					{
+						whichProjectile=objA;
+						otherObject=objB;
+					}
+					else
+						continue; // SHOULD NEVER BE HERE.
 
-							if(objB->objectType==ENTITYOBJECTTYPE_PROJECTILE)
-							{
-								whichProjectile=objB;
-								otherObject=objA;
-							}
-							else if(objA->objectType==ENTITYOBJECTTYPE_PROJECTILE)
+					if(otherObject->objectType==ENTITYOBJECTTYPE_PLAYER)
+					{
+						for(uint32_t i=0;i<NUM_ENEMY;i++)
+						{
+							if(&enemyAI[i].camera->body==otherObject->body)
 							{
-								whichProjectile=objA;
-								otherObject=objB;
+								DamageEnemy(&enemyAI[i], impactSpeed*0.5f);
+								break;
 							}
-							else
-								continue; // SHOULD NEVER BE HERE.
-
-							if(otherObject->objectType==ENTITYOBJECTTYPE_PLAYER)
+							else if(&camera.body==otherObject->body)
 							{
-								for(uint32_t i=0;i<NUM_ENEMY;i++)
-								{
-									if(&enemyAI[i].camera->body==otherObject->body)
-									{
-										DamageEnemy(&enemyAI[i], impactSpeed*0.5f);
-										break;
-									}
-									else if(&camera.body==otherObject->body)
-									{
-										playerHealth-=impactSpeed*0.5f;
-										break;
-									}
-								}
+								playerHealth-=impactSpeed*0.5f;
+								break;
 							}
+						}
+					}
 
-							// If the projectile hit an asteroid, split it.
-							if(otherObject->objectType==ENTITYOBJECTTYPE_FIELD)
+					// If the projectile hit an asteroid, split it.
+					if(otherObject->objectType==ENTITYOBJECTTYPE_FIELD)
+					{
+						for(uint32_t k=0;k<numAsteroids;k++)
+						{
+							if(otherObject->body==&asteroids[k])
 							{
-								for(uint32_t k=0;k<numAsteroids;k++)
-								{
-									if(otherObject->body==&asteroids[k])
-									{
-										SplitAsteroid(k, manifold->contacts[j], impactSpeed);
-										break;
-									}
-								}
+								SplitAsteroid(k, contacts[j], impactSpeed);
+								break;
 							}
+						}
+					}
 
-							// It collided, kill it.
-							// Setting this directly to <0.0 seems to cause emitters that won't get removed,
-							//     so setting it to nearly 0.0 allows the natural progression kill it off.
-							// Need to find the source emitter first:
-							for(uint32_t k=0;k<MAX_EMITTERS;k++)
+					// It collided, kill it.
+					// Setting this directly to <0.0 seems to cause emitters that won't get removed,
+					//     so setting it to nearly 0.0 allows the natural progression kill it off.
+					// Need to find the source emitter first:
+					for(uint32_t k=0;k<MAX_EMITTERS;k++)
+					{
+						if(emitters[k].life>0.0f)
+						{
+							if(whichProjectile->body==&emitters[k].body)
 							{
-								if(emitters[k].life>0.0f)
-								{
-									if(whichProjectile->body==&emitters[k].body)
-									{
-										emitters[k].life=0.001f;
-										break;
-									}
-								}
+								emitters[k].life=0.001f;
+								break;
 							}
-
-							Audio_PlaySample(&AssetManager_GetAsset(assets, RandRange(SOUND_EXPLODE1, SOUND_EXPLODE3))->sound, false, 1.0f, whichProjectile->body->position);
-							ParticleSystem_AddEmitter(&particleSystem,
-													whichProjectile->body->position,	// Position
-													whichProjectile->body->velocity,	// Initial velocity
-													Vec3(100.0f, 12.0f, 5.0f),	// Start color
-													Vec3(0.0f, 0.0f, 0.0f),		// End color
-													5.0f,						// Radius of particles
-													1000,						// Number of particles in system
-													PARTICLE_EMITTER_ONCE,		// Type?
-													ExplodeEmitterCallback		// Callback for particle generation
-							);
 						}
 					}
+
+					Audio_PlaySample(&AssetManager_GetAsset(assets, RandRange(SOUND_EXPLODE1, SOUND_EXPLODE3))->sound, false, 1.0f, whichProjectile->body->position);
+					ParticleSystem_AddEmitter(&particleSystem,
+											whichProjectile->body->position,	// Position
+											whichProjectile->body->velocity,	// Initial velocity
+											Vec3(100.0f, 12.0f, 5.0f),	// Start color
+											Vec3(0.0f, 0.0f, 0.0f),		// End color
+											5.0f,						// Radius of particles
+											1000,						// Number of particles in system
+											PARTICLE_EMITTER_ONCE,		// Type?
+											ExplodeEmitterCallback		// Callback for particle generation
+					);
 				}
 			}
+		}
+	}
 
-			for(uint32_t i=0;i<numManifolds;i++)
+	numSleeping=PhysicsIslands_Sleep(&islands, dt);
+
+	PhysicsRecorder_EndFrame();
+}
+
+// Runs anything physics related
+void Thread_Physics(void *arg)
+{
+	const uint32_t index=*((uint32_t *)arg);
+	double startTime=GetClock();
+
+	// Server runs physics, if connected
+	if(!ClientNetwork_IsConnected())
+	{
+		if(!pausePhysics)
+		{
+			// Run particle system simlation, purely visual so it can follow the frame time
+			ParticleSystem_Step(&particleSystem, fTimeStep);
+
+			// Step the simulation at a fixed rate, however long the frame took
+			physicsAccumulator+=fTimeStep;
+
+			uint32_t substeps=0;
+
+			while(physicsAccumulator>=PHYSICS_TIMESTEP)
 			{
-				CollisionManifold_t *manifold=&manifoldList[i].manifold;
+				// Too far behind to catch up, drop the backlog instead of spending even longer next frame
+				if(substeps>=PHYSICS_MAX_SUBSTEPS)
+				{
+					physicsAccumulator=fmodf(physicsAccumulator, PHYSICS_TIMESTEP);
+					break;
+				}
 
-				for(uint32_t j=0;j<manifold->contactCount;j++)
-					PhysicsPositionCorrection(manifold->a, manifold->b, manifold->contacts[j]);
+				PhysicsStep(PHYSICS_TIMESTEP);
+
+				physicsAccumulator-=PHYSICS_TIMESTEP;
+				substeps++;
 			}
 
-			PhysicsRecorder_EndFrame();
+			physicsAlpha=physicsAccumulator/PHYSICS_TIMESTEP;
+		}
+		else
+		{
+			physicsAccumulator=0.0f;
+			physicsAlpha=1.0f;
 		}
 	}
 	else
 	{
+		// Server sends final transforms, nothing to blend between
+		physicsAlpha=1.0f;
+
 		ParticleSystem_Step(&particleSystem, fTimeStep);
 
 		// Run lifetime check for particle emitter objects
@@ -1275,10 +1723,21 @@ void Thread_Physics(void *arg)
 	if(pausePhysics||ClientNetwork_IsConnected())
 		PhysicsIntegrate(&camera.body, fTimeStep);
 
-	// Update camera and modelview matrix
+	// Update camera and modelview matrix, from the blended transform so the view moves as smoothly as the entities
 	if(playerHealth>0.0f)
+	{
+		const vec3 position=camera.body.position;
+		const vec4 orientation=camera.body.orientation;
+
+		camera.body.position=PhysicsInterpolatePosition(&camera.body, physicsAlpha);
+		camera.body.orientation=PhysicsInterpolateOrientation(&camera.body, physicsAlpha);
+
 		modelView=CameraUpdate(&camera, fTimeStep);
 
+		camera.body.position=position;
+		camera.body.orientation=orientation;
+	}
+
 	for(uint32_t i=0;i<NUM_ENEMY;i++)
 		CameraUpdate(&enemy[i], fTimeStep);
 
@@ -1330,8 +1789,9 @@ void Render(void)
 
 	ClientNetwork_Update(GetClock(), fTimeStep);
 
-	DBGPRINTF(DEBUG_INFO, "Number of entities: %d            \r", entityList.entityCount);
+	DBGPRINTF(DEBUG_INFO, "Number of entities: %d (%d asleep)            \r", entityList.entityCount, numSleeping);
 
+	// Only refreshed here, before physics is kicked off, so everything culling this frame sees the same bounds
 	EntityList_RecalculateBounds(&entityList);
 	EntityList_Rebuild(&entityList);
 	//////
@@ -1343,6 +1803,9 @@ void Render(void)
 
 	vkWaitForFences(vkContext.device, 1, &perFrame[index].frameFence, VK_TRUE, UINT64_MAX);
 
+	// Kick off any uploads recorded since last frame and reclaim staging space from finished ones
+	vkuUploadBatch_Flush(&uploadBatch);
+
 	// Handle VR frame start
 	if(config.isVR)
 	{
@@ -1509,8 +1972,45 @@ void Render(void)
 	//       Seems ok for now, but may change later.
 	matrix mvp=MatrixMult(MatrixMult(modelView, headPose[0]), projection[0]);
 	frustum cameraFrustum=Frustum_ExtractPlanes(mvp);
-	EntityList_FrustumCull(&entityList, cameraFrustum);
-	EntityList_UpdateInstances(&entityList, index);
+
+	// Pixels covered by a unit sized object one unit away, taking the larger axis so a rotated projection still works
+	const float LODScale=fmaxf(fmaxf(fabsf(projection[0].x.x), fabsf(projection[0].x.y))*0.5f*config.renderWidth, fmaxf(fabsf(projection[0].y.x), fabsf(projection[0].y.y))*0.5f*config.renderHeight);
+
+	// Walk the BVH if it's still current, otherwise every entity gets tested
+	const bool BVHCulled=BVH_CullFrustum(renderBVH, &entityList, &cameraFrustum, CAMERA_CULL_PADDING, cameraVisible);
+	EntityList_FrustumCull(&entityList, cameraFrustum, BVHCulled?cameraVisible:NULL, camera.body.position, LODScale);
+
+	// Instances are built once here, every pass copies its own from them
+	EntityList_BuildInstances(&entityList, physicsAlpha);
+
+	// The GPU culls the main pass itself, the CPU cull above still provides the shadow caster LODs
+	if(!CullUpdate(&entityList, index))
+		EntityList_UpdateInstances(&entityList, index);
+
+	ShadowCullCasters(&entityList, renderBVH, modelView, index);
+
+	const uint32_t numEyes=config.isVR?2:1;
+
+	for(uint32_t eye=0;eye<numEyes;eye++)
+		EyeUpdateUBO(index, eye, headPose[eye]);
+
+	// Declare everything that gets recorded on the worker threads: shadow cascades, then each eye's main pass
+	RecordBegin(index);
+
+	uint32_t shadowJobs[NUM_CASCADES];
+
+	for(uint32_t cascade=0;cascade<NUM_CASCADES;cascade++)
+	{
+		shadowJobs[cascade]=UINT32_MAX;
+
+		if(ShadowCascadeNeedsUpdate(cascade))
+			shadowJobs[cascade]=RecordAddJob(RecordShadowCascade, 0, cascade, 1, RECORD_LOCK_NONE, ShadowGetCascadeInheritance(cascade), (VkExtent2D){ 0, 0 });
+	}
+
+	for(uint32_t eye=0;eye<numEyes;eye++)
+		EyeAddRecordJobs(index, eye, &eyeFirstJob[eye], &eyeNumJobs[eye]);
+
+	RecordKick();
 
 	// Start recording the commands
 	vkBeginCommandBuffer(perFrame[index].commandBuffer, &(VkCommandBufferBeginInfo)
@@ -1519,23 +2019,22 @@ void Render(void)
 		.flags=VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
 	});
 
-	// Update shadow depth map
-	ShadowUpdateMap(perFrame[index].commandBuffer, &entityList, index);
+	CullDispatch(perFrame[index].commandBuffer, index, cameraFrustum, camera.body.position, LODScale);
 
-	EyeRender(index, 0, headPose[0]);
+	RecordWait();
 
-	if(config.isVR)
-		EyeRender(index, 1, headPose[1]);
+	for(uint32_t cascade=0;cascade<NUM_CASCADES;cascade++)
+		shadowCommandBuffers[cascade]=(shadowJobs[cascade]!=UINT32_MAX)?recordQueue.jobs[shadowJobs[cascade]].commandBuffer:VK_NULL_HANDLE;
 
-	// Final drawing compositing
-	CompositeDraw(imageIndex[0], index, 0);
-	//////
+	// Shadow maps, then per eye the main pass, bloom and compositing
+	vkuRenderGraph_Execute(&renderGraph, perFrame[index].commandBuffer, &(RenderFrame_t)
+	{
+		.index=index,
+		.imageIndex={ imageIndex[0], imageIndex[1] },
+	});
 
-	// Other eye compositing
 	if(config.isVR)
 	{
-		CompositeDraw(imageIndex[1], index, 1);
-
 		// Render VR UI
 		vkCmdBeginRenderPass(perFrame[index].commandBuffer, &(VkRenderPassBeginInfo)
 		{
@@ -1575,6 +2074,15 @@ void Render(void)
 	// Wait for physics to finish before submitting frame
 	ThreadBarrier_Wait(&physicsThreadBarrier);
 
+	// Nothing reads the render BVH past this point, the freshly built one gets used for culling next frame
+	if(physicsBVHBuilt)
+	{
+		BVH_t *swapBVH=renderBVH;
+		renderBVH=physicsBVH;
+		physicsBVH=swapBVH;
+		physicsBVHBuilt=false;
+	}
+
 	// Submit command queue
 	VkSubmitInfo SubmitInfo=
 	{
@@ -1692,7 +2200,7 @@ void Console_CmdPhysicsRecord(Console_t *console, const char *param)
 
 	if(strcmp(param, "start")==0)
 	{
-		if(!PhysicsRecorder_Init("physics_session.bin", 1.0f/60.0f))
+		if(!PhysicsRecorder_Init("physics_session.bin", PHYSICS_TIMESTEP))
 			ConsolePrint(console, "Failed to start recording.");
 		else
 			ConsolePrint(console, "Started recording physics.");
@@ -1705,12 +2213,56 @@ void Console_CmdPhysicsRecord(Console_t *console, const char *param)
 		ConsolePrint(console, "Invalid parameter. Use 'start' or 'stop'.");
 }
 
+void Console_CmdPhysicsBench(Console_t *console, const char *param)
+{
+	physicsBenchRequested=true;
+	ConsolePrint(console, "Running solver benchmark on the next physics step.");
+}
+
+void Console_CmdBroadphase(Console_t *console, const char *param)
+{
+	if(param==NULL)
+	{
+		ConsolePrint(console, config.gridBroadphase?"Broad phase: grid":"Broad phase: bvh");
+		return;
+	}
+
+	if(strcmp(param, "grid")==0)
+	{
+		if(physicsGrid.maxObjects==0)
+		{
+			ConsolePrint(console, "Grid broad phase is unavailable.");
+			return;
+		}
+
+		config.gridBroadphase=true;
+	}
+	else if(strcmp(param, "bvh")==0)
+		config.gridBroadphase=false;
+	else
+		ConsolePrint(console, "Invalid parameter. Use 'grid' or 'bvh'.");
+}
+
+void Console_CmdNarrowPhaseBench(Console_t *console, const char *param)
+{
+	narrowPhaseBenchRequested=true;
+	ConsolePrint(console, "Running narrow phase benchmark on the next physics step.");
+}
+
 // Initialization call from system main
 bool Init(void)
 {
 	Input_PlatformInit();
 
-	vkuMemAllocator_Init(&vkContext);
+	// Assets are loaded from the packed archive when there is one, otherwise from loose files
+	if(!Archive_Mount("assets.pak"))
+		DBGPRINTF(DEBUG_WARNING, "Asset archive not found, loading loose asset files.\n");
+
+	// Heap chunk sizes from config.ini, 0 lets the allocator size them from the device
+	vkuMemAllocator_Init(&vkContext, (VkDeviceSize)config.hostHeapSize*1024*1024, (VkDeviceSize)config.deviceHeapSize*1024*1024);
+
+	if(!vkuUploadBatch_Init(&vkContext, &uploadBatch, UPLOAD_STAGING_SIZE))
+		return false;
 
 	LoadingScreenInit(&loadingScreen, NUM_ASSETS+11);
 
@@ -1728,6 +2280,18 @@ bool Init(void)
 	ConsoleRegisterCommand(&console, "disconnect", Console_CmdDisconnect);
 	ConsoleRegisterCommand(&console, "explode", Console_CmdExplode);
 	ConsoleRegisterCommand(&console, "physics_record", Console_CmdPhysicsRecord);
+	ConsoleRegisterCommand(&console, "physics_bench", Console_CmdPhysicsBench);
+	ConsoleRegisterCommand(&console, "narrowphase_bench", Console_CmdNarrowPhaseBench);
+	ConsoleRegisterCommand(&console, "broadphase", Console_CmdBroadphase);
+
+	PhysicsSolver_Init(&solver, config.velocityIterations, config.positionIterations);
+
+	// Cell size is picked from the bodies each step
+	if(!SpatialHash_Create(&physicsGrid, MAX_ENTITY, 0.0f))
+	{
+		DBGPRINTF(DEBUG_WARNING, "Init: Unable to create broad phase grid, using the BVH.\n");
+		config.gridBroadphase=false;
+	}
 
 	CameraInit(&camera, Vec3(0.0f, 0.0f, -100.0f), Vec3(0.0f, 1.0f, 0.0f), Vec3(0.0f, 0.0f, 1.0f));
 
@@ -1751,6 +2315,7 @@ bool Init(void)
 
 	// Create primary pipeline
 	CreateLightingPipeline();
+	CreateCullPipeline();
 	LoadingScreenAdvance(&loadingScreen);
 
 	// Create skybox pipeline
@@ -1779,15 +2344,11 @@ bool Init(void)
 	CreateCompositePipeline();
 	LoadingScreenAdvance(&loadingScreen);
 
-	// Create primary frame buffers, depth image
-	CreateFramebuffers(0);
-	CreateCompositeFramebuffers(0);
-
-	// Second eye framebuffer for VR
-	if(config.isVR)
+	// Create the render graph, with it the per eye images and framebuffers
+	if(!CreateRenderGraph())
 	{
-		CreateFramebuffers(1);
-		CreateCompositeFramebuffers(1);
+		DBGPRINTF(DEBUG_ERROR, "Init: CreateRenderGraph failed.\n");
+		return false;
 	}
 
 	// Set up particle system
@@ -1827,6 +2388,8 @@ bool Init(void)
 			.restitution=1.0f,
 			.friction=0.0f,
 
+			.ccd=true,
+
 			.type=RIGIDBODY_SPHERE,
 			.radius=radius,
 		};
@@ -2017,8 +2580,14 @@ bool Init(void)
 		}, perFrame[i].secCommandBuffer);
 	}
 
-	// Set up and initialize threads
-	for(uint32_t i=0;i<NUM_THREADS;i++)
+	// Set up and initialize threads, leaving a core each for the main and physics threads
+	numThreads=min(max(2, (int32_t)Thread_GetCPUCount()-2), MAX_THREADS);
+	DBGPRINTF(DEBUG_INFO, "Using %d threads for command recording.\n", numThreads);
+
+	for(uint32_t i=0;i<NUM_RECORD_LOCKS;i++)
+		mtx_init(&recordQueue.locks[i], mtx_plain);
+
+	for(uint32_t i=0;i<numThreads;i++)
 	{
 		Thread_Init(&thread[i]);
 		Thread_AddConstructor(&thread[i], Thread_Constructor, (void *)&threadData[i]);
@@ -2027,7 +2596,7 @@ bool Init(void)
 	}
 
 	// Synchronization barrier, count is number of threads+main thread
-	ThreadBarrier_Init(&threadBarrier, NUM_THREADS+1);
+	ThreadBarrier_Init(&threadBarrier, numThreads+1);
 
 	// Thread for physics, and sync barrier
 	Thread_Init(&threadPhysics);
@@ -2035,6 +2604,29 @@ bool Init(void)
 
 	ThreadBarrier_Init(&physicsThreadBarrier, 2);
 
+	// Broad phase helpers, kept few since they run alongside command recording
+	numPhysicsWorkers=min(max(1, (int32_t)Thread_GetCPUCount()/4), MAX_PHYSICS_WORKERS);
+
+	if(BVH_ParallelTestCreate(&broadphaseTest, numPhysicsWorkers+1, PHYSICS_MAX_CANDIDATES))
+	{
+		DBGPRINTF(DEBUG_INFO, "Using %d threads for the broad phase.\n", numPhysicsWorkers);
+
+		for(uint32_t i=0;i<numPhysicsWorkers;i++)
+		{
+			broadphaseBuffer[i]=i+1;
+			Thread_Init(&physicsWorkers[i]);
+			Thread_Start(&physicsWorkers[i]);
+		}
+
+		// Count is number of workers+physics thread
+		ThreadBarrier_Init(&physicsWorkerBarrier, numPhysicsWorkers+1);
+	}
+	else
+	{
+		DBGPRINTF(DEBUG_WARNING, "Init: Unable to create broad phase pair buffers, running it on the physics thread alone.\n");
+		numPhysicsWorkers=0;
+	}
+
 	DestroyLoadingScreen(&loadingScreen);
 
 	if(!Zone_VerifyHeap(zone))
@@ -2046,7 +2638,7 @@ bool Init(void)
 	return true;
 }
 
-bool CreateFramebuffers(uint32_t eye)
+static bool SelectDepthFormat(void)
 {
 	VkImageFormatProperties imageFormatProps;
 	VkResult result;
@@ -2067,21 +2659,17 @@ bool CreateFramebuffers(uint32_t eye)
 
 		if(result!=VK_SUCCESS)
 		{
-			DBGPRINTF(DEBUG_ERROR, "CreateFramebuffers: No suitable depth format found.\n");
+			DBGPRINTF(DEBUG_ERROR, "SelectDepthFormat: No suitable depth format found.\n");
 			return false;
 		}
 	}
 
-	vkuCreateTexture2D(&vkContext, &colorImage[eye], config.renderWidth, config.renderHeight, config.colorFormat, config.MSAA);
-	vkuCreateTexture2D(&vkContext, &depthImage[eye], config.renderWidth, config.renderHeight, config.depthFormat, config.MSAA);
-	vkuCreateTexture2D(&vkContext, &colorResolve[eye], config.renderWidth, config.renderHeight, config.colorFormat, VK_SAMPLE_COUNT_1_BIT);
-
-	VkCommandBuffer commandBuffer=vkuOneShotCommandBufferBegin(&vkContext);
-	vkuTransitionLayout(commandBuffer, colorImage[eye].image, 1, 0, 1, 0, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-	vkuTransitionLayout(commandBuffer, depthImage[eye].image, 1, 0, 1, 0, VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-	vkuTransitionLayout(commandBuffer, colorResolve[eye].image, 1, 0, 1, 0, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-	vkuOneShotCommandBufferEnd(&vkContext, commandBuffer);
+	return true;
+}
 
+// Framebuffers for the images the render graph created, call after it's compiled
+void CreateFramebuffers(uint32_t eye)
+{
 	vkCreateFramebuffer(vkContext.device, &(VkFramebufferCreateInfo)
 	{
 		.sType=VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
@@ -2092,26 +2680,73 @@ bool CreateFramebuffers(uint32_t eye)
 		.height=config.renderHeight,
 		.layers=1,
 	}, 0, &framebuffer[eye]);
-
-	return true;
 }
 
 void DestroyFramebuffers(void)
 {
-	vkuDestroyImageBuffer(&vkContext, &colorImage[0]);
-	vkuDestroyImageBuffer(&vkContext, &depthImage[0]);
-	vkuDestroyImageBuffer(&vkContext, &colorResolve[0]);
-
 	vkDestroyFramebuffer(vkContext.device, framebuffer[0], VK_NULL_HANDLE);
 
 	if(config.isVR)
+		vkDestroyFramebuffer(vkContext.device, framebuffer[1], VK_NULL_HANDLE);
+}
+
+// Declares every pass and the images passed between them.
+// The per eye images are all transients, so the graph can put images that are never alive at the same time
+//   (MSAA color and the bloom chain, or one eye's images and the next's in VR) in the same memory.
+bool CreateRenderGraph(void)
+{
+	if(!SelectDepthFormat())
+		return false;
+
+	vkuRenderGraph_Init(&vkContext, &renderGraph);
+
+	// Cascades are kept from frame to frame, so the shadow map is imported rather than transient. Its render pass does its own transitions.
+	const uint32_t shadowResource=vkuRenderGraph_ImportImage(&renderGraph, &shadowDepth, VK_IMAGE_ASPECT_DEPTH_BIT, NUM_CASCADES, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false);
+
+	const uint32_t shadowPass=vkuRenderGraph_AddPass(&renderGraph, "Shadow", ShadowPass, NULL);
+	vkuRenderGraph_PassWrite(&renderGraph, shadowPass, shadowResource, VKU_RENDERGRAPH_ACCESS_EXTERNAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+	const uint32_t numEyes=config.isVR?2:1;
+
+	for(uint32_t eye=0;eye<numEyes;eye++)
 	{
-		vkuDestroyImageBuffer(&vkContext, &colorImage[1]);
-		vkuDestroyImageBuffer(&vkContext, &depthImage[1]);
-		vkuDestroyImageBuffer(&vkContext, &colorResolve[1]);
+		const uint32_t colorResource=vkuRenderGraph_AddTransientImage(&renderGraph, &colorImage[eye], config.renderWidth, config.renderHeight, config.colorFormat, config.MSAA);
+		const uint32_t depthResource=vkuRenderGraph_AddTransientImage(&renderGraph, &depthImage[eye], config.renderWidth, config.renderHeight, config.depthFormat, config.MSAA);
+		const uint32_t resolveResource=vkuRenderGraph_AddTransientImage(&renderGraph, &colorResolve[eye], config.renderWidth, config.renderHeight, config.colorFormat, VK_SAMPLE_COUNT_1_BIT);
 
-		vkDestroyFramebuffer(vkContext.device, framebuffer[1], VK_NULL_HANDLE);
+		if(colorResource==UINT32_MAX||depthResource==UINT32_MAX||resolveResource==UINT32_MAX)
+			return false;
+
+		const uint32_t mainPass=vkuRenderGraph_AddPass(&renderGraph, "Main", MainPass, &eyeIndex[eye]);
+		vkuRenderGraph_PassRead(&renderGraph, mainPass, shadowResource);
+		vkuRenderGraph_PassWrite(&renderGraph, mainPass, colorResource, VKU_RENDERGRAPH_ACCESS_COLOR, VK_IMAGE_LAYOUT_UNDEFINED);
+		vkuRenderGraph_PassWrite(&renderGraph, mainPass, depthResource, VKU_RENDERGRAPH_ACCESS_DEPTH, VK_IMAGE_LAYOUT_UNDEFINED);
+		vkuRenderGraph_PassWrite(&renderGraph, mainPass, resolveResource, VKU_RENDERGRAPH_ACCESS_COLOR, VK_IMAGE_LAYOUT_UNDEFINED);
+
+		// The swapchain image this eye presents, only there so the graph knows what's actually needed
+		const uint32_t outputResource=vkuRenderGraph_ImportImage(&renderGraph, NULL, VK_IMAGE_ASPECT_COLOR_BIT, 1, VK_IMAGE_LAYOUT_UNDEFINED, true);
+
+		if(!CompositeAddPasses(&renderGraph, eye, resolveResource, depthResource, shadowResource, outputResource))
+			return false;
 	}
+
+	if(!vkuRenderGraph_Compile(&renderGraph))
+		return false;
+
+	for(uint32_t eye=0;eye<numEyes;eye++)
+	{
+		CreateFramebuffers(eye);
+		CreateCompositeFramebuffers(eye);
+	}
+
+	return true;
+}
+
+void DestroyRenderGraph(void)
+{
+	DestroyFramebuffers();
+	DestroyCompositeFramebuffers();
+	vkuRenderGraph_Destroy(&renderGraph);
 }
 
 // Rebuild Vulkan swapchain and related data
@@ -2136,8 +2771,7 @@ void RecreateSwapchain(void)
 	}
 
 	// swapchain, framebuffer, and depth buffer destruction
-	DestroyFramebuffers();
-	DestroyCompositeFramebuffers();
+	DestroyRenderGraph();
 
 	// Recreate the swapchain, vkuCreateSwapchain will see that there is an existing swapchain and deal accordingly.
 	vkuCreateSwapchain(&vkContext, &swapchain, VK_TRUE);
@@ -2148,15 +2782,9 @@ void RecreateSwapchain(void)
 	UI.size.x=(float)config.renderWidth;
 	UI.size.y=(float)config.renderHeight;
 
-	// Recreate the framebuffer
-	CreateFramebuffers(0);
-	CreateCompositeFramebuffers(0);
-
-	if(config.isVR)
-	{
-		CreateFramebuffers(1);
-		CreateCompositeFramebuffers(1);
-	}
+	// Recreate the render graph, its images and framebuffers
+	if(!CreateRenderGraph())
+		DBGPRINTF(DEBUG_ERROR, "RecreateSwapchain: CreateRenderGraph failed.\n");
 }
 
 // Destroy call from system main
@@ -2178,11 +2806,20 @@ void Destroy(void)
 	if(config.isVR)
 		xruDestroy(&xrContext);
 
-	for(uint32_t i=0;i<NUM_THREADS;i++)
+	for(uint32_t i=0;i<numThreads;i++)
 		Thread_Destroy(&thread[i]);
 
+	for(uint32_t i=0;i<NUM_RECORD_LOCKS;i++)
+		mtx_destroy(&recordQueue.locks[i]);
+
 	Thread_Destroy(&threadPhysics);
 
+	for(uint32_t i=0;i<numPhysicsWorkers;i++)
+		Thread_Destroy(&physicsWorkers[i]);
+
+	BVH_ParallelTestDestroy(&broadphaseTest);
+	SpatialHash_Destroy(&physicsGrid);
+
 	if(vkContext.pipelineCache)
 	{
 		DBGPRINTF(DEBUG_INFO, "\nWriting pipeline cache to disk...\n");
@@ -2232,6 +2869,7 @@ void Destroy(void)
 
 	// Lighting pipeline destruction
 	DestroyLighting();
+	DestroyCull();
 	//////////
 
 	// Debug object pipeline destruction
@@ -2262,21 +2900,8 @@ void Destroy(void)
 
 	vkDestroyRenderPass(vkContext.device, renderPass, VK_NULL_HANDLE);
 
-	// swapchain, framebuffer, and depth buffer destruction
-	vkuDestroyImageBuffer(&vkContext, &colorImage[0]);
-	vkuDestroyImageBuffer(&vkContext, &colorResolve[0]);
-	vkuDestroyImageBuffer(&vkContext, &depthImage[0]);
-
-	vkDestroyFramebuffer(vkContext.device, framebuffer[0], VK_NULL_HANDLE);
-
-	if(config.isVR)
-	{
-		vkuDestroyImageBuffer(&vkContext, &colorImage[1]);
-		vkuDestroyImageBuffer(&vkContext, &colorResolve[1]);
-		vkuDestroyImageBuffer(&vkContext, &depthImage[1]);
-
-		vkDestroyFramebuffer(vkContext.device, framebuffer[1], VK_NULL_HANDLE);
-	}
+	// Render graph images and framebuffers
+	DestroyRenderGraph();
 
 	for(uint32_t i=0;i<FRAMES_IN_FLIGHT;i++)
 	{
@@ -2295,7 +2920,11 @@ void Destroy(void)
 	vkuDestroySwapchain(&vkContext, &swapchain);
 	//////////
 
+	vkuUploadBatch_Destroy(&uploadBatch);
+
 	DBGPRINTF(DEBUG_INFO, "Remaining Vulkan memory blocks:\n");
 	vkuMemAllocator_Print();
 	vkuMemAllocator_Destroy();
+
+	Archive_Unmount();
 }
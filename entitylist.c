@@ -5,6 +5,8 @@
 #include "system/system.h"
 #include "vulkan/vulkan.h"
 #include "perframe.h"
+#include "assetmanager.h"
+#include "math/simd.h"
 #include "entitylist.h"
 
 extern VkuContext_t vkContext;
@@ -33,17 +35,15 @@ bool EntityList_Init(EntityList_t *list)
 	list->culledBatchCapacity=64;
 	list->culledBatches=Zone_Malloc(zone, sizeof(EntityBatch_t)*list->culledBatchCapacity);
 
-	if(!list->batches||!list->culledBatches)
+	list->LODBatchCapacity=64;
+	list->LODBatches=Zone_Malloc(zone, sizeof(EntityBatch_t)*list->LODBatchCapacity);
+
+	if(!list->batches||!list->culledBatches||!list->LODBatches)
 		goto fail;
 
 	for(uint32_t i=0;i<FRAMES_IN_FLIGHT;i++)
 	{
-		if(!vkuCreateHostBuffer(&vkContext, &list->perFrame[i].instanceBuffer, sizeof(matrix)*MAX_ENTITY, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT))
-			goto fail;
-
-		list->perFrame[i].instancePtr=list->perFrame[i].instanceBuffer.memory->mappedPointer;
-
-		if(!vkuCreateHostBuffer(&vkContext, &list->perFrame[i].culledInstanceBuffer, sizeof(matrix)*MAX_ENTITY, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT))
+		if(!vkuCreateHostBuffer(&vkContext, &list->perFrame[i].culledInstanceBuffer, sizeof(EntityInstance_t)*MAX_ENTITY, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT))
 			goto fail;
 
 		list->perFrame[i].culledInstancePtr=list->perFrame[i].culledInstanceBuffer.memory->mappedPointer;
@@ -64,44 +64,25 @@ void EntityList_Destroy(EntityList_t *list)
 {
 	for(uint32_t i=0;i<FRAMES_IN_FLIGHT;i++)
 	{
-		if(list->perFrame[i].instanceBuffer.buffer)
-			vkuDestroyBuffer(&vkContext, &list->perFrame[i].instanceBuffer);
-
 		if(list->perFrame[i].culledInstanceBuffer.buffer)
 			vkuDestroyBuffer(&vkContext, &list->perFrame[i].culledInstanceBuffer);
 	}
 
 	Zone_Free(zone, list->batches);
 	Zone_Free(zone, list->culledBatches);
+	Zone_Free(zone, list->LODBatches);
 	memset(list, 0, sizeof(*list));
 }
 
-uint32_t EntityList_Add(EntityList_t *list, RigidBody_t *body, bool noRender, uint32_t modelID, uint32_t tex0, uint32_t tex1, EntityObjectType_e objectType, EntityTransformFunc transformFunc)
+// World space bounds of a body in its current pose
+static aabb EntityBodyBounds(const RigidBody_t *body)
 {
-	if(list->entityCount>=MAX_ENTITY)
-	{
-		DBGPRINTF(DEBUG_ERROR, "Ran out of entity space.\n");
-		return UINT32_MAX;
-	}
-
-	Entity_t entity={
-		.ID=ID_Generate(list->IDPool),
-		.body=body,
-		.objectType=objectType,
-		.isAttractor=false,
-		.influenceRadius=0.0f,
-		.baseGravity=0.0f,
-		.noRender=noRender,
-		.modelID=modelID,
-		.textureIDs[0]=tex0,
-		.textureIDs[1]=tex1,
-		.transformFunc=transformFunc,
-	};
+	aabb bounds={ 0 };
 
 	if(body->type==RIGIDBODY_SPHERE)
 	{
-		entity.bounds.min=Vec3(body->position.x-body->radius, body->position.y-body->radius, body->position.z-body->radius);
-		entity.bounds.max=Vec3(body->position.x+body->radius, body->position.y+body->radius, body->position.z+body->radius);
+		bounds.min=Vec3(body->position.x-body->radius, body->position.y-body->radius, body->position.z-body->radius);
+		bounds.max=Vec3(body->position.x+body->radius, body->position.y+body->radius, body->position.z+body->radius);
 	}
 	else if(body->type==RIGIDBODY_OBB)
 	{
@@ -114,8 +95,8 @@ uint32_t EntityList_Add(EntityList_t *list, RigidBody_t *body, bool noRender, ui
 			fabsf(axis[0].z)*body->size.x+fabsf(axis[1].z)*body->size.y+fabsf(axis[2].z)*body->size.z
 		};
 
-		entity.bounds.min=Vec3_Subv(body->position, extents);
-		entity.bounds.max=Vec3_Addv(body->position, extents);
+		bounds.min=Vec3_Subv(body->position, extents);
+		bounds.max=Vec3_Addv(body->position, extents);
 	}
 	else if(body->type==RIGIDBODY_CAPSULE)
 	{
@@ -127,18 +108,49 @@ uint32_t EntityList_Add(EntityList_t *list, RigidBody_t *body, bool noRender, ui
 		vec3 a=Vec3_Subv(body->position, offset);
 		vec3 b=Vec3_Addv(body->position, offset);
 
-		entity.bounds.min=Vec3(
+		bounds.min=Vec3(
 			fminf(a.x, b.x)-body->radius,
 			fminf(a.y, b.y)-body->radius,
 			fminf(a.z, b.z)-body->radius
 		);
-		entity.bounds.max=Vec3(
+		bounds.max=Vec3(
 			fmaxf(a.x, b.x)+body->radius,
 			fmaxf(a.y, b.y)+body->radius,
 			fmaxf(a.z, b.z)+body->radius
 		);
 	}
 
+	return bounds;
+}
+
+uint32_t EntityList_Add(EntityList_t *list, RigidBody_t *body, bool noRender, uint32_t modelID, uint32_t tex0, uint32_t tex1, EntityObjectType_e objectType, const EntityTransform_t transform)
+{
+	if(list->entityCount>=MAX_ENTITY)
+	{
+		DBGPRINTF(DEBUG_ERROR, "Ran out of entity space.\n");
+		return UINT32_MAX;
+	}
+
+	Entity_t entity={
+		.ID=ID_Generate(list->IDPool),
+		.body=body,
+		.objectType=objectType,
+		.isAttractor=false,
+		.influenceRadius=0.0f,
+		.baseGravity=0.0f,
+		.noRender=noRender,
+		.modelID=modelID,
+		.textureIDs[0]=tex0,
+		.textureIDs[1]=tex1,
+		.transform=transform,
+	};
+
+	// Don't blend in from wherever the body's history was left, or stay asleep from a previous use of the body
+	PhysicsResetInterpolation(body);
+	PhysicsWake(body);
+
+	entity.bounds=EntityBodyBounds(body);
+
 	list->entities[list->entityCount++]=entity;
 
 	list->dirty=true;
@@ -177,48 +189,25 @@ void EntityList_RecalculateBounds(EntityList_t *list)
 	for(uint32_t i=0;i<list->entityCount;i++)
 	{
 		Entity_t *entity=&list->entities[i];
-		RigidBody_t *body=entity->body;
-	
-		if(body->type==RIGIDBODY_SPHERE)
-		{
-			entity->bounds.min=Vec3(body->position.x-body->radius, body->position.y-body->radius, body->position.z-body->radius);
-			entity->bounds.max=Vec3(body->position.x+body->radius, body->position.y+body->radius, body->position.z+body->radius);
-		}
-		else if(body->type==RIGIDBODY_OBB)
-		{
-			vec3 axis[3];
-			QuatAxes(body->orientation, axis);
 
-			vec3 extents={
-				fabsf(axis[0].x)*body->size.x+fabsf(axis[1].x)*body->size.y+fabsf(axis[2].x)*body->size.z,
-				fabsf(axis[0].y)*body->size.x+fabsf(axis[1].y)*body->size.y+fabsf(axis[2].y)*body->size.z,
-				fabsf(axis[0].z)*body->size.x+fabsf(axis[1].z)*body->size.y+fabsf(axis[2].z)*body->size.z
-			};
+		// Sleeping bodies haven't moved, so their bounds are still good
+		if(entity->body->asleep)
+			continue;
 
-			entity->bounds.min=Vec3_Subv(body->position, extents);
-			entity->bounds.max=Vec3_Addv(body->position, extents);
-		}
-		else if(body->type==RIGIDBODY_CAPSULE)
-		{
-			vec3 axis[3];
-			QuatAxes(body->orientation, axis);
-
-			vec3 offset=Vec3_Muls(axis[1], body->size.y);
-
-			vec3 a=Vec3_Subv(body->position, offset);
-			vec3 b=Vec3_Addv(body->position, offset);
-
-			entity->bounds.min=Vec3(
-				fminf(a.x, b.x)-body->radius,
-				fminf(a.y, b.y)-body->radius,
-				fminf(a.z, b.z)-body->radius
-			);
-			entity->bounds.max=Vec3(
-				fmaxf(a.x, b.x)+body->radius,
-				fmaxf(a.y, b.y)+body->radius,
-				fmaxf(a.z, b.z)+body->radius
-			);
-		}
+		entity->bounds=EntityBodyBounds(entity->body);
+	}
+}
+
+void EntityList_CalculateBounds(const EntityList_t *list, aabb *bounds)
+{
+	for(uint32_t i=0;i<list->entityCount;i++)
+	{
+		const Entity_t *entity=&list->entities[i];
+
+		if(entity->body->asleep)
+			bounds[i]=entity->bounds;
+		else
+			bounds[i]=EntityBodyBounds(entity->body);
 	}
 }
 
@@ -275,6 +264,7 @@ void EntityList_Rebuild(EntityList_t *list)
 			b->modelID=entity->modelID;
 			b->textureIDs[0]=entity->textureIDs[0];
 			b->textureIDs[1]=entity->textureIDs[1];
+			b->LOD=0;
 			b->instanceOffset=i;
 			b->instanceCount=0;
 		}
@@ -282,70 +272,224 @@ void EntityList_Rebuild(EntityList_t *list)
 		list->batches[list->batchCount-1].instanceCount++;
 	}
 
+	list->version++;
 	list->dirty=false;
 }
 
-void EntityList_FrustumCull(EntityList_t *list, const frustum frustum)
+// Picks the coarsest LOD whose simplification error projects to less than ENTITY_LOD_PIXEL_ERROR on screen.
+// LODScale is the number of pixels a unit sized object covers at a distance of one unit.
+// Entities without a model (model is NULL) always get LOD 0.
+static uint32_t EntityList_SelectLOD(const BModel_t *model, const Entity_t *entity, const vec3 eye, const float LODScale)
+{
+	if(model==NULL||model->numLOD<2)
+		return 0;
+
+	const vec3 center=Vec3_Muls(Vec3_Addv(entity->bounds.min, entity->bounds.max), 0.5f);
+	const float radius=(entity->body->type==RIGIDBODY_SPHERE)?entity->body->radius:Vec3_Distance(entity->bounds.min, entity->bounds.max)*0.5f;
+	const float distance=Vec3_Distance(center, eye)-radius;
+
+	if(distance<=0.0f)
+		return 0;
+
+	// Model errors are relative to its radius, so this is the on-screen size of a whole radius
+	const float projectedRadius=radius*LODScale/distance;
+	uint32_t LOD=0;
+
+	while(LOD+1<model->numLOD&&model->LODError[LOD+1]*projectedRadius<=ENTITY_LOD_PIXEL_ERROR)
+		LOD++;
+
+	return LOD;
+}
+
+static void EntityList_AddBatch(EntityBatch_t **batches, uint32_t *batchCount, uint32_t *batchCapacity, const EntityBatch_t *src, uint32_t LOD, uint32_t instanceOffset, uint32_t instanceCount)
+{
+	if(*batchCount==*batchCapacity)
+	{
+		*batchCapacity*=2;
+		*batches=Zone_Realloc(zone, *batches, sizeof(EntityBatch_t)*(*batchCapacity));
+	}
+
+	EntityBatch_t *dst=&(*batches)[(*batchCount)++];
+	dst->noRender=src->noRender;
+	dst->modelID=src->modelID;
+	dst->textureIDs[0]=src->textureIDs[0];
+	dst->textureIDs[1]=src->textureIDs[1];
+	dst->LOD=LOD;
+	dst->instanceOffset=instanceOffset;
+	dst->instanceCount=instanceCount;
+}
+
+// Culls entities against the view frustum and selects each entity's LOD, then splits every (model, textures) batch into
+//   one batch per LOD, for both the culled entities and the full list.
+// If visible isn't NULL it holds per entity visibility from an earlier cull (BVH_CullFrustum), otherwise every entity is tested.
+void EntityList_FrustumCull(EntityList_t *list, const frustum frustum, const bool *visible, const vec3 eye, const float LODScale)
 {
 	list->culledCount=0;
 	list->culledBatchCount=0;
+	list->LODCount=0;
+	list->LODBatchCount=0;
 
 	for(uint32_t b=0;b<list->batchCount;b++)
 	{
 		const EntityBatch_t *src=&list->batches[b];
+		// Batches that aren't drawn don't have a model asset, their model ID is only there for sorting
+		const BModel_t *model=src->noRender?NULL:&AssetManager_GetAsset(assets, src->modelID)->model;
 		uint32_t srcEnd=src->instanceOffset+src->instanceCount;
-		uint32_t batchStart=list->culledCount;
+		uint32_t LODCounts[BMODEL_MAX_LOD]={ 0 }, culledLODCounts[BMODEL_MAX_LOD]={ 0 };
 
 		for(uint32_t i=src->instanceOffset;i<srcEnd;i++)
 		{
-			const Entity_t *entity=&list->entities[list->sortedIndices[i]];
+			const uint32_t index=list->sortedIndices[i];
+			const Entity_t *entity=&list->entities[index];
+			const uint32_t LOD=EntityList_SelectLOD(model, entity, eye, LODScale);
 
-			if(Frustum_TestAABB(frustum, entity->bounds))
-				list->culledIndices[list->culledCount++]=list->sortedIndices[i];
+			list->entityLOD[index]=(uint8_t)LOD;
+			list->entityVisible[index]=visible?visible[index]:Frustum_TestAABB(frustum, entity->bounds);
+
+			LODCounts[LOD]++;
+
+			if(list->entityVisible[index])
+				culledLODCounts[LOD]++;
 		}
 
-		uint32_t remaining=list->culledCount-batchStart;
+		// Counting sort the batch's entities by LOD into both lists
+		uint32_t LODOffsets[BMODEL_MAX_LOD], culledLODOffsets[BMODEL_MAX_LOD];
 
-		if(remaining>0)
+		for(uint32_t LOD=0;LOD<BMODEL_MAX_LOD;LOD++)
 		{
-			if(list->culledBatchCount==list->culledBatchCapacity)
-			{
-				list->culledBatchCapacity*=2;
-				list->culledBatches=Zone_Realloc(zone, list->culledBatches, sizeof(EntityBatch_t)*list->culledBatchCapacity);
-			}
+			LODOffsets[LOD]=list->LODCount;
+			culledLODOffsets[LOD]=list->culledCount;
 
-			EntityBatch_t *dst=&list->culledBatches[list->culledBatchCount++];
-			dst->noRender=src->noRender;
-			dst->modelID=src->modelID;
-			dst->textureIDs[0]=src->textureIDs[0];
-			dst->textureIDs[1]=src->textureIDs[1];
-			dst->instanceOffset=batchStart;
-			dst->instanceCount=remaining;
+			if(LODCounts[LOD])
+				EntityList_AddBatch(&list->LODBatches, &list->LODBatchCount, &list->LODBatchCapacity, src, LOD, list->LODCount, LODCounts[LOD]);
+
+			if(culledLODCounts[LOD])
+				EntityList_AddBatch(&list->culledBatches, &list->culledBatchCount, &list->culledBatchCapacity, src, LOD, list->culledCount, culledLODCounts[LOD]);
+
+			list->LODCount+=LODCounts[LOD];
+			list->culledCount+=culledLODCounts[LOD];
+		}
+
+		for(uint32_t i=src->instanceOffset;i<srcEnd;i++)
+		{
+			const uint32_t index=list->sortedIndices[i];
+			const uint32_t LOD=list->entityLOD[index];
+
+			list->LODIndices[LODOffsets[LOD]++]=index;
+
+			if(list->entityVisible[index])
+				list->culledIndices[culledLODOffsets[LOD]++]=index;
 		}
 	}
 }
 
-void EntityList_UpdateInstances(EntityList_t *list, uint32_t frameIndex)
+// Body and model transform data for 4 entities, one lane each
+typedef struct
 {
-	// Update all entities
-	matrix *dst=list->perFrame[frameIndex].instancePtr;
+	float position[3][4];
+	float orientation[4][4];
+	float rotation[4][4];
+	float offset[3][4];
+} EntityInstanceLanes_t;
 
-	for(uint32_t i=0;i<list->sortedCount;i++)
+static inline int16_t PackSnorm16(float x)
+{
+	return (int16_t)lrintf(fminf(fmaxf(x, -1.0f), 1.0f)*32767.0f);
+}
+
+// Builds 4 instances at once.
+// The body orientation is applied to the model's offset and rotation, so the shader only has to scale, rotate and translate.
+static void EntityList_BuildInstances4(const EntityInstanceLanes_t *lanes, float position[3][4], float rotation[4][4])
+{
+	const float4_t px=Float4_Load(lanes->position[0]), py=Float4_Load(lanes->position[1]), pz=Float4_Load(lanes->position[2]);
+	float4_t qx=Float4_Load(lanes->orientation[0]), qy=Float4_Load(lanes->orientation[1]);
+	float4_t qz=Float4_Load(lanes->orientation[2]), qw=Float4_Load(lanes->orientation[3]);
+	const float4_t rx=Float4_Load(lanes->rotation[0]), ry=Float4_Load(lanes->rotation[1]);
+	const float4_t rz=Float4_Load(lanes->rotation[2]), rw=Float4_Load(lanes->rotation[3]);
+	const float4_t ox=Float4_Load(lanes->offset[0]), oy=Float4_Load(lanes->offset[1]), oz=Float4_Load(lanes->offset[2]);
+
+	// Same as QuatRotate, orientation gets normalized first
+	const float4_t invLength=Float4_RSqrt(Float4_Add(Float4_Add(Float4_Mul(qx, qx), Float4_Mul(qy, qy)), Float4_Add(Float4_Mul(qz, qz), Float4_Mul(qw, qw))));
+	qx=Float4_Mul(qx, invLength);
+	qy=Float4_Mul(qy, invLength);
+	qz=Float4_Mul(qz, invLength);
+	qw=Float4_Mul(qw, invLength);
+
+	// offset'=offset+w*t+cross(q, t), t=2*cross(q, offset)
+	const float4_t tx=Float4_Muls(Float4_Sub(Float4_Mul(qy, oz), Float4_Mul(qz, oy)), 2.0f);
+	const float4_t ty=Float4_Muls(Float4_Sub(Float4_Mul(qz, ox), Float4_Mul(qx, oz)), 2.0f);
+	const float4_t tz=Float4_Muls(Float4_Sub(Float4_Mul(qx, oy), Float4_Mul(qy, ox)), 2.0f);
+
+	Float4_Store(position[0], Float4_Add(Float4_Add(px, ox), Float4_Add(Float4_Mul(qw, tx), Float4_Sub(Float4_Mul(qy, tz), Float4_Mul(qz, ty)))));
+	Float4_Store(position[1], Float4_Add(Float4_Add(py, oy), Float4_Add(Float4_Mul(qw, ty), Float4_Sub(Float4_Mul(qz, tx), Float4_Mul(qx, tz)))));
+	Float4_Store(position[2], Float4_Add(Float4_Add(pz, oz), Float4_Add(Float4_Mul(qw, tz), Float4_Sub(Float4_Mul(qx, ty), Float4_Mul(qy, tx)))));
+
+	// Same as QuatMultiply(orientation, rotation)
+	Float4_Store(rotation[0], Float4_Add(Float4_Add(Float4_Mul(qw, rx), Float4_Mul(qx, rw)), Float4_Sub(Float4_Mul(qy, rz), Float4_Mul(qz, ry))));
+	Float4_Store(rotation[1], Float4_Add(Float4_Sub(Float4_Mul(qw, ry), Float4_Mul(qx, rz)), Float4_Add(Float4_Mul(qy, rw), Float4_Mul(qz, rx))));
+	Float4_Store(rotation[2], Float4_Add(Float4_Add(Float4_Mul(qw, rz), Float4_Mul(qx, ry)), Float4_Sub(Float4_Mul(qz, rw), Float4_Mul(qy, rx))));
+	Float4_Store(rotation[3], Float4_Sub(Float4_Sub(Float4_Mul(qw, rw), Float4_Mul(qx, rx)), Float4_Add(Float4_Mul(qy, ry), Float4_Mul(qz, rz))));
+}
+
+// Builds every entity's instance once for the frame, culled and shadow instances are then copied out by entity index.
+// Bodies are placed alpha of the way from their previous to current physics step.
+void EntityList_BuildInstances(EntityList_t *list, const float alpha)
+{
+	for(uint32_t i=0;i<list->entityCount;i+=4)
 	{
-		const Entity_t *entity=&list->entities[list->sortedIndices[i]];
+		const uint32_t count=min(4, list->entityCount-i);
+		EntityInstanceLanes_t lanes;
+		float position[3][4], rotation[4][4];
+
+		// Gather, unused lanes repeat the first entity
+		for(uint32_t j=0;j<4;j++)
+		{
+			const Entity_t *entity=&list->entities[i+((j<count)?j:0)];
+			const vec3 position=PhysicsInterpolatePosition(entity->body, alpha);
+			const vec4 orientation=PhysicsInterpolateOrientation(entity->body, alpha);
+
+			lanes.position[0][j]=position.x;
+			lanes.position[1][j]=position.y;
+			lanes.position[2][j]=position.z;
+			lanes.orientation[0][j]=orientation.x;
+			lanes.orientation[1][j]=orientation.y;
+			lanes.orientation[2][j]=orientation.z;
+			lanes.orientation[3][j]=orientation.w;
+			lanes.rotation[0][j]=entity->transform.rotation.x;
+			lanes.rotation[1][j]=entity->transform.rotation.y;
+			lanes.rotation[2][j]=entity->transform.rotation.z;
+			lanes.rotation[3][j]=entity->transform.rotation.w;
+			lanes.offset[0][j]=entity->transform.offset.x;
+			lanes.offset[1][j]=entity->transform.offset.y;
+			lanes.offset[2][j]=entity->transform.offset.z;
+		}
 
-		if(entity->transformFunc)
-			dst[i]=entity->transformFunc(entity->body);
+		EntityList_BuildInstances4(&lanes, position, rotation);
+
+		for(uint32_t j=0;j<count;j++)
+		{
+			const Entity_t *entity=&list->entities[i+j];
+			EntityInstance_t *dst=&list->instances[i+j];
+
+			dst->position=Vec3(position[0][j], position[1][j], position[2][j]);
+			dst->rotation[0]=PackSnorm16(rotation[0][j]);
+			dst->rotation[1]=PackSnorm16(rotation[1][j]);
+			dst->rotation[2]=PackSnorm16(rotation[2][j]);
+			dst->rotation[3]=PackSnorm16(rotation[3][j]);
+
+			if(entity->body->type==RIGIDBODY_OBB)
+				dst->scale=Vec3_Muls(entity->body->size, entity->transform.scale);
+			else
+				dst->scale=Vec3b(entity->body->radius*entity->transform.scale);
+		}
 	}
+}
 
-	// Update culled entities
-	matrix *culledDst=list->perFrame[frameIndex].culledInstancePtr;
+void EntityList_UpdateInstances(EntityList_t *list, uint32_t frameIndex)
+{
+	// Only the culled entities, shadow casters are copied separately per cascade
+	EntityInstance_t *culledDst=list->perFrame[frameIndex].culledInstancePtr;
 
 	for(uint32_t i=0;i<list->culledCount;i++)
-	{
-		const Entity_t *entity=&list->entities[list->culledIndices[i]];
-
-		if(entity->transformFunc)
-			culledDst[i]=entity->transformFunc(entity->body);
-	}
+		culledDst[i]=list->instances[list->culledIndices[i]];
 }
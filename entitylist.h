@@ -11,7 +11,28 @@
 
 #define MAX_ENTITY 50000
 
-typedef matrix (*EntityTransformFunc)(const RigidBody_t *body);
+// Largest on-screen error (in pixels) that a model's LOD is allowed to introduce
+#define ENTITY_LOD_PIXEL_ERROR 1.0f
+
+// How a body is placed onto its model: the model is scaled by the body's size (OBB) or radius times scale,
+//   rotated and offset in body space, then moved by the body's own orientation and position.
+typedef struct
+{
+	vec4 rotation;
+	vec3 offset;
+	float scale;
+} EntityTransform_t;
+
+// For entities that are never drawn
+#define ENTITY_TRANSFORM_IDENTITY ((EntityTransform_t){ .rotation={ .w=1.0f }, .scale=1.0f })
+
+// Packed per instance data, expanded into a transform in the vertex shader
+typedef struct
+{
+	vec3 position;
+	int16_t rotation[4];	// Quaternion, snorm
+	vec3 scale;
+} EntityInstance_t;
 
 typedef enum
 {
@@ -35,7 +56,7 @@ typedef struct
 	bool noRender;
 	uint32_t modelID, textureIDs[2];
 
-	EntityTransformFunc transformFunc;
+	EntityTransform_t transform;
 
 	bool remove;
 } Entity_t;
@@ -45,6 +66,7 @@ typedef struct
 	bool noRender;
 	uint32_t modelID;
 	uint32_t textureIDs[2];
+	uint32_t LOD;
 	uint32_t instanceOffset;
 	uint32_t instanceCount;
 } EntityBatch_t;
@@ -60,6 +82,14 @@ typedef struct
 	uint32_t culledIndices[MAX_ENTITY];
 	uint32_t culledCount;
 
+	// All entities in (model, textures, LOD) order, rebuilt each frame with the culled list for passes that do their own culling
+	uint32_t LODIndices[MAX_ENTITY];
+	uint32_t LODCount;
+
+	// Per entity results from the last cull
+	uint8_t entityLOD[MAX_ENTITY];
+	bool entityVisible[MAX_ENTITY];
+
 	EntityBatch_t *batches;
 	uint32_t batchCount;
 	uint32_t batchCapacity;
@@ -68,30 +98,40 @@ typedef struct
 	uint32_t culledBatchCount;
 	uint32_t culledBatchCapacity;
 
+	EntityBatch_t *LODBatches;
+	uint32_t LODBatchCount;
+	uint32_t LODBatchCapacity;
+
 	ID_t IDPool;
 
 	bool dirty;
 
+	// Every entity's instance, by entity index, built once a frame for all the passes to copy from
+	EntityInstance_t instances[MAX_ENTITY];
+
+	// Bumped whenever a rebuild moves entities around, so anything holding entity indices can tell they're stale
+	uint32_t version;
+
 	struct
 	{
-		VkuBuffer_t instanceBuffer;
-		matrix *instancePtr;
-
 		VkuBuffer_t culledInstanceBuffer;
-		matrix *culledInstancePtr;
+		EntityInstance_t *culledInstancePtr;
 	} perFrame[VKU_MAX_FRAME_COUNT];
 } EntityList_t;
 
 bool EntityList_Init(EntityList_t *list);
 void EntityList_Destroy(EntityList_t *list);
 
-uint32_t EntityList_Add(EntityList_t *list, RigidBody_t *body, bool noRender, uint32_t modelID, uint32_t tex0, uint32_t tex1, EntityObjectType_e objectType, EntityTransformFunc transformFunc);
+uint32_t EntityList_Add(EntityList_t *list, RigidBody_t *body, bool noRender, uint32_t modelID, uint32_t tex0, uint32_t tex1, EntityObjectType_e objectType, const EntityTransform_t transform);
 bool EntityList_Remove(EntityList_t *list, uint32_t ID);
 void EntityList_Clear(EntityList_t *list);
 
 void EntityList_RecalculateBounds(EntityList_t *list);
+// Current bounds of every entity into bounds[], by entity index, without writing the entities
+void EntityList_CalculateBounds(const EntityList_t *list, aabb *bounds);
 void EntityList_Rebuild(EntityList_t *list);
+void EntityList_BuildInstances(EntityList_t *list, const float alpha);
 void EntityList_UpdateInstances(EntityList_t *list, uint32_t frameIndex);
-void EntityList_FrustumCull(EntityList_t *list, const frustum frustum);
+void EntityList_FrustumCull(EntityList_t *list, const frustum frustum, const bool *visible, const vec3 eye, const float LODScale);
 
 #endif
@@ -779,14 +779,66 @@ static void _GenerateMipmaps(VkCommandBuffer commandBuffer, VkuImage_t *image, u
 	vkuTransitionLayout(commandBuffer, image->image, 1, mipLevels-1, layerCount, baseLayer, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 }
 
-// Image_Upload, external function.
-// Loads an image file and uploads to the GPU, while performing conversions
-//   and other processes based on the set flags.
+// Image_Load, external function.
+// Loads an image file into system memory and performs any CPU side conversions
+//   based on the set flags, does not touch the GPU so this is safe to call from worker threads.
+bool Image_Load(VkuImage_t *image, const char *filename, uint32_t flags)
+{
+	const char *extension=strrchr(filename, '.');
+
+	if(extension==NULL)
+		return false;
+
+	if(!strcmp(extension, ".tga"))
+	{
+		if(!TGA_Load(filename, image))
+			return false;
+	}
+	else if(!strcmp(extension, ".qoi"))
+	{
+		if(!QOI_Load(filename, image))
+			return false;
+	}
+	else
+		return false;
+
+	// Convert from RGB to RGBA if needed.
+	_RGBtoRGBA(image);
+
+	if(flags&IMAGE_RGBE)
+		_RGBE2Float(image);
+
+	if(flags&IMAGE_NORMALMAP)
+		_MakeNormalMap(image);
+
+	if(flags&IMAGE_NORMALIZE)
+		_Normalize(image);
+
+	switch(image->depth)
+	{
+		case 128:
+		case 64:
+		case 32:
+		case 16:
+		case 8:
+			break;
+
+		default:
+			Zone_Free(zone, image->data);
+			image->data=NULL;
+			return false;
+	}
+
+	return true;
+}
+
+// Image_UploadBatch, external function.
+// Takes an image already loaded by Image_Load, creates the GPU side objects and records the
+//   upload into a staging batch. The copy isn't complete until the batch is finished.
 //
 // Flags also set Vulkan texture sampler properties.
-VkBool32 Image_Upload(VkuContext_t *context, VkuImage_t *image, const char *filename, uint32_t flags)
+VkBool32 Image_UploadBatch(VkuContext_t *context, VkuUploadBatch_t *batch, VkuImage_t *image, uint32_t flags)
 {
-	const char *extension=strrchr(filename, '.');
 	VkFilter minFilter=VK_FILTER_LINEAR;
 	VkFilter magFilter=VK_FILTER_LINEAR;
 	VkSamplerMipmapMode mipmapMode=VK_SAMPLER_MIPMAP_MODE_NEAREST;
@@ -795,25 +847,12 @@ VkBool32 Image_Upload(VkuContext_t *context, VkuImage_t *image, const char *file
 	VkSamplerAddressMode wrapModeW=VK_SAMPLER_ADDRESS_MODE_REPEAT;
 	VkFormat format=VK_FORMAT_UNDEFINED;
 	VkCommandBuffer commandBuffer;
-	VkuBuffer_t stagingBuffer;
+	VkDeviceSize stagingOffset=0;
 	uint32_t mipLevels=1;
 	void *data=NULL;
 
-	if(extension!=NULL)
-	{
-		if(!strcmp(extension, ".tga"))
-		{
-			if(!TGA_Load(filename, image))
-				return VK_FALSE;
-		}
-		else if(!strcmp(extension, ".qoi"))
-		{
-			if(!QOI_Load(filename, image))
-				return VK_FALSE;
-		}
-		else
-			return VK_FALSE;
-	}
+	if(image->data==NULL)
+		return VK_FALSE;
 
 	if(flags&IMAGE_NEAREST)
 	{
@@ -854,18 +893,6 @@ VkBool32 Image_Upload(VkuContext_t *context, VkuImage_t *image, const char *file
 	if(flags&IMAGE_REPEAT_W)
 		wrapModeW=VK_SAMPLER_ADDRESS_MODE_REPEAT;
 
-	// Convert from RGB to RGBA if needed.
-	_RGBtoRGBA(image);
-
-	if(flags&IMAGE_RGBE)
-		_RGBE2Float(image);
-
-	if(flags&IMAGE_NORMALMAP)
-		_MakeNormalMap(image);
-
-	if(flags&IMAGE_NORMALIZE)
-		_Normalize(image);
-
 	switch(image->depth)
 	{
 		case 128:
@@ -897,7 +924,6 @@ VkBool32 Image_Upload(VkuContext_t *context, VkuImage_t *image, const char *file
 	if(flags&IMAGE_CUBEMAP_ANGULAR)
 	{
 		VkuImage_t Out;
-		void *data=NULL;
 
 		// Calculate the cubemap face size from the angular map size (half the size of the original seems to be good)
 		Out.width=NextPower2(image->width>>1);
@@ -907,11 +933,16 @@ VkBool32 Image_Upload(VkuContext_t *context, VkuImage_t *image, const char *file
 		// Precalculate each cube face iamge size in bytes
 		uint32_t size=Out.width*Out.height*(image->depth>>3);
 
-		// Create staging buffer
-		vkuCreateHostBuffer(context, &stagingBuffer, size*6, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+		// Get staging space for all 6 faces
+		data=vkuUploadBatch_Alloc(batch, (VkDeviceSize)size*6, 16, &stagingOffset);
+
+		if(data==NULL)
+		{
+			Zone_Free(zone, image->data);
+			return VK_FALSE;
+		}
 
-		// Map image memory and copy data for each cube face
-		data=stagingBuffer.memory->mappedPointer;
+		// Copy data for each cube face
 		for(uint32_t i=0;i<6;i++)
 		{
 			// Extract the cubemap face from the angular map lightprobe
@@ -945,21 +976,21 @@ VkBool32 Image_Upload(VkuContext_t *context, VkuImage_t *image, const char *file
 							 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 							 VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT);
 
-		// Start a one shot command buffer
-		commandBuffer=vkuOneShotCommandBufferBegin(context);
+		// Record into the batch's command buffer (must come after the staging allocation)
+		commandBuffer=vkuUploadBatch_GetCommandBuffer(batch);
 
 		// Change image layout from undefined to destination optimal, so we can copy from the staging buffer to the texture.
 		vkuTransitionLayout(commandBuffer, image->image, mipLevels, 0, 6, 0, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
 
 		// Copy all faces from staging buffer to the texture image buffer.
-		vkCmdCopyBufferToImage(commandBuffer, stagingBuffer.buffer, image->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 6, (VkBufferImageCopy[6])
+		vkCmdCopyBufferToImage(commandBuffer, batch->stagingBuffer.buffer, image->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 6, (VkBufferImageCopy[6])
 		{
-			{ (VkDeviceSize)size*0, 0, 0, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 }, { 0, 0, 0 }, { Out.width, Out.height, 1 } },
-			{ (VkDeviceSize)size*1, 0, 0, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 1 }, { 0, 0, 0 }, { Out.width, Out.height, 1 } },
-			{ (VkDeviceSize)size*2, 0, 0, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 2, 1 }, { 0, 0, 0 }, { Out.width, Out.height, 1 } },
-			{ (VkDeviceSize)size*3, 0, 0, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 3, 1 }, { 0, 0, 0 }, { Out.width, Out.height, 1 } },
-			{ (VkDeviceSize)size*4, 0, 0, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 4, 1 }, { 0, 0, 0 }, { Out.width, Out.height, 1 } },
-			{ (VkDeviceSize)size*5, 0, 0, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 5, 1 }, { 0, 0, 0 }, { Out.width, Out.height, 1 } }
+			{ stagingOffset+(VkDeviceSize)size*0, 0, 0, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 }, { 0, 0, 0 }, { Out.width, Out.height, 1 } },
+			{ stagingOffset+(VkDeviceSize)size*1, 0, 0, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 1 }, { 0, 0, 0 }, { Out.width, Out.height, 1 } },
+			{ stagingOffset+(VkDeviceSize)size*2, 0, 0, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 2, 1 }, { 0, 0, 0 }, { Out.width, Out.height, 1 } },
+			{ stagingOffset+(VkDeviceSize)size*3, 0, 0, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 3, 1 }, { 0, 0, 0 }, { Out.width, Out.height, 1 } },
+			{ stagingOffset+(VkDeviceSize)size*4, 0, 0, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 4, 1 }, { 0, 0, 0 }, { Out.width, Out.height, 1 } },
+			{ stagingOffset+(VkDeviceSize)size*5, 0, 0, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 5, 1 }, { 0, 0, 0 }, { Out.width, Out.height, 1 } }
 		});
 
 		// Final change to image layout from destination optimal to be optimal reading only by shader.
@@ -975,23 +1006,21 @@ VkBool32 Image_Upload(VkuContext_t *context, VkuImage_t *image, const char *file
 		}
 		else
 			vkuTransitionLayout(commandBuffer, image->image, mipLevels, 0, 6, 0, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-		// End one shot command buffer and submit
-		vkuOneShotCommandBufferEnd(context, commandBuffer);
-
-		// Delete staging buffers
-		vkuDestroyBuffer(context, &stagingBuffer);
 	}
 	else // Otherwise it's a 2D texture
 	{
 		// Byte size of image data
 		uint32_t size=image->width*image->height*(image->depth>>3);
 
-		// Create staging buffer
-		vkuCreateHostBuffer(context, &stagingBuffer, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+		// Get staging space and copy data
+		data=vkuUploadBatch_Alloc(batch, size, 16, &stagingOffset);
+
+		if(data==NULL)
+		{
+			Zone_Free(zone, image->data);
+			return VK_FALSE;
+		}
 
-		// Map image memory and copy data
-		data=stagingBuffer.memory->mappedPointer;
 		memcpy(data, image->data, size);
 
 		// Original image data is now in a Vulkan memory object, so no longer need the original data.
@@ -1007,16 +1036,16 @@ VkBool32 Image_Upload(VkuContext_t *context, VkuImage_t *image, const char *file
 		   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0))
 			return VK_FALSE;
 
-		// Start a one shot command buffer
-		commandBuffer=vkuOneShotCommandBufferBegin(context);
+		// Record into the batch's command buffer (must come after the staging allocation)
+		commandBuffer=vkuUploadBatch_GetCommandBuffer(batch);
 
 		// Change image layout from undefined to destination optimal, so we can copy from the staging buffer to the texture.
 		vkuTransitionLayout(commandBuffer, image->image, mipLevels, 0, 1, 0, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
 
 		// Copy from staging buffer to the texture buffer.
-		vkCmdCopyBufferToImage(commandBuffer, stagingBuffer.buffer, image->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, (VkBufferImageCopy[1])
+		vkCmdCopyBufferToImage(commandBuffer, batch->stagingBuffer.buffer, image->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, (VkBufferImageCopy[1])
 		{
-			{ 0, 0, 0, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 }, { 0, 0, 0 }, { image->width, image->height, 1 } }
+			{ stagingOffset, 0, 0, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 }, { 0, 0, 0 }, { image->width, image->height, 1 } }
 		});
 
 		// Final change to image layout from destination optimal to be optimal reading only by shader.
@@ -1025,14 +1054,10 @@ VkBool32 Image_Upload(VkuContext_t *context, VkuImage_t *image, const char *file
 			_GenerateMipmaps(commandBuffer, image, mipLevels, 1, 0);
 		else
 			vkuTransitionLayout(commandBuffer, image->image, mipLevels, 0, 1, 0, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-		// End one shot command buffer and submit
-		vkuOneShotCommandBufferEnd(context, commandBuffer);
-
-		// Delete staging buffers
-		vkuDestroyBuffer(context, &stagingBuffer);
 	}
 
+	image->data=NULL;
+
 	// Create texture sampler object
 	vkCreateSampler(context->device, &(VkSamplerCreateInfo)
 	{
@@ -1065,3 +1090,19 @@ VkBool32 Image_Upload(VkuContext_t *context, VkuImage_t *image, const char *file
 
 	return VK_TRUE;
 }
+
+// Image_Upload, external function.
+// Loads an image file and uploads to the GPU, while performing conversions
+//   and other processes based on the set flags.
+//
+// Stand-alone version of Image_Load+Image_UploadBatch that waits on just this upload before returning.
+VkBool32 Image_Upload(VkuContext_t *context, VkuUploadBatch_t *batch, VkuImage_t *image, const char *filename, uint32_t flags)
+{
+	if(!Image_Load(image, filename, flags))
+		return VK_FALSE;
+
+	if(!Image_UploadBatch(context, batch, image, flags))
+		return VK_FALSE;
+
+	return vkuUploadBatch_Wait(batch, vkuUploadBatch_GetTicket(batch));
+}
@@ -23,12 +23,16 @@
 #define IMAGE_REPEAT									(IMAGE_REPEAT_U|IMAGE_REPEAT_V|IMAGE_REPEAT_W)
 
 // Image read/write functions
+bool TGA_LoadMemory(const uint8_t *buffer, size_t size, VkuImage_t *image);
 bool TGA_Load(const char *filename, VkuImage_t *image);
 bool TGA_Write(const char *filename, VkuImage_t *image, bool rle);
+bool QOI_LoadMemory(const uint8_t *buffer, size_t size, VkuImage_t *image);
 bool QOI_Load(const char *filename, VkuImage_t *image);
 bool QOI_Write(const char *filename, VkuImage_t *image);
 
 // Creates texture objects
-VkBool32 Image_Upload(VkuContext_t *context, VkuImage_t *image, const char *filename, uint32_t flags);
+bool Image_Load(VkuImage_t *image, const char *filename, uint32_t flags);
+VkBool32 Image_UploadBatch(VkuContext_t *context, VkuUploadBatch_t *batch, VkuImage_t *image, uint32_t flags);
+VkBool32 Image_Upload(VkuContext_t *context, VkuUploadBatch_t *batch, VkuImage_t *image, const char *filename, uint32_t flags);
 
 #endif
@@ -3,8 +3,10 @@
 #include <stdbool.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include "../system/system.h"
 #include "../vulkan/vulkan.h"
+#include "../utils/archive.h"
 #include "image.h"
 
 static uint32_t QOI_MAGIC='q'<<24|'o'<<16|'i'<<8|'f';
@@ -34,9 +36,9 @@ static uint32_t Int32Swap(const uint32_t l)
 	return ((uint32_t)b1<<24)+((uint32_t)b2<<16)+((uint32_t)b3<<8)+((uint32_t)b4<<0);
 }
 
-bool QOI_Load(const char *filename, VkuImage_t *image)
+bool QOI_LoadMemory(const uint8_t *buffer, size_t size, VkuImage_t *image)
 {
-	FILE *stream=NULL;
+	const uint8_t *ptr=buffer, *end=buffer+size;
 	uint32_t magic=0;
 	uint32_t width=0;
 	uint32_t height=0;
@@ -46,20 +48,21 @@ bool QOI_Load(const char *filename, VkuImage_t *image)
 	uint8_t index[64][4]={ {0, 0, 0, 0} }, bytes[4]={ 0 };
 	uint32_t run=0;
 
-	if(!(stream=fopen(filename, "rb")))
+	// Header is 14 bytes, stream ends with 8 bytes of padding
+	if(buffer==NULL||size<14+sizeof(qoiPadding))
 		return false;
 
-	fread(&magic, 1, 4, stream);
+	memcpy(&magic, ptr, 4);	ptr+=4;
 	magic=Int32Swap(magic);
 
-	fread(&width, 1, 4, stream);
+	memcpy(&width, ptr, 4);	ptr+=4;
 	width=Int32Swap(width);
 
-	fread(&height, 1, 4, stream);
+	memcpy(&height, ptr, 4);	ptr+=4;
 	height=Int32Swap(height);
 
-	fread(&channels, 1, 1, stream);
-	fread(&colorspace, 1, 1, stream);
+	channels=*ptr++;
+	colorspace=*ptr++;
 
 	if(width==0||height==0||channels<3||channels>4||colorspace>1||magic!=QOI_MAGIC)
 		return false;
@@ -82,14 +85,28 @@ bool QOI_Load(const char *filename, VkuImage_t *image)
 	{
 		if(run>0)
 			run--;
-		else
+		else if(ptr<end)
 		{
-			fread(&b1, 1, 1, stream);
+			b1=*ptr++;
 
-			if(b1==QOI_OP_RGB)
-				fread(bytes, 1, 3, stream);
+			// Bytes following the tag, a truncated opcode at the very end stops decoding
+			const ptrdiff_t opSize=(b1==QOI_OP_RGBA)?4:(b1==QOI_OP_RGB)?3:((b1&QOI_OP_MASK)==QOI_OP_LUMA)?1:0;
+
+			if(end-ptr<opSize)
+				ptr=end;
+			else if(b1==QOI_OP_RGB)
+			{
+				bytes[0]=*ptr++;
+				bytes[1]=*ptr++;
+				bytes[2]=*ptr++;
+			}
 			else if(b1==QOI_OP_RGBA)
-				fread(bytes, 1, 4, stream);
+			{
+				bytes[0]=*ptr++;
+				bytes[1]=*ptr++;
+				bytes[2]=*ptr++;
+				bytes[3]=*ptr++;
+			}
 			else if((b1&QOI_OP_MASK)==QOI_OP_INDEX)
 			{
 				bytes[0]=index[b1][0];
@@ -105,7 +122,7 @@ bool QOI_Load(const char *filename, VkuImage_t *image)
 			}
 			else if((b1&QOI_OP_MASK)==QOI_OP_LUMA)
 			{
-				fread(&b2, 1, 1, stream);
+				b2=*ptr++;
 
 				int vg=(b1&0x3f)-32;
 
@@ -130,11 +147,23 @@ bool QOI_Load(const char *filename, VkuImage_t *image)
 			image->data[i+3]=bytes[3];
 	}
 
-	fclose(stream);
-
 	return true;
 }
 
+bool QOI_Load(const char *filename, VkuImage_t *image)
+{
+	ArchiveFile_t file;
+
+	if(!Archive_ReadFile(filename, &file))
+		return false;
+
+	bool result=QOI_LoadMemory(file.data, file.size, image);
+
+	Archive_CloseFile(&file);
+
+	return result;
+}
+
 bool QOI_Write(const char *filename, VkuImage_t *image)
 {
 	FILE *stream=NULL;
@@ -5,37 +5,50 @@
 #include <string.h>
 #include "../system/system.h"
 #include "../vulkan/vulkan.h"
+#include "../utils/archive.h"
+#include "../utils/memstream.h"
 #include "image.h"
 
 #ifndef FREE
 #define FREE(p) { if(p) { free(p); p=NULL; } }
 #endif
 
-static void rle_read(uint8_t *row, const uint32_t width, const uint8_t bpp, FILE *stream)
+static bool rle_read(uint8_t *row, const uint32_t width, const uint8_t bpp, MemStream_t *stream)
 {
 	uint32_t pos=0, len, i;
 	uint8_t header;
 
 	while(pos<width)
 	{
-		fread(&header, sizeof(uint8_t), 1, stream);
+		if(MemStream_Read(stream, &header, sizeof(uint8_t), 1)!=1)
+			return false;
 
 		len=(header&0x7F)+1;
 
+		// Packets aren't supposed to cross scanlines, but clamp it anyway so a bad file can't overrun the row
+		if(pos+len>width)
+			len=width-pos;
+
 		if(header&0x80)
 		{
 			uint32_t buffer;
 
-			fread(&buffer, sizeof(uint8_t), bpp, stream);
+			if(MemStream_Read(stream, &buffer, sizeof(uint8_t), bpp)!=bpp)
+				return false;
 
 			for(i=0;i<len*bpp;i+=bpp)
 				memcpy(&row[bpp*pos+i], &buffer, bpp);
 		}
 		else
-			fread(&row[bpp*pos], sizeof(uint8_t), len*bpp, stream);
+		{
+			if(MemStream_Read(stream, &row[bpp*pos], sizeof(uint8_t), len*bpp)!=len*bpp)
+				return false;
+		}
 
 		pos+=len;
 	}
+
+	return true;
 }
 
 static bool rle_type(uint8_t *data, const uint32_t pos, const uint32_t width, const uint8_t bpp)
@@ -167,9 +180,9 @@ bool TGA_Write(const char *filename, VkuImage_t *image, bool rle)
 	return true;
 }
 
-bool TGA_Load(const char *filename, VkuImage_t *image)
+bool TGA_LoadMemory(const uint8_t *buffer, size_t size, VkuImage_t *image)
 {
-	FILE *stream=NULL;
+	MemStream_t stream;
 	uint8_t IDLength=0;
 	uint8_t colorMapType=0, imageType=0;
 	uint16_t colorMapStart=0, colorMapLength=0;
@@ -177,22 +190,27 @@ bool TGA_Load(const char *filename, VkuImage_t *image)
 	uint16_t xOffset=0, yOffset=0, width=0, height=0;
 	uint8_t depth=0, imageDescriptor=0, bpp;
 
-	if((stream=fopen(filename, "rb"))==NULL)
+	// Header is 18 bytes
+	if(buffer==NULL||size<18)
 		return false;
 
-	fread(&IDLength, sizeof(uint8_t), 1, stream);
-	fread(&colorMapType, sizeof(uint8_t), 1, stream);
-	fread(&imageType, sizeof(uint8_t), 1, stream);
-	fread(&colorMapStart, sizeof(uint16_t), 1, stream);
-	fread(&colorMapLength, sizeof(uint16_t), 1, stream);
-	fread(&colorMapDepth, sizeof(uint8_t), 1, stream);
-	fread(&xOffset, sizeof(uint16_t), 1, stream);
-	fread(&yOffset, sizeof(uint16_t), 1, stream);
-	fread(&width, sizeof(uint16_t), 1, stream);
-	fread(&height, sizeof(uint16_t), 1, stream);
-	fread(&depth, sizeof(uint8_t), 1, stream);
-	fread(&imageDescriptor, sizeof(uint8_t), 1, stream);
-	fseek(stream, IDLength, SEEK_CUR);
+	MemStream_Init(&stream, buffer, size);
+
+	MemStream_Read(&stream, &IDLength, sizeof(uint8_t), 1);
+	MemStream_Read(&stream, &colorMapType, sizeof(uint8_t), 1);
+	MemStream_Read(&stream, &imageType, sizeof(uint8_t), 1);
+	MemStream_Read(&stream, &colorMapStart, sizeof(uint16_t), 1);
+	MemStream_Read(&stream, &colorMapLength, sizeof(uint16_t), 1);
+	MemStream_Read(&stream, &colorMapDepth, sizeof(uint8_t), 1);
+	MemStream_Read(&stream, &xOffset, sizeof(uint16_t), 1);
+	MemStream_Read(&stream, &yOffset, sizeof(uint16_t), 1);
+	MemStream_Read(&stream, &width, sizeof(uint16_t), 1);
+	MemStream_Read(&stream, &height, sizeof(uint16_t), 1);
+	MemStream_Read(&stream, &depth, sizeof(uint8_t), 1);
+	MemStream_Read(&stream, &imageDescriptor, sizeof(uint8_t), 1);
+
+	if(!MemStream_Skip(&stream, IDLength))
+		return false;
 
 	switch(imageType)
 	{
@@ -203,7 +221,6 @@ bool TGA_Load(const char *filename, VkuImage_t *image)
 			break;
 
 		default:
-			fclose(stream);
 			return false;
 	}
 
@@ -225,19 +242,30 @@ bool TGA_Load(const char *filename, VkuImage_t *image)
 				uint8_t *ptr=(uint8_t *)image->data;
 
 				for(uint32_t i=0;i<height;i++, ptr+=width*bpp)
-					rle_read(ptr, width, bpp, stream);
+				{
+					if(!rle_read(ptr, width, bpp, &stream))
+					{
+						Zone_Free(zone, image->data);
+						image->data=NULL;
+						return false;
+					}
+				}
 			}
 			else
-				fread(image->data, sizeof(uint8_t), width*height*bpp, stream);
+			{
+				if(MemStream_Read(&stream, image->data, sizeof(uint8_t), width*height*bpp)!=(size_t)width*height*bpp)
+				{
+					Zone_Free(zone, image->data);
+					image->data=NULL;
+					return false;
+				}
+			}
 			break;
 
 		default:
-			fclose(stream);
 			return false;
 	}
 
-	fclose(stream);
-
 	if(!(imageDescriptor&0x20))
 	{
 		int32_t scanline=width*bpp, size=scanline*height;
@@ -263,3 +291,17 @@ bool TGA_Load(const char *filename, VkuImage_t *image)
 
 	return true;
 }
+
+bool TGA_Load(const char *filename, VkuImage_t *image)
+{
+	ArchiveFile_t file;
+
+	if(!Archive_ReadFile(filename, &file))
+		return false;
+
+	bool result=TGA_LoadMemory(file.data, file.size, image);
+
+	Archive_CloseFile(&file);
+
+	return result;
+}
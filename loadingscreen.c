@@ -6,6 +6,7 @@
 #include "loadingscreen.h"
 
 extern VkuContext_t vkContext;
+extern VkuUploadBatch_t uploadBatch;
 extern VkuSwapchain_t swapchain;
 
 void LoadingScreenAdvance(LoadingScreen_t *loadingScreen)
@@ -132,7 +133,7 @@ bool LoadingScreenInit(LoadingScreen_t *loadingScreen, uint32_t numItems)
 		}
 	}, 0, &loadingScreen->renderPass);
 
-	if(!Image_Upload(&vkContext, &loadingScreen->logo, "assets/splash.qoi", IMAGE_BILINEAR))
+	if(!Image_Upload(&vkContext, &uploadBatch, &loadingScreen->logo, "assets/splash.qoi", IMAGE_BILINEAR))
 		return false;
 
 	if(!UI_Init(&loadingScreen->UI, Vec2(0, 0), Vec2(config.renderWidth, config.renderHeight), loadingScreen->renderPass))
@@ -159,6 +159,75 @@ float Lerp(const float a, const float b, const float t)
 	return t*(b-a)+a;
 }
 
+// IEEE 754 single to half precision, round to nearest even, overflow goes to infinity
+uint16_t FloatToHalf(const float f)
+{
+	uint32_t x;
+	memcpy(&x, &f, sizeof(uint32_t));
+
+	const uint16_t sign=(x>>16)&0x8000;
+	const uint32_t absX=x&0x7FFFFFFF;
+
+	// NaN/Inf
+	if(absX>=0x7F800000)
+		return sign|0x7C00|(absX>0x7F800000?0x0200:0);
+
+	// Too big, infinity
+	if(absX>=0x477FF000)
+		return sign|0x7C00;
+
+	// Too small, denormal or zero
+	if(absX<0x38800000)
+	{
+		if(absX<0x33000000)
+			return sign;
+
+		const uint32_t mantissa=(absX&0x007FFFFF)|0x00800000;
+		const uint32_t shift=113-(absX>>23)+13;
+		const uint32_t half=mantissa>>shift;
+		const uint32_t remainder=mantissa&((1u<<shift)-1);
+		const uint32_t midpoint=1u<<(shift-1);
+
+		return sign|(uint16_t)(half+(remainder>midpoint||(remainder==midpoint&&(half&1))));
+	}
+
+	const uint32_t half=((absX-0x38000000)>>13);
+	const uint32_t remainder=absX&0x1FFF;
+
+	return sign|(uint16_t)(half+(remainder>0x1000||(remainder==0x1000&&(half&1))));
+}
+
+// Maps a unit vector onto the [-1,1] square of an octahedron, 2 components instead of 3
+vec2 OctahedralEncode(const vec3 n)
+{
+	const float invL1=1.0f/(fabsf(n.x)+fabsf(n.y)+fabsf(n.z));
+	vec2 result=Vec2(n.x*invL1, n.y*invL1);
+
+	// Fold the lower hemisphere over the diagonals
+	if(n.z<0.0f)
+	{
+		const float x=result.x, y=result.y;
+
+		result.x=(1.0f-fabsf(y))*(x>=0.0f?1.0f:-1.0f);
+		result.y=(1.0f-fabsf(x))*(y>=0.0f?1.0f:-1.0f);
+	}
+
+	return result;
+}
+
+vec3 OctahedralDecode(const vec2 e)
+{
+	vec3 n=Vec3(e.x, e.y, 1.0f-fabsf(e.x)-fabsf(e.y));
+	const float t=fmaxf(-n.z, 0.0f);
+
+	n.x+=(n.x>=0.0f)?-t:t;
+	n.y+=(n.y>=0.0f)?-t:t;
+
+	Vec3_Normalize(&n);
+
+	return n;
+}
+
 float RayOBBIntersect(const vec3 origin, const vec3 direction, const vec3 center, const vec3 halfSize, const vec4 orientation)
 {
 	// Transform ray into OBB local space using inverse rotation
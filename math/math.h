@@ -219,6 +219,10 @@ uint32_t NextPower2(uint32_t value);
 int32_t ComputeLog(uint32_t value);
 float Lerp(const float a, const float b, const float t);
 
+uint16_t FloatToHalf(const float f);
+vec2 OctahedralEncode(const vec3 n);
+vec3 OctahedralDecode(const vec2 e);
+
 float RayOBBIntersect(const vec3 origin, const vec3 direction, const vec3 center, const vec3 halfSize, const vec4 orientation);
 float RaySphereIntersect(const vec3 origin, const vec3 direction, const vec3 center, const float radius);
 float RayCapsuleIntersect(const vec3 origin, const vec3 direction, const vec3 center, const float radius, const float halfHeight, const vec4 orientation);
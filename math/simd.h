@@ -0,0 +1,62 @@
+#ifndef __SIMD_H__
+#define __SIMD_H__
+
+// 4 wide float math shared by the entity, physics and BVH kernels, plain C when there's no SSE or NEON.
+// SIMD_SSE/SIMD_NEON are also set for code that needs intrinsics the wrapper doesn't cover.
+
+#include <string.h>
+#if defined(__SSE2__)||defined(_M_X64)||defined(_M_IX86)
+#include <emmintrin.h>
+#define SIMD_SSE
+#elif defined(__ARM_NEON)&&defined(__aarch64__)
+#include <arm_neon.h>
+#define SIMD_NEON
+#endif
+#include "math.h"
+
+#if defined(SIMD_SSE)
+typedef __m128 float4_t;
+#define Float4_Load(p) _mm_loadu_ps(p)
+#define Float4_Store(p, a) _mm_storeu_ps(p, a)
+#define Float4_Set1(s) _mm_set1_ps(s)
+#define Float4_Add(a, b) _mm_add_ps(a, b)
+#define Float4_Sub(a, b) _mm_sub_ps(a, b)
+#define Float4_Mul(a, b) _mm_mul_ps(a, b)
+#define Float4_Muls(a, s) _mm_mul_ps(a, _mm_set1_ps(s))
+#define Float4_Div(a, b) _mm_div_ps(a, b)
+#define Float4_Min(a, b) _mm_min_ps(a, b)
+#define Float4_Max(a, b) _mm_max_ps(a, b)
+#define Float4_Sqrt(a) _mm_sqrt_ps(a)
+#define Float4_RSqrt(a) _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(a))
+#elif defined(SIMD_NEON)
+typedef float32x4_t float4_t;
+#define Float4_Load(p) vld1q_f32(p)
+#define Float4_Store(p, a) vst1q_f32(p, a)
+#define Float4_Set1(s) vdupq_n_f32(s)
+#define Float4_Add(a, b) vaddq_f32(a, b)
+#define Float4_Sub(a, b) vsubq_f32(a, b)
+#define Float4_Mul(a, b) vmulq_f32(a, b)
+#define Float4_Muls(a, s) vmulq_n_f32(a, s)
+#define Float4_Div(a, b) vdivq_f32(a, b)
+#define Float4_Min(a, b) vminq_f32(a, b)
+#define Float4_Max(a, b) vmaxq_f32(a, b)
+#define Float4_Sqrt(a) vsqrtq_f32(a)
+#define Float4_RSqrt(a) vdivq_f32(vdupq_n_f32(1.0f), vsqrtq_f32(a))
+#else
+typedef struct { float v[4]; } float4_t;
+
+static inline float4_t Float4_Load(const float *p) { return (float4_t) { { p[0], p[1], p[2], p[3] } }; }
+static inline void Float4_Store(float *p, const float4_t a) { memcpy(p, a.v, sizeof(a.v)); }
+static inline float4_t Float4_Set1(const float s) { return (float4_t) { { s, s, s, s } }; }
+static inline float4_t Float4_Add(const float4_t a, const float4_t b) { return (float4_t) { { a.v[0]+b.v[0], a.v[1]+b.v[1], a.v[2]+b.v[2], a.v[3]+b.v[3] } }; }
+static inline float4_t Float4_Sub(const float4_t a, const float4_t b) { return (float4_t) { { a.v[0]-b.v[0], a.v[1]-b.v[1], a.v[2]-b.v[2], a.v[3]-b.v[3] } }; }
+static inline float4_t Float4_Mul(const float4_t a, const float4_t b) { return (float4_t) { { a.v[0]*b.v[0], a.v[1]*b.v[1], a.v[2]*b.v[2], a.v[3]*b.v[3] } }; }
+static inline float4_t Float4_Muls(const float4_t a, const float s) { return (float4_t) { { a.v[0]*s, a.v[1]*s, a.v[2]*s, a.v[3]*s } }; }
+static inline float4_t Float4_Div(const float4_t a, const float4_t b) { return (float4_t) { { a.v[0]/b.v[0], a.v[1]/b.v[1], a.v[2]/b.v[2], a.v[3]/b.v[3] } }; }
+static inline float4_t Float4_Min(const float4_t a, const float4_t b) { return (float4_t) { { fminf(a.v[0], b.v[0]), fminf(a.v[1], b.v[1]), fminf(a.v[2], b.v[2]), fminf(a.v[3], b.v[3]) } }; }
+static inline float4_t Float4_Max(const float4_t a, const float4_t b) { return (float4_t) { { fmaxf(a.v[0], b.v[0]), fmaxf(a.v[1], b.v[1]), fmaxf(a.v[2], b.v[2]), fmaxf(a.v[3], b.v[3]) } }; }
+static inline float4_t Float4_Sqrt(const float4_t a) { return (float4_t) { { sqrtf(a.v[0]), sqrtf(a.v[1]), sqrtf(a.v[2]), sqrtf(a.v[3]) } }; }
+static inline float4_t Float4_RSqrt(const float4_t a) { return (float4_t) { { 1.0f/sqrtf(a.v[0]), 1.0f/sqrtf(a.v[1]), 1.0f/sqrtf(a.v[2]), 1.0f/sqrtf(a.v[3]) } }; }
+#endif
+
+#endif
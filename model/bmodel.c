@@ -7,6 +7,9 @@
 #include "../system/system.h"
 #include "../math/math.h"
 #include "../vulkan/vulkan.h"
+#include "../utils/archive.h"
+#include "../utils/memstream.h"
+#include "simplify.h"
 #include "bmodel.h"
 
 const uint32_t BMDL_MAGIC='B'|'M'<<8|'D'<<16|'L'<<24;
@@ -17,6 +20,8 @@ const uint32_t TEXC_MAGIC='T'|'E'<<8|'X'<<16|'C'<<24;
 const uint32_t TANG_MAGIC='T'|'A'<<8|'N'<<16|'G'<<24;
 const uint32_t BNRM_MAGIC='B'|'N'<<8|'R'<<16|'M'<<24;
 const uint32_t NORM_MAGIC='N'|'O'<<8|'R'<<16|'M'<<24;
+const uint32_t GVTX_MAGIC='G'|'V'<<8|'T'<<16|'X'<<24;
+const uint32_t BNDS_MAGIC='B'|'N'<<8|'D'<<16|'S'<<24;
 
 static void CalculateTangent(BModel_t *model)
 {
@@ -183,27 +188,208 @@ static void CalculateBounds(BModel_t *model)
 	}
 }
 
-static void ReadString(char *string, size_t stringLength, FILE *fp)
+static inline int16_t FloatToSnorm16(const float v)
+{
+	return (int16_t)roundf(clampf(v, -1.0f, 1.0f)*32767.0f);
+}
+
+// Builds the packed GPU vertices from the separate fp32 arrays, for models that haven't been through convertBModel.py
+static bool PackVertices(BModel_t *model)
+{
+	model->packedVertex=(BModel_Vertex_t *)Zone_Malloc(zone, sizeof(BModel_Vertex_t)*model->numVertex);
+
+	if(model->packedVertex==NULL)
+		return false;
+
+	for(uint32_t i=0;i<model->numVertex;i++)
+	{
+		BModel_Vertex_t *out=&model->packedVertex[i];
+		vec3 n=Vec3(0.0f, 0.0f, 1.0f), t=Vec3(1.0f, 0.0f, 0.0f), b=Vec3(0.0f, 1.0f, 0.0f);
+
+		out->position[0]=model->vertex[3*i+0];
+		out->position[1]=model->vertex[3*i+1];
+		out->position[2]=model->vertex[3*i+2];
+
+		if(model->UV)
+		{
+			out->UV[0]=FloatToHalf(model->UV[2*i+0]);
+			out->UV[1]=FloatToHalf(1.0f-model->UV[2*i+1]);
+		}
+		else
+			out->UV[0]=out->UV[1]=0;
+
+		if(model->normal)
+			n=Vec3(model->normal[3*i+0], model->normal[3*i+1], model->normal[3*i+2]);
+
+		if(model->tangent)
+			t=Vec3(model->tangent[3*i+0], model->tangent[3*i+1], model->tangent[3*i+2]);
+
+		if(model->binormal)
+			b=Vec3(model->binormal[3*i+0], model->binormal[3*i+1], model->binormal[3*i+2]);
+
+		// Degenerate vectors from unused vertices would encode as NaN
+		if(Vec3_Normalize(&n)==0.0f)
+			n=Vec3(0.0f, 0.0f, 1.0f);
+
+		if(Vec3_Normalize(&t)==0.0f)
+			t=Vec3(1.0f, 0.0f, 0.0f);
+
+		const vec2 octNormal=OctahedralEncode(n);
+		const vec2 octTangent=OctahedralEncode(t);
+
+		out->normal[0]=FloatToSnorm16(octNormal.x);
+		out->normal[1]=FloatToSnorm16(octNormal.y);
+		out->tangent[0]=FloatToSnorm16(octTangent.x);
+		out->tangent[1]=FloatToSnorm16(octTangent.y);
+		out->binormalSign=(Vec3_Dot(Vec3_Cross(n, t), b)<0.0f)?-32767:32767;
+		out->pad=0;
+	}
+
+	// Only the packed vertices are used from here on
+	if(model->UV)
+	{
+		Zone_Free(zone, model->UV);
+		model->UV=NULL;
+	}
+
+	if(model->tangent)
+	{
+		Zone_Free(zone, model->tangent);
+		model->tangent=NULL;
+	}
+
+	if(model->binormal)
+	{
+		Zone_Free(zone, model->binormal);
+		model->binormal=NULL;
+	}
+
+	if(model->normal)
+	{
+		Zone_Free(zone, model->normal);
+		model->normal=NULL;
+	}
+
+	return true;
+}
+
+// Meshes smaller than this aren't worth simplifying
+#define LOD_MIN_FACE 64
+
+// Furthest a LOD is allowed to move the surface, relative to the model radius
+#define LOD_MAX_ERROR 0.15f
+
+// Builds a chain of simplified index lists for each mesh, each aiming for half the triangles of the last.
+// They're simplified from the full mesh each time so the error is measured against the original surface.
+static bool GenerateLODs(BModel_t *model)
+{
+	// All meshes and their LODs share one index buffer, laid out mesh by mesh
+	uint32_t baseIndex=0;
+
+	model->numLOD=1;
+	model->LODError[0]=0.0f;
+
+	for(uint32_t i=0;i<model->numMesh;i++)
+	{
+		BModel_Mesh_t *mesh=&model->mesh[i];
+		const uint32_t numIndex=mesh->numFace*3;
+		uint32_t LODIndexCount=0;
+
+		mesh->numLOD=1;
+		mesh->LOD[0]=(BModel_LOD_t){ .firstIndex=baseIndex, .numIndex=numIndex, .error=0.0f };
+		mesh->LODFace=NULL;
+
+		if(mesh->numFace>=LOD_MIN_FACE&&model->radius>0.0f)
+		{
+			mesh->LODFace=(uint32_t *)Zone_Malloc(zone, sizeof(uint32_t)*numIndex*(BMODEL_MAX_LOD-1));
+
+			if(mesh->LODFace==NULL)
+				return false;
+
+			for(uint32_t j=1;j<BMODEL_MAX_LOD;j++)
+			{
+				const BModel_LOD_t *previous=&mesh->LOD[j-1];
+				uint32_t *dst=mesh->LODFace+LODIndexCount;
+				float error=0.0f;
+
+				uint32_t count=SimplifyMesh(dst, mesh->face, numIndex, model->vertex, model->numVertex, (numIndex>>j)/3*3, LOD_MAX_ERROR*model->radius, &error);
+
+				// Hit the error limit before getting meaningfully smaller than the last level, so stop here
+				if(count==0||count*5>previous->numIndex*4)
+					break;
+
+				mesh->LOD[j]=(BModel_LOD_t){ .firstIndex=baseIndex+numIndex+LODIndexCount, .numIndex=count, .error=error/model->radius };
+				mesh->numLOD++;
+
+				LODIndexCount+=count;
+			}
+
+			if(LODIndexCount==0)
+			{
+				Zone_Free(zone, mesh->LODFace);
+				mesh->LODFace=NULL;
+			}
+			else
+				mesh->LODFace=(uint32_t *)Zone_Realloc(zone, mesh->LODFace, sizeof(uint32_t)*LODIndexCount);
+		}
+
+		if(mesh->numLOD>model->numLOD)
+			model->numLOD=mesh->numLOD;
+
+		baseIndex+=numIndex+LODIndexCount;
+	}
+
+	model->numIndex=baseIndex;
+
+	// Meshes that ran out of levels keep drawing their last one
+	for(uint32_t j=1;j<model->numLOD;j++)
+	{
+		model->LODError[j]=0.0f;
+
+		for(uint32_t i=0;i<model->numMesh;i++)
+		{
+			const BModel_Mesh_t *mesh=&model->mesh[i];
+			const float error=mesh->LOD[min(j, mesh->numLOD-1)].error;
+
+			if(error>model->LODError[j])
+				model->LODError[j]=error;
+		}
+	}
+
+	return true;
+}
+
+static void ReadString(char *string, size_t stringLength, MemStream_t *stream)
 {
 	uint32_t i=0;
-	char ch=127;
+	int ch=127;
 
 	while(ch!='\0'&&i<stringLength)
 	{
-		ch=fgetc(fp);
-		string[i++]=ch;
+		ch=MemStream_GetC(stream);
+
+		// Ran out of data, terminate what's there
+		if(ch==EOF)
+			ch='\0';
+
+		string[i++]=(char)ch;
 	}
+
+	string[stringLength-1]='\0';
 }
 
-bool LoadBModel(BModel_t *model, const char *filename)
+bool LoadBModelMemory(BModel_t *model, const uint8_t *buffer, size_t size)
 {
-	FILE *fp;
+	MemStream_t stream;
+	bool hasBounds=false;
 
-	if(!(fp=fopen(filename, "rb")))
+	if(buffer==NULL)
 		return false;
 
+	MemStream_Init(&stream, buffer, size);
+
 	uint32_t magic=0;
-	fread(&magic, sizeof(uint32_t), 1, fp);
+	MemStream_Read(&stream, &magic, sizeof(uint32_t), 1);
 
 	if(magic!=BMDL_MAGIC)
 		return false;
@@ -213,7 +399,7 @@ bool LoadBModel(BModel_t *model, const char *filename)
 	/////// Read in materials
 
 	// Get number of materials
-	fread(&model->numMaterial, sizeof(uint32_t), 1, fp);
+	MemStream_Read(&stream, &model->numMaterial, sizeof(uint32_t), 1);
 
 	// If there materials, allocate memory for them
 	if(model->numMaterial)
@@ -228,25 +414,25 @@ bool LoadBModel(BModel_t *model, const char *filename)
 	for(uint32_t i=0;i<model->numMaterial;i++)
 	{
 		uint32_t Magic=0;
-		fread(&Magic, sizeof(uint32_t), 1, fp);
+		MemStream_Read(&stream, &Magic, sizeof(uint32_t), 1);
 
 		if(Magic!=MATL_MAGIC)
 			return false;
 
-		ReadString(model->material[i].name, 256, fp);
-		fread(&model->material[i].ambient, sizeof(float), 3, fp);
-		fread(&model->material[i].diffuse, sizeof(float), 3, fp);
-		fread(&model->material[i].specular, sizeof(float), 3, fp);
-		fread(&model->material[i].emission, sizeof(float), 3, fp);
-		fread(&model->material[i].shininess, sizeof(float), 1, fp);
-		ReadString(model->material[i].texture, 256, fp);
+		ReadString(model->material[i].name, 256, &stream);
+		MemStream_Read(&stream, &model->material[i].ambient, sizeof(float), 3);
+		MemStream_Read(&stream, &model->material[i].diffuse, sizeof(float), 3);
+		MemStream_Read(&stream, &model->material[i].specular, sizeof(float), 3);
+		MemStream_Read(&stream, &model->material[i].emission, sizeof(float), 3);
+		MemStream_Read(&stream, &model->material[i].shininess, sizeof(float), 1);
+		ReadString(model->material[i].texture, 256, &stream);
 	}
 	///////
 
 	/////// Read in meshes
 
 	// Get number of meshes
-	fread(&model->numMesh, sizeof(uint32_t), 1, fp);
+	MemStream_Read(&stream, &model->numMesh, sizeof(uint32_t), 1);
 
 	// If there meshes, allocate memory for them
 	if(model->numMesh)
@@ -261,15 +447,15 @@ bool LoadBModel(BModel_t *model, const char *filename)
 	for(uint32_t i=0;i<model->numMesh;i++)
 	{
 		uint32_t magic=0;
-		fread(&magic, sizeof(uint32_t), 1, fp);
+		MemStream_Read(&stream, &magic, sizeof(uint32_t), 1);
 
 		if(magic!=MESH_MAGIC)
 			return false;
 
-		ReadString(model->mesh[i].name, 256, fp);
-		ReadString(model->mesh[i].materialName, 256, fp);
+		ReadString(model->mesh[i].name, 256, &stream);
+		ReadString(model->mesh[i].materialName, 256, &stream);
 
-		fread(&model->mesh[i].numFace, sizeof(uint32_t), 1, fp);
+		MemStream_Read(&stream, &model->mesh[i].numFace, sizeof(uint32_t), 1);
 
 		if(model->mesh[i].numFace)
 		{
@@ -278,23 +464,23 @@ bool LoadBModel(BModel_t *model, const char *filename)
 			if(model->mesh[i].face==NULL)
 				return false;
 
-			fread(model->mesh[i].face, sizeof(uint32_t), model->mesh[i].numFace*3, fp);
+			MemStream_Read(&stream, model->mesh[i].face, sizeof(uint32_t), model->mesh[i].numFace*3);
 		}
 	}
 
 	// Read in number of vertices
-	fread(&model->numVertex, sizeof(uint32_t), 1, fp);
+	MemStream_Read(&stream, &model->numVertex, sizeof(uint32_t), 1);
 
 	// If there are vertices
 	if(model->numVertex)
 	{
 		// Read out until end of file
-		while(!feof(fp))
+		while(!MemStream_EOF(&stream))
 		{
 			uint32_t magic=0;
 
 			// Read magic ID for chunk
-			if(!fread(&magic, sizeof(uint32_t), 1, fp))
+			if(!MemStream_Read(&stream, &magic, sizeof(uint32_t), 1))
 				break;
 
 			switch(magic)
@@ -305,7 +491,7 @@ bool LoadBModel(BModel_t *model, const char *filename)
 					if(model->vertex==NULL)
 						return false;
 
-					if(fread(model->vertex, sizeof(float)*3, model->numVertex, fp)!=model->numVertex)
+					if(MemStream_Read(&stream, model->vertex, sizeof(float)*3, model->numVertex)!=model->numVertex)
 					{
 						Zone_Free(zone, model->vertex);
 						model->vertex=NULL;
@@ -318,7 +504,7 @@ bool LoadBModel(BModel_t *model, const char *filename)
 					if(model->UV==NULL)
 						return false;
 
-					if(fread(model->UV, sizeof(float)*2, model->numVertex, fp)!=model->numVertex)
+					if(MemStream_Read(&stream, model->UV, sizeof(float)*2, model->numVertex)!=model->numVertex)
 					{
 						Zone_Free(zone, model->UV);
 						model->UV=NULL;
@@ -331,7 +517,7 @@ bool LoadBModel(BModel_t *model, const char *filename)
 					if(model->tangent==NULL)
 						return false;
 
-					if(fread(model->tangent, sizeof(float)*3, model->numVertex, fp)!=model->numVertex)
+					if(MemStream_Read(&stream, model->tangent, sizeof(float)*3, model->numVertex)!=model->numVertex)
 					{
 						Zone_Free(zone, model->tangent);
 						model->tangent=NULL;
@@ -344,7 +530,7 @@ bool LoadBModel(BModel_t *model, const char *filename)
 					if(model->binormal==NULL)
 						return false;
 
-					if(fread(model->binormal, sizeof(float)*3, model->numVertex, fp)!=model->numVertex)
+					if(MemStream_Read(&stream, model->binormal, sizeof(float)*3, model->numVertex)!=model->numVertex)
 					{
 						Zone_Free(zone, model->binormal);
 						model->binormal=NULL;
@@ -357,24 +543,84 @@ bool LoadBModel(BModel_t *model, const char *filename)
 					if(model->normal==NULL)
 						return false;
 
-					if(fread(model->normal, sizeof(float)*3, model->numVertex, fp)!=model->numVertex)
+					if(MemStream_Read(&stream, model->normal, sizeof(float)*3, model->numVertex)!=model->numVertex)
 					{
 						Zone_Free(zone, model->normal);
 						model->normal=NULL;
 					}
 					break;
 
+				case GVTX_MAGIC:
+				{
+					uint32_t stride=0;
+
+					if(MemStream_Read(&stream, &stride, sizeof(uint32_t), 1)!=1)
+						break;
+
+					// Packed with a different vertex layout, skip it and build them from the fp32 data instead
+					if(stride!=sizeof(BModel_Vertex_t))
+					{
+						DBGPRINTF(DEBUG_WARNING, "LoadBModel: Packed vertex stride mismatch (%d, expected %d), repacking.\n", stride, (uint32_t)sizeof(BModel_Vertex_t));
+						MemStream_Skip(&stream, (size_t)stride*model->numVertex);
+						break;
+					}
+
+					model->packedVertex=(BModel_Vertex_t *)Zone_Malloc(zone, sizeof(BModel_Vertex_t)*model->numVertex);
+
+					if(model->packedVertex==NULL)
+						return false;
+
+					if(MemStream_Read(&stream, model->packedVertex, sizeof(BModel_Vertex_t), model->numVertex)!=model->numVertex)
+					{
+						Zone_Free(zone, model->packedVertex);
+						model->packedVertex=NULL;
+					}
+					break;
+				}
+
+				case BNDS_MAGIC:
+				{
+					float bounds[10];
+
+					if(MemStream_Read(&stream, bounds, sizeof(float), 10)!=10)
+						break;
+
+					model->bBoxMin=Vec3(bounds[0], bounds[1], bounds[2]);
+					model->bBoxMax=Vec3(bounds[3], bounds[4], bounds[5]);
+					model->center=Vec3(bounds[6], bounds[7], bounds[8]);
+					model->radius=bounds[9];
+					hasBounds=true;
+					break;
+				}
+
 				default:
 					break;
 			}
 		}
 	}
 
-	CalculateTangent(model);
+	if(model->vertex==NULL)
+		return false;
 
-	CalculateBounds(model);
+	// Converted models come with their vertices already packed, everything else gets tangents generated and packed here
+	if(model->packedVertex==NULL)
+	{
+		CalculateTangent(model);
 
-	DBGPRINTF(DEBUG_INFO, "Model: %s\n\tMin: %f %f %f Max: %f %f %f\n\tCenter: %f %f %f Radius: %f\n", model->mesh[0].name, model->bBoxMin.x, model->bBoxMin.y, model->bBoxMin.z, model->bBoxMax.x, model->bBoxMax.y, model->bBoxMax.z, model->center.x, model->center.y, model->center.z, model->radius);
+		if(!PackVertices(model))
+			return false;
+	}
+
+	if(!hasBounds)
+		CalculateBounds(model);
+
+	if(!GenerateLODs(model))
+		return false;
+
+	// 16 bit indices when all vertices can be addressed by them
+	model->indexType=(model->numVertex<=UINT16_MAX+1)?VK_INDEX_TYPE_UINT16:VK_INDEX_TYPE_UINT32;
+
+	DBGPRINTF(DEBUG_INFO, "Model: %s\n\tMin: %f %f %f Max: %f %f %f\n\tCenter: %f %f %f Radius: %f\n\tLODs: %d\n", model->mesh[0].name, model->bBoxMin.x, model->bBoxMin.y, model->bBoxMin.z, model->bBoxMax.x, model->bBoxMax.y, model->bBoxMax.z, model->center.x, model->center.y, model->center.z, model->radius, model->numLOD);
 
 	// Match up material names with their meshes with an index number
 	if(model->numMaterial)
@@ -392,104 +638,126 @@ bool LoadBModel(BModel_t *model, const char *filename)
 	return true;
 }
 
+bool LoadBModel(BModel_t *model, const char *filename)
+{
+	ArchiveFile_t file;
+
+	if(!Archive_ReadFile(filename, &file))
+		return false;
+
+	bool result=LoadBModelMemory(model, file.data, file.size);
+
+	Archive_CloseFile(&file);
+
+	return result;
+}
+
 // Free memory allocated for the model
 void FreeBModel(BModel_t *model)
 {
 	Zone_Free(zone, model->vertex);
-	Zone_Free(zone, model->UV);
-	Zone_Free(zone, model->normal);
-	Zone_Free(zone, model->tangent);
-	Zone_Free(zone, model->binormal);
+
+	if(model->UV)
+		Zone_Free(zone, model->UV);
+
+	if(model->normal)
+		Zone_Free(zone, model->normal);
+
+	if(model->tangent)
+		Zone_Free(zone, model->tangent);
+
+	if(model->binormal)
+		Zone_Free(zone, model->binormal);
+
+	if(model->packedVertex)
+		Zone_Free(zone, model->packedVertex);
 
 	if(model->numMesh)
 	{
 		/* Free mesh data */
 		for(uint32_t i=0;i<model->numMesh;i++)
+		{
 			Zone_Free(zone, model->mesh[i].face);
 
+			if(model->mesh[i].LODFace)
+				Zone_Free(zone, model->mesh[i].LODFace);
+		}
+
 		Zone_Free(zone, model->mesh);
 	}
 
 	Zone_Free(zone, model->material);
 }
 
-void BuildMemoryBuffersBModel(VkuContext_t *context, BModel_t *model)
+// Creates the vertex/index buffers and records their uploads into a staging batch,
+//   the buffers aren't valid until the batch has been submitted and finished.
+bool BuildMemoryBuffersBModel(VkuContext_t *context, VkuUploadBatch_t *batch, BModel_t *model)
 {
-	VkCommandBuffer copyCommand=VK_NULL_HANDLE;
-	VkuBuffer_t stagingBuffer;
+	VkDeviceSize stagingOffset=0;
+	const VkDeviceSize vertexSize=sizeof(BModel_Vertex_t)*model->numVertex;
 
-	// Vertex data on device memory
-	vkuCreateGPUBuffer(context, &model->vertexBuffer, sizeof(float)*20*model->numVertex, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT|VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+	if(model->packedVertex==NULL)
+		return false;
 
-	// Create staging buffer to transfer from host memory to device memory
-	vkuCreateHostBuffer(context, &stagingBuffer, sizeof(float)*20*model->numVertex, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+	// Vertex data on device memory
+	if(!vkuCreateGPUBuffer(context, &model->vertexBuffer, (uint32_t)vertexSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT|VK_BUFFER_USAGE_TRANSFER_DST_BIT))
+		return false;
 
-	if(!stagingBuffer.memory->mappedPointer)
-		return;
+	// Get staging space to transfer from host memory to device memory
+	void *vPtr=vkuUploadBatch_Alloc(batch, vertexSize, 16, &stagingOffset);
 
-	float *fPtr=(float *)stagingBuffer.memory->mappedPointer;
+	if(vPtr==NULL)
+		return false;
 
-	for(uint32_t j=0;j<model->numVertex;j++)
-	{
-		*fPtr++=model->vertex[3*j+0];
-		*fPtr++=model->vertex[3*j+1];
-		*fPtr++=model->vertex[3*j+2];
-		*fPtr++=1.0f;
-
-		*fPtr++=model->UV[2*j+0];
-		*fPtr++=1.0f-model->UV[2*j+1];
-		*fPtr++=0.0f;
-		*fPtr++=0.0f;
-
-		*fPtr++=model->tangent[3*j+0];
-		*fPtr++=model->tangent[3*j+1];
-		*fPtr++=model->tangent[3*j+2];
-		*fPtr++=0.0f;
-
-		*fPtr++=model->binormal[3*j+0];
-		*fPtr++=model->binormal[3*j+1];
-		*fPtr++=model->binormal[3*j+2];
-		*fPtr++=0.0f;
-
-		*fPtr++=model->normal[3*j+0];
-		*fPtr++=model->normal[3*j+1];
-		*fPtr++=model->normal[3*j+2];
-		*fPtr++=0.0f;
-	}
+	// Already in the final layout
+	memcpy(vPtr, model->packedVertex, vertexSize);
 
 	// Copy to device memory
-	copyCommand=vkuOneShotCommandBufferBegin(context);
-	vkCmdCopyBuffer(copyCommand, stagingBuffer.buffer, model->vertexBuffer.buffer, 1, &(VkBufferCopy) {.srcOffset=0, .dstOffset=0, .size=sizeof(float)*20*model->numVertex });
-	vkuOneShotCommandBufferEnd(context, copyCommand);
+	vkCmdCopyBuffer(vkuUploadBatch_GetCommandBuffer(batch), batch->stagingBuffer.buffer, model->vertexBuffer.buffer, 1, &(VkBufferCopy) {.srcOffset=stagingOffset, .dstOffset=0, .size=vertexSize });
+
+	const bool index16=model->indexType==VK_INDEX_TYPE_UINT16;
+	const VkDeviceSize indexSize=(index16?sizeof(uint16_t):sizeof(uint32_t))*model->numIndex;
+
+	// Index data, all meshes and LODs in one buffer so drawing any of them only needs one bind
+	if(!vkuCreateGPUBuffer(context, &model->indexBuffer, (uint32_t)indexSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT|VK_BUFFER_USAGE_TRANSFER_DST_BIT))
+		return false;
+
+	void *iPtr=vkuUploadBatch_Alloc(batch, indexSize, 16, &stagingOffset);
 
-	// Delete staging data
-	vkuDestroyBuffer(context, &stagingBuffer);
+	if(iPtr==NULL)
+		return false;
 
 	for(uint32_t i=0;i<model->numMesh;i++)
 	{
-		// Index data
-		vkuCreateGPUBuffer(context, &model->mesh[i].indexBuffer, sizeof(uint32_t)*model->mesh[i].numFace*3, VK_BUFFER_USAGE_INDEX_BUFFER_BIT|VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+		const BModel_Mesh_t *mesh=&model->mesh[i];
+		const uint32_t firstIndex=mesh->LOD[0].firstIndex;
+		const uint32_t numFaceIndex=mesh->numFace*3;
+		const BModel_LOD_t *lastLOD=&mesh->LOD[mesh->numLOD-1];
+		const uint32_t numLODIndex=lastLOD->firstIndex+lastLOD->numIndex-firstIndex-numFaceIndex;
+
+		// Full mesh, followed by its LODs
+		if(index16)
+		{
+			uint16_t *sPtr=(uint16_t *)iPtr+firstIndex;
 
-		// Staging buffer
-		vkuCreateHostBuffer(context, &stagingBuffer, sizeof(uint32_t)*model->mesh[i].numFace*3, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+			for(uint32_t j=0;j<numFaceIndex;j++)
+				sPtr[j]=(uint16_t)mesh->face[j];
 
-		if(!stagingBuffer.memory->mappedPointer)
-			return;
+			for(uint32_t j=0;j<numLODIndex;j++)
+				sPtr[numFaceIndex+j]=(uint16_t)mesh->LODFace[j];
+		}
+		else
+		{
+			uint32_t *lPtr=(uint32_t *)iPtr+firstIndex;
 
-		uint32_t *iPtr=(uint32_t *)stagingBuffer.memory->mappedPointer;
+			memcpy(lPtr, mesh->face, sizeof(uint32_t)*numFaceIndex);
 
-		for(uint32_t j=0;j<model->mesh[i].numFace;j++)
-		{
-			*iPtr++=model->mesh[i].face[3*j+0];
-			*iPtr++=model->mesh[i].face[3*j+1];
-			*iPtr++=model->mesh[i].face[3*j+2];
+			if(numLODIndex)
+				memcpy(lPtr+numFaceIndex, mesh->LODFace, sizeof(uint32_t)*numLODIndex);
 		}
+	}
 
-		copyCommand=vkuOneShotCommandBufferBegin(context);
-		vkCmdCopyBuffer(copyCommand, stagingBuffer.buffer, model->mesh[i].indexBuffer.buffer, 1, &(VkBufferCopy) {.srcOffset=0, .dstOffset=0, .size=sizeof(uint32_t)*model->mesh[i].numFace*3 });
-		vkuOneShotCommandBufferEnd(context, copyCommand);
+	vkCmdCopyBuffer(vkuUploadBatch_GetCommandBuffer(batch), batch->stagingBuffer.buffer, model->indexBuffer.buffer, 1, &(VkBufferCopy) {.srcOffset=stagingOffset, .dstOffset=0, .size=indexSize });
 
-		// Delete staging data
-		vkuDestroyBuffer(context, &stagingBuffer);
-	}
+	return true;
 }
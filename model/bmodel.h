@@ -5,6 +5,29 @@
 #include "../vulkan/vulkan.h"
 #include "../math/math.h"
 
+// GPU vertex layout, matches the vertex bindings in lighting.pipeline and shadow.pipeline.
+// Normal and tangent are octahedral encoded, the binormal is rebuilt in the shader as cross(normal, tangent)*sign.
+typedef struct
+{
+	float position[3];
+	uint16_t UV[2];			// Half float
+	int16_t normal[2];		// Octahedral, snorm
+	int16_t tangent[2];		// Octahedral, snorm
+	int16_t binormalSign;	// -1 or 1, snorm
+	int16_t pad;
+} BModel_Vertex_t;
+
+// Number of detail levels generated for each mesh, LOD 0 is the full resolution mesh
+#define BMODEL_MAX_LOD 4
+
+// A level of detail, a range of the model's index buffer that draws with the same vertex buffer
+typedef struct
+{
+	uint32_t firstIndex;
+	uint32_t numIndex;
+	float error;			// Largest distance the surface moved in simplification, relative to the model radius
+} BModel_LOD_t;
+
 typedef struct
 {
 	char name[256];
@@ -25,7 +48,10 @@ typedef struct
 	uint32_t numFace;
 	uint32_t *face;
 
-	VkuBuffer_t indexBuffer;
+	// Simplified indices for LOD 1 and up, these follow face in the model's index buffer
+	uint32_t numLOD;
+	BModel_LOD_t LOD[BMODEL_MAX_LOD];
+	uint32_t *LODFace;
 } BModel_Mesh_t;
 
 typedef struct
@@ -43,16 +69,29 @@ typedef struct
 	float *binormal;
 	float *normal;
 
+	// Packed vertices ready for upload, either loaded from the model file or built from the above at load
+	BModel_Vertex_t *packedVertex;
+
 	VkuBuffer_t vertexBuffer;
 
+	// Indices for every mesh and LOD, LOD index ranges point into this
+	uint32_t numIndex;
+	VkIndexType indexType;
+	VkuBuffer_t indexBuffer;
+
+	// Detail levels for the model as a whole, the error is the largest of any mesh's at that level
+	uint32_t numLOD;
+	float LODError[BMODEL_MAX_LOD];
+
 	vec3 bBoxMin;
 	vec3 bBoxMax;
 	vec3 center;
 	float radius;
 } BModel_t;
 
+bool LoadBModelMemory(BModel_t *model, const uint8_t *buffer, size_t size);
 bool LoadBModel(BModel_t *model, const char *filename);
 void FreeBModel(BModel_t *model);
-void BuildMemoryBuffersBModel(VkuContext_t *Context, BModel_t *model);
+bool BuildMemoryBuffersBModel(VkuContext_t *context, VkuUploadBatch_t *batch, BModel_t *model);
 
 #endif
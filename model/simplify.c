@@ -0,0 +1,427 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../system/system.h"
+#include "simplify.h"
+
+// Most distinct vertices sharing one position that a collapse will remap
+#define MAX_WEDGE 16
+
+// Smallest cosine between a triangle's normal before and after a collapse, anything lower is treated as a flip
+#define FLIP_THRESHOLD 0.25f
+
+// Symmetric 4x4 error quadric of a set of planes, weighted by triangle area
+typedef struct
+{
+	double a2, b2, c2, ab, ac, bc, ad, bd, cd, d2;
+	double weight;
+} Quadric_t;
+
+typedef struct
+{
+	float cost;
+	uint32_t v0, v1;
+} Collapse_t;
+
+static void Quadric_AddPlane(Quadric_t *q, const double a, const double b, const double c, const double d, const double weight)
+{
+	q->a2+=a*a*weight;	q->b2+=b*b*weight;	q->c2+=c*c*weight;
+	q->ab+=a*b*weight;	q->ac+=a*c*weight;	q->bc+=b*c*weight;
+	q->ad+=a*d*weight;	q->bd+=b*d*weight;	q->cd+=c*d*weight;
+	q->d2+=d*d*weight;
+	q->weight+=weight;
+}
+
+static void Quadric_Add(Quadric_t *q, const Quadric_t *r)
+{
+	q->a2+=r->a2;	q->b2+=r->b2;	q->c2+=r->c2;
+	q->ab+=r->ab;	q->ac+=r->ac;	q->bc+=r->bc;
+	q->ad+=r->ad;	q->bd+=r->bd;	q->cd+=r->cd;
+	q->d2+=r->d2;
+	q->weight+=r->weight;
+}
+
+// Area weighted mean squared distance from v to the quadric's planes
+static float Quadric_Error(const Quadric_t *q, const float *v)
+{
+	const double x=v[0], y=v[1], z=v[2];
+	const double r=q->a2*x*x+q->b2*y*y+q->c2*z*z+2.0*(q->ab*x*y+q->ac*x*z+q->bc*y*z+q->ad*x+q->bd*y+q->cd*z)+q->d2;
+
+	return (float)(fabs(r)/(q->weight>0.0?q->weight:1.0));
+}
+
+static int CollapseCompare(const void *a, const void *b)
+{
+	const float ca=((const Collapse_t *)a)->cost;
+	const float cb=((const Collapse_t *)b)->cost;
+
+	return (ca>cb)-(ca<cb);
+}
+
+// Maps every vertex to the first vertex with the exact same position
+static bool BuildPositionRemap(uint32_t *remap, const float *vertex, uint32_t numVertex)
+{
+	uint32_t tableSize=1;
+
+	while(tableSize<numVertex*2)
+		tableSize<<=1;
+
+	uint32_t *table=(uint32_t *)Zone_Malloc(zone, sizeof(uint32_t)*tableSize);
+
+	if(table==NULL)
+		return false;
+
+	memset(table, 0xFF, sizeof(uint32_t)*tableSize);
+
+	for(uint32_t i=0;i<numVertex;i++)
+	{
+		uint32_t bits[3];
+		memcpy(bits, &vertex[3*i], sizeof(bits));
+
+		uint32_t hash=((bits[0]*73856093u)^(bits[1]*19349663u)^(bits[2]*83492791u))&(tableSize-1);
+
+		while(table[hash]!=UINT32_MAX&&memcmp(&vertex[3*table[hash]], &vertex[3*i], sizeof(float)*3)!=0)
+			hash=(hash+1)&(tableSize-1);
+
+		if(table[hash]==UINT32_MAX)
+			table[hash]=i;
+
+		remap[i]=table[hash];
+	}
+
+	Zone_Free(zone, table);
+
+	return true;
+}
+
+// Triangle lists for each welded position, in compressed row form
+static void BuildAdjacency(uint32_t *triStart, uint32_t *triList, const uint32_t *indices, uint32_t numIndex, const uint32_t *remap, uint32_t numVertex)
+{
+	memset(triStart, 0, sizeof(uint32_t)*(numVertex+1));
+
+	for(uint32_t i=0;i<numIndex;i++)
+		triStart[remap[indices[i]]+1]++;
+
+	for(uint32_t i=0;i<numVertex;i++)
+		triStart[i+1]+=triStart[i];
+
+	for(uint32_t i=0;i<numIndex;i++)
+		triList[triStart[remap[indices[i]]]++]=i/3;
+
+	// Filling shifted the starts up by one slot, shift them back
+	for(uint32_t i=numVertex;i>0;i--)
+		triStart[i]=triStart[i-1];
+
+	triStart[0]=0;
+}
+
+static inline int32_t TriangleCorner(const uint32_t *indices, uint32_t triangle, const uint32_t *remap, uint32_t position)
+{
+	for(uint32_t k=0;k<3;k++)
+	{
+		if(remap[indices[3*triangle+k]]==position)
+			return k;
+	}
+
+	return -1;
+}
+
+static inline void TriangleNormal(float *n, const float *p0, const float *p1, const float *p2)
+{
+	const float e0[3]={ p1[0]-p0[0], p1[1]-p0[1], p1[2]-p0[2] };
+	const float e1[3]={ p2[0]-p0[0], p2[1]-p0[1], p2[2]-p0[2] };
+
+	n[0]=e0[1]*e1[2]-e0[2]*e1[1];
+	n[1]=e0[2]*e1[0]-e0[0]*e1[2];
+	n[2]=e0[0]*e1[1]-e0[1]*e1[0];
+}
+
+// Checks if position v0 can collapse onto v1 without flipping triangles or tearing attribute seams,
+//   and if so writes where each of v0's vertices should be remapped to.
+static bool CheckCollapse(uint32_t v0, uint32_t v1, const uint32_t *indices, const uint32_t *triStart, const uint32_t *triList, const uint32_t *remap, const float *vertex, uint32_t *wedgeFrom, uint32_t *wedgeTo, uint32_t *numWedge)
+{
+	*numWedge=0;
+
+	// Gather the distinct vertices at this position, and where they go using the triangles that get removed by the collapse
+	for(uint32_t i=triStart[v0];i<triStart[v0+1];i++)
+	{
+		const uint32_t t=triList[i];
+		const uint32_t w=indices[3*t+TriangleCorner(indices, t, remap, v0)];
+		const int32_t k1=TriangleCorner(indices, t, remap, v1);
+		uint32_t j;
+
+		for(j=0;j<*numWedge;j++)
+		{
+			if(wedgeFrom[j]==w)
+				break;
+		}
+
+		if(j==*numWedge)
+		{
+			if(*numWedge==MAX_WEDGE)
+				return false;
+
+			wedgeFrom[j]=w;
+			wedgeTo[j]=UINT32_MAX;
+			(*numWedge)++;
+		}
+
+		// Shares a triangle, so it's continuous in UV space with that vertex
+		if(k1!=-1&&wedgeTo[j]==UINT32_MAX)
+			wedgeTo[j]=indices[3*t+k1];
+	}
+
+	const float *p1=&vertex[3*v1];
+
+	for(uint32_t i=triStart[v0];i<triStart[v0+1];i++)
+	{
+		const uint32_t t=triList[i];
+
+		// Removed by the collapse
+		if(TriangleCorner(indices, t, remap, v1)!=-1)
+			continue;
+
+		const int32_t k0=TriangleCorner(indices, t, remap, v0);
+		const uint32_t w=indices[3*t+k0];
+
+		// A surviving triangle has a vertex with no counterpart at v1, collapsing would tear the seam
+		for(uint32_t j=0;j<*numWedge;j++)
+		{
+			if(wedgeFrom[j]==w&&wedgeTo[j]==UINT32_MAX)
+				return false;
+		}
+
+		const float *p[3]={ &vertex[3*remap[indices[3*t+0]]], &vertex[3*remap[indices[3*t+1]]], &vertex[3*remap[indices[3*t+2]]] };
+		float before[3], after[3];
+
+		TriangleNormal(before, p[0], p[1], p[2]);
+		p[k0]=p1;
+		TriangleNormal(after, p[0], p[1], p[2]);
+
+		const float dot=before[0]*after[0]+before[1]*after[1]+before[2]*after[2];
+		const float lengths=sqrtf((before[0]*before[0]+before[1]*before[1]+before[2]*before[2])*(after[0]*after[0]+after[1]*after[1]+after[2]*after[2]));
+
+		if(dot<=FLIP_THRESHOLD*lengths)
+			return false;
+	}
+
+	// Vertices only used by removed triangles vanish, they can go anywhere
+	for(uint32_t j=0;j<*numWedge;j++)
+	{
+		if(wedgeTo[j]==UINT32_MAX)
+			wedgeTo[j]=v1;
+	}
+
+	return true;
+}
+
+uint32_t SimplifyMesh(uint32_t *dst, const uint32_t *indices, uint32_t numIndex, const float *vertex, uint32_t numVertex, uint32_t targetIndexCount, float maxError, float *error)
+{
+	uint32_t count=0;
+	float maxCost=0.0f;
+	const float errorLimit=maxError*maxError;
+
+	if(error)
+		*error=0.0f;
+
+	uint32_t *remap=(uint32_t *)Zone_Malloc(zone, sizeof(uint32_t)*numVertex);
+	uint32_t *collapse=(uint32_t *)Zone_Malloc(zone, sizeof(uint32_t)*numVertex);
+	uint32_t *triStart=(uint32_t *)Zone_Malloc(zone, sizeof(uint32_t)*(numVertex+1));
+	uint32_t *triList=(uint32_t *)Zone_Malloc(zone, sizeof(uint32_t)*numIndex);
+	uint8_t *locked=(uint8_t *)Zone_Malloc(zone, sizeof(uint8_t)*numVertex);
+	uint8_t *touched=(uint8_t *)Zone_Malloc(zone, sizeof(uint8_t)*numVertex);
+	Quadric_t *quadric=(Quadric_t *)Zone_Malloc(zone, sizeof(Quadric_t)*numVertex);
+	Collapse_t *candidates=(Collapse_t *)Zone_Malloc(zone, sizeof(Collapse_t)*numIndex*2);
+
+	if(!remap||!collapse||!triStart||!triList||!locked||!touched||!quadric||!candidates)
+		goto cleanup;
+
+	if(!BuildPositionRemap(remap, vertex, numVertex))
+		goto cleanup;
+
+	memset(locked, 0, sizeof(uint8_t)*numVertex);
+	memset(quadric, 0, sizeof(Quadric_t)*numVertex);
+
+	// Copy over the input, dropping anything that's already degenerate after welding, and build up the plane quadrics
+	for(uint32_t i=0;i+2<numIndex;i+=3)
+	{
+		const uint32_t p0=remap[indices[i+0]], p1=remap[indices[i+1]], p2=remap[indices[i+2]];
+
+		if(p0==p1||p1==p2||p2==p0)
+			continue;
+
+		dst[count++]=indices[i+0];
+		dst[count++]=indices[i+1];
+		dst[count++]=indices[i+2];
+
+		float n[3];
+		TriangleNormal(n, &vertex[3*p0], &vertex[3*p1], &vertex[3*p2]);
+
+		const float area=sqrtf(n[0]*n[0]+n[1]*n[1]+n[2]*n[2]);
+
+		if(area==0.0f)
+			continue;
+
+		n[0]/=area;
+		n[1]/=area;
+		n[2]/=area;
+
+		const float d=-(n[0]*vertex[3*p0+0]+n[1]*vertex[3*p0+1]+n[2]*vertex[3*p0+2]);
+
+		Quadric_AddPlane(&quadric[p0], n[0], n[1], n[2], d, area);
+		Quadric_AddPlane(&quadric[p1], n[0], n[1], n[2], d, area);
+		Quadric_AddPlane(&quadric[p2], n[0], n[1], n[2], d, area);
+	}
+
+	// Lock positions on open or non-manifold edges, the quadrics don't hold anything to keep the boundary in place
+	BuildAdjacency(triStart, triList, dst, count, remap, numVertex);
+
+	for(uint32_t i=0;i<count;i++)
+	{
+		const uint32_t a=remap[dst[i]];
+		const uint32_t b=remap[dst[(i%3==2)?i-2:i+1]];
+		uint32_t edgeCount=0;
+
+		for(uint32_t j=triStart[a];j<triStart[a+1];j++)
+		{
+			if(TriangleCorner(dst, triList[j], remap, b)!=-1)
+				edgeCount++;
+		}
+
+		if(edgeCount!=2)
+			locked[a]=locked[b]=1;
+	}
+
+	// Collapse in passes, cheapest first, each position changed at most once per pass
+	while(count>targetIndexCount)
+	{
+		uint32_t numCandidate=0;
+
+		BuildAdjacency(triStart, triList, dst, count, remap, numVertex);
+
+		for(uint32_t i=0;i<count;i++)
+		{
+			const uint32_t a=remap[dst[i]];
+			const uint32_t b=remap[dst[(i%3==2)?i-2:i+1]];
+
+			Quadric_t q=quadric[a];
+			Quadric_Add(&q, &quadric[b]);
+
+			if(!locked[a])
+				candidates[numCandidate++]=(Collapse_t){ Quadric_Error(&q, &vertex[3*b]), a, b };
+
+			if(!locked[b])
+				candidates[numCandidate++]=(Collapse_t){ Quadric_Error(&q, &vertex[3*a]), b, a };
+		}
+
+		if(numCandidate==0)
+			break;
+
+		qsort(candidates, numCandidate, sizeof(Collapse_t), CollapseCompare);
+
+		// Only take about as many of the cheapest collapses as are needed to hit the target, otherwise a pass
+		//   ends up picking expensive collapses while the cheap ones nearby are blocked, and the error climbs for no gain.
+		// Each edge shows up about 4 times (both directions, both triangles) and each collapse removes about 2 triangles.
+		uint32_t goal=(count-targetIndexCount)/3*2;
+
+		if(goal>numCandidate-1)
+			goal=numCandidate-1;
+
+		const float passLimit=fminf(errorLimit, candidates[goal].cost);
+
+		for(uint32_t i=0;i<numVertex;i++)
+			collapse[i]=i;
+
+		memset(touched, 0, sizeof(uint8_t)*numVertex);
+
+		uint32_t removed=0, applied=0;
+
+		for(uint32_t i=0;i<numCandidate;i++)
+		{
+			const Collapse_t *c=&candidates[i];
+			uint32_t wedgeFrom[MAX_WEDGE], wedgeTo[MAX_WEDGE], numWedge;
+
+			if(c->cost>passLimit||count-removed*3<=targetIndexCount)
+				break;
+
+			if(touched[c->v0]||touched[c->v1])
+				continue;
+
+			if(!CheckCollapse(c->v0, c->v1, dst, triStart, triList, remap, vertex, wedgeFrom, wedgeTo, &numWedge))
+				continue;
+
+			for(uint32_t j=0;j<numWedge;j++)
+				collapse[wedgeFrom[j]]=wedgeTo[j];
+
+			// Everything around v0 changes shape, so nothing there can be collapsed again this pass
+			for(uint32_t j=triStart[c->v0];j<triStart[c->v0+1];j++)
+			{
+				const uint32_t t=triList[j];
+
+				touched[remap[dst[3*t+0]]]=touched[remap[dst[3*t+1]]]=touched[remap[dst[3*t+2]]]=1;
+
+				if(TriangleCorner(dst, t, remap, c->v1)!=-1)
+					removed++;
+			}
+
+			Quadric_Add(&quadric[c->v1], &quadric[c->v0]);
+
+			if(c->cost>maxCost)
+				maxCost=c->cost;
+
+			applied++;
+		}
+
+		if(applied==0)
+			break;
+
+		// Apply the collapses and compact out the triangles that collapsed away
+		uint32_t newCount=0;
+
+		for(uint32_t i=0;i<count;i+=3)
+		{
+			const uint32_t a=collapse[dst[i+0]], b=collapse[dst[i+1]], c=collapse[dst[i+2]];
+
+			if(remap[a]==remap[b]||remap[b]==remap[c]||remap[c]==remap[a])
+				continue;
+
+			dst[newCount++]=a;
+			dst[newCount++]=b;
+			dst[newCount++]=c;
+		}
+
+		count=newCount;
+	}
+
+	if(error)
+		*error=sqrtf(maxCost);
+
+cleanup:
+	if(remap)
+		Zone_Free(zone, remap);
+
+	if(collapse)
+		Zone_Free(zone, collapse);
+
+	if(triStart)
+		Zone_Free(zone, triStart);
+
+	if(triList)
+		Zone_Free(zone, triList);
+
+	if(locked)
+		Zone_Free(zone, locked);
+
+	if(touched)
+		Zone_Free(zone, touched);
+
+	if(quadric)
+		Zone_Free(zone, quadric);
+
+	if(candidates)
+		Zone_Free(zone, candidates);
+
+	return count;
+}
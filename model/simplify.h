@@ -0,0 +1,15 @@
+#ifndef __SIMPLIFY_H__
+#define __SIMPLIFY_H__
+
+#include <stdint.h>
+
+// Quadric error edge collapse mesh simplifier.
+// Vertices are only ever collapsed onto other existing vertices, so the output indexes the same vertex buffer as the input,
+//   vertices that share a position (UV seams, hard edges) are collapsed together so seams stay closed.
+//
+// dst must have room for numIndex indices, returns the number of indices written.
+// Stops once the index count is at or below targetIndexCount, or when the next collapse would move the surface by more than maxError.
+// If error isn't NULL, it's set to the largest distance the surface was moved by.
+uint32_t SimplifyMesh(uint32_t *dst, const uint32_t *indices, uint32_t numIndex, const float *vertex, uint32_t numVertex, uint32_t targetIndexCount, float maxError, float *error);
+
+#endif
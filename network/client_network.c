@@ -28,7 +28,7 @@ typedef struct
 
 extern PhyParticleEmitter_t emitters[MAX_EMITTERS];
 
-extern matrix FighterTransform(const RigidBody_t *body);
+extern EntityTransform_t FighterTransform(void);
 
 extern ParticleSystem_t particleSystem;
 extern void emitterCallback(uint32_t index, uint32_t numParticles, Particle_t *particle);
@@ -183,7 +183,7 @@ static void SpawnEntity(uint32_t netID, EntityObjectType_e objectType, uint32_t
             remotePlayers[clientID].body.orientation=orientation;
             remotePlayerActive[clientID]=true;
 
-            uint32_t localID=EntityList_Add(&entityList, &remotePlayers[clientID].body, false, MODEL_FIGHTER, TEXTURE_FIGHTER1, TEXTURE_FIGHTER1_NORMAL, ENTITYOBJECTTYPE_PLAYER, FighterTransform);
+            uint32_t localID=EntityList_Add(&entityList, &remotePlayers[clientID].body, false, MODEL_FIGHTER, TEXTURE_FIGHTER1, TEXTURE_FIGHTER1_NORMAL, ENTITYOBJECTTYPE_PLAYER, FighterTransform());
 
             NetMap_Set(netID, localID);
             break;
@@ -204,7 +204,7 @@ static void SpawnEntity(uint32_t netID, EntityObjectType_e objectType, uint32_t
                 emitters[i].body.radius=radius;
 
                 // Add physics entity - purely local ID, no server ID fixup
-                uint32_t localID=EntityList_Add(&entityList, &emitters[i].body, true, 0, 0, 0, ENTITYOBJECTTYPE_PROJECTILE, NULL);
+                uint32_t localID=EntityList_Add(&entityList, &emitters[i].body, true, 0, 0, 0, ENTITYOBJECTTYPE_PROJECTILE, ENTITY_TRANSFORM_IDENTITY);
 
                 emitters[i].entityID=localID;
                 NetMap_Set(netID, localID);
@@ -0,0 +1,169 @@
+#!/usr/bin/python
+
+import argparse
+import struct
+from pathlib import Path
+
+# Must match utils/archive.h
+ARCHIVE_MAGIC = b"VPAK"
+ARCHIVE_VERSION = 1
+ARCHIVE_ALIGNMENT = 64
+ARCHIVE_MAX_NAME = 64
+ARCHIVE_ENTRY_LZ4 = 0x00000001
+
+HEADER_FORMAT = "<4sIII"
+ENTRY_FORMAT = f"<{ARCHIVE_MAX_NAME}sIIII"
+
+# LZ4 block format constants
+MIN_MATCH = 4
+LAST_LITERALS = 5
+MF_LIMIT = 12
+MAX_DISTANCE = 65535
+
+# Only keep the compressed version if it saves at least this much
+MIN_COMPRESSION_RATIO = 0.875
+
+def align_up(value, alignment):
+    return (value + alignment - 1) & ~(alignment - 1)
+
+def write_length(out, length):
+    """Writes the extra length bytes for a literal run or match length that overflowed its nibble."""
+    length -= 15
+    while length >= 255:
+        out.append(255)
+        length -= 255
+    out.append(length)
+
+def write_sequence(out, literals, distance, match_length):
+    literal_length = len(literals)
+    token_literals = min(literal_length, 15)
+    token_match = 0 if match_length is None else min(match_length - MIN_MATCH, 15)
+
+    out.append((token_literals << 4) | token_match)
+
+    if literal_length >= 15:
+        write_length(out, literal_length)
+
+    out += literals
+
+    if match_length is not None:
+        out += struct.pack("<H", distance)
+
+        if match_length - MIN_MATCH >= 15:
+            write_length(out, match_length - MIN_MATCH)
+
+def lz4_compress(data):
+    """Greedy hash-chain-less LZ4 block compressor, output is decodable by utils/lz4.c."""
+    length = len(data)
+    out = bytearray()
+    table = {}
+    anchor = 0
+    p = 0
+
+    # Last match must start at least MF_LIMIT bytes before the end, and end LAST_LITERALS before it
+    match_limit = length - MF_LIMIT
+
+    while p < match_limit:
+        key = data[p:p + MIN_MATCH]
+        candidate = table.get(key)
+        table[key] = p
+
+        if candidate is None or p - candidate > MAX_DISTANCE:
+            p += 1
+            continue
+
+        match_length = MIN_MATCH
+        max_length = length - LAST_LITERALS - p
+
+        while match_length < max_length and data[candidate + match_length] == data[p + match_length]:
+            match_length += 1
+
+        write_sequence(out, data[anchor:p], p - candidate, match_length)
+
+        # Seed the table with a couple of positions inside the match so later matches can find it
+        end = p + match_length
+        for q in (end - 2, end - 1):
+            if q < match_limit:
+                table[data[q:q + MIN_MATCH]] = q
+
+        p = end
+        anchor = p
+
+    # Trailing literals
+    write_sequence(out, data[anchor:], 0, None)
+
+    return bytes(out)
+
+def pack(input_dir, output_file, compress, excludes):
+    input_path = Path(input_dir)
+    if not input_path.is_dir():
+        print(f"Error: '{input_dir}' is not a directory.")
+        return False
+
+    # Entry names are relative to the input directory's parent, so "assets/foo.qoi" matches the paths used at runtime
+    root = input_path.parent
+
+    files = sorted(f for f in input_path.rglob("*") if f.is_file() and not any(f.relative_to(input_path).as_posix().startswith(e) for e in excludes))
+
+    entries = []
+    for file in files:
+        name = file.relative_to(root).as_posix()
+        encoded_name = name.encode("utf-8")
+
+        if len(encoded_name) >= ARCHIVE_MAX_NAME:
+            print(f"Warning: Name '{name}' is too long for the archive. Skipping.")
+            continue
+
+        raw = file.read_bytes()
+        stored = raw
+        flags = 0
+
+        # Tiny files don't gain anything and the LZ4 end conditions need some data to work with
+        if compress and len(raw) > MF_LIMIT * 4:
+            compressed = lz4_compress(raw)
+
+            if len(compressed) < len(raw) * MIN_COMPRESSION_RATIO:
+                stored = compressed
+                flags |= ARCHIVE_ENTRY_LZ4
+
+        entries.append((encoded_name, raw, stored, flags))
+
+    # Sorted by encoded name, runtime lookup is a binary search with strncmp
+    entries.sort(key=lambda e: e[0])
+
+    offset = align_up(struct.calcsize(HEADER_FORMAT) + struct.calcsize(ENTRY_FORMAT) * len(entries), ARCHIVE_ALIGNMENT)
+
+    toc = bytearray()
+    data = bytearray()
+    for encoded_name, raw, stored, flags in entries:
+        toc += struct.pack(ENTRY_FORMAT, encoded_name, offset + len(data), len(raw), len(stored), flags)
+        data += stored
+        data += bytes(align_up(len(data), ARCHIVE_ALIGNMENT) - len(data))
+
+    with open(output_file, "wb") as f:
+        f.write(struct.pack(HEADER_FORMAT, ARCHIVE_MAGIC, ARCHIVE_VERSION, len(entries), 0))
+        f.write(toc)
+        f.write(bytes(offset - f.tell()))
+        f.write(data)
+        # Slack at the end, the LZ4 decoder reads literals in 4 byte chunks
+        f.write(bytes(ARCHIVE_ALIGNMENT))
+
+    total_raw = sum(len(e[1]) for e in entries)
+    total_stored = sum(len(e[2]) for e in entries)
+    print(f"Packed {len(entries)} files into '{output_file}', {total_raw} -> {total_stored} bytes.")
+
+    return True
+
+def main():
+    parser = argparse.ArgumentParser(description="Pack an asset directory into a single archive for memory mapped loading.")
+    parser.add_argument("input", help="Path to the asset directory to pack")
+    parser.add_argument("--output", help="Archive file to write", default="assets.pak")
+    parser.add_argument("--lz4", help="LZ4 compress entries where it helps", action="store_true")
+    parser.add_argument("--exclude", help="Relative path prefix to leave out (can be repeated)", action="append", default=[])
+
+    args = parser.parse_args()
+    if not pack(args.input, args.output, args.lz4, args.exclude):
+        raise SystemExit(1)
+
+if __name__ == "__main__":
+    main()
@@ -34,6 +34,11 @@ typedef struct
 	VkuBuffer_t mainUBOBuffer[2];
 	//////
 
+	// Shadow caster instances, one range of MAX_ENTITY per cascade
+	EntityInstance_t *shadowInstance;
+	VkuBuffer_t shadowInstanceBuffer;
+	//////
+
 	// Descriptor pool
 	VkDescriptorPool descriptorPool;
 
@@ -47,6 +52,13 @@ typedef struct
 	VkSemaphore completeSemaphore;
 } PerFrame_t;
 
+// What render graph passes get told about the frame they're recording
+typedef struct
+{
+	uint32_t index;			// Frame in flight
+	uint32_t imageIndex[2];	// Swapchain image for each eye
+} RenderFrame_t;
+
 #define FRAMES_IN_FLIGHT 3
 extern PerFrame_t perFrame[FRAMES_IN_FLIGHT];
 
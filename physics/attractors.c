@@ -1,6 +1,7 @@
 #include <float.h>
 #include "../math/math.h"
 #include "physics.h"
+#include "../math/simd.h"
 
 vec3 AttractorOBBComputeGravity(vec3 position, vec3 center, vec3 halfExtents, vec4 orientation, float baseGravity, float influenceRadius)
 {
@@ -132,3 +133,521 @@ vec3 AttractorSphereComputeGravity(vec3 position, vec3 center, float radius, flo
 
     return Vec3_Muls(gravityDir, strength);
 }
+
+void PhysicsGravity_Begin(PhysicsGravity_t *gravity)
+{
+	gravity->numAttractors=0;
+	gravity->numNodes=0;
+	gravity->overflow=0;
+
+	for(uint32_t i=0;i<MAX_RIGIDBODYTYPE;i++)
+		gravity->numInteractions[i]=0;
+}
+
+bool PhysicsGravity_AddAttractor(PhysicsGravity_t *gravity, RigidBody_t *body, float baseGravity, float influenceRadius)
+{
+	if(gravity->numAttractors>=PHYSICS_MAX_ATTRACTORS)
+	{
+		gravity->overflow++;
+		return false;
+	}
+
+	const uint32_t index=gravity->numAttractors++;
+
+	gravity->attractor[index]=body;
+	gravity->baseGravity[index]=baseGravity;
+	gravity->influenceRadius[index]=influenceRadius;
+	gravity->order[index]=index;
+
+	return true;
+}
+
+// Partially sorts order[first..first+count) along axis so the middle element is in place, smaller before it and larger after
+static void GravitySelectMedian(PhysicsGravity_t *gravity, uint32_t first, uint32_t count, uint32_t axis)
+{
+	uint32_t *order=gravity->order;
+	uint32_t left=first, right=first+count-1;
+	const uint32_t middle=first+count/2;
+
+	while(right>left)
+	{
+		// Partition around the range's middle element, parked at the end meanwhile
+		uint32_t temp=order[(left+right)/2];
+		order[(left+right)/2]=order[right];
+		order[right]=temp;
+
+		const float pivot=gravity->attractor[order[right]]->position.v[axis];
+		uint32_t store=left;
+
+		for(uint32_t i=left;i<right;i++)
+		{
+			if(gravity->attractor[order[i]]->position.v[axis]<pivot)
+			{
+				temp=order[i];
+				order[i]=order[store];
+				order[store++]=temp;
+			}
+		}
+
+		temp=order[store];
+		order[store]=order[right];
+		order[right]=temp;
+
+		if(store==middle)
+			break;
+		else if(store<middle)
+			left=store+1;
+		else
+			right=store-1;
+	}
+}
+
+static uint32_t GravityBuildNode(PhysicsGravity_t *gravity, uint32_t first, uint32_t count)
+{
+	const uint32_t index=gravity->numNodes++;
+	PhysicsGravityNode_t *node=&gravity->nodes[index];
+
+	node->first=first;
+	node->count=count;
+	node->children[0]=UINT32_MAX;
+	node->children[1]=UINT32_MAX;
+
+	// Gravity weighted center, plain average if it all cancels out
+	vec3 weighted=Vec3b(0.0f), average=Vec3b(0.0f);
+	vec3 boundsMin=Vec3b(FLT_MAX), boundsMax=Vec3b(-FLT_MAX);
+
+	node->baseGravity=0.0f;
+	node->minInfluence=FLT_MAX;
+	node->maxInfluence=0.0f;
+
+	for(uint32_t i=first;i<first+count;i++)
+	{
+		const uint32_t attractor=gravity->order[i];
+		const vec3 position=gravity->attractor[attractor]->position;
+
+		weighted=Vec3_Addv(weighted, Vec3_Muls(position, gravity->baseGravity[attractor]));
+		average=Vec3_Addv(average, position);
+		node->baseGravity+=gravity->baseGravity[attractor];
+		node->minInfluence=fminf(node->minInfluence, gravity->influenceRadius[attractor]);
+		node->maxInfluence=fmaxf(node->maxInfluence, gravity->influenceRadius[attractor]);
+
+		for(uint32_t j=0;j<3;j++)
+		{
+			boundsMin.v[j]=fminf(boundsMin.v[j], position.v[j]);
+			boundsMax.v[j]=fmaxf(boundsMax.v[j], position.v[j]);
+		}
+	}
+
+	if(fabsf(node->baseGravity)>FLT_EPSILON)
+		node->center=Vec3_Muls(weighted, 1.0f/node->baseGravity);
+	else
+		node->center=Vec3_Muls(average, 1.0f/count);
+
+	node->radius=0.0f;
+
+	for(uint32_t i=first;i<first+count;i++)
+	{
+		const RigidBody_t *body=gravity->attractor[gravity->order[i]];
+		node->radius=fmaxf(node->radius, Vec3_Distance(node->center, body->position)+PhysicsBoundingRadius(body));
+	}
+
+	if(count<=PHYSICS_GRAVITY_LEAF_SIZE)
+		return index;
+
+	// Split at the median along the widest axis
+	const vec3 extent=Vec3_Subv(boundsMax, boundsMin);
+	uint32_t axis=0;
+
+	if(extent.y>extent.v[axis])
+		axis=1;
+
+	if(extent.z>extent.v[axis])
+		axis=2;
+
+	GravitySelectMedian(gravity, first, count, axis);
+
+	const uint32_t half=count/2;
+
+	// Children are built after this node, so the pointer can't be used past here
+	const uint32_t left=GravityBuildNode(gravity, first, half);
+	const uint32_t right=GravityBuildNode(gravity, first+half, count-half);
+
+	gravity->nodes[index].children[0]=left;
+	gravity->nodes[index].children[1]=right;
+
+	return index;
+}
+
+void PhysicsGravity_Build(PhysicsGravity_t *gravity)
+{
+	gravity->numNodes=0;
+
+	if(gravity->numAttractors>0)
+		GravityBuildNode(gravity, 0, gravity->numAttractors);
+}
+
+static void GravityAddInteraction(PhysicsGravity_t *gravity, RigidBodyType_e type, RigidBody_t *body, uint32_t source)
+{
+	if(gravity->numInteractions[type]>=PHYSICS_MAX_GRAVITY_INTERACTIONS)
+	{
+		gravity->overflow++;
+		return;
+	}
+
+	const uint32_t index=gravity->numInteractions[type]++;
+
+	gravity->interactionBody[type][index]=body;
+	gravity->interactionSource[type][index]=source;
+}
+
+// Walks the attractor tree for one body, gathering the interactions that can reach it
+void PhysicsGravity_Gather(PhysicsGravity_t *gravity, RigidBody_t *body)
+{
+	if(gravity->numNodes==0)
+		return;
+
+	// Balanced tree over at most PHYSICS_MAX_ATTRACTORS, the stack never gets near this
+	uint32_t stack[64];
+	uint32_t stackSize=0;
+
+	stack[stackSize++]=0;
+
+	while(stackSize>0)
+	{
+		const uint32_t nodeIndex=stack[--stackSize];
+		const PhysicsGravityNode_t *node=&gravity->nodes[nodeIndex];
+		const float distance=Vec3_Distance(body->position, node->center);
+
+		// Out of reach of everything below
+		if(distance-node->radius>node->maxInfluence)
+			continue;
+
+		// Far field, small for its distance and every attractor in it pulls at full strength
+		if(node->count>1&&node->radius<PHYSICS_GRAVITY_OPENING_ANGLE*distance&&distance+node->radius<=0.8f*node->minInfluence)
+		{
+			GravityAddInteraction(gravity, RIGIDBODY_SPHERE, body, nodeIndex|PHYSICS_GRAVITY_NODE);
+			continue;
+		}
+
+		if(node->children[0]==UINT32_MAX)
+		{
+			for(uint32_t i=node->first;i<node->first+node->count;i++)
+			{
+				const uint32_t attractor=gravity->order[i];
+				const RigidBody_t *attractorBody=gravity->attractor[attractor];
+
+				// Don't calculate against self
+				if(attractorBody==body)
+					continue;
+
+				if(Vec3_Distance(body->position, attractorBody->position)-PhysicsBoundingRadius(attractorBody)>gravity->influenceRadius[attractor])
+					continue;
+
+				GravityAddInteraction(gravity, attractorBody->type, body, attractor);
+			}
+
+			continue;
+		}
+
+		if(stackSize+2<=sizeof(stack)/sizeof(stack[0]))
+		{
+			stack[stackSize++]=node->children[0];
+			stack[stackSize++]=node->children[1];
+		}
+	}
+}
+
+// Same falloff as the single attractor functions, full strength out to 80% of the influence radius and smoothstepped to nothing at the edge
+static inline float4_t GravityFalloff4(const float4_t distance, const float4_t baseGravity, const float4_t influenceRadius)
+{
+	const float4_t falloffStart=Float4_Muls(influenceRadius, 0.8f);
+	float4_t t=Float4_Div(Float4_Sub(influenceRadius, distance), Float4_Sub(influenceRadius, falloffStart));
+
+	t=Float4_Max(Float4_Set1(0.0f), Float4_Min(t, Float4_Set1(1.0f)));
+
+	return Float4_Mul(baseGravity, Float4_Mul(Float4_Mul(t, t), Float4_Sub(Float4_Set1(3.0f), Float4_Muls(t, 2.0f))));
+}
+
+// Pull for 4 interactions, one lane each
+typedef struct
+{
+	float direction[3][4];
+	float strength[4];
+	float distance[4];	// Distance the direction was normalized by, lanes at or under FLT_EPSILON need their direction fixed up
+} GravityLanes_t;
+
+static void GravityApplyLane(RigidBody_t *body, const GravityLanes_t *out, const uint32_t lane, const float dt)
+{
+	const vec3 direction=Vec3(out->direction[0][lane], out->direction[1][lane], out->direction[2][lane]);
+
+	body->force=Vec3_Addv(body->force, Vec3_Muls(direction, out->strength[lane]*dt));
+}
+
+static void GravitySphereBatch(PhysicsGravity_t *gravity, const float dt)
+{
+	const uint32_t count=gravity->numInteractions[RIGIDBODY_SPHERE];
+	RigidBody_t **bodies=gravity->interactionBody[RIGIDBODY_SPHERE];
+	const uint32_t *sources=gravity->interactionSource[RIGIDBODY_SPHERE];
+
+	for(uint32_t i=0;i<count;i+=4)
+	{
+		const uint32_t lanes=min(4, count-i);
+		float position[3][4], center[3][4], radius[4], baseGravity[4], influenceRadius[4];
+
+		for(uint32_t j=0;j<4;j++)
+		{
+			const uint32_t index=i+min(j, lanes-1);
+			const uint32_t source=sources[index];
+
+			if(source&PHYSICS_GRAVITY_NODE)
+			{
+				// Far field node, a point that's known to be inside everyone's full strength range
+				const PhysicsGravityNode_t *node=&gravity->nodes[source&~PHYSICS_GRAVITY_NODE];
+
+				for(uint32_t k=0;k<3;k++)
+					center[k][j]=node->center.v[k];
+
+				radius[j]=0.0f;
+				baseGravity[j]=node->baseGravity;
+				influenceRadius[j]=node->minInfluence;
+			}
+			else
+			{
+				for(uint32_t k=0;k<3;k++)
+					center[k][j]=gravity->attractor[source]->position.v[k];
+
+				radius[j]=gravity->attractor[source]->radius;
+				baseGravity[j]=gravity->baseGravity[source];
+				influenceRadius[j]=gravity->influenceRadius[source];
+			}
+
+			for(uint32_t k=0;k<3;k++)
+				position[k][j]=bodies[index]->position.v[k];
+		}
+
+		const float4_t tx=Float4_Sub(Float4_Load(center[0]), Float4_Load(position[0]));
+		const float4_t ty=Float4_Sub(Float4_Load(center[1]), Float4_Load(position[1]));
+		const float4_t tz=Float4_Sub(Float4_Load(center[2]), Float4_Load(position[2]));
+
+		const float4_t distanceToCenter=Float4_Sqrt(Float4_Add(Float4_Add(Float4_Mul(tx, tx), Float4_Mul(ty, ty)), Float4_Mul(tz, tz)));
+		const float4_t distance=Float4_Max(Float4_Sub(distanceToCenter, Float4_Load(radius)), Float4_Set1(0.0f));
+		const float4_t invDistance=Float4_Div(Float4_Set1(1.0f), Float4_Max(distanceToCenter, Float4_Set1(FLT_EPSILON)));
+
+		GravityLanes_t out;
+		Float4_Store(out.direction[0], Float4_Mul(tx, invDistance));
+		Float4_Store(out.direction[1], Float4_Mul(ty, invDistance));
+		Float4_Store(out.direction[2], Float4_Mul(tz, invDistance));
+		Float4_Store(out.strength, GravityFalloff4(distance, Float4_Load(baseGravity), Float4_Load(influenceRadius)));
+		Float4_Store(out.distance, distanceToCenter);
+
+		for(uint32_t j=0;j<lanes;j++)
+		{
+			// At the center, pull up like the scalar version
+			if(out.distance[j]<=FLT_EPSILON)
+			{
+				out.direction[0][j]=0.0f;
+				out.direction[1][j]=1.0f;
+				out.direction[2][j]=0.0f;
+			}
+
+			GravityApplyLane(bodies[i+j], &out, j, dt);
+		}
+	}
+}
+
+// Axes of 4 orientations, normalized first as QuatRotate does
+static void GravityAxes4(const float orientation[4][4], float4_t axes[3][3])
+{
+	float4_t qx=Float4_Load(orientation[0]), qy=Float4_Load(orientation[1]), qz=Float4_Load(orientation[2]), qw=Float4_Load(orientation[3]);
+	const float4_t invLength=Float4_Div(Float4_Set1(1.0f), Float4_Sqrt(Float4_Add(Float4_Add(Float4_Mul(qx, qx), Float4_Mul(qy, qy)), Float4_Add(Float4_Mul(qz, qz), Float4_Mul(qw, qw)))));
+
+	qx=Float4_Mul(qx, invLength);
+	qy=Float4_Mul(qy, invLength);
+	qz=Float4_Mul(qz, invLength);
+	qw=Float4_Mul(qw, invLength);
+
+	const float4_t one=Float4_Set1(1.0f);
+	const float4_t xx=Float4_Mul(qx, qx), yy=Float4_Mul(qy, qy), zz=Float4_Mul(qz, qz);
+	const float4_t xy=Float4_Mul(qx, qy), xz=Float4_Mul(qx, qz), yz=Float4_Mul(qy, qz);
+	const float4_t wx=Float4_Mul(qw, qx), wy=Float4_Mul(qw, qy), wz=Float4_Mul(qw, qz);
+
+	axes[0][0]=Float4_Sub(one, Float4_Muls(Float4_Add(yy, zz), 2.0f));
+	axes[0][1]=Float4_Muls(Float4_Add(xy, wz), 2.0f);
+	axes[0][2]=Float4_Muls(Float4_Sub(xz, wy), 2.0f);
+	axes[1][0]=Float4_Muls(Float4_Sub(xy, wz), 2.0f);
+	axes[1][1]=Float4_Sub(one, Float4_Muls(Float4_Add(xx, zz), 2.0f));
+	axes[1][2]=Float4_Muls(Float4_Add(yz, wx), 2.0f);
+	axes[2][0]=Float4_Muls(Float4_Add(xz, wy), 2.0f);
+	axes[2][1]=Float4_Muls(Float4_Sub(yz, wx), 2.0f);
+	axes[2][2]=Float4_Sub(one, Float4_Muls(Float4_Add(xx, yy), 2.0f));
+}
+
+static void GravityOBBBatch(PhysicsGravity_t *gravity, const float dt)
+{
+	const uint32_t count=gravity->numInteractions[RIGIDBODY_OBB];
+	RigidBody_t **bodies=gravity->interactionBody[RIGIDBODY_OBB];
+	const uint32_t *sources=gravity->interactionSource[RIGIDBODY_OBB];
+
+	for(uint32_t i=0;i<count;i+=4)
+	{
+		const uint32_t lanes=min(4, count-i);
+		float position[3][4], center[3][4], orientation[4][4], size[3][4], baseGravity[4], influenceRadius[4];
+
+		for(uint32_t j=0;j<4;j++)
+		{
+			const uint32_t index=i+min(j, lanes-1);
+			const RigidBody_t *attractor=gravity->attractor[sources[index]];
+
+			for(uint32_t k=0;k<3;k++)
+			{
+				position[k][j]=bodies[index]->position.v[k];
+				center[k][j]=attractor->position.v[k];
+				size[k][j]=attractor->size.v[k];
+			}
+
+			for(uint32_t k=0;k<4;k++)
+				orientation[k][j]=attractor->orientation.v[k];
+
+			baseGravity[j]=gravity->baseGravity[sources[index]];
+			influenceRadius[j]=gravity->influenceRadius[sources[index]];
+		}
+
+		float4_t axes[3][3];
+		GravityAxes4(orientation, axes);
+
+		const float4_t cx=Float4_Load(center[0]), cy=Float4_Load(center[1]), cz=Float4_Load(center[2]);
+		const float4_t px=Float4_Load(position[0]), py=Float4_Load(position[1]), pz=Float4_Load(position[2]);
+		const float4_t rx=Float4_Sub(px, cx), ry=Float4_Sub(py, cy), rz=Float4_Sub(pz, cz);
+
+		// Closest point on the box
+		float4_t closestX=cx, closestY=cy, closestZ=cz;
+
+		for(uint32_t k=0;k<3;k++)
+		{
+			const float4_t extent=Float4_Load(size[k]);
+			const float4_t local=Float4_Add(Float4_Add(Float4_Mul(rx, axes[k][0]), Float4_Mul(ry, axes[k][1])), Float4_Mul(rz, axes[k][2]));
+			const float4_t clamped=Float4_Max(Float4_Sub(Float4_Set1(0.0f), extent), Float4_Min(local, extent));
+
+			closestX=Float4_Add(closestX, Float4_Mul(axes[k][0], clamped));
+			closestY=Float4_Add(closestY, Float4_Mul(axes[k][1], clamped));
+			closestZ=Float4_Add(closestZ, Float4_Mul(axes[k][2], clamped));
+		}
+
+		const float4_t tx=Float4_Sub(closestX, px), ty=Float4_Sub(closestY, py), tz=Float4_Sub(closestZ, pz);
+		const float4_t distance=Float4_Sqrt(Float4_Add(Float4_Add(Float4_Mul(tx, tx), Float4_Mul(ty, ty)), Float4_Mul(tz, tz)));
+		const float4_t invDistance=Float4_Div(Float4_Set1(1.0f), Float4_Max(distance, Float4_Set1(FLT_EPSILON)));
+
+		GravityLanes_t out;
+		Float4_Store(out.direction[0], Float4_Mul(tx, invDistance));
+		Float4_Store(out.direction[1], Float4_Mul(ty, invDistance));
+		Float4_Store(out.direction[2], Float4_Mul(tz, invDistance));
+		Float4_Store(out.strength, GravityFalloff4(distance, Float4_Load(baseGravity), Float4_Load(influenceRadius)));
+		Float4_Store(out.distance, distance);
+
+		for(uint32_t j=0;j<lanes;j++)
+		{
+			RigidBody_t *body=bodies[i+j];
+
+			// Inside the box, the scalar version picks the nearest face
+			if(out.distance[j]<=FLT_EPSILON)
+			{
+				const uint32_t source=sources[i+j];
+				const RigidBody_t *attractor=gravity->attractor[source];
+				const vec3 pull=AttractorOBBComputeGravity(body->position, attractor->position, attractor->size, attractor->orientation, gravity->baseGravity[source], gravity->influenceRadius[source]);
+
+				body->force=Vec3_Addv(body->force, Vec3_Muls(pull, dt));
+				continue;
+			}
+
+			GravityApplyLane(body, &out, j, dt);
+		}
+	}
+}
+
+static void GravityCapsuleBatch(PhysicsGravity_t *gravity, const float dt)
+{
+	const uint32_t count=gravity->numInteractions[RIGIDBODY_CAPSULE];
+	RigidBody_t **bodies=gravity->interactionBody[RIGIDBODY_CAPSULE];
+	const uint32_t *sources=gravity->interactionSource[RIGIDBODY_CAPSULE];
+
+	for(uint32_t i=0;i<count;i+=4)
+	{
+		const uint32_t lanes=min(4, count-i);
+		float position[3][4], center[3][4], orientation[4][4], radius[4], halfHeight[4], baseGravity[4], influenceRadius[4];
+
+		for(uint32_t j=0;j<4;j++)
+		{
+			const uint32_t index=i+min(j, lanes-1);
+			const RigidBody_t *attractor=gravity->attractor[sources[index]];
+
+			for(uint32_t k=0;k<3;k++)
+			{
+				position[k][j]=bodies[index]->position.v[k];
+				center[k][j]=attractor->position.v[k];
+			}
+
+			for(uint32_t k=0;k<4;k++)
+				orientation[k][j]=attractor->orientation.v[k];
+
+			radius[j]=attractor->radiusHeight.x;
+			halfHeight[j]=attractor->radiusHeight.y;
+			baseGravity[j]=gravity->baseGravity[sources[index]];
+			influenceRadius[j]=gravity->influenceRadius[sources[index]];
+		}
+
+		float4_t axes[3][3];
+		GravityAxes4(orientation, axes);
+
+		// Closest point on the capsule's segment, which runs along its local Y
+		const float4_t h=Float4_Load(halfHeight);
+		const float4_t startX=Float4_Sub(Float4_Load(center[0]), Float4_Mul(axes[1][0], h));
+		const float4_t startY=Float4_Sub(Float4_Load(center[1]), Float4_Mul(axes[1][1], h));
+		const float4_t startZ=Float4_Sub(Float4_Load(center[2]), Float4_Mul(axes[1][2], h));
+		const float4_t segmentX=Float4_Mul(axes[1][0], Float4_Add(h, h));
+		const float4_t segmentY=Float4_Mul(axes[1][1], Float4_Add(h, h));
+		const float4_t segmentZ=Float4_Mul(axes[1][2], Float4_Add(h, h));
+		const float4_t segmentLengthSq=Float4_Add(Float4_Add(Float4_Mul(segmentX, segmentX), Float4_Mul(segmentY, segmentY)), Float4_Mul(segmentZ, segmentZ));
+
+		const float4_t px=Float4_Load(position[0]), py=Float4_Load(position[1]), pz=Float4_Load(position[2]);
+		const float4_t along=Float4_Add(Float4_Add(Float4_Mul(Float4_Sub(px, startX), segmentX), Float4_Mul(Float4_Sub(py, startY), segmentY)), Float4_Mul(Float4_Sub(pz, startZ), segmentZ));
+		float4_t t=Float4_Div(along, Float4_Max(segmentLengthSq, Float4_Set1(FLT_EPSILON)));
+
+		t=Float4_Max(Float4_Set1(0.0f), Float4_Min(t, Float4_Set1(1.0f)));
+
+		const float4_t tx=Float4_Sub(Float4_Add(startX, Float4_Mul(segmentX, t)), px);
+		const float4_t ty=Float4_Sub(Float4_Add(startY, Float4_Mul(segmentY, t)), py);
+		const float4_t tz=Float4_Sub(Float4_Add(startZ, Float4_Mul(segmentZ, t)), pz);
+
+		const float4_t distanceToClosest=Float4_Sqrt(Float4_Add(Float4_Add(Float4_Mul(tx, tx), Float4_Mul(ty, ty)), Float4_Mul(tz, tz)));
+		const float4_t distance=Float4_Max(Float4_Sub(distanceToClosest, Float4_Load(radius)), Float4_Set1(0.0f));
+		const float4_t invDistance=Float4_Div(Float4_Set1(1.0f), Float4_Max(distanceToClosest, Float4_Set1(FLT_EPSILON)));
+
+		GravityLanes_t out;
+		Float4_Store(out.direction[0], Float4_Mul(tx, invDistance));
+		Float4_Store(out.direction[1], Float4_Mul(ty, invDistance));
+		Float4_Store(out.direction[2], Float4_Mul(tz, invDistance));
+		Float4_Store(out.strength, GravityFalloff4(distance, Float4_Load(baseGravity), Float4_Load(influenceRadius)));
+		Float4_Store(out.distance, distanceToClosest);
+
+		for(uint32_t j=0;j<lanes;j++)
+		{
+			// On the segment, pull up like the scalar version
+			if(out.distance[j]<=FLT_EPSILON)
+			{
+				out.direction[0][j]=0.0f;
+				out.direction[1][j]=1.0f;
+				out.direction[2][j]=0.0f;
+			}
+
+			GravityApplyLane(bodies[i+j], &out, j, dt);
+		}
+	}
+}
+
+// Evaluates everything gathered this step and adds it to the bodies' forces
+void PhysicsGravity_Apply(PhysicsGravity_t *gravity, const float dt)
+{
+	GravitySphereBatch(gravity, dt);
+	GravityOBBBatch(gravity, dt);
+	GravityCapsuleBatch(gravity, dt);
+}
@@ -0,0 +1,251 @@
+#include <float.h>
+#include "../math/math.h"
+#include "physics.h"
+
+// Gap at which a swept body counts as touching
+#define CCD_TOLERANCE (0.005f*WORLD_SCALE)
+// Refinement steps from the swept shape's first contact to the body's, usually done in one or two
+#define CCD_MAX_ADVANCE_ITERATIONS 8
+
+// Radius of a sphere around the body's center that contains its whole shape
+float PhysicsBoundingRadius(const RigidBody_t *body)
+{
+	if(body->type==RIGIDBODY_OBB)
+		return Vec3_Length(body->size);
+	else if(body->type==RIGIDBODY_CAPSULE)
+		return body->radius+body->size.y;
+
+	return body->radius;
+}
+
+// Flagged bodies always get swept, anything else once it moves more than half its size in a step
+bool PhysicsNeedsCCD(const RigidBody_t *body, const float dt)
+{
+	if(body->asleep)
+		return false;
+
+	if(body->ccd)
+		return true;
+
+	const float radius=PhysicsBoundingRadius(body);
+
+	return Vec3_LengthSq(body->velocity)*dt*dt>0.25f*radius*radius;
+}
+
+// Bounds covering the last step's motion (for time of impact) and the next step's (for speculative contacts)
+aabb PhysicsSweptBounds(const RigidBody_t *body, const float dt)
+{
+	const float radius=PhysicsBoundingRadius(body);
+	const vec3 next=Vec3_Addv(body->position, Vec3_Muls(body->velocity, dt));
+
+	const vec3 min=Vec3(
+		fminf(fminf(body->prevPosition.x, body->position.x), next.x),
+		fminf(fminf(body->prevPosition.y, body->position.y), next.y),
+		fminf(fminf(body->prevPosition.z, body->position.z), next.z)
+	);
+	const vec3 max=Vec3(
+		fmaxf(fmaxf(body->prevPosition.x, body->position.x), next.x),
+		fmaxf(fmaxf(body->prevPosition.y, body->position.y), next.y),
+		fmaxf(fmaxf(body->prevPosition.z, body->position.z), next.z)
+	);
+
+	return (aabb) { Vec3_Subs(min, radius), Vec3_Adds(max, radius) };
+}
+
+// Earliest time (0..1) a sphere moving from start by motion touches a sphere, returns FLT_MAX on a miss
+static float SweptSphereSphere(const vec3 start, const vec3 motion, const float radius, const vec3 center, const float otherRadius)
+{
+	const vec3 m=Vec3_Subv(start, center);
+	const float r=radius+otherRadius;
+	const float c=Vec3_Dot(m, m)-r*r;
+
+	// Already touching at the start
+	if(c<=0.0f)
+		return 0.0f;
+
+	const float a=Vec3_Dot(motion, motion);
+	const float b=Vec3_Dot(m, motion);
+
+	// Not moving, or moving away
+	if(a<=FLT_EPSILON||b>=0.0f)
+		return FLT_MAX;
+
+	const float discriminant=b*b-a*c;
+
+	if(discriminant<0.0f)
+		return FLT_MAX;
+
+	const float t=(-b-sqrtf(discriminant))/a;
+
+	return t<=1.0f?t:FLT_MAX;
+}
+
+// Slab test of the moving sphere against the box grown by the sphere's radius.
+// Rounded corners are treated as square, so this can report a hit slightly early near edges, never late.
+static float SweptSphereOBB(const vec3 start, const vec3 motion, const float radius, const RigidBody_t *obb)
+{
+	const vec4 invOrientation=QuatInverse(obb->orientation);
+	const vec3 localStart=QuatRotate(invOrientation, Vec3_Subv(start, obb->position));
+	const vec3 localMotion=QuatRotate(invOrientation, motion);
+	const vec3 extents=Vec3_Adds(obb->size, radius);
+
+	float tMin=0.0f, tMax=1.0f;
+
+	for(uint32_t i=0;i<3;i++)
+	{
+		if(fabsf(localMotion.v[i])<FLT_EPSILON)
+		{
+			if(localStart.v[i]<-extents.v[i]||localStart.v[i]>extents.v[i])
+				return FLT_MAX;
+
+			continue;
+		}
+
+		const float invMotion=1.0f/localMotion.v[i];
+		float t0=(-extents.v[i]-localStart.v[i])*invMotion;
+		float t1=(extents.v[i]-localStart.v[i])*invMotion;
+
+		if(t0>t1)
+		{
+			const float temp=t0;
+			t0=t1;
+			t1=temp;
+		}
+
+		tMin=fmaxf(tMin, t0);
+		tMax=fminf(tMax, t1);
+
+		if(tMin>tMax)
+			return FLT_MAX;
+	}
+
+	return tMin;
+}
+
+static float SweptTimeOfImpact(const vec3 start, const vec3 motion, const float radius, const RigidBody_t *other)
+{
+	if(other->type==RIGIDBODY_OBB)
+		return SweptSphereOBB(start, motion, radius, other);
+
+	// Capsules are swept as their bounding sphere, which errs early
+	return SweptSphereSphere(start, motion, radius, other->position, PhysicsBoundingRadius(other));
+}
+
+// Closest feature contact from a sphere to another body, normal points from the sphere to the other body.
+// Penetration is negative when they're apart. Fails if the sphere's center is inside the other's core, which the discrete test handles.
+static bool SphereClosestContact(const vec3 center, const float radius, const RigidBody_t *other, ContactPoint_t *contact)
+{
+	vec3 closest=other->position;
+	float otherRadius=0.0f;
+
+	if(other->type==RIGIDBODY_SPHERE)
+		otherRadius=other->radius;
+	else if(other->type==RIGIDBODY_OBB)
+	{
+		vec3 axes[3];
+		QuatAxes(other->orientation, axes);
+
+		const vec3 relativeCenter=Vec3_Subv(center, other->position);
+
+		for(uint32_t i=0;i<3;i++)
+			closest=Vec3_Addv(closest, Vec3_Muls(axes[i], clampf(Vec3_Dot(relativeCenter, axes[i]), -other->size.v[i], other->size.v[i])));
+	}
+	else if(other->type==RIGIDBODY_CAPSULE)
+	{
+		vec3 axes[3];
+		QuatAxes(other->orientation, axes);
+
+		const float along=clampf(Vec3_Dot(Vec3_Subv(center, other->position), axes[1]), -other->size.y, other->size.y);
+
+		closest=Vec3_Addv(other->position, Vec3_Muls(axes[1], along));
+		otherRadius=other->radius;
+	}
+
+	vec3 normal=Vec3_Subv(closest, center);
+	const float distance=Vec3_Normalize(&normal);
+
+	if(distance<FLT_EPSILON)
+		return false;
+
+	contact->normal=normal;
+	contact->position=Vec3_Subv(closest, Vec3_Muls(normal, otherRadius));
+	contact->penetration=radius+otherRadius-distance;
+
+	return true;
+}
+
+// Collision for pairs where at least one body needs CCD.
+// Overlaps are handled by the discrete test as usual, otherwise the fast body (as its bounding sphere) is swept over the last step
+//   against the other body held at its end position, and pulled back to the time of impact if it passed through something.
+// Failing that, a speculative contact is made if the gap will close within the next step, the solver then only lets it close that far.
+uint32_t PhysicsSweptCollision(PhysicsContactStream_t *stream, RigidBody_t *a, RigidBody_t *b, uint32_t userA, uint32_t userB, const float dt)
+{
+	const uint32_t contactCount=PhysicsCollision(stream, a, b, userA, userB);
+
+	if(contactCount>0)
+		return contactCount;
+
+	const bool sweepA=PhysicsNeedsCCD(a, dt);
+	RigidBody_t *sweeper=sweepA?a:b;
+	const RigidBody_t *other=sweepA?b:a;
+	const float radius=PhysicsBoundingRadius(sweeper);
+
+	// Motion relative to the other body, which stays where it ended up
+	const vec3 start=Vec3_Addv(other->position, Vec3_Subv(sweeper->prevPosition, other->prevPosition));
+	const vec3 motion=Vec3_Subv(Vec3_Subv(sweeper->position, sweeper->prevPosition), Vec3_Subv(other->position, other->prevPosition));
+
+	ContactPoint_t contact;
+	float t=SweptTimeOfImpact(start, motion, radius, other);
+
+	if(t<=1.0f)
+	{
+		// The sweep tests are a lower bound (bounding sphere, square corners), so close in on the real time of impact by
+		//   conservative advancement, the gap at any time is how far the body can safely move before it could touch
+		const float motionLength=Vec3_Length(motion);
+		bool touching=false;
+
+		for(uint32_t i=0;i<CCD_MAX_ADVANCE_ITERATIONS&&t<=1.0f;i++)
+		{
+			if(!SphereClosestContact(Vec3_Addv(start, Vec3_Muls(motion, t)), radius, other, &contact)||contact.penetration>-CCD_TOLERANCE)
+			{
+				touching=true;
+				break;
+			}
+
+			t+=-contact.penetration/motionLength;
+		}
+
+		if(touching)
+		{
+			// Passed through during the last step, so back up to where it first touched
+			sweeper->position=Vec3_Addv(start, Vec3_Muls(motion, t));
+
+			if(!SphereClosestContact(sweeper->position, radius, other, &contact))
+				return 0;
+
+			contact.penetration=fmaxf(contact.penetration, 0.0f);
+			t=0.0f;
+		}
+		else
+			t=FLT_MAX;
+	}
+
+	if(t>1.0f)
+	{
+		if(!SphereClosestContact(sweeper->position, radius, other, &contact))
+			return 0;
+
+		const float closingSpeed=Vec3_Dot(Vec3_Subv(sweeper->velocity, other->velocity), contact.normal);
+
+		if(closingSpeed*dt<=-contact.penetration)
+			return 0;
+	}
+
+	// Contact normals point from a to b
+	if(!sweepA)
+		contact.normal=Vec3_Muls(contact.normal, -1.0f);
+
+	PhysicsContactStream_BeginPair(stream)[0]=contact;
+
+	return PhysicsContactStream_EndPair(stream, a, b, userA, userB, 1);
+}
@@ -1,14 +1,15 @@
 #include <float.h>
 #include "physics.h"
+#include "../math/simd.h"
 
-static CollisionManifold_t SphereToSphereCollision(RigidBody_t *a, RigidBody_t *b)
+static uint32_t SphereToSphereCollision(PhysicsContactStream_t *stream, RigidBody_t *a, RigidBody_t *b, uint32_t userA, uint32_t userB)
 {
 	const vec3 relativePosition=Vec3_Subv(b->position, a->position);
 	const float distanceSq=Vec3_LengthSq(relativePosition);
 	const float radiiSum=a->radius+b->radius;
 
 	if(distanceSq>radiiSum*radiiSum)
-		return (CollisionManifold_t) { 0 };
+		return 0;
 
 	// Penetration
 	const float distance=fmaxf(sqrtf(distanceSq), FLT_EPSILON);
@@ -20,18 +21,15 @@ static CollisionManifold_t SphereToSphereCollision(RigidBody_t *a, RigidBody_t *
 	// Contact point
 	const vec3 contact=Vec3_Addv(a->position, Vec3_Muls(normal, a->radius-penetration*0.5f));
 
-	CollisionManifold_t manifold;
-	manifold.a=a;
-	manifold.b=b;
-	manifold.contacts[0].position=contact;
-	manifold.contacts[0].normal=normal;
-	manifold.contacts[0].penetration=penetration;
-	manifold.contactCount=1;
+	ContactPoint_t *contacts=PhysicsContactStream_BeginPair(stream);
+	contacts[0].position=contact;
+	contacts[0].normal=normal;
+	contacts[0].penetration=penetration;
 
-	return manifold;
+	return PhysicsContactStream_EndPair(stream, a, b, userA, userB, 1);
 }
 
-static CollisionManifold_t SphereToOBBCollision(RigidBody_t *sphere, RigidBody_t *obb)
+static uint32_t SphereToOBBCollision(PhysicsContactStream_t *stream, RigidBody_t *sphere, RigidBody_t *obb, uint32_t userSphere, uint32_t userOBB)
 {
 	vec3 axes[3];
 	QuatAxes(obb->orientation, axes);
@@ -48,7 +46,7 @@ static CollisionManifold_t SphereToOBBCollision(RigidBody_t *sphere, RigidBody_t
 	if(distanceSq>sphere->radius*sphere->radius)
 	{
 		// No collision
-		return (CollisionManifold_t) { 0 };
+		return 0;
 	}
 
 	// Penetration
@@ -61,15 +59,12 @@ static CollisionManifold_t SphereToOBBCollision(RigidBody_t *sphere, RigidBody_t
 	// Contact point
 	const vec3 contact=Vec3_Subv(closestPoint, Vec3_Muls(normal, penetration*0.5f));
 
-	CollisionManifold_t manifold;
-	manifold.b=sphere;
-	manifold.a=obb;
-	manifold.contacts[0].position=contact;
-	manifold.contacts[0].normal=normal;
-	manifold.contacts[0].penetration=penetration;
-	manifold.contactCount=1;
+	ContactPoint_t *contacts=PhysicsContactStream_BeginPair(stream);
+	contacts[0].position=contact;
+	contacts[0].normal=normal;
+	contacts[0].penetration=penetration;
 
-	return manifold;
+	return PhysicsContactStream_EndPair(stream, obb, sphere, userOBB, userSphere, 1);
 }
 
 static uint32_t ClipPolygon(const vec3 *in, uint32_t inCount, vec3 *out, uint32_t maxOut, vec3 planeNormal, float planeDist)
@@ -131,34 +126,34 @@ static bool TestCrossSATAxis(vec3 edgeA, vec3 edgeB, const vec3 axesA[3], vec3 s
     return TestSATAxis(axis, axesA, sA, axesB, sB, relPos, axisIndex, penetration, normal, minAxisIndex);
 }
 
-static void ReduceManifoldContacts(CollisionManifold_t *m)
+static uint32_t ReduceManifoldContacts(ContactPoint_t *contacts, uint32_t count)
 {
-	if(m->contactCount<=4)
-		return;
+	if(count<=4)
+		return count;
 
 	// Keep the deepest penetration first.
 	uint32_t bestIndex=0;
 
-	for(uint32_t i=1;i<m->contactCount;i++)
+	for(uint32_t i=1;i<count;i++)
 	{
-		if(m->contacts[i].penetration>m->contacts[bestIndex].penetration)
+		if(contacts[i].penetration>contacts[bestIndex].penetration)
 			bestIndex=i;
 	}
 
-	ContactPoint_t reduced[4]={ m->contacts[bestIndex] };
-	m->contacts[bestIndex]=m->contacts[--m->contactCount];
+	ContactPoint_t reduced[4]={ contacts[bestIndex] };
+	contacts[bestIndex]=contacts[--count];
 
 	// Greedily pick the point farthest from the current set.
 	uint32_t reducedCount=1;
 
-	while(reducedCount<4&&m->contactCount>0)
+	while(reducedCount<4&&count>0)
 	{
 		float bestDistance=-1.0f;
 		uint32_t bestCandidate=0;
 
-		for(uint32_t i=0;i<m->contactCount;i++)
+		for(uint32_t i=0;i<count;i++)
 		{
-			const vec3 candidatePos=m->contacts[i].position;
+			const vec3 candidatePos=contacts[i].position;
 			float nearestDistance=FLT_MAX;
 
 			for(uint32_t j=0;j<reducedCount;j++)
@@ -176,19 +171,19 @@ static void ReduceManifoldContacts(CollisionManifold_t *m)
 			}
 		}
 
-		reduced[reducedCount++]=m->contacts[bestCandidate];
-		m->contacts[bestCandidate]=m->contacts[--m->contactCount];
+		reduced[reducedCount++]=contacts[bestCandidate];
+		contacts[bestCandidate]=contacts[--count];
 	}
 
-	m->contactCount=reducedCount;
-
 	for(uint32_t i=0;i<reducedCount;i++)
-		m->contacts[i]=reduced[i];
+		contacts[i]=reduced[i];
+
+	return reducedCount;
 }
 
 #define MAX_CLIP_VERTS 16
 
-static CollisionManifold_t OBBToOBBCollision(RigidBody_t *a, RigidBody_t *b)
+static uint32_t OBBToOBBCollision(PhysicsContactStream_t *stream, RigidBody_t *a, RigidBody_t *b, uint32_t userA, uint32_t userB)
 {
     // Extract axes
     vec3 axesA[3], axesB[3];
@@ -201,22 +196,22 @@ static CollisionManifold_t OBBToOBBCollision(RigidBody_t *a, RigidBody_t *b)
 	vec3 normal=Vec3b(0.0f);
 	uint32_t minAxisIndex=0;
 
-    if(!TestSATAxis(axesA[0], axesA, a->size, axesB, b->size, relPos, 0, &penetration, &normal, &minAxisIndex)) return (CollisionManifold_t) { 0 };
-    if(!TestSATAxis(axesA[1], axesA, a->size, axesB, b->size, relPos, 1, &penetration, &normal, &minAxisIndex)) return (CollisionManifold_t) { 0 };
-    if(!TestSATAxis(axesA[2], axesA, a->size, axesB, b->size, relPos, 2, &penetration, &normal, &minAxisIndex)) return (CollisionManifold_t) { 0 };
-    if(!TestSATAxis(axesB[0], axesA, a->size, axesB, b->size, relPos, 3, &penetration, &normal, &minAxisIndex)) return (CollisionManifold_t) { 0 };
-    if(!TestSATAxis(axesB[1], axesA, a->size, axesB, b->size, relPos, 4, &penetration, &normal, &minAxisIndex)) return (CollisionManifold_t) { 0 };
-    if(!TestSATAxis(axesB[2], axesA, a->size, axesB, b->size, relPos, 5, &penetration, &normal, &minAxisIndex)) return (CollisionManifold_t) { 0 };
-
-	if(!TestCrossSATAxis(axesA[0], axesB[0], axesA, a->size, axesB, b->size, relPos, 6, &penetration, &normal, &minAxisIndex)) return (CollisionManifold_t) { 0 };
-    if(!TestCrossSATAxis(axesA[0], axesB[1], axesA, a->size, axesB, b->size, relPos, 7, &penetration, &normal, &minAxisIndex)) return (CollisionManifold_t) { 0 };
-    if(!TestCrossSATAxis(axesA[0], axesB[2], axesA, a->size, axesB, b->size, relPos, 8, &penetration, &normal, &minAxisIndex)) return (CollisionManifold_t) { 0 };
-    if(!TestCrossSATAxis(axesA[1], axesB[0], axesA, a->size, axesB, b->size, relPos, 9, &penetration, &normal, &minAxisIndex)) return (CollisionManifold_t) { 0 };
-    if(!TestCrossSATAxis(axesA[1], axesB[1], axesA, a->size, axesB, b->size, relPos, 10, &penetration, &normal, &minAxisIndex)) return (CollisionManifold_t) { 0 };
-    if(!TestCrossSATAxis(axesA[1], axesB[2], axesA, a->size, axesB, b->size, relPos, 11, &penetration, &normal, &minAxisIndex)) return (CollisionManifold_t) { 0 };
-    if(!TestCrossSATAxis(axesA[2], axesB[0], axesA, a->size, axesB, b->size, relPos, 12, &penetration, &normal, &minAxisIndex)) return (CollisionManifold_t) { 0 };
-    if(!TestCrossSATAxis(axesA[2], axesB[1], axesA, a->size, axesB, b->size, relPos, 13, &penetration, &normal, &minAxisIndex)) return (CollisionManifold_t) { 0 };
-    if(!TestCrossSATAxis(axesA[2], axesB[2], axesA, a->size, axesB, b->size, relPos, 14, &penetration, &normal, &minAxisIndex)) return (CollisionManifold_t) { 0 };
+    if(!TestSATAxis(axesA[0], axesA, a->size, axesB, b->size, relPos, 0, &penetration, &normal, &minAxisIndex)) return 0;
+    if(!TestSATAxis(axesA[1], axesA, a->size, axesB, b->size, relPos, 1, &penetration, &normal, &minAxisIndex)) return 0;
+    if(!TestSATAxis(axesA[2], axesA, a->size, axesB, b->size, relPos, 2, &penetration, &normal, &minAxisIndex)) return 0;
+    if(!TestSATAxis(axesB[0], axesA, a->size, axesB, b->size, relPos, 3, &penetration, &normal, &minAxisIndex)) return 0;
+    if(!TestSATAxis(axesB[1], axesA, a->size, axesB, b->size, relPos, 4, &penetration, &normal, &minAxisIndex)) return 0;
+    if(!TestSATAxis(axesB[2], axesA, a->size, axesB, b->size, relPos, 5, &penetration, &normal, &minAxisIndex)) return 0;
+
+	if(!TestCrossSATAxis(axesA[0], axesB[0], axesA, a->size, axesB, b->size, relPos, 6, &penetration, &normal, &minAxisIndex)) return 0;
+    if(!TestCrossSATAxis(axesA[0], axesB[1], axesA, a->size, axesB, b->size, relPos, 7, &penetration, &normal, &minAxisIndex)) return 0;
+    if(!TestCrossSATAxis(axesA[0], axesB[2], axesA, a->size, axesB, b->size, relPos, 8, &penetration, &normal, &minAxisIndex)) return 0;
+    if(!TestCrossSATAxis(axesA[1], axesB[0], axesA, a->size, axesB, b->size, relPos, 9, &penetration, &normal, &minAxisIndex)) return 0;
+    if(!TestCrossSATAxis(axesA[1], axesB[1], axesA, a->size, axesB, b->size, relPos, 10, &penetration, &normal, &minAxisIndex)) return 0;
+    if(!TestCrossSATAxis(axesA[1], axesB[2], axesA, a->size, axesB, b->size, relPos, 11, &penetration, &normal, &minAxisIndex)) return 0;
+    if(!TestCrossSATAxis(axesA[2], axesB[0], axesA, a->size, axesB, b->size, relPos, 12, &penetration, &normal, &minAxisIndex)) return 0;
+    if(!TestCrossSATAxis(axesA[2], axesB[1], axesA, a->size, axesB, b->size, relPos, 13, &penetration, &normal, &minAxisIndex)) return 0;
+    if(!TestCrossSATAxis(axesA[2], axesB[2], axesA, a->size, axesB, b->size, relPos, 14, &penetration, &normal, &minAxisIndex)) return 0;
 
 	// No separating axis found
 
@@ -244,15 +239,12 @@ static CollisionManifold_t OBBToOBBCollision(RigidBody_t *a, RigidBody_t *b)
 					Vec3_Muls(axesB[2], (Vec3_Dot(normal, axesB[2])<=0.0f)?b->size.z:-b->size.z)
 		);
 
-        CollisionManifold_t manifold;
-        manifold.a=a;
-        manifold.b=b;
-        manifold.contacts[0].position=Vec3_Muls(Vec3_Addv(pA, pB), 0.5f);
-        manifold.contacts[0].normal=normal;
-        manifold.contacts[0].penetration=penetration;
-        manifold.contactCount=1;
+        ContactPoint_t *contacts=PhysicsContactStream_BeginPair(stream);
+        contacts[0].position=Vec3_Muls(Vec3_Addv(pA, pB), 0.5f);
+        contacts[0].normal=normal;
+        contacts[0].penetration=penetration;
 
-		return manifold;
+		return PhysicsContactStream_EndPair(stream, a, b, userA, userB, 1);
     }
 
     // Face contact
@@ -313,35 +305,33 @@ static CollisionManifold_t OBBToOBBCollision(RigidBody_t *a, RigidBody_t *b)
     const float refFaceDist=Vec3_Dot(ref->position, refFaceNormal)+ref->size.v[refFaceAxis];
 
     count=ClipPolygon(buf0, count, buf1, MAX_CLIP_VERTS, refAxes[rt1], refDotRt1+rs1);
-	if(!count) return (CollisionManifold_t) { 0 };
+	if(!count) return 0;
     count=ClipPolygon(buf1, count, buf0, MAX_CLIP_VERTS, Vec3_Muls(refAxes[rt1], -1.0f), -refDotRt1+rs1);
-	if(!count) return (CollisionManifold_t) { 0 };
+	if(!count) return 0;
     count=ClipPolygon(buf0, count, buf1, MAX_CLIP_VERTS, refAxes[rt2], refDotRt2+rs2);
-    if(!count) return (CollisionManifold_t) { 0 };
+    if(!count) return 0;
     count=ClipPolygon(buf1, count, buf0, MAX_CLIP_VERTS, Vec3_Muls(refAxes[rt2], -1.0f), -refDotRt2+rs2);
-    if(!count) return (CollisionManifold_t) { 0 };
+    if(!count) return 0;
     count=ClipPolygon(buf0, count, buf1, MAX_CLIP_VERTS, refFaceNormal, refFaceDist);
-    if(!count) return (CollisionManifold_t) { 0 };
+    if(!count) return 0;
 
-    CollisionManifold_t manifold;
-    manifold.a=a;
-    manifold.b=b;
-    manifold.contactCount=0;
+    ContactPoint_t *contacts=PhysicsContactStream_BeginPair(stream);
+    uint32_t contactCount=0;
 
-    for(uint32_t i=0;i<count&&manifold.contactCount<MAX_CONTACTS_PER_MANIFOLD;i++)
+    for(uint32_t i=0;i<count&&contactCount<MAX_CONTACTS_PER_MANIFOLD;i++)
     {
-		manifold.contacts[manifold.contactCount].position=buf1[i];
-        manifold.contacts[manifold.contactCount].normal=normal;
-        manifold.contacts[manifold.contactCount].penetration=fmaxf(refFaceDist-Vec3_Dot(buf1[i], refFaceNormal), 0.0f);
-        manifold.contactCount++;
+		contacts[contactCount].position=buf1[i];
+        contacts[contactCount].normal=normal;
+        contacts[contactCount].penetration=fmaxf(refFaceDist-Vec3_Dot(buf1[i], refFaceNormal), 0.0f);
+        contactCount++;
     }
 
-	ReduceManifoldContacts(&manifold);
+	contactCount=ReduceManifoldContacts(contacts, contactCount);
 
-	return manifold;
+	return PhysicsContactStream_EndPair(stream, a, b, userA, userB, contactCount);
 }
 
-static CollisionManifold_t CapsuleToSphereCollision(RigidBody_t *capsule, RigidBody_t *sphere)
+static uint32_t CapsuleToSphereCollision(PhysicsContactStream_t *stream, RigidBody_t *capsule, RigidBody_t *sphere, uint32_t userCapsule, uint32_t userSphere)
 {
 	// Capsule endpoints
 	vec3 axes[3];
@@ -363,7 +353,7 @@ static CollisionManifold_t CapsuleToSphereCollision(RigidBody_t *capsule, RigidB
 	float r=capsule->radius+sphere->radius;
 
 	if(distSq>r*r)
-		return (CollisionManifold_t) { 0 };
+		return 0;
 
 	float dist=fmaxf(sqrtf(distSq), FLT_EPSILON); // Avoid zero for degenerate case
 	float penetration=r-dist;
@@ -371,18 +361,15 @@ static CollisionManifold_t CapsuleToSphereCollision(RigidBody_t *capsule, RigidB
 	vec3 normal=distSq < FLT_EPSILON ? Vec3(0.0f, 1.0f, 0.0f) : Vec3_Muls(delta, 1.0f/dist); // Fallback to world up if coincident
 	vec3 contact=Vec3_Subv(sphere->position, Vec3_Muls(normal, sphere->radius-penetration*0.5f));
 
-	CollisionManifold_t manifold;
-	manifold.a=capsule;
-	manifold.b=sphere;
-	manifold.contacts[0].position=contact;
-	manifold.contacts[0].normal=normal;
-	manifold.contacts[0].penetration=penetration;
-	manifold.contactCount=1;
+	ContactPoint_t *contacts=PhysicsContactStream_BeginPair(stream);
+	contacts[0].position=contact;
+	contacts[0].normal=normal;
+	contacts[0].penetration=penetration;
 
-	return manifold;
+	return PhysicsContactStream_EndPair(stream, capsule, sphere, userCapsule, userSphere, 1);
 }
 
-static CollisionManifold_t CapsuleToCapsuleCollision(RigidBody_t *a, RigidBody_t *b)
+static uint32_t CapsuleToCapsuleCollision(PhysicsContactStream_t *stream, RigidBody_t *a, RigidBody_t *b, uint32_t userA, uint32_t userB)
 {
 	vec3 axes[3], offset;
 
@@ -451,7 +438,7 @@ static CollisionManifold_t CapsuleToCapsuleCollision(RigidBody_t *a, RigidBody_t
 	float rSum=a->radius+b->radius;
 
 	if(distSq>rSum*rSum)
-		return (CollisionManifold_t) { 0 };
+		return 0;
 
 	float dist=fmaxf(sqrtf(distSq), FLT_EPSILON); // Avoid zero for degenerate case
 	float penetration=rSum-dist;
@@ -459,18 +446,15 @@ static CollisionManifold_t CapsuleToCapsuleCollision(RigidBody_t *a, RigidBody_t
 	vec3 normal=distSq < FLT_EPSILON ? Vec3(0.0f, 1.0f, 0.0f) : Vec3_Muls(delta, 1.0f/dist); // Fallback to world up if coincident
 	vec3 contact=Vec3_Muls(Vec3_Addv(pA, pB), 0.5f);
 
-	CollisionManifold_t manifold;
-	manifold.a=a;
-	manifold.b=b;
-	manifold.contacts[0].position=contact;
-	manifold.contacts[0].normal=normal;
-	manifold.contacts[0].penetration=penetration;
-	manifold.contactCount=1;
+	ContactPoint_t *contacts=PhysicsContactStream_BeginPair(stream);
+	contacts[0].position=contact;
+	contacts[0].normal=normal;
+	contacts[0].penetration=penetration;
 
-	return manifold;
+	return PhysicsContactStream_EndPair(stream, a, b, userA, userB, 1);
 }
 
-static CollisionManifold_t CapsuleToOBBCollision(RigidBody_t *capsule, RigidBody_t *obb)
+static uint32_t CapsuleToOBBCollision(PhysicsContactStream_t *stream, RigidBody_t *capsule, RigidBody_t *obb, uint32_t userCapsule, uint32_t userOBB)
 {
 	// Capsule endpoints
 	vec3 capAxes[3];
@@ -561,7 +545,7 @@ static CollisionManifold_t CapsuleToOBBCollision(RigidBody_t *capsule, RigidBody
 	float distSq=Vec3_LengthSq(Vec3_Subv(pLocal, closestLocal));
 
 	if(distSq>capsule->radius*capsule->radius||distSq<FLT_EPSILON)
-		return (CollisionManifold_t) { 0 };
+		return 0;
 
 	float dist=sqrtf(distSq);
 	float penetration=capsule->radius-dist;
@@ -580,37 +564,349 @@ static CollisionManifold_t CapsuleToOBBCollision(RigidBody_t *capsule, RigidBody
 
 	vec3 contact=Vec3_Subv(pSegWorld, Vec3_Muls(normal, capsule->radius-penetration*0.5f));
 
-	CollisionManifold_t manifold;
-	manifold.a=obb;
-	manifold.b=capsule;
-	manifold.contacts[0].position=contact;
-	manifold.contacts[0].normal=normal;
-	manifold.contacts[0].penetration=penetration;
-	manifold.contactCount=1;
+	ContactPoint_t *contacts=PhysicsContactStream_BeginPair(stream);
+	contacts[0].position=contact;
+	contacts[0].normal=normal;
+	contacts[0].penetration=penetration;
 
-	return manifold;
+	return PhysicsContactStream_EndPair(stream, obb, capsule, userOBB, userCapsule, 1);
 }
 
-CollisionManifold_t PhysicsCollision(RigidBody_t *a, RigidBody_t *b)
+uint32_t PhysicsCollision(PhysicsContactStream_t *stream, RigidBody_t *a, RigidBody_t *b, uint32_t userA, uint32_t userB)
 {
 	if(a->type==RIGIDBODY_SPHERE&&b->type==RIGIDBODY_SPHERE)
-		return SphereToSphereCollision(a, b);
+		return SphereToSphereCollision(stream, a, b, userA, userB);
 	else if(a->type==RIGIDBODY_SPHERE&&b->type==RIGIDBODY_OBB)
-		return SphereToOBBCollision(a, b);
+		return SphereToOBBCollision(stream, a, b, userA, userB);
 	else if(a->type==RIGIDBODY_OBB&&b->type==RIGIDBODY_SPHERE)
-		return SphereToOBBCollision(b, a);
+		return SphereToOBBCollision(stream, b, a, userB, userA);
 	else if(a->type==RIGIDBODY_OBB&&b->type==RIGIDBODY_OBB)
-		return OBBToOBBCollision(a, b);
+		return OBBToOBBCollision(stream, a, b, userA, userB);
 	else if(a->type==RIGIDBODY_CAPSULE&&b->type==RIGIDBODY_SPHERE)
-		return CapsuleToSphereCollision(a, b);
+		return CapsuleToSphereCollision(stream, a, b, userA, userB);
 	else if(a->type==RIGIDBODY_SPHERE&&b->type==RIGIDBODY_CAPSULE)
-		return CapsuleToSphereCollision(b, a);
+		return CapsuleToSphereCollision(stream, b, a, userB, userA);
 	else if(a->type==RIGIDBODY_CAPSULE&&b->type==RIGIDBODY_CAPSULE)
-		return CapsuleToCapsuleCollision(a, b);
+		return CapsuleToCapsuleCollision(stream, a, b, userA, userB);
 	else if(a->type==RIGIDBODY_CAPSULE&&b->type==RIGIDBODY_OBB)
-		return CapsuleToOBBCollision(a, b);
+		return CapsuleToOBBCollision(stream, a, b, userA, userB);
 	else if(a->type==RIGIDBODY_OBB&&b->type==RIGIDBODY_CAPSULE)
-		return CapsuleToOBBCollision(b, a);
+		return CapsuleToOBBCollision(stream, b, a, userB, userA);
+
+	return 0;
+}
+
+// Contacts for 4 pairs, one lane each, lanes with distanceSq>radiusSq aren't touching
+typedef struct
+{
+	float position[3][4], normal[3][4];
+	float penetration[4];
+	float distanceSq[4], radiusSq[4];
+} ContactLanes_t;
+
+// Writes the touching lanes to the stream, a/b are in the order the contact normals were built for
+static void StreamContactLanes(PhysicsContactStream_t *stream, const ContactLanes_t *out, const uint32_t lanes, RigidBody_t *a[4], RigidBody_t *b[4], const uint32_t userA[4], const uint32_t userB[4])
+{
+	for(uint32_t j=0;j<lanes;j++)
+	{
+		if(out->distanceSq[j]>out->radiusSq[j])
+			continue;
+
+		ContactPoint_t *contacts=PhysicsContactStream_BeginPair(stream);
+		contacts[0].position=Vec3(out->position[0][j], out->position[1][j], out->position[2][j]);
+		contacts[0].normal=Vec3(out->normal[0][j], out->normal[1][j], out->normal[2][j]);
+		contacts[0].penetration=out->penetration[j];
+
+		PhysicsContactStream_EndPair(stream, a[j], b[j], userA[j], userB[j], 1);
+	}
+}
+
+// Same as SphereToSphereCollision, four pairs at a time.
+// Short batches are padded by repeating the last pair, which is then ignored.
+static void SphereToSphereBatch(PhysicsContactStream_t *stream, const PhysicsPair_t *pairs, const uint32_t *order, uint32_t count)
+{
+	for(uint32_t i=0;i<count;i+=4)
+	{
+		const uint32_t lanes=min(4, count-i);
+		RigidBody_t *a[4], *b[4];
+		uint32_t userA[4], userB[4];
+		float position[2][3][4], radius[2][4];
+
+		for(uint32_t j=0;j<4;j++)
+		{
+			const PhysicsPair_t *pair=&pairs[order[i+min(j, lanes-1)]];
+
+			a[j]=pair->a;
+			b[j]=pair->b;
+			userA[j]=pair->userA;
+			userB[j]=pair->userB;
+
+			for(uint32_t k=0;k<3;k++)
+			{
+				position[0][k][j]=pair->a->position.v[k];
+				position[1][k][j]=pair->b->position.v[k];
+			}
+
+			radius[0][j]=pair->a->radius;
+			radius[1][j]=pair->b->radius;
+		}
+
+		const float4_t ax=Float4_Load(position[0][0]), ay=Float4_Load(position[0][1]), az=Float4_Load(position[0][2]);
+		const float4_t dx=Float4_Sub(Float4_Load(position[1][0]), ax);
+		const float4_t dy=Float4_Sub(Float4_Load(position[1][1]), ay);
+		const float4_t dz=Float4_Sub(Float4_Load(position[1][2]), az);
+		const float4_t radiusA=Float4_Load(radius[0]);
+		const float4_t radiiSum=Float4_Add(radiusA, Float4_Load(radius[1]));
+
+		const float4_t distanceSq=Float4_Add(Float4_Add(Float4_Mul(dx, dx), Float4_Mul(dy, dy)), Float4_Mul(dz, dz));
+		const float4_t distance=Float4_Max(Float4_Sqrt(distanceSq), Float4_Set1(FLT_EPSILON));
+		const float4_t penetration=Float4_Sub(radiiSum, distance);
+
+		const float4_t invDistance=Float4_Div(Float4_Set1(1.0f), distance);
+		const float4_t nx=Float4_Mul(dx, invDistance), ny=Float4_Mul(dy, invDistance), nz=Float4_Mul(dz, invDistance);
+
+		// Contact sits halfway into the overlap
+		const float4_t offset=Float4_Sub(radiusA, Float4_Muls(penetration, 0.5f));
+
+		ContactLanes_t out;
+		Float4_Store(out.position[0], Float4_Add(ax, Float4_Mul(nx, offset)));
+		Float4_Store(out.position[1], Float4_Add(ay, Float4_Mul(ny, offset)));
+		Float4_Store(out.position[2], Float4_Add(az, Float4_Mul(nz, offset)));
+		Float4_Store(out.normal[0], nx);
+		Float4_Store(out.normal[1], ny);
+		Float4_Store(out.normal[2], nz);
+		Float4_Store(out.penetration, penetration);
+		Float4_Store(out.distanceSq, distanceSq);
+		Float4_Store(out.radiusSq, Float4_Mul(radiiSum, radiiSum));
+
+		StreamContactLanes(stream, &out, lanes, a, b, userA, userB);
+	}
+}
+
+// Same as SphereToOBBCollision, four pairs at a time, either body of a pair can be the sphere.
+// Box axes come straight from the orientations (as QuatAxes), so the whole test stays in lanes.
+static void SphereToOBBBatch(PhysicsContactStream_t *stream, const PhysicsPair_t *pairs, const uint32_t *order, uint32_t count)
+{
+	for(uint32_t i=0;i<count;i+=4)
+	{
+		const uint32_t lanes=min(4, count-i);
+		RigidBody_t *obb[4], *sphere[4];
+		uint32_t userOBB[4], userSphere[4];
+		float spherePosition[3][4], radius[4];
+		float obbPosition[3][4], orientation[4][4], size[3][4];
+
+		for(uint32_t j=0;j<4;j++)
+		{
+			const PhysicsPair_t *pair=&pairs[order[i+min(j, lanes-1)]];
+			const bool sphereIsA=pair->a->type==RIGIDBODY_SPHERE;
+
+			sphere[j]=sphereIsA?pair->a:pair->b;
+			obb[j]=sphereIsA?pair->b:pair->a;
+			userSphere[j]=sphereIsA?pair->userA:pair->userB;
+			userOBB[j]=sphereIsA?pair->userB:pair->userA;
+
+			for(uint32_t k=0;k<3;k++)
+			{
+				spherePosition[k][j]=sphere[j]->position.v[k];
+				obbPosition[k][j]=obb[j]->position.v[k];
+				size[k][j]=obb[j]->size.v[k];
+			}
+
+			for(uint32_t k=0;k<4;k++)
+				orientation[k][j]=obb[j]->orientation.v[k];
+
+			radius[j]=sphere[j]->radius;
+		}
+
+		const float4_t qx=Float4_Load(orientation[0]), qy=Float4_Load(orientation[1]), qz=Float4_Load(orientation[2]), qw=Float4_Load(orientation[3]);
+		const float4_t one=Float4_Set1(1.0f);
+
+		const float4_t xx=Float4_Mul(qx, qx), yy=Float4_Mul(qy, qy), zz=Float4_Mul(qz, qz);
+		const float4_t xy=Float4_Mul(qx, qy), xz=Float4_Mul(qx, qz), yz=Float4_Mul(qy, qz);
+		const float4_t wx=Float4_Mul(qw, qx), wy=Float4_Mul(qw, qy), wz=Float4_Mul(qw, qz);
+
+		const float4_t axes[3][3]=
+		{
+			{ Float4_Sub(one, Float4_Muls(Float4_Add(yy, zz), 2.0f)), Float4_Muls(Float4_Add(xy, wz), 2.0f), Float4_Muls(Float4_Sub(xz, wy), 2.0f) },
+			{ Float4_Muls(Float4_Sub(xy, wz), 2.0f), Float4_Sub(one, Float4_Muls(Float4_Add(xx, zz), 2.0f)), Float4_Muls(Float4_Add(yz, wx), 2.0f) },
+			{ Float4_Muls(Float4_Add(xz, wy), 2.0f), Float4_Muls(Float4_Sub(yz, wx), 2.0f), Float4_Sub(one, Float4_Muls(Float4_Add(xx, yy), 2.0f)) }
+		};
+
+		const float4_t sx=Float4_Load(spherePosition[0]), sy=Float4_Load(spherePosition[1]), sz=Float4_Load(spherePosition[2]);
+		const float4_t ox=Float4_Load(obbPosition[0]), oy=Float4_Load(obbPosition[1]), oz=Float4_Load(obbPosition[2]);
+		const float4_t rx=Float4_Sub(sx, ox), ry=Float4_Sub(sy, oy), rz=Float4_Sub(sz, oz);
+
+		// Closest point on the box, the sphere's center clamped to the box along each axis
+		float4_t cx=ox, cy=oy, cz=oz;
+
+		for(uint32_t k=0;k<3;k++)
+		{
+			const float4_t extent=Float4_Load(size[k]);
+			const float4_t d=Float4_Add(Float4_Add(Float4_Mul(rx, axes[k][0]), Float4_Mul(ry, axes[k][1])), Float4_Mul(rz, axes[k][2]));
+			const float4_t clamped=Float4_Max(Float4_Sub(Float4_Set1(0.0f), extent), Float4_Min(d, extent));
+
+			cx=Float4_Add(cx, Float4_Mul(axes[k][0], clamped));
+			cy=Float4_Add(cy, Float4_Mul(axes[k][1], clamped));
+			cz=Float4_Add(cz, Float4_Mul(axes[k][2], clamped));
+		}
+
+		const float4_t dx=Float4_Sub(sx, cx), dy=Float4_Sub(sy, cy), dz=Float4_Sub(sz, cz);
+		const float4_t sphereRadius=Float4_Load(radius);
+
+		const float4_t distanceSq=Float4_Add(Float4_Add(Float4_Mul(dx, dx), Float4_Mul(dy, dy)), Float4_Mul(dz, dz));
+		const float4_t distance=Float4_Max(Float4_Sqrt(distanceSq), Float4_Set1(FLT_EPSILON));
+		const float4_t penetration=Float4_Sub(sphereRadius, distance);
+
+		const float4_t invDistance=Float4_Div(one, distance);
+		const float4_t nx=Float4_Mul(dx, invDistance), ny=Float4_Mul(dy, invDistance), nz=Float4_Mul(dz, invDistance);
+		const float4_t offset=Float4_Muls(penetration, 0.5f);
+
+		ContactLanes_t out;
+		Float4_Store(out.position[0], Float4_Sub(cx, Float4_Mul(nx, offset)));
+		Float4_Store(out.position[1], Float4_Sub(cy, Float4_Mul(ny, offset)));
+		Float4_Store(out.position[2], Float4_Sub(cz, Float4_Mul(nz, offset)));
+		Float4_Store(out.normal[0], nx);
+		Float4_Store(out.normal[1], ny);
+		Float4_Store(out.normal[2], nz);
+		Float4_Store(out.penetration, penetration);
+		Float4_Store(out.distanceSq, distanceSq);
+		Float4_Store(out.radiusSq, Float4_Mul(sphereRadius, sphereRadius));
+
+		StreamContactLanes(stream, &out, lanes, obb, sphere, userOBB, userSphere);
+	}
+}
+
+void PhysicsPairList_Reset(PhysicsPairList_t *list)
+{
+	list->numPairs=0;
+	list->overflow=0;
+}
 
-	return (CollisionManifold_t) { 0 };
+bool PhysicsPairList_Add(PhysicsPairList_t *list, RigidBody_t *a, RigidBody_t *b, uint32_t userA, uint32_t userB)
+{
+	if(list->numPairs>=PHYSICS_MAX_CANDIDATES)
+	{
+		list->overflow++;
+		return false;
+	}
+
+	list->pairs[list->numPairs++]=(PhysicsPair_t){ a, b, userA, userB };
+
+	return true;
+}
+
+// Only the counts are reset, the arrays are overwritten as pairs are added
+void PhysicsContactStream_Reset(PhysicsContactStream_t *stream)
+{
+	stream->numPairs=0;
+	stream->numContacts=0;
+	stream->overflow=0;
+}
+
+// Room for one pair's contacts at the end of the stream, or the scratch space if the stream is full
+ContactPoint_t *PhysicsContactStream_BeginPair(PhysicsContactStream_t *stream)
+{
+	if(stream->numPairs>=PHYSICS_MAX_PAIRS||stream->numContacts+MAX_CONTACTS_PER_MANIFOLD>PHYSICS_MAX_STREAM_CONTACTS)
+		return stream->scratch;
+
+	return &stream->contacts[stream->numContacts];
+}
+
+// Commits the contacts written since BeginPair, returns the number kept
+uint32_t PhysicsContactStream_EndPair(PhysicsContactStream_t *stream, RigidBody_t *a, RigidBody_t *b, uint32_t userA, uint32_t userB, uint32_t contactCount)
+{
+	if(contactCount==0)
+		return 0;
+
+	if(stream->numPairs>=PHYSICS_MAX_PAIRS||stream->numContacts+MAX_CONTACTS_PER_MANIFOLD>PHYSICS_MAX_STREAM_CONTACTS)
+	{
+		stream->overflow++;
+		return 0;
+	}
+
+	const uint32_t pair=stream->numPairs++;
+
+	stream->bodyA[pair]=a;
+	stream->bodyB[pair]=b;
+	stream->userA[pair]=userA;
+	stream->userB[pair]=userB;
+	stream->firstContact[pair]=stream->numContacts;
+	stream->contactCount[pair]=contactCount;
+	stream->numContacts+=contactCount;
+
+	return contactCount;
+}
+
+// Candidates are bucketed by shape pair (order within a pair doesn't matter), swept pairs get a bucket of their own
+#define NARROWPHASE_SWEPT_BUCKET (MAX_RIGIDBODYTYPE*MAX_RIGIDBODYTYPE)
+#define NARROWPHASE_NUM_BUCKETS (NARROWPHASE_SWEPT_BUCKET+1)
+
+static uint8_t pairBucket[PHYSICS_MAX_CANDIDATES];
+static uint32_t sortedPairs[PHYSICS_MAX_CANDIDATES];
+
+// Runs the narrow phase over every broad phase candidate.
+// Candidates are counting sorted by shape pair first, so each test runs over a contiguous run of pairs and sphere/sphere and sphere/box
+//   pairs can go through the batched tests. The sort is stable, so pairs come out in the same order every run.
+// With batched false every pair goes through the scalar tests, in the same order, for checking the batched ones against.
+void PhysicsNarrowPhase(PhysicsContactStream_t *stream, const PhysicsPairList_t *candidates, const float dt, const bool batched)
+{
+	uint32_t bucketStart[NARROWPHASE_NUM_BUCKETS+1]={ 0 };
+
+	for(uint32_t i=0;i<candidates->numPairs;i++)
+	{
+		const PhysicsPair_t *pair=&candidates->pairs[i];
+		uint32_t bucket=NARROWPHASE_SWEPT_BUCKET;
+
+		if(!PhysicsNeedsCCD(pair->a, dt)&&!PhysicsNeedsCCD(pair->b, dt))
+		{
+			const uint32_t typeA=min(pair->a->type, pair->b->type);
+			const uint32_t typeB=max(pair->a->type, pair->b->type);
+
+			bucket=typeA*MAX_RIGIDBODYTYPE+typeB;
+		}
+
+		pairBucket[i]=(uint8_t)bucket;
+		bucketStart[bucket+1]++;
+	}
+
+	for(uint32_t i=0;i<NARROWPHASE_NUM_BUCKETS;i++)
+		bucketStart[i+1]+=bucketStart[i];
+
+	uint32_t bucketEnd[NARROWPHASE_NUM_BUCKETS];
+
+	for(uint32_t i=0;i<NARROWPHASE_NUM_BUCKETS;i++)
+		bucketEnd[i]=bucketStart[i];
+
+	for(uint32_t i=0;i<candidates->numPairs;i++)
+		sortedPairs[bucketEnd[pairBucket[i]]++]=i;
+
+	for(uint32_t i=0;i<NARROWPHASE_NUM_BUCKETS;i++)
+	{
+		const uint32_t *order=&sortedPairs[bucketStart[i]];
+		const uint32_t count=bucketStart[i+1]-bucketStart[i];
+
+		if(count==0)
+			continue;
+
+		if(batched&&i==RIGIDBODY_SPHERE*MAX_RIGIDBODYTYPE+RIGIDBODY_SPHERE)
+			SphereToSphereBatch(stream, candidates->pairs, order, count);
+		else if(batched&&i==RIGIDBODY_OBB*MAX_RIGIDBODYTYPE+RIGIDBODY_SPHERE)
+			SphereToOBBBatch(stream, candidates->pairs, order, count);
+		else if(i==NARROWPHASE_SWEPT_BUCKET)
+		{
+			for(uint32_t j=0;j<count;j++)
+			{
+				const PhysicsPair_t *pair=&candidates->pairs[order[j]];
+				PhysicsSweptCollision(stream, pair->a, pair->b, pair->userA, pair->userB, dt);
+			}
+		}
+		else
+		{
+			for(uint32_t j=0;j<count;j++)
+			{
+				const PhysicsPair_t *pair=&candidates->pairs[order[j]];
+				PhysicsCollision(stream, pair->a, pair->b, pair->userA, pair->userB);
+			}
+		}
+	}
 }
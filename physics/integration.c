@@ -20,10 +20,9 @@ static void ApplyConstraints(RigidBody_t *body, const float dt)
 {
 	vec3 center={ 0.0f, 0.0f, 0.0f };
 	const float maxRadius=2000.0f;
-	const float maxVelocity=500.0f;
 
 	// Clamp velocity, this reduces the chance of the simulation going unstable
-	body->velocity=Vec3_Clamp(body->velocity, -maxVelocity, maxVelocity);
+	body->velocity=Vec3_Clamp(body->velocity, -PHYSICS_MAX_VELOCITY, PHYSICS_MAX_VELOCITY);
 
 	// Check for collision with outer boundary sphere and reflect velocity if needed
 	vec3 normal=Vec3_Subv(body->position, center);
@@ -84,6 +83,18 @@ void PhysicsIntegrate(RigidBody_t *body, const float dt)
 	// const vec3 gravity=Vec3(0.0f, -9.81f*WORLD_SCALE, 0.0f);
 	const vec3 gravity=Vec3b(0.0f);
 
+	// Sleeping bodies are zeroed when put to sleep, so anything that pushed one since wakes it
+	if(body->asleep)
+	{
+		if(Vec3_LengthSq(body->force)==0.0f&&Vec3_LengthSq(body->velocity)==0.0f&&Vec3_LengthSq(body->angularVelocity)==0.0f)
+			return;
+
+		PhysicsWake(body);
+	}
+
+	body->prevPosition=body->position;
+	body->prevOrientation=body->orientation;
+
 	// Apply gravity
 	if(body!=&camera.body)
 		body->force=Vec3_Addv(body->force, Vec3_Muls(gravity, body->mass));
@@ -103,6 +114,57 @@ void PhysicsIntegrate(RigidBody_t *body, const float dt)
 	ApplyConstraints(body, dt);
 }
 
+// Snaps the interpolation history to the current transform, for new or teleported bodies
+void PhysicsResetInterpolation(RigidBody_t *body)
+{
+	body->prevPosition=body->position;
+	body->prevOrientation=body->orientation;
+}
+
+// Alpha is how far the render clock is past the last fixed step, 0 gives the previous transform and 1 the current
+vec3 PhysicsInterpolatePosition(const RigidBody_t *body, const float alpha)
+{
+	return Vec3_Lerp(body->prevPosition, body->position, alpha);
+}
+
+vec4 PhysicsInterpolateOrientation(const RigidBody_t *body, const float alpha)
+{
+	vec4 prev=body->prevOrientation;
+
+	// Take the short way around
+	if(Vec4_Dot(prev, body->orientation)<0.0f)
+		prev=Vec4_Muls(prev, -1.0f);
+
+	// Steps are small, so a normalized lerp is close enough to a slerp
+	vec4 result=Vec4_Lerp(prev, body->orientation, alpha);
+	Vec4_Normalize(&result);
+
+	return result;
+}
+
+// Stops a body dead and snaps its interpolation so it renders in place while asleep
+void PhysicsSleep(RigidBody_t *body)
+{
+	body->velocity=Vec3b(0.0f);
+	body->angularVelocity=Vec3b(0.0f);
+	body->force=Vec3b(0.0f);
+	body->asleep=true;
+
+	PhysicsResetInterpolation(body);
+}
+
+void PhysicsWake(RigidBody_t *body)
+{
+	body->asleep=false;
+	body->sleepTimer=0.0f;
+}
+
+// True if contacts can't move the body, either asleep or immovable
+bool PhysicsIsResting(const RigidBody_t *body)
+{
+	return body->asleep||body->invMass==0.0f;
+}
+
 void PhysicsExplode(RigidBody_t *body)
 {
 	const vec3 explosion_center={ 0.0f, 0.0f, 0.0f };
@@ -0,0 +1,122 @@
+#include <float.h>
+#include "../math/math.h"
+#include "physics.h"
+
+static uint32_t IslandFind(PhysicsIslands_t *islands, uint32_t index)
+{
+	// Path halving, keeps the trees flat without recursion
+	while(islands->parent[index]!=index)
+	{
+		islands->parent[index]=islands->parent[islands->parent[index]];
+		index=islands->parent[index];
+	}
+
+	return index;
+}
+
+void PhysicsIslands_Begin(PhysicsIslands_t *islands)
+{
+	islands->numBodies=0;
+}
+
+void PhysicsIslands_AddBody(PhysicsIslands_t *islands, RigidBody_t *body)
+{
+	if(islands->numBodies>=PHYSICS_ISLAND_MAX_BODIES)
+	{
+		body->islandIndex=UINT32_MAX;
+		return;
+	}
+
+	const uint32_t index=islands->numBodies++;
+
+	islands->body[index]=body;
+	islands->parent[index]=index;
+	body->islandIndex=index;
+}
+
+// Joins the islands of two touching bodies.
+// Immovable bodies don't join anything, otherwise everything resting on the same one would become a single island.
+void PhysicsIslands_AddContact(PhysicsIslands_t *islands, RigidBody_t *a, RigidBody_t *b)
+{
+	if(a->invMass==0.0f||b->invMass==0.0f)
+		return;
+
+	if(a->islandIndex>=islands->numBodies||b->islandIndex>=islands->numBodies||
+	   islands->body[a->islandIndex]!=a||islands->body[b->islandIndex]!=b)
+		return;
+
+	const uint32_t rootA=IslandFind(islands, a->islandIndex);
+	const uint32_t rootB=IslandFind(islands, b->islandIndex);
+
+	if(rootA!=rootB)
+		islands->parent[rootB]=rootA;
+}
+
+// Smallest sleep timer in each island, sleeping bodies count as ready
+static void IslandGatherTimers(PhysicsIslands_t *islands)
+{
+	for(uint32_t i=0;i<islands->numBodies;i++)
+		islands->minSleepTimer[i]=FLT_MAX;
+
+	for(uint32_t i=0;i<islands->numBodies;i++)
+	{
+		const RigidBody_t *body=islands->body[i];
+		const uint32_t root=IslandFind(islands, i);
+		const float timer=body->asleep?FLT_MAX:body->sleepTimer;
+
+		islands->minSleepTimer[root]=fminf(islands->minSleepTimer[root], timer);
+	}
+}
+
+// Wakes every sleeping body that's in an island with a body that isn't ready to sleep.
+// Run after contacts are added and before solving, so whatever hit a sleeping pile gets solved against all of it.
+void PhysicsIslands_Wake(PhysicsIslands_t *islands)
+{
+	IslandGatherTimers(islands);
+
+	for(uint32_t i=0;i<islands->numBodies;i++)
+	{
+		RigidBody_t *body=islands->body[i];
+
+		if(body->asleep&&islands->minSleepTimer[IslandFind(islands, i)]<PHYSICS_SLEEP_TIME)
+			PhysicsWake(body);
+	}
+}
+
+// Advances sleep timers from the solved velocities, then puts to sleep every island whose bodies have all been slow long enough.
+// Returns the number of sleeping bodies.
+uint32_t PhysicsIslands_Sleep(PhysicsIslands_t *islands, const float dt)
+{
+	const float linearSq=PHYSICS_SLEEP_LINEAR_VELOCITY*PHYSICS_SLEEP_LINEAR_VELOCITY;
+	const float angularSq=PHYSICS_SLEEP_ANGULAR_VELOCITY*PHYSICS_SLEEP_ANGULAR_VELOCITY;
+
+	for(uint32_t i=0;i<islands->numBodies;i++)
+	{
+		RigidBody_t *body=islands->body[i];
+
+		if(body->asleep)
+			continue;
+
+		if(Vec3_LengthSq(body->velocity)<linearSq&&Vec3_LengthSq(body->angularVelocity)<angularSq)
+			body->sleepTimer+=dt;
+		else
+			body->sleepTimer=0.0f;
+	}
+
+	IslandGatherTimers(islands);
+
+	uint32_t numAsleep=0;
+
+	for(uint32_t i=0;i<islands->numBodies;i++)
+	{
+		RigidBody_t *body=islands->body[i];
+
+		if(!body->asleep&&islands->minSleepTimer[IslandFind(islands, i)]>=PHYSICS_SLEEP_TIME)
+			PhysicsSleep(body);
+
+		if(body->asleep)
+			numAsleep++;
+	}
+
+	return numAsleep;
+}
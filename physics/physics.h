@@ -7,6 +7,19 @@
 #define WORLD_SCALE 10.0f
 #define EXPLOSION_POWER (1500.0f*WORLD_SCALE)
 
+// Fixed simulation rate, render frames blend between the last two steps
+#define PHYSICS_TIMESTEP (1.0f/60.0f)
+// Most steps taken in one frame before dropping time, keeps a slow frame from snowballing
+#define PHYSICS_MAX_SUBSTEPS 4
+
+// Bodies slower than these for PHYSICS_SLEEP_TIME seconds (along with everything touching them) go to sleep
+#define PHYSICS_SLEEP_LINEAR_VELOCITY (0.05f*WORLD_SCALE)
+#define PHYSICS_SLEEP_ANGULAR_VELOCITY 0.05f
+#define PHYSICS_SLEEP_TIME 1.0f
+
+// Per axis velocity limit, just a guard against blowing up now that fast bodies are swept instead of tunneling
+#define PHYSICS_MAX_VELOCITY 2500.0f
+
 typedef enum
 {
 	RIGIDBODY_OBB=0,
@@ -26,9 +39,26 @@ typedef struct RigidBody_s
 	vec3 angularVelocity;
 	float inertia, invInertia;
 
+	// Transform before the last integration step, for render interpolation
+	vec3 prevPosition;
+	vec4 prevOrientation;
+
+	// Solver scratch, index into the solver's body arrays when solverEpoch matches the solver's
+	uint32_t solverEpoch, solverIndex;
+
+	// Time spent under the sleep thresholds, bodies asleep aren't integrated until something wakes them
+	float sleepTimer;
+	bool asleep;
+
+	// Island scratch, index into the island builder's body list
+	uint32_t islandIndex;
+
 	float restitution;
 	float friction;
 
+	// Always swept for continuous collision, for small fast bodies like projectiles
+	bool ccd;
+
 	RigidBodyType_e type;	// OBB, sphere, capsule
 	union
 	{
@@ -46,19 +76,160 @@ typedef struct
 
 #define MAX_CONTACTS_PER_MANIFOLD 8
 
+// Broad phase candidate, the user values are the caller's own (entity indices in the engine) and are carried through to the contacts
 typedef struct
 {
 	RigidBody_t *a, *b;
-	ContactPoint_t contacts[MAX_CONTACTS_PER_MANIFOLD];
-	uint32_t contactCount;
-} CollisionManifold_t;
+	uint32_t userA, userB;
+} PhysicsPair_t;
+
+#define PHYSICS_MAX_CANDIDATES 65536
+
+typedef struct
+{
+	uint32_t numPairs;
+	PhysicsPair_t pairs[PHYSICS_MAX_CANDIDATES];
+
+	// Candidates that didn't fit this step
+	uint32_t overflow;
+} PhysicsPairList_t;
+
+// Narrow phase output, written in place by the collision tests.
+// Pairs are stored as parallel arrays, each owning a run of the flat contact array.
+// Bodies (and their user values) are in normal order, which isn't always the order they were tested in.
+#define PHYSICS_MAX_PAIRS 10000
+#define PHYSICS_MAX_STREAM_CONTACTS (PHYSICS_MAX_PAIRS*4)
+
+typedef struct
+{
+	uint32_t numPairs;
+	RigidBody_t *bodyA[PHYSICS_MAX_PAIRS], *bodyB[PHYSICS_MAX_PAIRS];
+	uint32_t userA[PHYSICS_MAX_PAIRS], userB[PHYSICS_MAX_PAIRS];
+	uint32_t firstContact[PHYSICS_MAX_PAIRS], contactCount[PHYSICS_MAX_PAIRS];
+
+	uint32_t numContacts;
+	ContactPoint_t contacts[PHYSICS_MAX_STREAM_CONTACTS];
+
+	// Tests write here once the stream is full, so they can still report what got dropped
+	ContactPoint_t scratch[MAX_CONTACTS_PER_MANIFOLD];
+
+	// Touching pairs that didn't fit this step
+	uint32_t overflow;
+} PhysicsContactStream_t;
 
 void PhysicsIntegrate(RigidBody_t *body, const float dt);
+void PhysicsResetInterpolation(RigidBody_t *body);
+vec3 PhysicsInterpolatePosition(const RigidBody_t *body, const float alpha);
+vec4 PhysicsInterpolateOrientation(const RigidBody_t *body, const float alpha);
+void PhysicsSleep(RigidBody_t *body);
+void PhysicsWake(RigidBody_t *body);
+bool PhysicsIsResting(const RigidBody_t *body);
 void PhysicsExplode(RigidBody_t *body);
 void PhysicsApplyImpulse(RigidBody_t *body, const vec3 impulse, const vec3 point);
-float PhysicsResolveCollision(RigidBody_t *a, RigidBody_t *b, ContactPoint_t contact);
-void PhysicsPositionCorrection(RigidBody_t *a, RigidBody_t *b, ContactPoint_t contact);
-CollisionManifold_t PhysicsCollision(RigidBody_t *a, RigidBody_t *b);
+
+void PhysicsPairList_Reset(PhysicsPairList_t *list);
+bool PhysicsPairList_Add(PhysicsPairList_t *list, RigidBody_t *a, RigidBody_t *b, uint32_t userA, uint32_t userB);
+
+void PhysicsContactStream_Reset(PhysicsContactStream_t *stream);
+ContactPoint_t *PhysicsContactStream_BeginPair(PhysicsContactStream_t *stream);
+uint32_t PhysicsContactStream_EndPair(PhysicsContactStream_t *stream, RigidBody_t *a, RigidBody_t *b, uint32_t userA, uint32_t userB, uint32_t contactCount);
+
+uint32_t PhysicsCollision(PhysicsContactStream_t *stream, RigidBody_t *a, RigidBody_t *b, uint32_t userA, uint32_t userB);
+void PhysicsNarrowPhase(PhysicsContactStream_t *stream, const PhysicsPairList_t *candidates, const float dt, const bool batched);
+
+float PhysicsBoundingRadius(const RigidBody_t *body);
+bool PhysicsNeedsCCD(const RigidBody_t *body, const float dt);
+aabb PhysicsSweptBounds(const RigidBody_t *body, const float dt);
+uint32_t PhysicsSweptCollision(PhysicsContactStream_t *stream, RigidBody_t *a, RigidBody_t *b, uint32_t userA, uint32_t userB, const float dt);
+
+// Sequential impulse contact solver
+#define PHYSICS_SOLVER_MAX_CONTACTS 65536
+#define PHYSICS_SOLVER_MAX_BODIES 65536
+// Pair slots in each contact cache table, power of two and comfortably more than the pairs in a step
+#define PHYSICS_CACHE_SIZE 32768
+
+// Cached impulses from the previous step, keyed on entity ID pair.
+// Points are in the lower ID body's local space and impulses are as applied to the higher ID body.
+typedef struct
+{
+	uint64_t key;
+	uint32_t firstPoint, numPoints;
+} PhysicsCachePair_t;
+
+typedef struct
+{
+	PhysicsCachePair_t pairs[PHYSICS_CACHE_SIZE];
+	uint32_t usedSlots[PHYSICS_CACHE_SIZE];
+	uint32_t numUsed;
+
+	vec3 localPoint[PHYSICS_SOLVER_MAX_CONTACTS];
+	vec3 impulse[PHYSICS_SOLVER_MAX_CONTACTS];
+	uint32_t numPoints;
+} PhysicsContactCache_t;
+
+typedef struct
+{
+	uint32_t velocityIterations;
+	uint32_t positionIterations;
+	bool warmStarting;
+
+	uint32_t epoch;
+
+	// Bodies touched this step, velocities are world space while solving
+	uint32_t numBodies;
+	RigidBody_t *body[PHYSICS_SOLVER_MAX_BODIES];
+	vec3 velocity[PHYSICS_SOLVER_MAX_BODIES];
+	vec3 angularVelocity[PHYSICS_SOLVER_MAX_BODIES];
+	vec3 pseudoVelocity[PHYSICS_SOLVER_MAX_BODIES];
+	vec3 pseudoAngularVelocity[PHYSICS_SOLVER_MAX_BODIES];
+	float invMass[PHYSICS_SOLVER_MAX_BODIES];
+	float invInertia[PHYSICS_SOLVER_MAX_BODIES];
+
+	// Contact constraints, one per contact point
+	uint32_t numContacts;
+	uint32_t bodyA[PHYSICS_SOLVER_MAX_CONTACTS], bodyB[PHYSICS_SOLVER_MAX_CONTACTS];
+	uint32_t cachePoint[PHYSICS_SOLVER_MAX_CONTACTS];
+	bool swapped[PHYSICS_SOLVER_MAX_CONTACTS];
+	vec3 rA[PHYSICS_SOLVER_MAX_CONTACTS], rB[PHYSICS_SOLVER_MAX_CONTACTS];
+	vec3 normal[PHYSICS_SOLVER_MAX_CONTACTS], tangent1[PHYSICS_SOLVER_MAX_CONTACTS], tangent2[PHYSICS_SOLVER_MAX_CONTACTS];
+	float normalMass[PHYSICS_SOLVER_MAX_CONTACTS], tangentMass1[PHYSICS_SOLVER_MAX_CONTACTS], tangentMass2[PHYSICS_SOLVER_MAX_CONTACTS];
+	float friction[PHYSICS_SOLVER_MAX_CONTACTS];
+	float velocityBias[PHYSICS_SOLVER_MAX_CONTACTS], penetration[PHYSICS_SOLVER_MAX_CONTACTS];
+	float normalImpulse[PHYSICS_SOLVER_MAX_CONTACTS], tangentImpulse1[PHYSICS_SOLVER_MAX_CONTACTS], tangentImpulse2[PHYSICS_SOLVER_MAX_CONTACTS];
+	float positionImpulse[PHYSICS_SOLVER_MAX_CONTACTS];
+	float impactSpeed[PHYSICS_SOLVER_MAX_CONTACTS];
+
+	// Double buffered, read last step's while writing this step's
+	PhysicsContactCache_t cache[2];
+	uint32_t currentCache;
+
+	// Largest normal impulse change in the last velocity iteration, for judging convergence
+	float residual;
+} PhysicsSolver_t;
+
+void PhysicsSolver_Init(PhysicsSolver_t *solver, uint32_t velocityIterations, uint32_t positionIterations);
+void PhysicsSolver_Begin(PhysicsSolver_t *solver);
+uint32_t PhysicsSolver_AddContacts(PhysicsSolver_t *solver, RigidBody_t *bodyA, RigidBody_t *bodyB, const ContactPoint_t *contacts, uint32_t contactCount, uint32_t idA, uint32_t idB);
+void PhysicsSolver_Solve(PhysicsSolver_t *solver, const float dt);
+float PhysicsSolver_GetImpactSpeed(const PhysicsSolver_t *solver, uint32_t contact);
+
+// Groups bodies connected through contacts, so a body can only sleep when everything it touches can too,
+//   and waking one wakes the whole group
+#define PHYSICS_ISLAND_MAX_BODIES 65536
+
+typedef struct
+{
+	uint32_t numBodies;
+	RigidBody_t *body[PHYSICS_ISLAND_MAX_BODIES];
+	uint32_t parent[PHYSICS_ISLAND_MAX_BODIES];
+	float minSleepTimer[PHYSICS_ISLAND_MAX_BODIES];	// Per island root
+} PhysicsIslands_t;
+
+void PhysicsIslands_Begin(PhysicsIslands_t *islands);
+void PhysicsIslands_AddBody(PhysicsIslands_t *islands, RigidBody_t *body);
+void PhysicsIslands_AddContact(PhysicsIslands_t *islands, RigidBody_t *a, RigidBody_t *b);
+void PhysicsIslands_Wake(PhysicsIslands_t *islands);
+uint32_t PhysicsIslands_Sleep(PhysicsIslands_t *islands, const float dt);
 
 typedef struct
 {
@@ -76,4 +247,51 @@ vec3 AttractorOBBComputeGravity(vec3 position, vec3 center, vec3 halfExtents, ve
 vec3 AttractorCapsuleComputeGravity(vec3 position, vec3 center, vec4 orientation, float radius, float halfHeight, float baseGravity, float influenceRadius);
 vec3 AttractorSphereComputeGravity(vec3 position, vec3 center, float radius, float baseGravity, float influenceRadius);
 
+// Attractor gravity for a whole step.
+// Attractors go into a Barnes-Hut style tree, a group that's small enough for its distance and has every body of it at full
+//   strength is pulled toward as a single point at its gravity weighted center, so cost per body grows with the log of the attractor count.
+// Remaining (attractor, body) interactions are gathered by attractor shape and evaluated 4 at a time.
+#define PHYSICS_MAX_ATTRACTORS 4096
+#define PHYSICS_MAX_GRAVITY_INTERACTIONS 262144
+// Largest node size to distance ratio that's treated as a single attractor
+#define PHYSICS_GRAVITY_OPENING_ANGLE 0.5f
+#define PHYSICS_GRAVITY_LEAF_SIZE 4
+
+typedef struct
+{
+	vec3 center;			// Gravity weighted center of the attractors below
+	float radius;			// Around center, covers all their shapes
+	float baseGravity;		// Sum of the attractors' gravity
+	float minInfluence, maxInfluence;
+	uint32_t first, count;	// Range of the attractor order array
+	uint32_t children[2];	// UINT32_MAX on leaves
+} PhysicsGravityNode_t;
+
+typedef struct
+{
+	uint32_t numAttractors;
+	RigidBody_t *attractor[PHYSICS_MAX_ATTRACTORS];
+	float baseGravity[PHYSICS_MAX_ATTRACTORS], influenceRadius[PHYSICS_MAX_ATTRACTORS];
+	uint32_t order[PHYSICS_MAX_ATTRACTORS];
+
+	uint32_t numNodes;
+	PhysicsGravityNode_t nodes[PHYSICS_MAX_ATTRACTORS*2];
+
+	// Interactions by attractor shape, far field nodes are added to the spheres with PHYSICS_GRAVITY_NODE set on the source
+	uint32_t numInteractions[MAX_RIGIDBODYTYPE];
+	RigidBody_t *interactionBody[MAX_RIGIDBODYTYPE][PHYSICS_MAX_GRAVITY_INTERACTIONS];
+	uint32_t interactionSource[MAX_RIGIDBODYTYPE][PHYSICS_MAX_GRAVITY_INTERACTIONS];
+
+	// Attractors and interactions that didn't fit this step
+	uint32_t overflow;
+} PhysicsGravity_t;
+
+#define PHYSICS_GRAVITY_NODE 0x80000000u
+
+void PhysicsGravity_Begin(PhysicsGravity_t *gravity);
+bool PhysicsGravity_AddAttractor(PhysicsGravity_t *gravity, RigidBody_t *body, float baseGravity, float influenceRadius);
+void PhysicsGravity_Build(PhysicsGravity_t *gravity);
+void PhysicsGravity_Gather(PhysicsGravity_t *gravity, RigidBody_t *body);
+void PhysicsGravity_Apply(PhysicsGravity_t *gravity, const float dt);
+
 #endif
@@ -1,96 +1,427 @@
 #include <float.h>
+#include <string.h>
+#include "../system/system.h"
 #include "../math/math.h"
 #include "physics.h"
 
-float PhysicsResolveCollision(RigidBody_t *a, RigidBody_t *b, ContactPoint_t contact)
+// Penetration allowed before position correction kicks in
+#define SOLVER_SLOP 0.01f
+// Fraction of the remaining penetration removed per step
+#define SOLVER_BAUMGARTE 0.2f
+// Closing speeds below this don't bounce, keeps resting contacts from buzzing
+#define SOLVER_RESTITUTION_THRESHOLD 1.0f
+// How far a contact can drift (in body local space) and still be matched to last step's
+#define SOLVER_MATCH_DISTANCE (0.1f*WORLD_SCALE)
+
+static inline uint64_t PairKey(const uint32_t idA, const uint32_t idB)
 {
-	// Torque arms
-	const vec3 r1=Vec3_Subv(contact.position, a->position);
-	const vec3 r2=Vec3_Subv(contact.position, b->position);
+	return idA<idB?((uint64_t)idA<<32)|idB:((uint64_t)idB<<32)|idA;
+}
 
-    const vec3 wA=QuatRotate(a->orientation, a->angularVelocity);
-    const vec3 wB=QuatRotate(b->orientation, b->angularVelocity);
+static inline uint32_t PairHash(const uint64_t key)
+{
+	return (uint32_t)((key*0x9E3779B97F4A7C15ull)>>32)&(PHYSICS_CACHE_SIZE-1);
+}
 
-	const vec3 relativeVel=Vec3_Subv(
-        Vec3_Addv(b->velocity, Vec3_Cross(wB, r2)),
-        Vec3_Addv(a->velocity, Vec3_Cross(wA, r1))
-    );
+// Key 0 marks an empty slot, which is fine since a pair can't be an entity with itself
+static PhysicsCachePair_t *CacheFind(PhysicsContactCache_t *cache, const uint64_t key)
+{
+	for(uint32_t i=0, slot=PairHash(key);i<PHYSICS_CACHE_SIZE;i++, slot=(slot+1)&(PHYSICS_CACHE_SIZE-1))
+	{
+		if(cache->pairs[slot].key==key)
+			return &cache->pairs[slot];
 
-	const float relativeSpeed=Vec3_Dot(relativeVel, contact.normal);
+		if(cache->pairs[slot].key==0)
+			return NULL;
+	}
 
-	if(relativeSpeed>0.0f)
-		return 0.0f;
+	return NULL;
+}
 
-	// Masses
-	const vec3 d1=Vec3_Cross(Vec3_Muls(Vec3_Cross(r1, contact.normal), a->invInertia), r1);
-	const vec3 d2=Vec3_Cross(Vec3_Muls(Vec3_Cross(r2, contact.normal), b->invInertia), r2);
-	const float invMassSum=a->invMass+b->invMass;
+static PhysicsCachePair_t *CacheInsert(PhysicsContactCache_t *cache, const uint64_t key, const uint32_t numPoints)
+{
+	// Keep the table under half full so probes stay short
+	if(cache->numUsed>=PHYSICS_CACHE_SIZE/2||cache->numPoints+numPoints>PHYSICS_SOLVER_MAX_CONTACTS)
+		return NULL;
 
-	const float e=fminf(a->restitution, b->restitution);
-	const float j=-(1.0f+e)*relativeSpeed/(invMassSum+Vec3_Dot(contact.normal, Vec3_Addv(d1, d2)));
+	for(uint32_t slot=PairHash(key);;slot=(slot+1)&(PHYSICS_CACHE_SIZE-1))
+	{
+		PhysicsCachePair_t *pair=&cache->pairs[slot];
 
-	const vec3 impulse=Vec3_Muls(contact.normal, j);
+		// Same pair twice in a step (shouldn't happen), don't cache the second
+		if(pair->key==key)
+			return NULL;
 
-	// Head-on collision velocities
+		if(pair->key==0)
+		{
+			pair->key=key;
+			pair->firstPoint=cache->numPoints;
+			pair->numPoints=numPoints;
 
-    // Linear velocity
-	a->velocity=Vec3_Subv(a->velocity, Vec3_Muls(impulse, a->invMass));
-	b->velocity=Vec3_Addv(b->velocity, Vec3_Muls(impulse, b->invMass));
+			cache->numPoints+=numPoints;
+			cache->usedSlots[cache->numUsed++]=slot;
 
-    // Pre-calculate inverse orientation quats
-	const vec4 invOrientationA=QuatInverse(a->orientation);
-	const vec4 invOrientationB=QuatInverse(b->orientation);
+			return pair;
+		}
+	}
+}
 
-	// Transform torque to local space
-	vec3 localTorqueA=QuatRotate(invOrientationA, Vec3_Cross(r1, impulse));
-	vec3 localTorqueB=QuatRotate(invOrientationB, Vec3_Cross(r2, impulse));
+static void CacheClear(PhysicsContactCache_t *cache)
+{
+	for(uint32_t i=0;i<cache->numUsed;i++)
+		cache->pairs[cache->usedSlots[i]].key=0;
 
-    // Angular velocity
-	a->angularVelocity=Vec3_Subv(a->angularVelocity, Vec3_Muls(localTorqueA, a->invInertia));
-	b->angularVelocity=Vec3_Addv(b->angularVelocity, Vec3_Muls(localTorqueB, b->invInertia));
+	cache->numUsed=0;
+	cache->numPoints=0;
+}
 
-	// Calculate tangential velocities
-	vec3 tangentialVel=Vec3_Subv(relativeVel, Vec3_Muls(contact.normal, Vec3_Dot(relativeVel, contact.normal)));
-    Vec3_Normalize(&tangentialVel);
+// Returns the solver's index for a body, adding it on first use this step
+static uint32_t SolverGetBody(PhysicsSolver_t *solver, RigidBody_t *body)
+{
+	if(body->solverEpoch==solver->epoch)
+		return body->solverIndex;
 
-	const vec3 d1T=Vec3_Cross(Vec3_Muls(Vec3_Cross(r1, tangentialVel), a->invInertia), r1);
-	const vec3 d2T=Vec3_Cross(Vec3_Muls(Vec3_Cross(r2, tangentialVel), b->invInertia), r2);
+	if(solver->numBodies>=PHYSICS_SOLVER_MAX_BODIES)
+		return UINT32_MAX;
 
-	const float friction=sqrtf(a->friction*b->friction);
-	const float maxjT=friction*j;
+	const uint32_t index=solver->numBodies++;
 
-	const float jT=clampf(-Vec3_Dot(relativeVel, tangentialVel)/(invMassSum+Vec3_Dot(tangentialVel, Vec3_Addv(d1T, d2T))), -maxjT, maxjT);
+	solver->body[index]=body;
+	solver->velocity[index]=body->velocity;
+	solver->angularVelocity[index]=QuatRotate(body->orientation, body->angularVelocity);
+	solver->pseudoVelocity[index]=Vec3b(0.0f);
+	solver->pseudoAngularVelocity[index]=Vec3b(0.0f);
+	// Sleeping bodies only get here touching an island that's about to sleep too, hold them still rather than waking them
+	solver->invMass[index]=body->asleep?0.0f:body->invMass;
+	solver->invInertia[index]=body->asleep?0.0f:body->invInertia;
 
-	const vec3 impulseT=Vec3_Muls(tangentialVel, jT);
+	body->solverEpoch=solver->epoch;
+	body->solverIndex=index;
 
-	// Linear frictional velocity
-	a->velocity=Vec3_Subv(a->velocity, Vec3_Muls(impulseT, a->invMass));
-	b->velocity=Vec3_Addv(b->velocity, Vec3_Muls(impulseT, b->invMass));
+	return index;
+}
 
-	// Angular frictional velocity
-	localTorqueA=QuatRotate(invOrientationA, Vec3_Cross(r1, impulseT));
-	localTorqueB=QuatRotate(invOrientationB, Vec3_Cross(r2, impulseT));
+// Orthonormal tangent basis around a unit normal
+static void TangentBasis(const vec3 n, vec3 *t1, vec3 *t2)
+{
+	if(fabsf(n.x)>=0.57735f)
+		*t1=Vec3(n.y, -n.x, 0.0f);
+	else
+		*t1=Vec3(0.0f, n.z, -n.y);
 
-	a->angularVelocity=Vec3_Subv(a->angularVelocity, Vec3_Muls(localTorqueA, a->invInertia));
-	b->angularVelocity=Vec3_Addv(b->angularVelocity, Vec3_Muls(localTorqueB, b->invInertia));
+	Vec3_Normalize(t1);
+	*t2=Vec3_Cross(n, *t1);
+}
+
+static inline float EffectiveMass(const float invMassSum, const float invInertiaA, const float invInertiaB, const vec3 rA, const vec3 rB, const vec3 axis)
+{
+	const float k=invMassSum+invInertiaA*Vec3_LengthSq(Vec3_Cross(rA, axis))+invInertiaB*Vec3_LengthSq(Vec3_Cross(rB, axis));
 
-    return sqrtf(-relativeSpeed);
+	return k>FLT_EPSILON?1.0f/k:0.0f;
+}
+
+static inline vec3 RelativeVelocity(const vec3 vA, const vec3 wA, const vec3 vB, const vec3 wB, const vec3 rA, const vec3 rB)
+{
+	return Vec3_Subv(Vec3_Addv(vB, Vec3_Cross(wB, rB)), Vec3_Addv(vA, Vec3_Cross(wA, rA)));
+}
+
+static inline void ApplyImpulse(vec3 *v, vec3 *w, const uint32_t a, const uint32_t b, const float *invMass, const float *invInertia, const vec3 rA, const vec3 rB, const vec3 P)
+{
+	v[a]=Vec3_Subv(v[a], Vec3_Muls(P, invMass[a]));
+	w[a]=Vec3_Subv(w[a], Vec3_Muls(Vec3_Cross(rA, P), invInertia[a]));
+	v[b]=Vec3_Addv(v[b], Vec3_Muls(P, invMass[b]));
+	w[b]=Vec3_Addv(w[b], Vec3_Muls(Vec3_Cross(rB, P), invInertia[b]));
 }
 
-void PhysicsPositionCorrection(RigidBody_t *a, RigidBody_t *b, ContactPoint_t contact)
+void PhysicsSolver_Init(PhysicsSolver_t *solver, uint32_t velocityIterations, uint32_t positionIterations)
 {
-	const float penetration=contact.penetration;
-	const vec3 normal=contact.normal;
-	const float invMassSum=a->invMass+b->invMass;
+	memset(solver, 0, sizeof(PhysicsSolver_t));
 
-	if(invMassSum>FLT_EPSILON)
+	solver->velocityIterations=velocityIterations;
+	solver->positionIterations=positionIterations;
+	solver->warmStarting=true;
+}
+
+void PhysicsSolver_Begin(PhysicsSolver_t *solver)
+{
+	// Bodies are tagged with the epoch, skip 0 so freshly zeroed bodies never match
+	if(++solver->epoch==0)
+		solver->epoch=1;
+
+	solver->numBodies=0;
+	solver->numContacts=0;
+	solver->residual=0.0f;
+
+	solver->currentCache^=1;
+	CacheClear(&solver->cache[solver->currentCache]);
+}
+
+uint32_t PhysicsSolver_AddContacts(PhysicsSolver_t *solver, RigidBody_t *bodyA, RigidBody_t *bodyB, const ContactPoint_t *contacts, uint32_t contactCount, uint32_t idA, uint32_t idB)
+{
+	// Nothing to solve between two bodies that can't move
+	if(contactCount==0||(PhysicsIsResting(bodyA)&&PhysicsIsResting(bodyB)))
+		return UINT32_MAX;
+
+	if(solver->numContacts+contactCount>PHYSICS_SOLVER_MAX_CONTACTS)
 	{
-		const float penetrationSlop=0.01f;
-		const float percent=0.2f;
-		const float correctionAmount=fmaxf(penetration-penetrationSlop, 0.0f)*percent;
-		const vec3 correction=Vec3_Muls(normal, correctionAmount/invMassSum);
+		DBGPRINTF(DEBUG_WARNING, "PhysicsSolver_AddContacts: Out of contact slots, dropping pair.\n");
+		return UINT32_MAX;
+	}
 
-		a->position=Vec3_Subv(a->position, Vec3_Muls(correction, a->invMass));
-		b->position=Vec3_Addv(b->position, Vec3_Muls(correction, b->invMass));
+	const uint32_t a=SolverGetBody(solver, bodyA);
+	const uint32_t b=SolverGetBody(solver, bodyB);
+
+	if(a==UINT32_MAX||b==UINT32_MAX)
+	{
+		DBGPRINTF(DEBUG_WARNING, "PhysicsSolver_AddContacts: Out of body slots, dropping pair.\n");
+		return UINT32_MAX;
 	}
+
+	// Cache entries are stored relative to the lower ID of the pair, so it doesn't matter which way round the broad phase reports it
+	const bool swapped=idA>idB;
+	const uint64_t key=PairKey(idA, idB);
+	const RigidBody_t *canonicalA=swapped?bodyB:bodyA;
+	const vec4 invCanonicalOrientation=QuatInverse(canonicalA->orientation);
+	const float sign=swapped?-1.0f:1.0f;
+
+	PhysicsContactCache_t *previous=&solver->cache[solver->currentCache^1];
+	const PhysicsCachePair_t *previousPair=solver->warmStarting?CacheFind(previous, key):NULL;
+	const PhysicsCachePair_t *currentPair=CacheInsert(&solver->cache[solver->currentCache], key, contactCount);
+
+	const float invMassSum=solver->invMass[a]+solver->invMass[b];
+	const float invInertiaA=solver->invInertia[a], invInertiaB=solver->invInertia[b];
+	const float friction=sqrtf(bodyA->friction*bodyB->friction);
+	const float restitution=fminf(bodyA->restitution, bodyB->restitution);
+
+	const uint32_t first=solver->numContacts;
+
+	for(uint32_t i=0;i<contactCount;i++)
+	{
+		const ContactPoint_t *contact=&contacts[i];
+		const uint32_t c=solver->numContacts++;
+
+		const vec3 rA=Vec3_Subv(contact->position, bodyA->position);
+		const vec3 rB=Vec3_Subv(contact->position, bodyB->position);
+		const vec3 n=contact->normal;
+		vec3 t1, t2;
+
+		TangentBasis(n, &t1, &t2);
+
+		solver->bodyA[c]=a;
+		solver->bodyB[c]=b;
+		solver->cachePoint[c]=currentPair?currentPair->firstPoint+i:UINT32_MAX;
+		solver->swapped[c]=swapped;
+		solver->rA[c]=rA;
+		solver->rB[c]=rB;
+		solver->normal[c]=n;
+		solver->tangent1[c]=t1;
+		solver->tangent2[c]=t2;
+		solver->normalMass[c]=EffectiveMass(invMassSum, invInertiaA, invInertiaB, rA, rB, n);
+		solver->tangentMass1[c]=EffectiveMass(invMassSum, invInertiaA, invInertiaB, rA, rB, t1);
+		solver->tangentMass2[c]=EffectiveMass(invMassSum, invInertiaA, invInertiaB, rA, rB, t2);
+		solver->friction[c]=friction;
+		solver->penetration[c]=contact->penetration;
+		solver->positionImpulse[c]=0.0f;
+
+		const vec3 dv=RelativeVelocity(solver->velocity[a], solver->angularVelocity[a], solver->velocity[b], solver->angularVelocity[b], rA, rB);
+		const float vn=Vec3_Dot(dv, n);
+
+		// Speculative contacts (still apart) get their bias once dt is known, don't bounce, and haven't hit anything yet
+		if(contact->penetration<0.0f)
+		{
+			solver->impactSpeed[c]=0.0f;
+			solver->velocityBias[c]=0.0f;
+		}
+		else
+		{
+			solver->impactSpeed[c]=vn<0.0f?sqrtf(-vn):0.0f;
+			solver->velocityBias[c]=vn<-SOLVER_RESTITUTION_THRESHOLD?-restitution*vn:0.0f;
+		}
+
+		solver->normalImpulse[c]=0.0f;
+		solver->tangentImpulse1[c]=0.0f;
+		solver->tangentImpulse2[c]=0.0f;
+
+		// Warm start from the closest matching point last step, a speculative contact may never be touched so it starts from nothing
+		if(previousPair&&contact->penetration>=0.0f)
+		{
+			const vec3 localPoint=QuatRotate(invCanonicalOrientation, swapped?rB:rA);
+			float bestDistanceSq=SOLVER_MATCH_DISTANCE*SOLVER_MATCH_DISTANCE;
+			uint32_t best=UINT32_MAX;
+
+			for(uint32_t j=0;j<previousPair->numPoints;j++)
+			{
+				const float distanceSq=Vec3_LengthSq(Vec3_Subv(previous->localPoint[previousPair->firstPoint+j], localPoint));
+
+				if(distanceSq<bestDistanceSq)
+				{
+					bestDistanceSq=distanceSq;
+					best=previousPair->firstPoint+j;
+				}
+			}
+
+			if(best!=UINT32_MAX)
+			{
+				// Project the old impulse onto this step's basis, the normal may have turned a little
+				const vec3 P=Vec3_Muls(previous->impulse[best], sign);
+				const float normalImpulse=fmaxf(Vec3_Dot(P, n), 0.0f);
+				const float maxFriction=friction*normalImpulse;
+
+				solver->normalImpulse[c]=normalImpulse;
+				solver->tangentImpulse1[c]=clampf(Vec3_Dot(P, t1), -maxFriction, maxFriction);
+				solver->tangentImpulse2[c]=clampf(Vec3_Dot(P, t2), -maxFriction, maxFriction);
+			}
+		}
+	}
+
+	return first;
+}
+
+void PhysicsSolver_Solve(PhysicsSolver_t *solver, const float dt)
+{
+	vec3 *v=solver->velocity, *w=solver->angularVelocity;
+	vec3 *vp=solver->pseudoVelocity, *wp=solver->pseudoAngularVelocity;
+	const float *invMass=solver->invMass, *invInertia=solver->invInertia;
+
+	// Speculative contacts allow closing the gap within this step and no further
+	if(dt>0.0f)
+	{
+		for(uint32_t c=0;c<solver->numContacts;c++)
+		{
+			if(solver->penetration[c]<0.0f)
+				solver->velocityBias[c]=solver->penetration[c]/dt;
+		}
+	}
+
+	// Apply last step's accumulated impulses
+	for(uint32_t c=0;c<solver->numContacts;c++)
+	{
+		const vec3 P=Vec3_Addv(Vec3_Muls(solver->normal[c], solver->normalImpulse[c]),
+							   Vec3_Addv(Vec3_Muls(solver->tangent1[c], solver->tangentImpulse1[c]),
+										 Vec3_Muls(solver->tangent2[c], solver->tangentImpulse2[c])));
+
+		ApplyImpulse(v, w, solver->bodyA[c], solver->bodyB[c], invMass, invInertia, solver->rA[c], solver->rB[c], P);
+	}
+
+	// Velocity iterations, accumulated impulses are clamped rather than each increment
+	for(uint32_t iteration=0;iteration<solver->velocityIterations;iteration++)
+	{
+		float maxDelta=0.0f;
+
+		for(uint32_t c=0;c<solver->numContacts;c++)
+		{
+			const uint32_t a=solver->bodyA[c], b=solver->bodyB[c];
+			const vec3 rA=solver->rA[c], rB=solver->rB[c];
+
+			// Friction first, so the normal constraint has the last say
+			const float maxFriction=solver->friction[c]*solver->normalImpulse[c];
+
+			vec3 dv=RelativeVelocity(v[a], w[a], v[b], w[b], rA, rB);
+			float lambda=-Vec3_Dot(dv, solver->tangent1[c])*solver->tangentMass1[c];
+			float newImpulse=clampf(solver->tangentImpulse1[c]+lambda, -maxFriction, maxFriction);
+			lambda=newImpulse-solver->tangentImpulse1[c];
+			solver->tangentImpulse1[c]=newImpulse;
+			ApplyImpulse(v, w, a, b, invMass, invInertia, rA, rB, Vec3_Muls(solver->tangent1[c], lambda));
+
+			dv=RelativeVelocity(v[a], w[a], v[b], w[b], rA, rB);
+			lambda=-Vec3_Dot(dv, solver->tangent2[c])*solver->tangentMass2[c];
+			newImpulse=clampf(solver->tangentImpulse2[c]+lambda, -maxFriction, maxFriction);
+			lambda=newImpulse-solver->tangentImpulse2[c];
+			solver->tangentImpulse2[c]=newImpulse;
+			ApplyImpulse(v, w, a, b, invMass, invInertia, rA, rB, Vec3_Muls(solver->tangent2[c], lambda));
+
+			dv=RelativeVelocity(v[a], w[a], v[b], w[b], rA, rB);
+			lambda=(solver->velocityBias[c]-Vec3_Dot(dv, solver->normal[c]))*solver->normalMass[c];
+			newImpulse=fmaxf(solver->normalImpulse[c]+lambda, 0.0f);
+			lambda=newImpulse-solver->normalImpulse[c];
+			solver->normalImpulse[c]=newImpulse;
+			ApplyImpulse(v, w, a, b, invMass, invInertia, rA, rB, Vec3_Muls(solver->normal[c], lambda));
+
+			maxDelta=fmaxf(maxDelta, fabsf(lambda));
+		}
+
+		solver->residual=maxDelta;
+	}
+
+	// Split impulse, push penetration out through pseudo velocities that are thrown away after this step,
+	// so correction never adds energy to the real velocities
+	if(dt>0.0f)
+	{
+		const float biasFactor=SOLVER_BAUMGARTE/dt;
+
+		for(uint32_t iteration=0;iteration<solver->positionIterations;iteration++)
+		{
+			for(uint32_t c=0;c<solver->numContacts;c++)
+			{
+				const uint32_t a=solver->bodyA[c], b=solver->bodyB[c];
+				const float bias=biasFactor*fmaxf(solver->penetration[c]-SOLVER_SLOP, 0.0f);
+
+				if(bias<=0.0f)
+					continue;
+
+				const vec3 dv=RelativeVelocity(vp[a], wp[a], vp[b], wp[b], solver->rA[c], solver->rB[c]);
+				float lambda=(bias-Vec3_Dot(dv, solver->normal[c]))*solver->normalMass[c];
+				const float newImpulse=fmaxf(solver->positionImpulse[c]+lambda, 0.0f);
+				lambda=newImpulse-solver->positionImpulse[c];
+				solver->positionImpulse[c]=newImpulse;
+
+				ApplyImpulse(vp, wp, a, b, invMass, invInertia, solver->rA[c], solver->rB[c], Vec3_Muls(solver->normal[c], lambda));
+			}
+		}
+	}
+
+	// Store accumulated impulses for next step, before orientations change
+	PhysicsContactCache_t *cache=&solver->cache[solver->currentCache];
+
+	for(uint32_t c=0;c<solver->numContacts;c++)
+	{
+		const uint32_t point=solver->cachePoint[c];
+
+		if(point==UINT32_MAX)
+			continue;
+
+		const bool swapped=solver->swapped[c];
+		const RigidBody_t *canonicalA=solver->body[swapped?solver->bodyB[c]:solver->bodyA[c]];
+		const vec3 P=Vec3_Addv(Vec3_Muls(solver->normal[c], solver->normalImpulse[c]),
+							   Vec3_Addv(Vec3_Muls(solver->tangent1[c], solver->tangentImpulse1[c]),
+										 Vec3_Muls(solver->tangent2[c], solver->tangentImpulse2[c])));
+
+		cache->localPoint[point]=QuatRotate(QuatInverse(canonicalA->orientation), swapped?solver->rB[c]:solver->rA[c]);
+		cache->impulse[point]=swapped?Vec3_Muls(P, -1.0f):P;
+	}
+
+	// Write back, angular velocity goes back to body local space
+	for(uint32_t i=0;i<solver->numBodies;i++)
+	{
+		RigidBody_t *body=solver->body[i];
+		const vec4 invOrientation=QuatInverse(body->orientation);
+
+		body->velocity=v[i];
+		body->angularVelocity=QuatRotate(invOrientation, w[i]);
+
+		if(invMass[i]==0.0f&&invInertia[i]==0.0f)
+			continue;
+
+		body->position=Vec3_Addv(body->position, Vec3_Muls(vp[i], dt));
+
+		// One explicit step of dq/dt=0.5*q*w with the pseudo angular velocity
+		const vec3 lw=Vec3_Muls(QuatRotate(invOrientation, wp[i]), 0.5f*dt);
+		const vec4 q=body->orientation;
+
+		body->orientation=Vec4_Addv(q, Vec4(
+			 q.w*lw.x+q.y*lw.z-q.z*lw.y,
+			 q.w*lw.y-q.x*lw.z+q.z*lw.x,
+			 q.w*lw.z+q.x*lw.y-q.y*lw.x,
+			-q.x*lw.x-q.y*lw.y-q.z*lw.z
+		));
+		Vec4_Normalize(&body->orientation);
+	}
+}
+
+float PhysicsSolver_GetImpactSpeed(const PhysicsSolver_t *solver, uint32_t contact)
+{
+	if(contact>=solver->numContacts)
+		return 0.0f;
+
+	return solver->impactSpeed[contact];
 }
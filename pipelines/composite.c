@@ -43,6 +43,10 @@ VkRenderPass gaussianRenderPass;
 VkFramebuffer gaussianFramebufferTemp[2];
 VkFramebuffer gaussianFramebufferBlur[2];
 
+// Pass data for the render graph, which eye a pass is for
+static uint32_t compositeEye[2]={ 0, 1 };
+static uint32_t compositeFrame=0;
+
 bool CreateThresholdPipeline(void)
 {
 	vkCreateRenderPass(vkContext.device, &(VkRenderPassCreateInfo)
@@ -163,16 +167,9 @@ bool CreateGaussianPipeline(void)
 	return true;
 }
 
+// Framebuffers for the images the render graph created, call after it's compiled
 void CreateCompositeFramebuffers(uint32_t eye)
 {
-	vkuCreateTexture2D(&vkContext, &colorTemp[eye], config.renderWidth>>2, config.renderHeight>>2, config.colorFormat, VK_SAMPLE_COUNT_1_BIT);
-	vkuCreateTexture2D(&vkContext, &colorBlur[eye], config.renderWidth>>2, config.renderHeight>>2, config.colorFormat, VK_SAMPLE_COUNT_1_BIT);
-
-	VkCommandBuffer commandBuffer=vkuOneShotCommandBufferBegin(&vkContext);
-	vkuTransitionLayout(commandBuffer, colorTemp[eye].image, 1, 0, 1, 0, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-	vkuTransitionLayout(commandBuffer, colorBlur[eye].image, 1, 0, 1, 0, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-	vkuOneShotCommandBufferEnd(&vkContext, commandBuffer);
-
 	// Threshold framebuffer contains 1/4 sized final main render frame, outputs to ColorBlur image
 	vkCreateFramebuffer(vkContext.device, &(VkFramebufferCreateInfo)
 	{
@@ -328,17 +325,9 @@ bool CreateCompositePipeline(void)
 	return true;
 }
 
+// The images belong to the render graph, only the framebuffers go here
 void DestroyCompositeFramebuffers(void)
 {
-	vkuDestroyImageBuffer(&vkContext, &colorBlur[0]);
-	vkuDestroyImageBuffer(&vkContext, &colorTemp[0]);
-
-	if(config.isVR)
-	{
-		vkuDestroyImageBuffer(&vkContext, &colorBlur[1]);
-		vkuDestroyImageBuffer(&vkContext, &colorTemp[1]);
-	}
-
 	// Thresholding
 	vkDestroyFramebuffer(vkContext.device, thresholdFramebuffer[0], VK_NULL_HANDLE);
 
@@ -370,8 +359,6 @@ void DestroyCompositeFramebuffers(void)
 
 void DestroyComposite(void)
 {
-	DestroyCompositeFramebuffers();
-
 	// Thresholding pipeline
 	DestroyPipeline(&vkContext, &thresholdPipeline);
 	vkDestroyRenderPass(vkContext.device, thresholdRenderPass, VK_NULL_HANDLE);
@@ -388,14 +375,16 @@ void DestroyComposite(void)
 	//////
 }
 
-void CompositeDraw(uint32_t imageIndex, uint32_t frameIndex, uint32_t eye)
+// Threshold and down sample to 1/4 original image size
+// Input = colorResolve
+// Output = colorBlur
+static void ThresholdPass(VkCommandBuffer commandBuffer, void *passData, void *frameData)
 {
-	static uint32_t uFrame=0;
+	const RenderFrame_t *frame=(const RenderFrame_t *)frameData;
+	const uint32_t eye=*(const uint32_t *)passData;
+	const uint32_t frameIndex=frame->index;
 
-	// Threshold and down sample to 1/4 original image size
-	// Input = colorResolve
-	// Output = colorBlur
-	vkCmdBeginRenderPass(perFrame[frameIndex].commandBuffer, &(VkRenderPassBeginInfo)
+	vkCmdBeginRenderPass(commandBuffer, &(VkRenderPassBeginInfo)
 	{
 		.sType=VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
 		.renderPass=thresholdRenderPass,
@@ -403,25 +392,31 @@ void CompositeDraw(uint32_t imageIndex, uint32_t frameIndex, uint32_t eye)
 		.renderArea={ { 0, 0 }, { config.renderWidth>>2, config.renderHeight>>2 } },
 	}, VK_SUBPASS_CONTENTS_INLINE);
 
-	vkCmdSetViewport(perFrame[frameIndex].commandBuffer, 0, 1, &(VkViewport) { 0.0f, 0.0f, (float)(config.renderWidth>>2), (float)(config.renderHeight>>2), 0.0f, 1.0f });
-	vkCmdSetScissor(perFrame[frameIndex].commandBuffer, 0, 1, &(VkRect2D) { { 0, 0 }, { config.renderWidth>>2, config.renderHeight>>2 } });
+	vkCmdSetViewport(commandBuffer, 0, 1, &(VkViewport) { 0.0f, 0.0f, (float)(config.renderWidth>>2), (float)(config.renderHeight>>2), 0.0f, 1.0f });
+	vkCmdSetScissor(commandBuffer, 0, 1, &(VkRect2D) { { 0, 0 }, { config.renderWidth>>2, config.renderHeight>>2 } });
 
-	vkCmdBindPipeline(perFrame[frameIndex].commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, thresholdPipeline.pipeline.pipeline);
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, thresholdPipeline.pipeline.pipeline);
 
 	vkuDescriptorSet_UpdateBindingImageInfo(&thresholdPipeline.descriptorSet, 0, colorResolve[eye].sampler, colorResolve[eye].imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
 	vkuAllocateUpdateDescriptorSet(&thresholdPipeline.descriptorSet, perFrame[frameIndex].descriptorPool);
-	vkCmdBindDescriptorSets(perFrame[frameIndex].commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, thresholdPipeline.pipelineLayout, 0, 1, &thresholdPipeline.descriptorSet.descriptorSet, 0, VK_NULL_HANDLE);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, thresholdPipeline.pipelineLayout, 0, 1, &thresholdPipeline.descriptorSet.descriptorSet, 0, VK_NULL_HANDLE);
 
-	vkCmdDraw(perFrame[frameIndex].commandBuffer, 3, 1, 0, 0);
+	vkCmdDraw(commandBuffer, 3, 1, 0, 0);
 
-	vkCmdEndRenderPass(perFrame[frameIndex].commandBuffer);
-	//////
+	vkCmdEndRenderPass(commandBuffer);
+}
 
-	// Gaussian blur (vertical)
-	// Input = colorBlur
-	// Output = colorTemp
-	vkCmdBeginRenderPass(perFrame[frameIndex].commandBuffer, &(VkRenderPassBeginInfo)
+// Gaussian blur (vertical)
+// Input = colorBlur
+// Output = colorTemp
+static void GaussianVerticalPass(VkCommandBuffer commandBuffer, void *passData, void *frameData)
+{
+	const RenderFrame_t *frame=(const RenderFrame_t *)frameData;
+	const uint32_t eye=*(const uint32_t *)passData;
+	const uint32_t frameIndex=frame->index;
+
+	vkCmdBeginRenderPass(commandBuffer, &(VkRenderPassBeginInfo)
 	{
 		.sType=VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
 		.renderPass=gaussianRenderPass,
@@ -429,32 +424,38 @@ void CompositeDraw(uint32_t imageIndex, uint32_t frameIndex, uint32_t eye)
 		.renderArea={ { 0, 0 }, { config.renderWidth>>2, config.renderHeight>>2 } },
 	}, VK_SUBPASS_CONTENTS_INLINE);
 
-	vkCmdSetViewport(perFrame[frameIndex].commandBuffer, 0, 1, &(VkViewport) { 0.0f, 0.0f, (float)(config.renderWidth>>2), (float)(config.renderHeight>>2), 0.0f, 1.0f });
-	vkCmdSetScissor(perFrame[frameIndex].commandBuffer, 0, 1, &(VkRect2D) { { 0, 0 }, { config.renderWidth>>2, config.renderHeight>>2 } });
+	vkCmdSetViewport(commandBuffer, 0, 1, &(VkViewport) { 0.0f, 0.0f, (float)(config.renderWidth>>2), (float)(config.renderHeight>>2), 0.0f, 1.0f });
+	vkCmdSetScissor(commandBuffer, 0, 1, &(VkRect2D) { { 0, 0 }, { config.renderWidth>>2, config.renderHeight>>2 } });
 
-	vkCmdBindPipeline(perFrame[frameIndex].commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, gaussianPipeline.pipeline.pipeline);
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, gaussianPipeline.pipeline.pipeline);
 
 #ifdef ANDROID
 	// TODO: Need a better fix for this, Android/Vulkan pre-transform screws this up
-	vkCmdPushConstants(perFrame[frameIndex].commandBuffer, gaussianPipeline.pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(vec2), &(vec2){ (float)config.renderWidth/config.renderHeight, 0.0 });
+	vkCmdPushConstants(commandBuffer, gaussianPipeline.pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(vec2), &(vec2){ (float)config.renderWidth/config.renderHeight, 0.0 });
 #else
-	vkCmdPushConstants(perFrame[frameIndex].commandBuffer, gaussianPipeline.pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(vec2), &(vec2){ 1.0f, 0.0 });
+	vkCmdPushConstants(commandBuffer, gaussianPipeline.pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(vec2), &(vec2){ 1.0f, 0.0 });
 #endif
 
 	vkuDescriptorSet_UpdateBindingImageInfo(&gaussianPipeline.descriptorSet, 0, colorBlur[eye].sampler, colorBlur[eye].imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 	vkuAllocateUpdateDescriptorSet(&gaussianPipeline.descriptorSet, perFrame[frameIndex].descriptorPool);
 
-	vkCmdBindDescriptorSets(perFrame[frameIndex].commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, gaussianPipeline.pipelineLayout, 0, 1, &gaussianPipeline.descriptorSet.descriptorSet, 0, VK_NULL_HANDLE);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, gaussianPipeline.pipelineLayout, 0, 1, &gaussianPipeline.descriptorSet.descriptorSet, 0, VK_NULL_HANDLE);
 
-	vkCmdDraw(perFrame[frameIndex].commandBuffer, 3, 1, 0, 0);
+	vkCmdDraw(commandBuffer, 3, 1, 0, 0);
 
-	vkCmdEndRenderPass(perFrame[frameIndex].commandBuffer);
-	//////
+	vkCmdEndRenderPass(commandBuffer);
+}
+
+// Gaussian blur (horizontal)
+// Input = colorTemp
+// Output = colorBlur
+static void GaussianHorizontalPass(VkCommandBuffer commandBuffer, void *passData, void *frameData)
+{
+	const RenderFrame_t *frame=(const RenderFrame_t *)frameData;
+	const uint32_t eye=*(const uint32_t *)passData;
+	const uint32_t frameIndex=frame->index;
 
-	// Gaussian blur (horizontal)
-	// Input = colorTemp
-	// Output = colorBlur
-	vkCmdBeginRenderPass(perFrame[frameIndex].commandBuffer, &(VkRenderPassBeginInfo)
+	vkCmdBeginRenderPass(commandBuffer, &(VkRenderPassBeginInfo)
 	{
 		.sType=VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
 		.renderPass=gaussianRenderPass,
@@ -462,41 +463,51 @@ void CompositeDraw(uint32_t imageIndex, uint32_t frameIndex, uint32_t eye)
 		.renderArea={ { 0, 0 }, { config.renderWidth>>2, config.renderHeight>>2 } },
 	}, VK_SUBPASS_CONTENTS_INLINE);
 
+	vkCmdSetViewport(commandBuffer, 0, 1, &(VkViewport) { 0.0f, 0.0f, (float)(config.renderWidth>>2), (float)(config.renderHeight>>2), 0.0f, 1.0f });
+	vkCmdSetScissor(commandBuffer, 0, 1, &(VkRect2D) { { 0, 0 }, { config.renderWidth>>2, config.renderHeight>>2 } });
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, gaussianPipeline.pipeline.pipeline);
+
 #ifdef ANDROID
 	// TODO: Need a better fix for this, Android/Vulkan pre-transform screws this up
-	vkCmdPushConstants(perFrame[frameIndex].commandBuffer, gaussianPipeline.pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(vec2), &(vec2){ 0.0f, (float)config.renderHeight/config.renderWidth });
+	vkCmdPushConstants(commandBuffer, gaussianPipeline.pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(vec2), &(vec2){ 0.0f, (float)config.renderHeight/config.renderWidth });
 #else
-	vkCmdPushConstants(perFrame[frameIndex].commandBuffer, gaussianPipeline.pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(vec2), &(vec2){ 0.0f, 1.0f });
+	vkCmdPushConstants(commandBuffer, gaussianPipeline.pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(vec2), &(vec2){ 0.0f, 1.0f });
 #endif
 
 	vkuDescriptorSet_UpdateBindingImageInfo(&gaussianPipeline.descriptorSet, 0, colorTemp[eye].sampler, colorTemp[eye].imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 	vkuAllocateUpdateDescriptorSet(&gaussianPipeline.descriptorSet, perFrame[frameIndex].descriptorPool);
 
-	vkCmdBindDescriptorSets(perFrame[frameIndex].commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, gaussianPipeline.pipelineLayout, 0, 1, &gaussianPipeline.descriptorSet.descriptorSet, 0, VK_NULL_HANDLE);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, gaussianPipeline.pipelineLayout, 0, 1, &gaussianPipeline.descriptorSet.descriptorSet, 0, VK_NULL_HANDLE);
 
-	vkCmdDraw(perFrame[frameIndex].commandBuffer, 3, 1, 0, 0);
+	vkCmdDraw(commandBuffer, 3, 1, 0, 0);
 
-	vkCmdEndRenderPass(perFrame[frameIndex].commandBuffer);
-	//////
+	vkCmdEndRenderPass(commandBuffer);
+}
+
+// Draw final composited image
+// Input = colorResolve, colorBlur, depth, shadow
+// Output = swapchain
+static void CompositePass(VkCommandBuffer commandBuffer, void *passData, void *frameData)
+{
+	const RenderFrame_t *frame=(const RenderFrame_t *)frameData;
+	const uint32_t eye=*(const uint32_t *)passData;
+	const uint32_t frameIndex=frame->index;
 
-	// Draw final composited image
-	// Input = colorResolve, colorBlur
-	// Output = swapchain
-	// NOTE: ColorResolve should already be in shader read-only
-	vkCmdBeginRenderPass(perFrame[frameIndex].commandBuffer, &(VkRenderPassBeginInfo)
+	vkCmdBeginRenderPass(commandBuffer, &(VkRenderPassBeginInfo)
 	{
 		.sType=VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
 		.renderPass=compositeRenderPass,
-		.framebuffer=compositeFramebuffer[imageIndex][eye],
+		.framebuffer=compositeFramebuffer[frame->imageIndex[eye]][eye],
 		.clearValueCount=1,
 		.pClearValues=(VkClearValue[]){ {{{ 0.0f, 0.0f, 0.0f, 1.0f }}} },
 		.renderArea={ { 0, 0 }, { config.renderWidth, config.renderHeight } },
 	}, VK_SUBPASS_CONTENTS_INLINE);
 
-	vkCmdSetViewport(perFrame[frameIndex].commandBuffer, 0, 1, &(VkViewport) { 0.0f, 0.0f, (float)config.renderWidth, (float)config.renderHeight, 0.0f, 1.0f });
-	vkCmdSetScissor(perFrame[frameIndex].commandBuffer, 0, 1, &(VkRect2D) { { 0, 0 }, { config.renderWidth, config.renderHeight } });
+	vkCmdSetViewport(commandBuffer, 0, 1, &(VkViewport) { 0.0f, 0.0f, (float)config.renderWidth, (float)config.renderHeight, 0.0f, 1.0f });
+	vkCmdSetScissor(commandBuffer, 0, 1, &(VkRect2D) { { 0, 0 }, { config.renderWidth, config.renderHeight } });
 
-	vkCmdBindPipeline(perFrame[frameIndex].commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, compositePipeline.pipeline.pipeline);
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, compositePipeline.pipeline.pipeline);
 
 	vkuDescriptorSet_UpdateBindingImageInfo(&compositePipeline.descriptorSet, 0, colorResolve[eye].sampler, colorResolve[eye].imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 	vkuDescriptorSet_UpdateBindingImageInfo(&compositePipeline.descriptorSet, 1, colorBlur[eye].sampler, colorBlur[eye].imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
@@ -505,7 +516,7 @@ void CompositeDraw(uint32_t imageIndex, uint32_t frameIndex, uint32_t eye)
 	vkuDescriptorSet_UpdateBindingBufferInfo(&compositePipeline.descriptorSet, 4, perFrame[frameIndex].mainUBOBuffer[eye].buffer, 0, VK_WHOLE_SIZE);
 
 	vkuAllocateUpdateDescriptorSet(&compositePipeline.descriptorSet, perFrame[frameIndex].descriptorPool);
-	vkCmdBindDescriptorSets(perFrame[frameIndex].commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, compositePipeline.pipelineLayout, 0, 1, &compositePipeline.descriptorSet.descriptorSet, 0, VK_NULL_HANDLE);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, compositePipeline.pipelineLayout, 0, 1, &compositePipeline.descriptorSet.descriptorSet, 0, VK_NULL_HANDLE);
 
 	struct
 	{
@@ -516,7 +527,7 @@ void CompositeDraw(uint32_t imageIndex, uint32_t frameIndex, uint32_t eye)
 	PC.uSize[0]=config.renderWidth;
 	PC.uSize[1]=config.renderHeight;
 	PC.uSamples=config.msaaSamples;
-	PC.uFrame=uFrame++;
+	PC.uFrame=compositeFrame++;
 
 #ifdef ANDROID
 	matrix mvp=MatrixMult(MatrixScale(1.0f, -1.0f, 1.0f), MatrixRotate(PI/2.0f, 0.0f, 0.0f, 1.0f));
@@ -527,24 +538,59 @@ void CompositeDraw(uint32_t imageIndex, uint32_t frameIndex, uint32_t eye)
 	if(config.isVR)
 		mvp=MatrixMult(MatrixMult(MatrixScale(((float)config.renderWidth/config.renderHeight)*1.0f, 1.0f, 1.0f), MatrixTranslate(0.0f, 0.0f, -1.0f)), MatrixMult(perFrame[frameIndex].mainUBO[eye]->HMD, perFrame[frameIndex].mainUBO[eye]->projection));
 
-	vkCmdPushConstants(perFrame[frameIndex].commandBuffer, compositePipeline.pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PC), &PC);
+	vkCmdPushConstants(commandBuffer, compositePipeline.pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PC), &PC);
 
-	vkCmdDraw(perFrame[frameIndex].commandBuffer, 3, 1, 0, 0);
+	vkCmdDraw(commandBuffer, 3, 1, 0, 0);
 
 	if(!config.isVR)
 	{
 		// Draw UI controls
-		UI_Draw(&UI, perFrame[frameIndex].commandBuffer, perFrame[frameIndex].descriptorPool, mvp, fTimeStep);
+		UI_Draw(&UI, commandBuffer, perFrame[frameIndex].descriptorPool, mvp, fTimeStep);
 
 		// Draw text in the compositing renderpass
 		Font_Print(&font, 16.0f, 0.0f, (float)config.renderHeight-16.0f, "FPS: %0.1f\n\x1B[33mFrame time: %0.3fms\nAudio time: %0.3fms\nPhysics time: %0.3fms", fps, fTimeStep*1000.0f, audioTime*1000.0f, physicsTime*1000.0f);
 
-		Font_Draw(&font, perFrame[frameIndex].commandBuffer, mvp);
+		Font_Draw(&font, commandBuffer, mvp);
 
-		DrawLineGraph(perFrame[frameIndex].commandBuffer, &frameTimes, mvp);
-		DrawLineGraph(perFrame[frameIndex].commandBuffer, &audioTimes, mvp);
-		DrawLineGraph(perFrame[frameIndex].commandBuffer, &physicsTimes, mvp);
+		DrawLineGraph(commandBuffer, &frameTimes, mvp);
+		DrawLineGraph(commandBuffer, &audioTimes, mvp);
+		DrawLineGraph(commandBuffer, &physicsTimes, mvp);
 	}
 
-	vkCmdEndRenderPass(perFrame[frameIndex].commandBuffer);
+	vkCmdEndRenderPass(commandBuffer);
+}
+
+// Declares the bloom chain and final composite for an eye, the blur images are transients so other eyes can reuse their memory
+bool CompositeAddPasses(VkuRenderGraph_t *graph, uint32_t eye, uint32_t colorResolveResource, uint32_t depthResource, uint32_t shadowResource, uint32_t outputResource)
+{
+	const uint32_t colorBlurResource=vkuRenderGraph_AddTransientImage(graph, &colorBlur[eye], config.renderWidth>>2, config.renderHeight>>2, config.colorFormat, VK_SAMPLE_COUNT_1_BIT);
+	const uint32_t colorTempResource=vkuRenderGraph_AddTransientImage(graph, &colorTemp[eye], config.renderWidth>>2, config.renderHeight>>2, config.colorFormat, VK_SAMPLE_COUNT_1_BIT);
+
+	if(colorBlurResource==UINT32_MAX||colorTempResource==UINT32_MAX)
+		return false;
+
+	// The blur render passes end in shader read-only themselves
+	const uint32_t thresholdPass=vkuRenderGraph_AddPass(graph, "Threshold", ThresholdPass, &compositeEye[eye]);
+	vkuRenderGraph_PassRead(graph, thresholdPass, colorResolveResource);
+	vkuRenderGraph_PassWrite(graph, thresholdPass, colorBlurResource, VKU_RENDERGRAPH_ACCESS_COLOR, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+	const uint32_t verticalPass=vkuRenderGraph_AddPass(graph, "Gaussian vertical", GaussianVerticalPass, &compositeEye[eye]);
+	vkuRenderGraph_PassRead(graph, verticalPass, colorBlurResource);
+	vkuRenderGraph_PassWrite(graph, verticalPass, colorTempResource, VKU_RENDERGRAPH_ACCESS_COLOR, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+	const uint32_t horizontalPass=vkuRenderGraph_AddPass(graph, "Gaussian horizontal", GaussianHorizontalPass, &compositeEye[eye]);
+	vkuRenderGraph_PassRead(graph, horizontalPass, colorTempResource);
+	vkuRenderGraph_PassWrite(graph, horizontalPass, colorBlurResource, VKU_RENDERGRAPH_ACCESS_COLOR, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+	// Composite render pass takes the swapchain image from/to present itself
+	const uint32_t compositePass=vkuRenderGraph_AddPass(graph, "Composite", CompositePass, &compositeEye[eye]);
+	vkuRenderGraph_PassRead(graph, compositePass, colorResolveResource);
+	vkuRenderGraph_PassRead(graph, compositePass, colorBlurResource);
+	vkuRenderGraph_PassRead(graph, compositePass, depthResource);
+	vkuRenderGraph_PassRead(graph, compositePass, shadowResource);
+
+	if(!vkuRenderGraph_PassWrite(graph, compositePass, outputResource, VKU_RENDERGRAPH_ACCESS_EXTERNAL, VK_IMAGE_LAYOUT_UNDEFINED))
+		return false;
+
+	return true;
 }
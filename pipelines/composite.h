@@ -8,9 +8,9 @@ extern VkuImage_t colorResolve[2];
 extern VkRenderPass compositeRenderPass;
 
 bool CreateCompositePipeline(void);
+bool CompositeAddPasses(VkuRenderGraph_t *graph, uint32_t eye, uint32_t colorResolveResource, uint32_t depthResource, uint32_t shadowResource, uint32_t outputResource);
 void CreateCompositeFramebuffers(uint32_t eye);
 void DestroyCompositeFramebuffers(void);
 void DestroyComposite(void);
-void CompositeDraw(uint32_t imageIndex, uint32_t frameIndex, uint32_t eye);
 
 #endif
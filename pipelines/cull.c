@@ -0,0 +1,376 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "../system/system.h"
+#include "../vulkan/vulkan.h"
+#include "../math/math.h"
+#include "../model/bmodel.h"
+#include "../utils/pipeline.h"
+#include "../assetmanager.h"
+#include "../perframe.h"
+#include "../entitylist.h"
+#include "cull.h"
+
+extern VkuContext_t vkContext;
+
+// Must match shaders/cull.comp
+typedef struct
+{
+	EntityInstance_t instance;
+	vec3 boundsMin;
+	float radius;
+	vec3 boundsMax;
+	uint32_t batch;
+} CullEntity_t;
+
+typedef struct
+{
+	uint32_t instanceOffset;
+	uint32_t numLOD;
+	uint32_t numMesh;
+	uint32_t drawOffset;
+	float LODError[BMODEL_MAX_LOD];
+} CullBatch_t;
+
+typedef struct
+{
+	vec4 planes[6];
+	vec4 eyeLODScale;
+	uint32_t count;
+	uint32_t pass;
+	uint32_t pad[2];
+} CullPushConstant_t;
+
+typedef enum
+{
+	CULL_PASS_ENTITIES,
+	CULL_PASS_DRAWS,
+	CULL_PASS_SCATTER,
+} CullPass_e;
+
+#define CULL_WORKGROUP_SIZE 64
+
+static Pipeline_t cullPipeline;
+static VkDescriptorPool cullDescriptorPool=VK_NULL_HANDLE;
+
+// Off when the device is missing a feature the indirect path needs, or the pipeline failed to load
+static bool cullSupported=false;
+
+static struct
+{
+	// Written by the CPU each frame
+	VkuBuffer_t entityBuffer;
+	CullEntity_t *entities;
+	VkuBuffer_t batchBuffer;
+	CullBatch_t *batches;
+	VkuBuffer_t meshLODBuffer;
+	uint32_t *meshLODs;
+
+	// Written by the GPU
+	VkuBuffer_t counterBuffer;
+	VkuBuffer_t slotBuffer;
+	VkuBuffer_t drawBuffer;
+	VkuBuffer_t drawCountBuffer;
+	VkuBuffer_t instanceBuffer;
+
+	VkDescriptorSet descriptorSet;
+
+	// What was culled this frame, kept separate from the entity list so a rebuild can't change it mid frame
+	bool active;
+	uint32_t entityCount;
+	uint32_t batchCount;
+	EntityBatch_t drawBatches[CULL_MAX_BATCHES];
+	uint32_t drawOffset[CULL_MAX_BATCHES];
+	uint32_t maxDraws[CULL_MAX_BATCHES];
+} cullFrame[FRAMES_IN_FLIGHT];
+
+bool CreateCullPipeline(void)
+{
+	cullSupported=false;
+
+	if(!config.gpuCulling)
+	{
+		DBGPRINTF(DEBUG_INFO, "GPU culling disabled by config, using CPU culling.\n");
+		return true;
+	}
+
+	// Batches draw straight out of the shared instance buffer and issue a draw per mesh and LOD in one call
+	if(!vkContext.deviceFeatures.multiDrawIndirect||!vkContext.deviceFeatures.drawIndirectFirstInstance)
+	{
+		DBGPRINTF(DEBUG_WARNING, "Device is missing multiDrawIndirect or drawIndirectFirstInstance, using CPU culling.\n");
+		return true;
+	}
+
+	if(!CreatePipeline(&vkContext, &cullPipeline, VK_NULL_HANDLE, "pipelines/cull.pipeline"))
+	{
+		DBGPRINTF(DEBUG_WARNING, "Failed to create culling pipeline, using CPU culling.\n");
+		return true;
+	}
+
+	if(vkCreateDescriptorPool(vkContext.device, &(VkDescriptorPoolCreateInfo)
+	{
+		.sType=VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.maxSets=FRAMES_IN_FLIGHT,
+		.poolSizeCount=1,
+		.pPoolSizes=(VkDescriptorPoolSize[])
+		{
+			{
+				.type=VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount=FRAMES_IN_FLIGHT*8,
+			},
+		},
+	}, VK_NULL_HANDLE, &cullDescriptorPool)!=VK_SUCCESS)
+	{
+		DBGPRINTF(DEBUG_ERROR, "CreateCullPipeline: Failed to create descriptor pool.\n");
+		return false;
+	}
+
+	for(uint32_t i=0;i<FRAMES_IN_FLIGHT;i++)
+	{
+		memset(&cullFrame[i], 0, sizeof(cullFrame[i]));
+
+		if(!vkuCreateHostBuffer(&vkContext, &cullFrame[i].entityBuffer, sizeof(CullEntity_t)*MAX_ENTITY, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT))
+			return false;
+
+		if(!vkuCreateHostBuffer(&vkContext, &cullFrame[i].batchBuffer, sizeof(CullBatch_t)*CULL_MAX_BATCHES, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT))
+			return false;
+
+		if(!vkuCreateHostBuffer(&vkContext, &cullFrame[i].meshLODBuffer, sizeof(uint32_t)*2*CULL_MAX_DRAWS, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT))
+			return false;
+
+		cullFrame[i].entities=(CullEntity_t *)cullFrame[i].entityBuffer.memory->mappedPointer;
+		cullFrame[i].batches=(CullBatch_t *)cullFrame[i].batchBuffer.memory->mappedPointer;
+		cullFrame[i].meshLODs=(uint32_t *)cullFrame[i].meshLODBuffer.memory->mappedPointer;
+
+		if(!vkuCreateGPUBuffer(&vkContext, &cullFrame[i].counterBuffer, sizeof(uint32_t)*BMODEL_MAX_LOD*CULL_MAX_BATCHES, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT|VK_BUFFER_USAGE_TRANSFER_DST_BIT))
+			return false;
+
+		if(!vkuCreateGPUBuffer(&vkContext, &cullFrame[i].slotBuffer, sizeof(uint32_t)*MAX_ENTITY, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT))
+			return false;
+
+		if(!vkuCreateGPUBuffer(&vkContext, &cullFrame[i].drawBuffer, sizeof(VkDrawIndexedIndirectCommand)*CULL_MAX_DRAWS, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT|VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT))
+			return false;
+
+		if(!vkuCreateGPUBuffer(&vkContext, &cullFrame[i].drawCountBuffer, sizeof(uint32_t)*CULL_MAX_BATCHES, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT|VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT))
+			return false;
+
+		if(!vkuCreateGPUBuffer(&vkContext, &cullFrame[i].instanceBuffer, sizeof(EntityInstance_t)*MAX_ENTITY, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT|VK_BUFFER_USAGE_VERTEX_BUFFER_BIT))
+			return false;
+
+		// Buffers never change, so each frame's set is written once here
+		vkuDescriptorSet_UpdateBindingBufferInfo(&cullPipeline.descriptorSet, 0, cullFrame[i].entityBuffer.buffer, 0, VK_WHOLE_SIZE);
+		vkuDescriptorSet_UpdateBindingBufferInfo(&cullPipeline.descriptorSet, 1, cullFrame[i].batchBuffer.buffer, 0, VK_WHOLE_SIZE);
+		vkuDescriptorSet_UpdateBindingBufferInfo(&cullPipeline.descriptorSet, 2, cullFrame[i].meshLODBuffer.buffer, 0, VK_WHOLE_SIZE);
+		vkuDescriptorSet_UpdateBindingBufferInfo(&cullPipeline.descriptorSet, 3, cullFrame[i].counterBuffer.buffer, 0, VK_WHOLE_SIZE);
+		vkuDescriptorSet_UpdateBindingBufferInfo(&cullPipeline.descriptorSet, 4, cullFrame[i].slotBuffer.buffer, 0, VK_WHOLE_SIZE);
+		vkuDescriptorSet_UpdateBindingBufferInfo(&cullPipeline.descriptorSet, 5, cullFrame[i].drawBuffer.buffer, 0, VK_WHOLE_SIZE);
+		vkuDescriptorSet_UpdateBindingBufferInfo(&cullPipeline.descriptorSet, 6, cullFrame[i].drawCountBuffer.buffer, 0, VK_WHOLE_SIZE);
+		vkuDescriptorSet_UpdateBindingBufferInfo(&cullPipeline.descriptorSet, 7, cullFrame[i].instanceBuffer.buffer, 0, VK_WHOLE_SIZE);
+
+		if(!vkuAllocateUpdateDescriptorSet(&cullPipeline.descriptorSet, cullDescriptorPool))
+			return false;
+
+		cullFrame[i].descriptorSet=cullPipeline.descriptorSet.descriptorSet;
+	}
+
+	cullSupported=true;
+
+	DBGPRINTF(DEBUG_INFO, "GPU culling enabled (%s).\n", vkContext.drawIndirectCountExtension?"indirect count":"indirect");
+
+	return true;
+}
+
+void DestroyCull(void)
+{
+	for(uint32_t i=0;i<FRAMES_IN_FLIGHT;i++)
+	{
+		if(cullFrame[i].entityBuffer.buffer)
+			vkuDestroyBuffer(&vkContext, &cullFrame[i].entityBuffer);
+
+		if(cullFrame[i].batchBuffer.buffer)
+			vkuDestroyBuffer(&vkContext, &cullFrame[i].batchBuffer);
+
+		if(cullFrame[i].meshLODBuffer.buffer)
+			vkuDestroyBuffer(&vkContext, &cullFrame[i].meshLODBuffer);
+
+		if(cullFrame[i].counterBuffer.buffer)
+			vkuDestroyBuffer(&vkContext, &cullFrame[i].counterBuffer);
+
+		if(cullFrame[i].slotBuffer.buffer)
+			vkuDestroyBuffer(&vkContext, &cullFrame[i].slotBuffer);
+
+		if(cullFrame[i].drawBuffer.buffer)
+			vkuDestroyBuffer(&vkContext, &cullFrame[i].drawBuffer);
+
+		if(cullFrame[i].drawCountBuffer.buffer)
+			vkuDestroyBuffer(&vkContext, &cullFrame[i].drawCountBuffer);
+
+		if(cullFrame[i].instanceBuffer.buffer)
+			vkuDestroyBuffer(&vkContext, &cullFrame[i].instanceBuffer);
+
+		memset(&cullFrame[i], 0, sizeof(cullFrame[i]));
+	}
+
+	if(cullDescriptorPool)
+	{
+		vkDestroyDescriptorPool(vkContext.device, cullDescriptorPool, VK_NULL_HANDLE);
+		cullDescriptorPool=VK_NULL_HANDLE;
+	}
+
+	if(cullSupported)
+		DestroyPipeline(&vkContext, &cullPipeline);
+
+	cullSupported=false;
+}
+
+// Uploads every entity's instance and bounds along with the batch and mesh LOD tables.
+// Returns false if the GPU path can't handle this frame, in which case the CPU culled instances should be used.
+bool CullUpdate(const EntityList_t *entityList, uint32_t frameIndex)
+{
+	cullFrame[frameIndex].active=false;
+
+	if(!cullSupported||entityList->batchCount>CULL_MAX_BATCHES)
+		return false;
+
+	CullBatch_t *batches=cullFrame[frameIndex].batches;
+	uint32_t *meshLODs=cullFrame[frameIndex].meshLODs;
+	uint32_t drawOffset=0;
+
+	for(uint32_t b=0;b<entityList->batchCount;b++)
+	{
+		const EntityBatch_t *batch=&entityList->batches[b];
+		// Batches that aren't drawn have no model asset behind their model ID, they're kept with no meshes so their
+		//   entities still index the right batch, but produce no draws
+		const BModel_t *model=batch->noRender?NULL:&AssetManager_GetAsset(assets, batch->modelID)->model;
+		const uint32_t numMesh=model?model->numMesh:0;
+		const uint32_t numLOD=model?model->numLOD:0;
+		const uint32_t numDraws=numMesh*BMODEL_MAX_LOD;
+
+		if(drawOffset+numDraws>CULL_MAX_DRAWS)
+			return false;
+
+		batches[b].instanceOffset=batch->instanceOffset;
+		batches[b].numLOD=numLOD;
+		batches[b].numMesh=numMesh;
+		batches[b].drawOffset=drawOffset;
+
+		for(uint32_t LOD=0;LOD<BMODEL_MAX_LOD;LOD++)
+			batches[b].LODError[LOD]=(LOD<numLOD)?model->LODError[LOD]:0.0f;
+
+		// Every LOD slot is filled, meshes with fewer LODs than the model keep drawing their last one
+		for(uint32_t m=0;m<numMesh;m++)
+		{
+			for(uint32_t LOD=0;LOD<BMODEL_MAX_LOD;LOD++)
+			{
+				const BModel_LOD_t *meshLOD=&model->mesh[m].LOD[min(LOD, model->mesh[m].numLOD-1)];
+				uint32_t *dst=&meshLODs[2*(drawOffset+m*BMODEL_MAX_LOD+LOD)];
+
+				dst[0]=meshLOD->firstIndex;
+				dst[1]=meshLOD->numIndex;
+			}
+		}
+
+		cullFrame[frameIndex].drawBatches[b]=*batch;
+		cullFrame[frameIndex].drawOffset[b]=drawOffset;
+		cullFrame[frameIndex].maxDraws[b]=numDraws;
+
+		drawOffset+=numDraws;
+
+		// Entities are uploaded in sorted order, so the batch ranges index them directly
+		for(uint32_t i=batch->instanceOffset;i<batch->instanceOffset+batch->instanceCount;i++)
+		{
+			const uint32_t index=entityList->sortedIndices[i];
+			const Entity_t *entity=&entityList->entities[index];
+			CullEntity_t *dst=&cullFrame[frameIndex].entities[i];
+
+			dst->instance=entityList->instances[index];
+			dst->boundsMin=entity->bounds.min;
+			dst->boundsMax=entity->bounds.max;
+			dst->radius=(entity->body->type==RIGIDBODY_SPHERE)?entity->body->radius:Vec3_Distance(entity->bounds.min, entity->bounds.max)*0.5f;
+			dst->batch=b;
+		}
+	}
+
+	cullFrame[frameIndex].entityCount=entityList->sortedCount;
+	cullFrame[frameIndex].batchCount=entityList->batchCount;
+	cullFrame[frameIndex].active=true;
+
+	return true;
+}
+
+static void CullBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+{
+	vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 1, &(VkMemoryBarrier)
+	{
+		.sType=VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask=srcAccess,
+		.dstAccessMask=dstAccess,
+	}, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE);
+}
+
+static void CullRunPass(VkCommandBuffer commandBuffer, CullPushConstant_t *pushConstant, CullPass_e pass, uint32_t count)
+{
+	pushConstant->pass=pass;
+	pushConstant->count=count;
+
+	vkCmdPushConstants(commandBuffer, cullPipeline.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstant_t), pushConstant);
+	vkCmdDispatch(commandBuffer, (count+CULL_WORKGROUP_SIZE-1)/CULL_WORKGROUP_SIZE, 1, 1);
+}
+
+// Records the culling dispatches, must be outside of a render pass and before anything draws with the results
+void CullDispatch(VkCommandBuffer commandBuffer, uint32_t frameIndex, const frustum frustum, const vec3 eye, const float LODScale)
+{
+	if(!cullFrame[frameIndex].active||cullFrame[frameIndex].entityCount==0)
+		return;
+
+	CullPushConstant_t pushConstant;
+
+	memcpy(pushConstant.planes, frustum.planes, sizeof(pushConstant.planes));
+
+	// Shader compares against one pixel, so fold the allowed error into the scale
+	pushConstant.eyeLODScale=Vec4(eye.x, eye.y, eye.z, LODScale/ENTITY_LOD_PIXEL_ERROR);
+
+	vkCmdFillBuffer(commandBuffer, cullFrame[frameIndex].counterBuffer.buffer, 0, sizeof(uint32_t)*BMODEL_MAX_LOD*cullFrame[frameIndex].batchCount, 0);
+
+	CullBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT|VK_ACCESS_SHADER_WRITE_BIT);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline.pipeline.pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline.pipelineLayout, 0, 1, &cullFrame[frameIndex].descriptorSet, 0, VK_NULL_HANDLE);
+
+	CullRunPass(commandBuffer, &pushConstant, CULL_PASS_ENTITIES, cullFrame[frameIndex].entityCount);
+	CullBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT|VK_ACCESS_SHADER_WRITE_BIT);
+
+	CullRunPass(commandBuffer, &pushConstant, CULL_PASS_DRAWS, cullFrame[frameIndex].batchCount);
+	CullBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+	CullRunPass(commandBuffer, &pushConstant, CULL_PASS_SCATTER, cullFrame[frameIndex].entityCount);
+	CullBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT|VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT|VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+}
+
+bool CullIsActive(uint32_t frameIndex)
+{
+	return cullFrame[frameIndex].active;
+}
+
+uint32_t CullGetBatches(uint32_t frameIndex, const EntityBatch_t **batches)
+{
+	*batches=cullFrame[frameIndex].drawBatches;
+
+	return cullFrame[frameIndex].batchCount;
+}
+
+void CullBindInstances(VkCommandBuffer commandBuffer, uint32_t frameIndex)
+{
+	vkCmdBindVertexBuffers(commandBuffer, 1, 1, &cullFrame[frameIndex].instanceBuffer.buffer, &(VkDeviceSize){0});
+}
+
+// Draws every mesh and LOD of a batch, expects the batch's model and material to already be bound
+void CullDrawBatch(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t batch)
+{
+	const VkDeviceSize offset=sizeof(VkDrawIndexedIndirectCommand)*cullFrame[frameIndex].drawOffset[batch];
+
+	if(vkContext.drawIndirectCountExtension)
+		vkCmdDrawIndexedIndirectCountKHR(commandBuffer, cullFrame[frameIndex].drawBuffer.buffer, offset, cullFrame[frameIndex].drawCountBuffer.buffer, sizeof(uint32_t)*batch, cullFrame[frameIndex].maxDraws[batch], sizeof(VkDrawIndexedIndirectCommand));
+	else
+		vkCmdDrawIndexedIndirect(commandBuffer, cullFrame[frameIndex].drawBuffer.buffer, offset, cullFrame[frameIndex].maxDraws[batch], sizeof(VkDrawIndexedIndirectCommand));
+}
@@ -0,0 +1,25 @@
+#ifndef __CULL_H__
+#define __CULL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../vulkan/vulkan.h"
+#include "../math/math.h"
+#include "../entitylist.h"
+
+// Limits for the GPU path, frames that go over fall back to CPU culling
+#define CULL_MAX_BATCHES 1024
+#define CULL_MAX_DRAWS 16384
+
+bool CreateCullPipeline(void);
+void DestroyCull(void);
+
+bool CullUpdate(const EntityList_t *entityList, uint32_t frameIndex);
+void CullDispatch(VkCommandBuffer commandBuffer, uint32_t frameIndex, const frustum frustum, const vec3 eye, const float LODScale);
+
+bool CullIsActive(uint32_t frameIndex);
+uint32_t CullGetBatches(uint32_t frameIndex, const EntityBatch_t **batches);
+void CullBindInstances(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+void CullDrawBatch(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t batch);
+
+#endif
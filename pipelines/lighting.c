@@ -1,5 +1,6 @@
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 #include "../system/system.h"
 #include "../vulkan/vulkan.h"
 #include "../math/math.h"
@@ -8,6 +9,7 @@
 #include "../entitylist.h"
 #include "../perframe.h"
 #include "shadow.h"
+#include "cull.h"
 
 extern VkuContext_t vkContext;
 extern VkuSwapchain_t swapchain;
@@ -15,6 +17,32 @@ extern VkuSwapchain_t swapchain;
 VkRenderPass renderPass;
 Pipeline_t mainPipeline;
 
+// Persistent descriptor sets, one per material (texture pair), per frame in flight and eye.
+// Everything else in the set (shadow map, UBOs) is fixed per frame and eye, so a set never needs rewriting once written.
+#define LIGHTING_MAX_MATERIALS 256
+#define LIGHTING_MATERIAL_HASH_SIZE (LIGHTING_MAX_MATERIALS*2)
+
+typedef struct
+{
+	uint32_t textureIDs[2];
+	VkDescriptorSet descriptorSet[FRAMES_IN_FLIGHT];
+} LightingMaterial_t;
+
+// One pool and table per eye. New materials are only added by LightingPrepare on the main thread,
+//   so recording threads can look sets up without any locking.
+typedef struct
+{
+	VkDescriptorPool descriptorPool;
+
+	uint32_t numMaterials;
+	LightingMaterial_t materials[LIGHTING_MAX_MATERIALS];
+
+	// Open addressed table of material index+1, 0 is empty
+	uint16_t hash[LIGHTING_MATERIAL_HASH_SIZE];
+} LightingMaterialCache_t;
+
+static LightingMaterialCache_t materialCache[2];
+
 bool CreateLightingPipeline(void)
 {
 	vkCreateRenderPass(vkContext.device, &(VkRenderPassCreateInfo)
@@ -166,6 +194,35 @@ bool CreateLightingPipeline(void)
 		perFrame[i].mainUBO[1]=perFrame[i].mainUBOBuffer[1].memory->mappedPointer;
 	}
 
+	for(uint32_t eye=0;eye<2;eye++)
+	{
+		memset(&materialCache[eye], 0, sizeof(LightingMaterialCache_t));
+
+		const uint32_t maxSets=LIGHTING_MAX_MATERIALS*FRAMES_IN_FLIGHT;
+
+		if(vkCreateDescriptorPool(vkContext.device, &(VkDescriptorPoolCreateInfo)
+		{
+			.sType=VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+			.maxSets=maxSets,
+			.poolSizeCount=2,
+			.pPoolSizes=(VkDescriptorPoolSize[])
+			{
+				{
+					.type=VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+					.descriptorCount=maxSets*2,
+				},
+				{
+					.type=VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+					.descriptorCount=maxSets*3,
+				},
+			},
+		}, VK_NULL_HANDLE, &materialCache[eye].descriptorPool)!=VK_SUCCESS)
+		{
+			DBGPRINTF(DEBUG_ERROR, "CreateLightingPipeline: Failed to create material descriptor pool.\n");
+			return false;
+		}
+	}
+
 	PipelineOverrideRasterizationSamples(config.MSAA);
 
 	if(!CreatePipeline(&vkContext, &mainPipeline, renderPass, "pipelines/lighting.pipeline"))
@@ -184,41 +241,221 @@ void DestroyLighting(void)
 		vkuDestroyBuffer(&vkContext, &perFrame[i].mainUBOBuffer[1]);
 	}
 
+	// Sets are freed along with their pool
+	for(uint32_t eye=0;eye<2;eye++)
+	{
+		vkDestroyDescriptorPool(vkContext.device, materialCache[eye].descriptorPool, VK_NULL_HANDLE);
+		memset(&materialCache[eye], 0, sizeof(LightingMaterialCache_t));
+	}
+
 	DestroyPipeline(&vkContext, &mainPipeline);
 }
 
-void DrawLighting(VkCommandBuffer commandBuffer, const EntityList_t *entityList, uint32_t index, uint32_t eye, VkDescriptorPool descriptorPool)
+// Allocates and writes a complete lighting descriptor set for a texture pair
+static VkDescriptorSet AllocateLightingSet(VkDescriptorPool descriptorPool, const uint32_t textureIDs[2], uint32_t index, uint32_t eye)
+{
+	VkDescriptorSet descriptorSet=VK_NULL_HANDLE;
+
+	if(vkAllocateDescriptorSets(vkContext.device, &(VkDescriptorSetAllocateInfo)
+	{
+		.sType=VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.descriptorPool=descriptorPool,
+		.descriptorSetCount=1,
+		.pSetLayouts=&mainPipeline.descriptorSet.descriptorSetLayout,
+	}, &descriptorSet)!=VK_SUCCESS)
+		return VK_NULL_HANDLE;
+
+	const VkuImage_t *texture0=&AssetManager_GetAsset(assets, textureIDs[0])->image;
+	const VkuImage_t *texture1=&AssetManager_GetAsset(assets, textureIDs[1])->image;
+
+	// Written locally rather than through mainPipeline.descriptorSet, both eyes record at the same time
+	const VkDescriptorImageInfo imageInfo[3]=
+	{
+		{ texture0->sampler, texture0->imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+		{ texture1->sampler, texture1->imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+		{ shadowDepth.sampler, shadowDepth.imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+	};
+
+	const VkDescriptorBufferInfo bufferInfo[2]=
+	{
+		{ perFrame[index].mainUBOBuffer[eye].buffer, 0, VK_WHOLE_SIZE },
+		{ perFrame[index].skyboxUBOBuffer[eye].buffer, 0, VK_WHOLE_SIZE },
+	};
+
+	VkWriteDescriptorSet writes[5];
+
+	for(uint32_t i=0;i<5;i++)
+	{
+		writes[i]=(VkWriteDescriptorSet)
+		{
+			.sType=VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet=descriptorSet,
+			.dstBinding=i,
+			.descriptorCount=1,
+			.descriptorType=i<3?VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+			.pImageInfo=i<3?&imageInfo[i]:VK_NULL_HANDLE,
+			.pBufferInfo=i<3?VK_NULL_HANDLE:&bufferInfo[i-3],
+		};
+	}
+
+	vkUpdateDescriptorSets(vkContext.device, 5, writes, 0, VK_NULL_HANDLE);
+
+	return descriptorSet;
+}
+
+// Finds the table slot for a texture pair, either its entry or the empty slot it would go in
+static uint16_t *FindLightingMaterialSlot(LightingMaterialCache_t *cache, const uint32_t textureIDs[2])
+{
+	uint32_t slot=((textureIDs[0]*73856093u)^(textureIDs[1]*19349663u))&(LIGHTING_MATERIAL_HASH_SIZE-1);
+
+	while(cache->hash[slot])
+	{
+		const LightingMaterial_t *entry=&cache->materials[cache->hash[slot]-1];
+
+		if(entry->textureIDs[0]==textureIDs[0]&&entry->textureIDs[1]==textureIDs[1])
+			break;
+
+		slot=(slot+1)&(LIGHTING_MATERIAL_HASH_SIZE-1);
+	}
+
+	return &cache->hash[slot];
+}
+
+// Finds (or creates) the persistent set for a texture pair, returns VK_NULL_HANDLE if the cache is full
+static VkDescriptorSet GetLightingMaterialSet(const uint32_t textureIDs[2], uint32_t index, uint32_t eye)
+{
+	LightingMaterialCache_t *cache=&materialCache[eye];
+
+	if(cache->descriptorPool==VK_NULL_HANDLE)
+		return VK_NULL_HANDLE;
+
+	uint16_t *slot=FindLightingMaterialSlot(cache, textureIDs);
+	LightingMaterial_t *material=NULL;
+
+	if(*slot)
+		material=&cache->materials[*slot-1];
+	else
+	{
+		if(cache->numMaterials>=LIGHTING_MAX_MATERIALS)
+			return VK_NULL_HANDLE;
+
+		material=&cache->materials[cache->numMaterials++];
+		material->textureIDs[0]=textureIDs[0];
+		material->textureIDs[1]=textureIDs[1];
+		*slot=(uint16_t)cache->numMaterials;
+	}
+
+	if(material->descriptorSet[index]==VK_NULL_HANDLE)
+		material->descriptorSet[index]=AllocateLightingSet(cache->descriptorPool, textureIDs, index, eye);
+
+	return material->descriptorSet[index];
+}
+
+// Read only lookup for recording threads, VK_NULL_HANDLE if LightingPrepare didn't create one
+static VkDescriptorSet FindLightingMaterialSet(const uint32_t textureIDs[2], uint32_t index, uint32_t eye)
+{
+	LightingMaterialCache_t *cache=&materialCache[eye];
+
+	if(cache->descriptorPool==VK_NULL_HANDLE)
+		return VK_NULL_HANDLE;
+
+	const uint16_t *slot=FindLightingMaterialSlot(cache, textureIDs);
+
+	if(*slot==0)
+		return VK_NULL_HANDLE;
+
+	return cache->materials[*slot-1].descriptorSet[index];
+}
+
+// The batches DrawLighting draws this frame, GPU culled frames draw every source batch indirectly
+static uint32_t GetLightingBatches(const EntityList_t *entityList, uint32_t index, const EntityBatch_t **batches)
+{
+	if(CullIsActive(index))
+		return CullGetBatches(index, batches);
+
+	*batches=entityList->culledBatches;
+	return entityList->culledBatchCount;
+}
+
+// Creates any missing material sets for this frame's batches, must be called on the main thread before recording DrawLighting.
+// Returns the number of batches, for splitting the draw up between threads.
+uint32_t LightingPrepare(const EntityList_t *entityList, uint32_t index, uint32_t eye)
+{
+	const EntityBatch_t *batches=NULL;
+	const uint32_t batchCount=GetLightingBatches(entityList, index, &batches);
+
+	for(uint32_t b=0;b<batchCount;b++)
+	{
+		if(!batches[b].noRender)
+			GetLightingMaterialSet(batches[b].textureIDs, index, eye);
+	}
+
+	return batchCount;
+}
+
+// Draws batches [first, first+count) of this frame's batches, so the draw can be split up between threads
+void DrawLighting(VkCommandBuffer commandBuffer, const EntityList_t *entityList, uint32_t index, uint32_t eye, VkDescriptorPool descriptorPool, uint32_t first, uint32_t count)
 {
 	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mainPipeline.pipeline.pipeline);
 
-	for(uint32_t b=0;b<entityList->culledBatchCount;b++)
+	// Instances are bound once, batches select into them with firstInstance
+	const bool GPUCulled=CullIsActive(index);
+	const EntityBatch_t *batches=NULL;
+	const uint32_t batchCount=GetLightingBatches(entityList, index, &batches);
+
+	if(GPUCulled)
+		CullBindInstances(commandBuffer, index);
+	else
+		vkCmdBindVertexBuffers(commandBuffer, 1, 1, &entityList->perFrame[index].culledInstanceBuffer.buffer, &(VkDeviceSize){0});
+
+	const BModel_t *boundModel=NULL;
+	VkDescriptorSet boundSet=VK_NULL_HANDLE;
+	const uint32_t last=min(first+count, batchCount);
+
+	for(uint32_t b=first;b<last;b++)
 	{
-		const EntityBatch_t *batch=&entityList->culledBatches[b];
+		const EntityBatch_t *batch=&batches[b];
 
 		if(batch->noRender)
 			continue;
 
 		const BModel_t *model=&AssetManager_GetAsset(assets, batch->modelID)->model;
 
-		vkuDescriptorSet_UpdateBindingImageInfo(&mainPipeline.descriptorSet, 0, AssetManager_GetAsset(assets, batch->textureIDs[0])->image.sampler, AssetManager_GetAsset(assets, batch->textureIDs[0])->image.imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-		vkuDescriptorSet_UpdateBindingImageInfo(&mainPipeline.descriptorSet, 1, AssetManager_GetAsset(assets, batch->textureIDs[1])->image.sampler, AssetManager_GetAsset(assets, batch->textureIDs[1])->image.imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-		vkuDescriptorSet_UpdateBindingImageInfo(&mainPipeline.descriptorSet, 2, shadowDepth.sampler, shadowDepth.imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-		vkuDescriptorSet_UpdateBindingBufferInfo(&mainPipeline.descriptorSet, 3, perFrame[index].mainUBOBuffer[eye].buffer, 0, VK_WHOLE_SIZE);
-		vkuDescriptorSet_UpdateBindingBufferInfo(&mainPipeline.descriptorSet, 4, perFrame[index].skyboxUBOBuffer[eye].buffer, 0, VK_WHOLE_SIZE);
-		vkuAllocateUpdateDescriptorSet(&mainPipeline.descriptorSet, descriptorPool);
+		VkDescriptorSet descriptorSet=FindLightingMaterialSet(batch->textureIDs, index, eye);
 
-		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mainPipeline.pipelineLayout, 0, 1, &mainPipeline.descriptorSet.descriptorSet, 0, VK_NULL_HANDLE);
+		// Cache is full, fall back to a transient set from this frame's pool
+		if(descriptorSet==VK_NULL_HANDLE)
+			descriptorSet=AllocateLightingSet(descriptorPool, batch->textureIDs, index, eye);
 
-		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &model->vertexBuffer.buffer, &(VkDeviceSize){0});
+		if(descriptorSet==VK_NULL_HANDLE)
+			continue;
+
+		if(descriptorSet!=boundSet)
+		{
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mainPipeline.pipelineLayout, 0, 1, &descriptorSet, 0, VK_NULL_HANDLE);
+			boundSet=descriptorSet;
+		}
 
-		// Offset the instance buffer binding to the start of this batch
-		VkDeviceSize instanceOffset=sizeof(matrix)*batch->instanceOffset;
-		vkCmdBindVertexBuffers(commandBuffer, 1, 1, &entityList->perFrame[index].culledInstanceBuffer.buffer, &instanceOffset);
+		// Batches are grouped by model, only rebind when it changes
+		if(model!=boundModel)
+		{
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &model->vertexBuffer.buffer, &(VkDeviceSize){0});
+			vkCmdBindIndexBuffer(commandBuffer, model->indexBuffer.buffer, 0, model->indexType);
+			boundModel=model;
+		}
+
+		if(GPUCulled)
+		{
+			CullDrawBatch(commandBuffer, index, b);
+			continue;
+		}
 
 		for(uint32_t m=0;m<model->numMesh;m++)
 		{
-			vkCmdBindIndexBuffer(commandBuffer, model->mesh[m].indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdDrawIndexed(commandBuffer, model->mesh[m].numFace*3, batch->instanceCount, 0, 0, 0);
+			// Meshes with fewer LODs than the model keep drawing their last one
+			const BModel_LOD_t *LOD=&model->mesh[m].LOD[min(batch->LOD, model->mesh[m].numLOD-1)];
+
+			vkCmdDrawIndexed(commandBuffer, LOD->numIndex, batch->instanceCount, LOD->firstIndex, 0, batch->instanceOffset);
 		}
 	}
 }
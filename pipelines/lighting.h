@@ -11,6 +11,7 @@ extern Pipeline_t mainPipeline;
 
 bool CreateLightingPipeline(void);
 void DestroyLighting(void);
-void DrawLighting(VkCommandBuffer commandBuffer, const EntityList_t *entityList, uint32_t index, uint32_t eye, VkDescriptorPool descriptorPool);
+uint32_t LightingPrepare(const EntityList_t *entityList, uint32_t index, uint32_t eye);
+void DrawLighting(VkCommandBuffer commandBuffer, const EntityList_t *entityList, uint32_t index, uint32_t eye, VkDescriptorPool descriptorPool, uint32_t first, uint32_t count);
 
 #endif
@@ -31,6 +31,24 @@ static VkImageView shadowDepthView[NUM_CASCADES];
 static VkFramebuffer shadowFrameBuffer[NUM_CASCADES];
 static VkFormat shadowDepthFormat=VK_FORMAT_D32_SFLOAT;
 
+// Grows the caster culling bounds to cover objects that moved since the physics thread last built the BVH
+#define SHADOW_CULL_PADDING 1.0f
+
+// Cascades from this one up are redrawn at a reduced rate, each half as often as the one before it,
+//   and keep their last depth map and matrix in between. Set to NUM_CASCADES to redraw every cascade every frame.
+#define SHADOW_REDUCED_RATE_CASCADE (NUM_CASCADES-1)
+
+// Per cascade casters, batched by (model, LOD) only since textures don't matter here
+static EntityBatch_t *casterBatches[NUM_CASCADES];
+static uint32_t casterBatchCount[NUM_CASCADES], casterBatchCapacity[NUM_CASCADES];
+
+// Bit N set if the entity casts into cascade N
+static uint8_t casterMasks[MAX_ENTITY];
+
+static bool cascadeUpdate[NUM_CASCADES];
+static bool cascadeValid[NUM_CASCADES];
+static uint32_t shadowFrameCount=0;
+
 static matrix BuildShadowMatrix(float fovyDeg, float aspect, float zNear, float zFar, const matrix cameraView, const vec3 lightDir)
 {
 	// Camera frustum corners in view space
@@ -139,6 +157,10 @@ void CreateShadowMap(void)
 		.subresourceRange.layerCount=NUM_CASCADES,
 	}, NULL, &shadowDepth.imageView);
 
+	// New depth maps, so any cached cascades are gone
+	for(uint32_t i=0;i<NUM_CASCADES;i++)
+		cascadeValid[i]=false;
+
 	VkCommandBuffer commandBuffer=vkuOneShotCommandBufferBegin(&vkContext);
 	for(uint32_t i=0;i<NUM_CASCADES;i++)
 		vkuTransitionLayout(commandBuffer, shadowDepth.image, 1, 0, 1, i, VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
@@ -249,66 +271,259 @@ bool CreateShadowPipeline(void)
 	if(!CreatePipeline(&vkContext, &shadowPipeline, shadowRenderPass, "pipelines/shadow.pipeline"))
 		return false;
 
+	for(uint32_t i=0;i<FRAMES_IN_FLIGHT;i++)
+	{
+		if(!vkuCreateHostBuffer(&vkContext, &perFrame[i].shadowInstanceBuffer, sizeof(EntityInstance_t)*MAX_ENTITY*NUM_CASCADES, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT))
+			return false;
+
+		perFrame[i].shadowInstance=perFrame[i].shadowInstanceBuffer.memory->mappedPointer;
+	}
+
+	for(uint32_t i=0;i<NUM_CASCADES;i++)
+	{
+		casterBatchCount[i]=0;
+		casterBatchCapacity[i]=64;
+		casterBatches[i]=Zone_Malloc(zone, sizeof(EntityBatch_t)*casterBatchCapacity[i]);
+
+		if(casterBatches[i]==NULL)
+			return false;
+	}
+
 	CalculateCascadeSplits(0.01, 3000.0f, NUM_CASCADES, 0.9f, cascadeSplits);
 
 	return true;
 }
 
-void ShadowUpdateMap(VkCommandBuffer commandBuffer, const EntityList_t *entityList, uint32_t frameIndex)
+static void ShadowAddCasterBatch(uint32_t cascade, const EntityBatch_t *src, uint32_t instanceOffset, uint32_t instanceCount)
 {
+	EntityBatch_t *last=casterBatchCount[cascade]?&casterBatches[cascade][casterBatchCount[cascade]-1]:NULL;
+
+	// Same model and LOD right after the last batch, so just extend it
+	if(last&&last->modelID==src->modelID&&last->LOD==src->LOD&&last->instanceOffset+last->instanceCount==instanceOffset)
+	{
+		last->instanceCount+=instanceCount;
+		return;
+	}
+
+	if(casterBatchCount[cascade]==casterBatchCapacity[cascade])
+	{
+		casterBatchCapacity[cascade]*=2;
+		casterBatches[cascade]=Zone_Realloc(zone, casterBatches[cascade], sizeof(EntityBatch_t)*casterBatchCapacity[cascade]);
+	}
+
+	EntityBatch_t *dst=&casterBatches[cascade][casterBatchCount[cascade]++];
+	*dst=*src;
+	dst->instanceOffset=instanceOffset;
+	dst->instanceCount=instanceCount;
+}
+
+// Updates the cascade matrices, and culls shadow casters against each cascade's light space frustum into their own
+//   compacted instance ranges. Needs to run after EntityList_FrustumCull, and before ShadowUpdateMap and the lighting UBO update.
+void ShadowCullCasters(EntityList_t *entityList, BVH_t *bvh, const matrix modelView, uint32_t frameIndex)
+{
+	vec3 lightDir={
+		-perFrame[frameIndex].skyboxUBO[0]->uSunPosition.x,
+		-perFrame[frameIndex].skyboxUBO[0]->uSunPosition.y,
+		-perFrame[frameIndex].skyboxUBO[0]->uSunPosition.z
+	};
+	Vec3_Normalize(&lightDir);
+
+	frustum casterFrustums[NUM_CASCADES];
+	uint32_t numUpdate=0;
+
 	for(uint32_t cascade=0;cascade<NUM_CASCADES;cascade++)
 	{
-		vkCmdBeginRenderPass(commandBuffer, &(VkRenderPassBeginInfo)
+		casterBatchCount[cascade]=0;
+
+		// Reduced rate cascades are staggered so they don't all land on the same frame
+		if(cascade>=SHADOW_REDUCED_RATE_CASCADE)
 		{
-			.sType=VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-			.renderPass=shadowRenderPass,
-			.framebuffer=shadowFrameBuffer[cascade],
-			.clearValueCount=1,
-			.pClearValues=(VkClearValue[]){ {{{ 1.0f, 0 }}} },
-			.renderArea.offset=(VkOffset2D){ 0, 0 },
-			.renderArea.extent=(VkExtent2D){ shadowSize, shadowSize },
-		}, VK_SUBPASS_CONTENTS_INLINE);
+			const uint32_t interval=1u<<(cascade-SHADOW_REDUCED_RATE_CASCADE+1);
+			cascadeUpdate[cascade]=!cascadeValid[cascade]||((shadowFrameCount+cascade)&(interval-1))==0;
+		}
+		else
+			cascadeUpdate[cascade]=true;
+
+		if(!cascadeUpdate[cascade])
+			continue;
 
-		// Bind the pipeline descriptor, this sets the pipeline states (blend, depth/stencil tests, etc)
-		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shadowPipeline.pipeline.pipeline);
+		shadowMVP[cascade]=BuildShadowMatrix(90.0f, (float)swapchain.extent.width/(float)swapchain.extent.height, cascadeSplits[cascade], cascadeSplits[cascade+1], modelView, lightDir);
+		cascadeValid[cascade]=true;
 
-		vkCmdSetViewport(commandBuffer, 0, 1, &(VkViewport) { 0.0f, 0.0f, (float)shadowSize, (float)shadowSize, 0.0f, 1.0f });
-		vkCmdSetScissor(commandBuffer, 0, 1, &(VkRect2D) { { 0, 0 }, { shadowSize, shadowSize } });
+		// With depth clamp, casters between the light and the near plane still cast shadows, so test against the far plane instead
+		casterFrustums[numUpdate]=Frustum_ExtractPlanes(shadowMVP[cascade]);
+		casterFrustums[numUpdate].planes[FRUSTUM_NEAR]=casterFrustums[numUpdate].planes[FRUSTUM_FAR];
+		numUpdate++;
+	}
 
-		matrix modelview=perFrame[frameIndex].mainUBO[0]->modelView;
-		vec3 lightDir={
-			-perFrame[frameIndex].skyboxUBO[0]->uSunPosition.x,
-			-perFrame[frameIndex].skyboxUBO[0]->uSunPosition.y,
-			-perFrame[frameIndex].skyboxUBO[0]->uSunPosition.z
-		};
-		Vec3_Normalize(&lightDir);
+	shadowFrameCount++;
 
-		shadowMVP[cascade]=BuildShadowMatrix(90.0f, (float)swapchain.extent.width/(float)swapchain.extent.height, cascadeSplits[cascade], cascadeSplits[cascade+1], modelview, lightDir);
+	if(numUpdate==0)
+		return;
 
-		vkCmdPushConstants(commandBuffer, shadowPipeline.pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(matrix), &shadowMVP[cascade]);
+	memset(casterMasks, 0, sizeof(uint8_t)*entityList->entityCount);
 
-		// Draw entity batches
-		for(uint32_t b=0;b<entityList->batchCount;b++)
+	// Stale tree, test every entity instead
+	if(!BVH_QueryFrustums(bvh, entityList, casterFrustums, numUpdate, SHADOW_CULL_PADDING, casterMasks))
+	{
+		for(uint32_t i=0;i<entityList->entityCount;i++)
 		{
-			const EntityBatch_t *batch=&entityList->batches[b];
+			uint8_t mask=0;
 
-			if(batch->noRender)
-				continue;
+			for(uint32_t j=0;j<numUpdate;j++)
+			{
+				if(Frustum_TestAABB(casterFrustums[j], entityList->entities[i].bounds))
+					mask|=1<<j;
+			}
 
-			const BModel_t *model=&AssetManager_GetAsset(assets, batch->modelID)->model;
+			casterMasks[i]=mask;
+		}
+	}
 
-			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &model->vertexBuffer.buffer, &(VkDeviceSize){0});
+	// Compact the masks from updated cascades only back to cascade indices
+	uint32_t cascadeIndex[NUM_CASCADES];
 
-			// Offset the instance buffer binding to the start of this batch
-			VkDeviceSize instanceOffset=sizeof(matrix)*batch->instanceOffset;
-			vkCmdBindVertexBuffers(commandBuffer, 1, 1, &entityList->perFrame[frameIndex].instanceBuffer.buffer, &instanceOffset);
+	for(uint32_t cascade=0, i=0;cascade<NUM_CASCADES;cascade++)
+	{
+		if(cascadeUpdate[cascade])
+			cascadeIndex[i++]=cascade;
+	}
+
+	EntityInstance_t *dst=perFrame[frameIndex].shadowInstance;
+	uint32_t count[NUM_CASCADES]={ 0 };
+
+	// LOD batches are sorted by model, then textures, then LOD.
+	// Go through each model's batches one LOD at a time, so batches that only differ by texture end up next to each other and merge.
+	for(uint32_t modelStart=0, modelEnd=0;modelStart<entityList->LODBatchCount;modelStart=modelEnd)
+	{
+		const uint32_t modelID=entityList->LODBatches[modelStart].modelID;
+
+		for(modelEnd=modelStart;modelEnd<entityList->LODBatchCount&&entityList->LODBatches[modelEnd].modelID==modelID;modelEnd++);
 
-			for(uint32_t m=0;m<model->numMesh;m++)
+		for(uint32_t LOD=0;LOD<BMODEL_MAX_LOD;LOD++)
+		{
+			for(uint32_t b=modelStart;b<modelEnd;b++)
 			{
-				vkCmdBindIndexBuffer(commandBuffer, model->mesh[m].indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
-				vkCmdDrawIndexed(commandBuffer, model->mesh[m].numFace*3, batch->instanceCount, 0, 0, 0);
+				const EntityBatch_t *batch=&entityList->LODBatches[b];
+
+				if(batch->noRender||batch->LOD!=LOD)
+					continue;
+
+				uint32_t start[NUM_CASCADES];
+
+				for(uint32_t i=0;i<numUpdate;i++)
+					start[i]=count[i];
+
+				for(uint32_t i=batch->instanceOffset;i<batch->instanceOffset+batch->instanceCount;i++)
+				{
+					const uint32_t index=entityList->LODIndices[i];
+					const uint8_t mask=casterMasks[index];
+
+					if(mask==0)
+						continue;
+
+					for(uint32_t j=0;j<numUpdate;j++)
+					{
+						if(mask&(1u<<j))
+							dst[cascadeIndex[j]*MAX_ENTITY+count[j]++]=entityList->instances[index];
+					}
+				}
+
+				for(uint32_t i=0;i<numUpdate;i++)
+				{
+					if(count[i]>start[i])
+						ShadowAddCasterBatch(cascadeIndex[i], batch, start[i], count[i]-start[i]);
+				}
 			}
 		}
+	}
+}
+
+bool ShadowCascadeNeedsUpdate(uint32_t cascade)
+{
+	return cascade<NUM_CASCADES&&cascadeUpdate[cascade];
+}
+
+// What a secondary command buffer recording a cascade needs to inherit
+VkCommandBufferInheritanceInfo ShadowGetCascadeInheritance(uint32_t cascade)
+{
+	return (VkCommandBufferInheritanceInfo)
+	{
+		.sType=VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+		.renderPass=shadowRenderPass,
+		.subpass=0,
+		.framebuffer=shadowFrameBuffer[cascade],
+	};
+}
+
+// Records one cascade's casters, from inside that cascade's render pass
+void ShadowDrawCascade(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t cascade)
+{
+	// Bind the pipeline descriptor, this sets the pipeline states (blend, depth/stencil tests, etc)
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shadowPipeline.pipeline.pipeline);
+
+	vkCmdSetViewport(commandBuffer, 0, 1, &(VkViewport) { 0.0f, 0.0f, (float)shadowSize, (float)shadowSize, 0.0f, 1.0f });
+	vkCmdSetScissor(commandBuffer, 0, 1, &(VkRect2D) { { 0, 0 }, { shadowSize, shadowSize } });
+
+	vkCmdPushConstants(commandBuffer, shadowPipeline.pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(matrix), &shadowMVP[cascade]);
+
+	// This cascade's instance range is bound once, batches select into it with firstInstance
+	VkDeviceSize instanceOffset=sizeof(EntityInstance_t)*MAX_ENTITY*cascade;
+	vkCmdBindVertexBuffers(commandBuffer, 1, 1, &perFrame[frameIndex].shadowInstanceBuffer.buffer, &instanceOffset);
+
+	const BModel_t *boundModel=NULL;
+
+	// Draw caster batches
+	for(uint32_t b=0;b<casterBatchCount[cascade];b++)
+	{
+		const EntityBatch_t *batch=&casterBatches[cascade][b];
+		const BModel_t *model=&AssetManager_GetAsset(assets, batch->modelID)->model;
+
+		// Batches are grouped by model, only rebind when it changes
+		if(model!=boundModel)
+		{
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &model->vertexBuffer.buffer, &(VkDeviceSize){0});
+			vkCmdBindIndexBuffer(commandBuffer, model->indexBuffer.buffer, 0, model->indexType);
+			boundModel=model;
+		}
+
+		for(uint32_t m=0;m<model->numMesh;m++)
+		{
+			// Meshes with fewer LODs than the model keep drawing their last one
+			const BModel_LOD_t *LOD=&model->mesh[m].LOD[min(batch->LOD, model->mesh[m].numLOD-1)];
+
+			vkCmdDrawIndexed(commandBuffer, LOD->numIndex, batch->instanceCount, LOD->firstIndex, 0, batch->instanceOffset);
+		}
+	}
+}
+
+// Renders the cascades that need updating this frame.
+// cascadeCommandBuffers (may be NULL) holds already recorded secondary command buffers per cascade, cascades without one are recorded inline.
+void ShadowUpdateMap(VkCommandBuffer commandBuffer, uint32_t frameIndex, const VkCommandBuffer *cascadeCommandBuffers)
+{
+	for(uint32_t cascade=0;cascade<NUM_CASCADES;cascade++)
+	{
+		// Keeps last frame's depth map
+		if(!cascadeUpdate[cascade])
+			continue;
+
+		const VkCommandBuffer secondary=cascadeCommandBuffers?cascadeCommandBuffers[cascade]:VK_NULL_HANDLE;
+
+		vkCmdBeginRenderPass(commandBuffer, &(VkRenderPassBeginInfo)
+		{
+			.sType=VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+			.renderPass=shadowRenderPass,
+			.framebuffer=shadowFrameBuffer[cascade],
+			.clearValueCount=1,
+			.pClearValues=(VkClearValue[]){ {{{ 1.0f, 0 }}} },
+			.renderArea.offset=(VkOffset2D){ 0, 0 },
+			.renderArea.extent=(VkExtent2D){ shadowSize, shadowSize },
+		}, secondary?VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS:VK_SUBPASS_CONTENTS_INLINE);
+
+		if(secondary)
+			vkCmdExecuteCommands(commandBuffer, 1, &secondary);
+		else
+			ShadowDrawCascade(commandBuffer, frameIndex, cascade);
 
 		vkCmdEndRenderPass(commandBuffer);
 	}
@@ -324,6 +539,12 @@ void DestroyShadow(void)
 		vkDestroyFramebuffer(vkContext.device, shadowFrameBuffer[i], VK_NULL_HANDLE);
 	}
 
+	for(uint32_t i=0;i<FRAMES_IN_FLIGHT;i++)
+		vkuDestroyBuffer(&vkContext, &perFrame[i].shadowInstanceBuffer);
+
+	for(uint32_t i=0;i<NUM_CASCADES;i++)
+		Zone_Free(zone, casterBatches[i]);
+
 	DestroyPipeline(&vkContext, &shadowPipeline);
 	vkDestroyRenderPass(vkContext.device, shadowRenderPass, VK_NULL_HANDLE);
 }
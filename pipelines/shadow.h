@@ -4,6 +4,7 @@
 #include "../vulkan/vulkan.h"
 #include "../math/math.h"
 #include "../entitylist.h"
+#include "../utils/bvh.h"
 
 #ifndef NUM_CASCADES
 #define NUM_CASCADES 4
@@ -15,7 +16,11 @@ extern VkuImage_t shadowDepth;
 
 void CreateShadowMap(void);
 bool CreateShadowPipeline(void);
-void ShadowUpdateMap(VkCommandBuffer commandBuffer, const EntityList_t *entityList, uint32_t frameIndex);
+void ShadowCullCasters(EntityList_t *entityList, BVH_t *bvh, const matrix modelView, uint32_t frameIndex);
+bool ShadowCascadeNeedsUpdate(uint32_t cascade);
+VkCommandBufferInheritanceInfo ShadowGetCascadeInheritance(uint32_t cascade);
+void ShadowDrawCascade(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t cascade);
+void ShadowUpdateMap(VkCommandBuffer commandBuffer, uint32_t frameIndex, const VkCommandBuffer *cascadeCommandBuffers);
 void DestroyShadow(void);
 
 #endif
@@ -1,12 +1,13 @@
 #version 450
 
-layout (location=0) in vec4 vPosition;
-layout (location=1) in vec4 vUV;
-layout (location=2) in vec4 vTangent;
-layout (location=3) in vec4 vBinormal;
-layout (location=4) in vec4 vNormal;
+layout (location=0) in vec3 vPosition;
+layout (location=1) in vec2 vUV;
+layout (location=2) in vec2 vNormal;	// Octahedral
+layout (location=3) in vec4 vTangent;	// Octahedral in xy, binormal sign in z
 
-layout (location=5) in mat4 iPosition;
+layout (location=4) in vec3 iPosition;
+layout (location=5) in vec4 iRotation;	// Quaternion
+layout (location=6) in vec3 iScale;
 
 #define NUM_CASCADES 4
 
@@ -32,17 +33,38 @@ layout (location=2) out mat3 Tangent;
 layout (location=5) out float ViewDepth;
 layout (location=6) out vec4 Shadow[NUM_CASCADES];
 
+vec3 QuatRotate(vec4 q, vec3 v)
+{
+	return v+2.0*cross(q.xyz, cross(q.xyz, v)+q.w*v);
+}
+
+vec3 OctahedralDecode(vec2 e)
+{
+	vec3 n=vec3(e.xy, 1.0-abs(e.x)-abs(e.y));
+	float t=max(-n.z, 0.0);
+
+	n.xy+=mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0)));
+
+	return normalize(n);
+}
+
 void main()
 {
-	Position=(iPosition*vPosition).xyz;
+	const vec4 rotation=normalize(iRotation);
+
+	Position=iPosition+QuatRotate(rotation, vPosition*iScale);
 	vec4 worldPosition=modelview*vec4(Position, 1.0);
 
 	gl_Position=projection*HMD*worldPosition;
 
 	ViewDepth=-worldPosition.z;
-	UV=vUV.xy;
+	UV=vUV;
+
+	vec3 normal=OctahedralDecode(vNormal);
+	vec3 tangent=OctahedralDecode(vTangent.xy);
+	vec3 binormal=cross(normal, tangent)*vTangent.z;
 
-	Tangent=mat3(iPosition)*mat3(vTangent.xyz, vBinormal.xyz, vNormal.xyz);
+	Tangent=mat3(QuatRotate(rotation, tangent), QuatRotate(rotation, binormal), QuatRotate(rotation, normal));
 
 	const mat4 biasMat=mat4(
 		0.5, 0.0, 0.0, 0.0,
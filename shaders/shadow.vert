@@ -1,7 +1,9 @@
 #version 450
 
-layout (location=0) in vec4 vPosition;
-layout (location=1) in mat4 iPosition;
+layout (location=0) in vec3 vPosition;
+layout (location=1) in vec3 iPosition;
+layout (location=2) in vec4 iRotation;	// Quaternion
+layout (location=3) in vec3 iScale;
 
 layout (push_constant) uniform ubo
 {
@@ -13,7 +15,12 @@ out gl_PerVertex
     vec4 gl_Position;
 };
 
+vec3 QuatRotate(vec4 q, vec3 v)
+{
+	return v+2.0*cross(q.xyz, cross(q.xyz, v)+q.w*v);
+}
+
 void main()
 {
-	gl_Position=mvp*iPosition*vec4(vPosition.xyz, 1.0);
+	gl_Position=mvp*vec4(iPosition+QuatRotate(normalize(iRotation), vPosition*iScale), 1.0);
 }
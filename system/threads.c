@@ -1,5 +1,10 @@
 #include <stdio.h>
 #include <string.h>
+#if defined(WIN32)||defined(_WIN32)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
 #include "system.h"
 #include "threads.h"
 
@@ -54,6 +59,21 @@ int Thread_Worker(void *data)
 	return 0;
 }
 
+// Get the number of logical CPUs, for sizing worker pools
+uint32_t Thread_GetCPUCount(void)
+{
+#if defined(WIN32)||defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+
+	return info.dwNumberOfProcessors>0?(uint32_t)info.dwNumberOfProcessors:1;
+#else
+	const long count=sysconf(_SC_NPROCESSORS_ONLN);
+
+	return count>0?(uint32_t)count:1;
+#endif
+}
+
 // Get the number of current jobs
 uint32_t Thread_GetJobCount(ThreadWorker_t *worker)
 {
@@ -52,6 +52,7 @@ typedef struct
 	uint32_t check;
 } ThreadBarrier_t;
 
+uint32_t Thread_GetCPUCount(void);
 uint32_t Thread_GetJobCount(ThreadWorker_t *worker);
 bool Thread_AddJob(ThreadWorker_t *worker, ThreadFunction_t jobFunc, void *arg);
 void Thread_AddConstructor(ThreadWorker_t *worker, ThreadFunction_t constructorFunc, void *arg);
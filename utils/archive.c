@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#ifdef WIN32
+#include <windows.h>
+#elif ANDROID
+#include <android/asset_manager.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "../system/system.h"
+#include "lz4.h"
+#include "archive.h"
+
+#ifdef ANDROID
+extern AAssetManager *android_asset_manager;
+#endif
+
+// The one mounted archive, read only once mounted so it's safe to read from multiple threads
+static struct
+{
+	bool mounted;
+
+	const uint8_t *data;
+	size_t size;
+
+	const ArchiveHeader_t *header;
+	const ArchiveEntry_t *entries;
+
+#ifdef WIN32
+	HANDLE file, mapping;
+#elif ANDROID
+	AAsset *asset;
+#endif
+} archive;
+
+static bool Archive_MapFile(const char *filename)
+{
+#ifdef WIN32
+	archive.file=CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+
+	if(archive.file==INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	GetFileSizeEx(archive.file, &size);
+	archive.size=(size_t)size.QuadPart;
+
+	archive.mapping=CreateFileMappingA(archive.file, NULL, PAGE_READONLY, 0, 0, NULL);
+
+	if(archive.mapping==NULL)
+	{
+		CloseHandle(archive.file);
+		return false;
+	}
+
+	archive.data=(const uint8_t *)MapViewOfFile(archive.mapping, FILE_MAP_READ, 0, 0, 0);
+
+	if(archive.data==NULL)
+	{
+		CloseHandle(archive.mapping);
+		CloseHandle(archive.file);
+		return false;
+	}
+#elif ANDROID
+	// Uncompressed APK assets are mapped directly by the asset manager
+	archive.asset=AAssetManager_open(android_asset_manager, filename, AASSET_MODE_BUFFER);
+
+	if(archive.asset==NULL)
+		return false;
+
+	archive.data=(const uint8_t *)AAsset_getBuffer(archive.asset);
+	archive.size=(size_t)AAsset_getLength(archive.asset);
+
+	if(archive.data==NULL)
+	{
+		AAsset_close(archive.asset);
+		return false;
+	}
+#else
+	int fd=open(filename, O_RDONLY);
+
+	if(fd==-1)
+		return false;
+
+	struct stat st;
+
+	if(fstat(fd, &st)==-1||st.st_size==0)
+	{
+		close(fd);
+		return false;
+	}
+
+	archive.size=(size_t)st.st_size;
+
+	void *data=mmap(NULL, archive.size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	// Mapping holds its own reference to the file
+	close(fd);
+
+	if(data==MAP_FAILED)
+		return false;
+
+	archive.data=(const uint8_t *)data;
+#endif
+
+	return true;
+}
+
+static void Archive_UnmapFile(void)
+{
+#ifdef WIN32
+	UnmapViewOfFile(archive.data);
+	CloseHandle(archive.mapping);
+	CloseHandle(archive.file);
+#elif ANDROID
+	AAsset_close(archive.asset);
+#else
+	munmap((void *)archive.data, archive.size);
+#endif
+}
+
+bool Archive_Mount(const char *filename)
+{
+	if(archive.mounted)
+		Archive_Unmount();
+
+	if(!Archive_MapFile(filename))
+		return false;
+
+	archive.header=(const ArchiveHeader_t *)archive.data;
+	archive.entries=(const ArchiveEntry_t *)(archive.data+sizeof(ArchiveHeader_t));
+
+	if(archive.size<sizeof(ArchiveHeader_t)||archive.header->magic!=ARCHIVE_MAGIC||archive.header->version!=ARCHIVE_VERSION)
+	{
+		DBGPRINTF(DEBUG_ERROR, "Archive_Mount: %s is not a valid archive.\n", filename);
+		Archive_UnmapFile();
+		return false;
+	}
+
+	// Validate the table of contents once, so lookups don't have to
+	if(sizeof(ArchiveHeader_t)+(size_t)archive.header->numEntries*sizeof(ArchiveEntry_t)>archive.size)
+	{
+		DBGPRINTF(DEBUG_ERROR, "Archive_Mount: %s table of contents is truncated.\n", filename);
+		Archive_UnmapFile();
+		return false;
+	}
+
+	for(uint32_t i=0;i<archive.header->numEntries;i++)
+	{
+		const ArchiveEntry_t *entry=&archive.entries[i];
+
+		if(entry->name[ARCHIVE_MAX_NAME-1]!='\0'||(size_t)entry->offset+entry->storedSize>archive.size)
+		{
+			DBGPRINTF(DEBUG_ERROR, "Archive_Mount: %s entry %d is corrupt.\n", filename, i);
+			Archive_UnmapFile();
+			return false;
+		}
+	}
+
+	archive.mounted=true;
+
+	DBGPRINTF(DEBUG_INFO, "Mounted archive %s (%d entries, %0.3fMB).\n", filename, archive.header->numEntries, (float)archive.size/1000.0f/1000.0f);
+
+	return true;
+}
+
+void Archive_Unmount(void)
+{
+	if(!archive.mounted)
+		return;
+
+	Archive_UnmapFile();
+	memset(&archive, 0, sizeof(archive));
+}
+
+static int Archive_Compare(const void *key, const void *element)
+{
+	return strncmp((const char *)key, ((const ArchiveEntry_t *)element)->name, ARCHIVE_MAX_NAME);
+}
+
+// Loads a loose file from disk in one read
+static bool Archive_ReadLooseFile(const char *filename, ArchiveFile_t *file)
+{
+	FILE *stream=fopen(filename, "rb");
+
+	if(stream==NULL)
+		return false;
+
+	fseek(stream, 0, SEEK_END);
+	long size=ftell(stream);
+	fseek(stream, 0, SEEK_SET);
+
+	if(size<=0)
+	{
+		fclose(stream);
+		return false;
+	}
+
+	file->allocation=Zone_Malloc(zone, size);
+
+	if(file->allocation==NULL)
+	{
+		DBGPRINTF(DEBUG_ERROR, "Archive_ReadFile: Unable to allocate memory for file %s.\n", filename);
+		fclose(stream);
+		return false;
+	}
+
+	if(fread(file->allocation, 1, size, stream)!=(size_t)size)
+	{
+		DBGPRINTF(DEBUG_ERROR, "Archive_ReadFile: Size read does not match for file %s.\n", filename);
+		Zone_Free(zone, file->allocation);
+		file->allocation=NULL;
+		fclose(stream);
+		return false;
+	}
+
+	fclose(stream);
+
+	file->data=(const uint8_t *)file->allocation;
+	file->size=(size_t)size;
+
+	return true;
+}
+
+// Gets the contents of a file, first from the mounted archive (if any), then from disk.
+// Stored entries are returned as a pointer into the mapping with no copy.
+bool Archive_ReadFile(const char *filename, ArchiveFile_t *file)
+{
+	if(filename==NULL||file==NULL)
+		return false;
+
+	memset(file, 0, sizeof(ArchiveFile_t));
+
+	if(archive.mounted)
+	{
+		const ArchiveEntry_t *entry=(const ArchiveEntry_t *)bsearch(filename, archive.entries, archive.header->numEntries, sizeof(ArchiveEntry_t), Archive_Compare);
+
+		if(entry)
+		{
+			const uint8_t *data=archive.data+entry->offset;
+
+			if(entry->flags&ARCHIVE_ENTRY_LZ4)
+			{
+				// Decompressor writes in 4 byte chunks, so give it some room to overrun
+				file->allocation=Zone_Malloc(zone, entry->size+4);
+
+				if(file->allocation==NULL)
+				{
+					DBGPRINTF(DEBUG_ERROR, "Archive_ReadFile: Unable to allocate memory for file %s.\n", filename);
+					return false;
+				}
+
+				if(lz4_decompress(data, entry->storedSize, (uint8_t *)file->allocation, entry->size)!=entry->size)
+				{
+					DBGPRINTF(DEBUG_ERROR, "Archive_ReadFile: Decompression failed for file %s.\n", filename);
+					Zone_Free(zone, file->allocation);
+					file->allocation=NULL;
+					return false;
+				}
+
+				file->data=(const uint8_t *)file->allocation;
+			}
+			else
+				file->data=data;
+
+			file->size=entry->size;
+
+			return true;
+		}
+	}
+
+	return Archive_ReadLooseFile(filename, file);
+}
+
+void Archive_CloseFile(ArchiveFile_t *file)
+{
+	if(file==NULL)
+		return;
+
+	if(file->allocation)
+		Zone_Free(zone, file->allocation);
+
+	memset(file, 0, sizeof(ArchiveFile_t));
+}
@@ -0,0 +1,53 @@
+#ifndef __ARCHIVE_H__
+#define __ARCHIVE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Packed asset archive, built by packAssets.py
+//
+// Layout (little endian):
+//   ArchiveHeader_t
+//   ArchiveEntry_t[numEntries], sorted by name
+//   entry data, each starting on an ARCHIVE_ALIGNMENT boundary
+#define ARCHIVE_MAGIC ('V'|'P'<<8|'A'<<16|'K'<<24)
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_ALIGNMENT 64
+#define ARCHIVE_MAX_NAME 64
+
+// Entry data is an LZ4 block, size is the decompressed size and storedSize the compressed size
+#define ARCHIVE_ENTRY_LZ4 0x00000001
+
+typedef struct
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t numEntries;
+	uint32_t reserved;
+} ArchiveHeader_t;
+
+typedef struct
+{
+	char name[ARCHIVE_MAX_NAME];
+	uint32_t offset;
+	uint32_t size;
+	uint32_t storedSize;
+	uint32_t flags;
+} ArchiveEntry_t;
+
+// A file's contents in memory, either pointing straight into the mapped archive or
+// into a zone allocation (for compressed entries or loose files that weren't in the archive).
+typedef struct
+{
+	const uint8_t *data;
+	size_t size;
+	void *allocation;
+} ArchiveFile_t;
+
+bool Archive_Mount(const char *filename);
+void Archive_Unmount(void);
+bool Archive_ReadFile(const char *filename, ArchiveFile_t *file);
+void Archive_CloseFile(ArchiveFile_t *file);
+
+#endif
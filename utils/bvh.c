@@ -1,10 +1,12 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <float.h>
+#include <string.h>
 #include <assert.h>
 #include "bvh.h"
 #include "../system/system.h"
 #include "../math/math.h"
+#include "../math/simd.h"
 #include "../entitylist.h"
 
 static int32_t indices[MAX_ENTITY];
@@ -20,6 +22,8 @@ static BVHBuildStackObj_t buildStack[BUILD_STACK_MAX];
 void BVH_Build(BVH_t *bvh, EntityList_t *entityList)
 {
 	bvh->numNodes=0;
+	bvh->numWideNodes=0;
+	bvh->version=entityList->version;
 
 	if(entityList->entityCount==0)
 		return;
@@ -37,11 +41,13 @@ void BVH_Build(BVH_t *bvh, EntityList_t *entityList)
 	{
 		BVHBuildStackObj_t work=buildStack[--stackTop];
 		BVHNode_t *node=&bvh->nodes[work.nodeIndex];
-		aabb nodeBounds=entityList->entities[indices[work.start]].bounds;
+		aabb nodeBounds=bvh->bounds[indices[work.start]];
+		bool asleep=entityList->entities[indices[work.start]].body->asleep;
 
 		for(int32_t i=1;i<work.count;i++)
 		{
-			const aabb *b=&entityList->entities[indices[work.start+i]].bounds;
+			const aabb *b=&bvh->bounds[indices[work.start+i]];
+			asleep&=entityList->entities[indices[work.start+i]].body->asleep;
 			nodeBounds=(aabb) {
 				nodeBounds.min.x<b->min.x?nodeBounds.min.x:b->min.x,
 				nodeBounds.min.y<b->min.y?nodeBounds.min.y:b->min.y,
@@ -53,6 +59,7 @@ void BVH_Build(BVH_t *bvh, EntityList_t *entityList)
 		}
 
 		node->bounds=nodeBounds;
+		node->asleep=asleep;
 
 		if(work.count==1)
 		{
@@ -66,11 +73,11 @@ void BVH_Build(BVH_t *bvh, EntityList_t *entityList)
 		uint32_t axis=(extent.x>=extent.y&&extent.x>=extent.z)?0:(extent.y>=extent.z)?1:2;
 
 		float centroidMin, centroidMax;
-		centroidMin=centroidMax=0.5f*(entityList->entities[indices[work.start]].bounds.min.v[axis]+entityList->entities[indices[work.start]].bounds.max.v[axis]);
+		centroidMin=centroidMax=0.5f*(bvh->bounds[indices[work.start]].min.v[axis]+bvh->bounds[indices[work.start]].max.v[axis]);
 
 		for(int32_t i=1;i<work.count;i++)
 		{
-			float c=0.5f*(entityList->entities[indices[work.start+i]].bounds.min.v[axis]+entityList->entities[indices[work.start+i]].bounds.max.v[axis]);
+			float c=0.5f*(bvh->bounds[indices[work.start+i]].min.v[axis]+bvh->bounds[indices[work.start+i]].max.v[axis]);
 
 			if(c<centroidMin)
 				centroidMin=c;
@@ -86,7 +93,7 @@ void BVH_Build(BVH_t *bvh, EntityList_t *entityList)
 
 		while(lo<=hi)
 		{
-			float c=0.5f*(entityList->entities[indices[lo]].bounds.min.v[axis]+entityList->entities[indices[lo]].bounds.max.v[axis]);;
+			float c=0.5f*(bvh->bounds[indices[lo]].min.v[axis]+bvh->bounds[indices[lo]].max.v[axis]);;
 
 			if(c<splitPos)
 				lo++;
@@ -124,177 +131,1287 @@ void BVH_Build(BVH_t *bvh, EntityList_t *entityList)
 	}
 }
 
+static inline bool SphereAABBOverlap(vec3 point, float radius, aabb bounds)
+{
+	float distSq=0.0f;
+
+	for(uint32_t i=0;i<3;i++)
+	{
+		float v=point.v[i];
+
+		if(v<bounds.min.v[i])
+		{
+			float d=bounds.min.v[i]-v;
+			distSq+=d*d;
+		}
+		else if(v>bounds.max.v[i])
+		{
+			float d=v-bounds.max.v[i];
+			distSq+=d*d;
+		}
+	}
+
+	return distSq<=(radius*radius);
+}
+
+static inline bool AABBAABBOverlap(aabb a, aabb b)
+{
+	return (a.min.v[0]<=b.max.v[0]&&a.max.v[0]>=b.min.v[0])&&
+	       (a.min.v[1]<=b.max.v[1]&&a.max.v[1]>=b.min.v[1])&&
+	       (a.min.v[2]<=b.max.v[2]&&a.max.v[2]>=b.min.v[2]);
+}
+
+// Slab test, hits anywhere between the origin and maxDistance along the ray count, padding grows the box on all sides
+static inline bool RayAABBOverlap(vec3 origin, vec3 invDirection, float maxDistance, float padding, aabb bounds)
+{
+	float tMin=0.0f, tMax=maxDistance;
+
+	for(uint32_t i=0;i<3;i++)
+	{
+		const float t0=(bounds.min.v[i]-padding-origin.v[i])*invDirection.v[i];
+		const float t1=(bounds.max.v[i]+padding-origin.v[i])*invDirection.v[i];
+
+		tMin=fmaxf(tMin, fminf(t0, t1));
+		tMax=fminf(tMax, fmaxf(t0, t1));
+	}
+
+	return tMin<=tMax;
+}
+
+// Axis parallel rays would divide by zero, a tiny direction instead keeps the slab test free of NaNs
+static inline vec3 RayInverseDirection(vec3 direction)
+{
+	vec3 invDirection;
+
+	for(uint32_t i=0;i<3;i++)
+	{
+		const float d=(fabsf(direction.v[i])<1e-8f)?copysignf(1e-8f, direction.v[i]):direction.v[i];
+		invDirection.v[i]=1.0f/d;
+	}
+
+	return invDirection;
+}
+
+#if defined(SIMD_NEON)
+static inline uint32_t NEONMoveMask(const uint32x4_t mask)
+{
+	return (vgetq_lane_u32(mask, 0)&1)|(vgetq_lane_u32(mask, 1)&2)|(vgetq_lane_u32(mask, 2)&4)|(vgetq_lane_u32(mask, 3)&8);
+}
+#endif
+
+// Child bounds are quantized to this many steps of the node's extent, the rest of the 16 bit range is headroom so the top steps
+//   always decode to at least the node's maximum
+#define BVH4_QUANTIZE_STEPS 65000.0f
+
+// Expands a wide node's child bounds into min x/y/z then max x/y/z lanes
+static inline void BVH4DecodeBounds(const BVH4Node_t *node, float boxes[6][4])
+{
+	for(uint32_t i=0;i<6;i++)
+	{
+		const uint32_t axis=i%3;
+
+#if defined(SIMD_SSE)
+		const __m128i q=_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)node->bounds[i]), _mm_setzero_si128());
+		_mm_storeu_ps(boxes[i], _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(q), _mm_set1_ps(node->scale.v[axis])), _mm_set1_ps(node->origin.v[axis])));
+#elif defined(SIMD_NEON)
+		const float32x4_t q=vcvtq_f32_u32(vmovl_u16(vld1_u16(node->bounds[i])));
+		vst1q_f32(boxes[i], vaddq_f32(vmulq_n_f32(q, node->scale.v[axis]), vdupq_n_f32(node->origin.v[axis])));
+#else
+		for(uint32_t j=0;j<4;j++)
+			boxes[i][j]=(float)node->bounds[i][j]*node->scale.v[axis]+node->origin.v[axis];
+#endif
+	}
+}
+
+static inline aabb BVH4ChildBounds(const float boxes[6][4], uint32_t i)
+{
+	return (aabb) { .min=Vec3(boxes[0][i], boxes[1][i], boxes[2][i]), .max=Vec3(boxes[3][i], boxes[4][i], boxes[5][i]) };
+}
+
+// Returns bit N set if the box overlaps child box N
+static inline uint32_t BVH4TestAABB(const float boxes[6][4], const aabb bounds)
+{
+#if defined(SIMD_SSE)
+	__m128 overlap=_mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(boxes[0]), _mm_set1_ps(bounds.max.x)), _mm_cmpge_ps(_mm_loadu_ps(boxes[3]), _mm_set1_ps(bounds.min.x)));
+	overlap=_mm_and_ps(overlap, _mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(boxes[1]), _mm_set1_ps(bounds.max.y)), _mm_cmpge_ps(_mm_loadu_ps(boxes[4]), _mm_set1_ps(bounds.min.y))));
+	overlap=_mm_and_ps(overlap, _mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(boxes[2]), _mm_set1_ps(bounds.max.z)), _mm_cmpge_ps(_mm_loadu_ps(boxes[5]), _mm_set1_ps(bounds.min.z))));
+
+	return (uint32_t)_mm_movemask_ps(overlap);
+#elif defined(SIMD_NEON)
+	uint32x4_t overlap=vandq_u32(vcleq_f32(vld1q_f32(boxes[0]), vdupq_n_f32(bounds.max.x)), vcgeq_f32(vld1q_f32(boxes[3]), vdupq_n_f32(bounds.min.x)));
+	overlap=vandq_u32(overlap, vandq_u32(vcleq_f32(vld1q_f32(boxes[1]), vdupq_n_f32(bounds.max.y)), vcgeq_f32(vld1q_f32(boxes[4]), vdupq_n_f32(bounds.min.y))));
+	overlap=vandq_u32(overlap, vandq_u32(vcleq_f32(vld1q_f32(boxes[2]), vdupq_n_f32(bounds.max.z)), vcgeq_f32(vld1q_f32(boxes[5]), vdupq_n_f32(bounds.min.z))));
+
+	return NEONMoveMask(overlap);
+#else
+	uint32_t result=0;
+
+	for(uint32_t j=0;j<4;j++)
+	{
+		if(AABBAABBOverlap(BVH4ChildBounds(boxes, j), bounds))
+			result|=1u<<j;
+	}
+
+	return result;
+#endif
+}
+
+// Returns bit N set if the sphere overlaps child box N
+static inline uint32_t BVH4TestSphere(const float boxes[6][4], const vec3 point, const float radius)
+{
+#if defined(SIMD_SSE)
+	const __m128 zero=_mm_setzero_ps();
+	__m128 distSq=zero;
+
+	for(uint32_t i=0;i<3;i++)
+	{
+		// Only one side can be past the point
+		const __m128 p=_mm_set1_ps(point.v[i]);
+		const __m128 d=_mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(boxes[i]), p), zero), _mm_max_ps(_mm_sub_ps(p, _mm_loadu_ps(boxes[i+3])), zero));
+
+		distSq=_mm_add_ps(distSq, _mm_mul_ps(d, d));
+	}
+
+	return (uint32_t)_mm_movemask_ps(_mm_cmple_ps(distSq, _mm_set1_ps(radius*radius)));
+#elif defined(SIMD_NEON)
+	const float32x4_t zero=vdupq_n_f32(0.0f);
+	float32x4_t distSq=zero;
+
+	for(uint32_t i=0;i<3;i++)
+	{
+		const float32x4_t p=vdupq_n_f32(point.v[i]);
+		const float32x4_t d=vaddq_f32(vmaxq_f32(vsubq_f32(vld1q_f32(boxes[i]), p), zero), vmaxq_f32(vsubq_f32(p, vld1q_f32(boxes[i+3])), zero));
+
+		distSq=vmlaq_f32(distSq, d, d);
+	}
+
+	return NEONMoveMask(vcleq_f32(distSq, vdupq_n_f32(radius*radius)));
+#else
+	uint32_t result=0;
+
+	for(uint32_t j=0;j<4;j++)
+	{
+		if(SphereAABBOverlap(point, radius, BVH4ChildBounds(boxes, j)))
+			result|=1u<<j;
+	}
+
+	return result;
+#endif
+}
+
+// Returns bit N set if the ray hits child box N grown by padding
+static inline uint32_t BVH4TestRay(const float boxes[6][4], const vec3 origin, const vec3 invDirection, const float maxDistance, const float padding)
+{
+#if defined(SIMD_SSE)
+	__m128 tMin=_mm_setzero_ps(), tMax=_mm_set1_ps(maxDistance);
+
+	for(uint32_t i=0;i<3;i++)
+	{
+		const __m128 o=_mm_set1_ps(origin.v[i]), inv=_mm_set1_ps(invDirection.v[i]), pad=_mm_set1_ps(padding);
+		const __m128 t0=_mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(boxes[i]), pad), o), inv);
+		const __m128 t1=_mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_loadu_ps(boxes[i+3]), pad), o), inv);
+
+		tMin=_mm_max_ps(tMin, _mm_min_ps(t0, t1));
+		tMax=_mm_min_ps(tMax, _mm_max_ps(t0, t1));
+	}
+
+	return (uint32_t)_mm_movemask_ps(_mm_cmple_ps(tMin, tMax));
+#elif defined(SIMD_NEON)
+	float32x4_t tMin=vdupq_n_f32(0.0f), tMax=vdupq_n_f32(maxDistance);
+
+	for(uint32_t i=0;i<3;i++)
+	{
+		const float32x4_t o=vdupq_n_f32(origin.v[i]), pad=vdupq_n_f32(padding);
+		const float32x4_t t0=vmulq_n_f32(vsubq_f32(vsubq_f32(vld1q_f32(boxes[i]), pad), o), invDirection.v[i]);
+		const float32x4_t t1=vmulq_n_f32(vsubq_f32(vaddq_f32(vld1q_f32(boxes[i+3]), pad), o), invDirection.v[i]);
+
+		tMin=vmaxq_f32(tMin, vminq_f32(t0, t1));
+		tMax=vminq_f32(tMax, vmaxq_f32(t0, t1));
+	}
+
+	return NEONMoveMask(vcleq_f32(tMin, tMax));
+#else
+	uint32_t result=0;
+
+	for(uint32_t j=0;j<4;j++)
+	{
+		if(RayAABBOverlap(origin, invDirection, maxDistance, padding, BVH4ChildBounds(boxes, j)))
+			result|=1u<<j;
+	}
+
+	return result;
+#endif
+}
+
+static inline float SurfaceArea(const aabb bounds)
+{
+	const vec3 extent=Vec3_Subv(bounds.max, bounds.min);
+
+	return extent.x*extent.y+extent.y*extent.z+extent.z*extent.x;
+}
+
+// Quantizes the children's bounds against the node's, rounding outwards
+static void BVH4Quantize(const BVH_t *bvh, BVH4Node_t *node, const aabb nodeBounds, const int32_t *children, uint32_t numChildren)
+{
+	node->origin=nodeBounds.min;
+
+	for(uint32_t axis=0;axis<3;axis++)
+		node->scale.v[axis]=(nodeBounds.max.v[axis]-nodeBounds.min.v[axis])/BVH4_QUANTIZE_STEPS;
+
+	memset(node->bounds, 0, sizeof(node->bounds));
+
+	for(uint32_t i=0;i<numChildren;i++)
+	{
+		const aabb childBounds=bvh->nodes[children[i]].bounds;
+
+		for(uint32_t axis=0;axis<3;axis++)
+		{
+			const float scale=node->scale.v[axis];
+
+			if(scale<=0.0f)
+				continue;
+
+			node->bounds[axis][i]=(uint16_t)clampf(floorf((childBounds.min.v[axis]-node->origin.v[axis])/scale), 0.0f, 65535.0f);
+			node->bounds[axis+3][i]=(uint16_t)clampf(ceilf((childBounds.max.v[axis]-node->origin.v[axis])/scale), 0.0f, 65535.0f);
+		}
+	}
+
+	// Rounding in the decode can still land a step inside a child, walk those out until every decoded box holds its child.
+	// Step 0 decodes to exactly the origin and the top step is past the node's maximum, so this always ends.
+	for(;;)
+	{
+		float boxes[6][4];
+		bool grown=false;
+
+		BVH4DecodeBounds(node, boxes);
+
+		for(uint32_t i=0;i<numChildren;i++)
+		{
+			const aabb childBounds=bvh->nodes[children[i]].bounds;
+
+			for(uint32_t axis=0;axis<3;axis++)
+			{
+				if(boxes[axis][i]>childBounds.min.v[axis]&&node->bounds[axis][i]>0)
+				{
+					node->bounds[axis][i]--;
+					grown=true;
+				}
+
+				if(boxes[axis+3][i]<childBounds.max.v[axis]&&node->bounds[axis+3][i]<65535)
+				{
+					node->bounds[axis+3][i]++;
+					grown=true;
+				}
+			}
+		}
+
+		if(!grown)
+			break;
+	}
+}
+
+typedef struct
+{
+	int32_t binaryIndex, parent, slot;
+} BVH4BuildStackObj_t;
+
+#define BVH4_BUILD_STACK_MAX (BUILD_STACK_MAX*4)
+
+// Collapses the binary tree into 4 wide nodes, each standing in for up to 3 binary nodes by opening its largest internal children.
+// Nodes are numbered depth first, so a node's first internal child directly follows it in memory.
+// Has to be redone after every BVH_Build, the tests and queries fall back to the binary tree until it is.
+void BVH_BuildWide(BVH_t *bvh)
+{
+	bvh->numWideNodes=0;
+
+	if(bvh->numNodes==0)
+		return;
+
+	BVH4BuildStackObj_t stack[BVH4_BUILD_STACK_MAX];
+	int32_t stackTop=0;
+
+	stack[stackTop++]=(BVH4BuildStackObj_t) { 0, -1, 0 };
+
+	while(stackTop>0)
+	{
+		const BVH4BuildStackObj_t work=stack[--stackTop];
+		const BVHNode_t *binaryNode=&bvh->nodes[work.binaryIndex];
+
+		assert(bvh->numWideNodes<BVH4_MAX_NODES&&"BVH4 node pool exhausted");
+
+		const int32_t nodeIndex=(int32_t)bvh->numWideNodes++;
+		BVH4Node_t *node=&bvh->wideNodes[nodeIndex];
+
+		if(work.parent>=0)
+			bvh->wideNodes[work.parent].child[work.slot]=nodeIndex;
+
+		int32_t children[4];
+		uint32_t numChildren=0;
+
+		// Only a single entity tree has a leaf at the root
+		if(binaryNode->left==-1)
+			children[numChildren++]=work.binaryIndex;
+		else
+		{
+			children[numChildren++]=binaryNode->left;
+			children[numChildren++]=binaryNode->right;
+		}
+
+		while(numChildren<4)
+		{
+			int32_t largest=-1;
+			float largestArea=-1.0f;
+
+			for(uint32_t i=0;i<numChildren;i++)
+			{
+				const BVHNode_t *child=&bvh->nodes[children[i]];
+
+				if(child->left!=-1&&SurfaceArea(child->bounds)>largestArea)
+				{
+					largest=(int32_t)i;
+					largestArea=SurfaceArea(child->bounds);
+				}
+			}
+
+			if(largest==-1)
+				break;
+
+			const BVHNode_t *opened=&bvh->nodes[children[largest]];
+
+			children[largest]=opened->left;
+			children[numChildren++]=opened->right;
+		}
+
+		BVH4Quantize(bvh, node, binaryNode->bounds, children, numChildren);
+
+		node->childMask=(uint8_t)((1u<<numChildren)-1);
+		node->asleepMask=0;
+
+		for(uint32_t i=numChildren;i<4;i++)
+			node->child[i]=0;
+
+		// Pushed last to first, so the first child is numbered next
+		for(int32_t i=(int32_t)numChildren-1;i>=0;i--)
+		{
+			const BVHNode_t *child=&bvh->nodes[children[i]];
+
+			if(child->asleep)
+				node->asleepMask|=(uint8_t)(1u<<i);
+
+			if(child->left==-1)
+				node->child[i]=~children[i];
+			else
+			{
+				assert(stackTop+1<=BVH4_BUILD_STACK_MAX&&"BVH4 build stack overflow");
+				stack[stackTop++]=(BVH4BuildStackObj_t) { children[i], nodeIndex, i };
+			}
+		}
+	}
+}
+
 typedef struct
 {
-	int32_t a;
-	int32_t b;
-} BVHPairStackObj_t;
+	int32_t a;
+	int32_t b;
+} BVHPairStackObj_t;
+
+// Pair traversal is depth first and each step adds at most 15 to the stack depth (a wide node pair), so this covers
+//   two full paths through the deepest tree the build stack allows
+#define TEST_STACK_MAX (BUILD_STACK_MAX*32)
+
+// One step of the pair traversal.
+// Writes the node pairs to visit next into children (at most 3) and returns how many, or sets leafPair if a and b are overlapping
+//   leaves of different objects.
+static inline uint32_t BVHExpandPair(const BVH_t *bvh, const BVHPairStackObj_t pair, BVHPairStackObj_t *children, bool *leafPair)
+{
+	const BVHNode_t *a=&bvh->nodes[pair.a];
+	const BVHNode_t *b=&bvh->nodes[pair.b];
+
+	*leafPair=false;
+
+	// Sleeping bodies were already resolved against each other before they went to sleep
+	if(a->asleep&&b->asleep)
+		return 0;
+
+	if(!((a->bounds.min.x<=b->bounds.max.x)&
+		 (a->bounds.max.x>=b->bounds.min.x)&
+		 (a->bounds.min.y<=b->bounds.max.y)&
+		 (a->bounds.max.y>=b->bounds.min.y)&
+		 (a->bounds.min.z<=b->bounds.max.z)&
+		 (a->bounds.max.z>=b->bounds.min.z)))
+		return 0;
+
+	int leafA=(a->left==-1);
+	int leafB=(b->left==-1);
+
+	if(leafA&&leafB)
+	{
+		*leafPair=(a->objectIndex!=b->objectIndex);
+		return 0;
+	}
+	else if(pair.a==pair.b)
+	{
+		children[0]=(BVHPairStackObj_t) { a->left, a->left };
+		children[1]=(BVHPairStackObj_t) { a->right, a->right };
+		children[2]=(BVHPairStackObj_t) { a->left, a->right };
+		return 3;
+	}
+	else if(leafA)
+	{
+		children[0]=(BVHPairStackObj_t) { pair.a, b->left };
+		children[1]=(BVHPairStackObj_t) { pair.a, b->right };
+		return 2;
+	}
+	else if(leafB)
+	{
+		children[0]=(BVHPairStackObj_t) { a->left, pair.b };
+		children[1]=(BVHPairStackObj_t) { a->right, pair.b };
+		return 2;
+	}
+
+	if((2.0f*Vec3_LengthSq(Vec3_Subv(a->bounds.max, a->bounds.min)))>=(2.0f*Vec3_LengthSq(Vec3_Subv(b->bounds.max, b->bounds.min))))
+	{
+		children[0]=(BVHPairStackObj_t) { a->left, pair.b };
+		children[1]=(BVHPairStackObj_t) { a->right, pair.b };
+	}
+	else
+	{
+		children[0]=(BVHPairStackObj_t) { pair.a, b->left };
+		children[1]=(BVHPairStackObj_t) { pair.a, b->right };
+	}
+
+	return 2;
+}
+
+// Most pairs one step of the wide traversal can produce, every child of one node against every child of another
+#define BVH4_MAX_PAIR_CHILDREN 16
+
+// One step of the pair traversal over the wide nodes, same contract as BVHExpandPair with pairs of child references.
+// Overlap and sleep are checked as pairs are made, so a popped pair only needs testing if it's two leaves, against their real bounds
+//   rather than the quantized ones.
+static inline uint32_t BVH4ExpandPair(const BVH_t *bvh, const BVHPairStackObj_t pair, BVHPairStackObj_t *children, bool *leafPair)
+{
+	float boxesA[6][4], boxesB[6][4];
+	uint32_t numChildren=0;
+
+	*leafPair=false;
+
+	if(pair.a<0&&pair.b<0)
+	{
+		*leafPair=AABBAABBOverlap(bvh->nodes[~pair.a].bounds, bvh->nodes[~pair.b].bounds);
+		return 0;
+	}
+
+	// Subtree against itself: each overlapping pair of children, and each internal child against itself
+	if(pair.a==pair.b)
+	{
+		const BVH4Node_t *node=&bvh->wideNodes[pair.a];
+
+		BVH4DecodeBounds(node, boxesA);
+
+		for(uint32_t i=0;i<4;i++)
+		{
+			if(!(node->childMask&(1u<<i)))
+				continue;
+
+			const bool asleep=(node->asleepMask>>i)&1;
+
+			// Only the children after this one, earlier ones already tested against it
+			uint32_t mask=BVH4TestAABB(boxesA, BVH4ChildBounds(boxesA, i))&node->childMask&~((2u<<i)-1);
+
+			if(asleep)
+				mask&=~node->asleepMask;
+
+			for(uint32_t j=i+1;j<4;j++)
+			{
+				if(mask&(1u<<j))
+					children[numChildren++]=(BVHPairStackObj_t) { node->child[i], node->child[j] };
+			}
+
+			if(node->child[i]>=0&&!asleep)
+				children[numChildren++]=(BVHPairStackObj_t) { node->child[i], node->child[i] };
+		}
+
+		return numChildren;
+	}
+
+	// Leaf against a node, the leaf keeps its side of the pair
+	if(pair.a<0||pair.b<0)
+	{
+		const bool leafFirst=(pair.a<0);
+		const BVHNode_t *leaf=&bvh->nodes[~(leafFirst?pair.a:pair.b)];
+		const BVH4Node_t *node=&bvh->wideNodes[leafFirst?pair.b:pair.a];
+
+		BVH4DecodeBounds(node, boxesB);
+
+		uint32_t mask=BVH4TestAABB(boxesB, leaf->bounds)&node->childMask;
+
+		if(leaf->asleep)
+			mask&=~node->asleepMask;
+
+		for(uint32_t j=0;j<4;j++)
+		{
+			if(!(mask&(1u<<j)))
+				continue;
+
+			if(leafFirst)
+				children[numChildren++]=(BVHPairStackObj_t) { pair.a, node->child[j] };
+			else
+				children[numChildren++]=(BVHPairStackObj_t) { node->child[j], pair.b };
+		}
+
+		return numChildren;
+	}
+
+	// Two different nodes, both are opened at once
+	const BVH4Node_t *a=&bvh->wideNodes[pair.a];
+	const BVH4Node_t *b=&bvh->wideNodes[pair.b];
+
+	BVH4DecodeBounds(a, boxesA);
+	BVH4DecodeBounds(b, boxesB);
+
+	for(uint32_t i=0;i<4;i++)
+	{
+		if(!(a->childMask&(1u<<i)))
+			continue;
+
+		uint32_t mask=BVH4TestAABB(boxesB, BVH4ChildBounds(boxesA, i))&b->childMask;
+
+		if((a->asleepMask>>i)&1)
+			mask&=~b->asleepMask;
+
+		for(uint32_t j=0;j<4;j++)
+		{
+			if(mask&(1u<<j))
+				children[numChildren++]=(BVHPairStackObj_t) { a->child[i], b->child[j] };
+		}
+	}
+
+	return numChildren;
+}
+
+// Traversal step for whichever layout the tree has, pairs are node indices into that layout
+static inline uint32_t ExpandPair(const BVH_t *bvh, const BVHPairStackObj_t pair, BVHPairStackObj_t *children, bool *leafPair)
+{
+	if(bvh->numWideNodes>0)
+		return BVH4ExpandPair(bvh, pair, children, leafPair);
+
+	return BVHExpandPair(bvh, pair, children, leafPair);
+}
+
+// Binary node of a leaf pair's side
+static inline const BVHNode_t *PairLeaf(const BVH_t *bvh, const int32_t index)
+{
+	return &bvh->nodes[(bvh->numWideNodes>0)?~index:index];
+}
+
+// Walks everything under one node pair with a stack of its own, so any number of these can run at once.
+// Leaf pairs go to the callback, or into the pair buffer if there is one. Returns the number of pairs written to the buffer.
+static uint32_t BVHTestNodePair(const BVH_t *bvh, const BVHPairStackObj_t start, EntityList_t *entityList, BVHLeafCallback_t callback, BVHPairBuffer_t *buffer)
+{
+	BVHPairStackObj_t stack[TEST_STACK_MAX];
+	int32_t stackTop=0;
+	uint32_t numPairs=0;
+
+	stack[stackTop++]=start;
+
+	while(stackTop>0)
+	{
+		const BVHPairStackObj_t pair=stack[--stackTop];
+		bool leafPair;
+
+		assert(stackTop+BVH4_MAX_PAIR_CHILDREN<=TEST_STACK_MAX&&"BVH test stack overflow");
+
+		stackTop+=ExpandPair(bvh, pair, &stack[stackTop], &leafPair);
+
+		if(!leafPair)
+			continue;
+
+		const int32_t objectA=PairLeaf(bvh, pair.a)->objectIndex;
+		const int32_t objectB=PairLeaf(bvh, pair.b)->objectIndex;
+
+		if(buffer==NULL)
+			callback(&entityList->entities[objectA], &entityList->entities[objectB]);
+		else if(buffer->numPairs<buffer->maxPairs)
+		{
+			buffer->pairs[buffer->numPairs][0]=(uint32_t)objectA;
+			buffer->pairs[buffer->numPairs][1]=(uint32_t)objectB;
+			buffer->numPairs++;
+			numPairs++;
+		}
+		else
+			buffer->overflow++;
+	}
+
+	return numPairs;
+}
+
+void BVH_Test(BVH_t *bvh, EntityList_t *entityList, BVHLeafCallback_t callback)
+{
+	if(bvh->numNodes==0||entityList->entityCount==0)
+		return;
+
+	BVHTestNodePair(bvh, (BVHPairStackObj_t) { 0, 0 }, entityList, callback, NULL);
+}
+
+bool BVH_ParallelTestCreate(BVHParallelTest_t *test, uint32_t numBuffers, uint32_t maxPairsPerBuffer)
+{
+	if(test==NULL)
+		return false;
+
+	if(numBuffers==0||numBuffers>BVH_MAX_TEST_BUFFERS||maxPairsPerBuffer==0)
+		return false;
+
+	memset(test, 0, sizeof(BVHParallelTest_t));
+
+	test->numBuffers=numBuffers;
+
+	for(uint32_t i=0;i<numBuffers;i++)
+	{
+		test->buffers[i].maxPairs=maxPairsPerBuffer;
+		test->buffers[i].pairs=(uint32_t (*)[2])Zone_Malloc(zone, sizeof(uint32_t)*2*maxPairsPerBuffer);
+
+		if(test->buffers[i].pairs==NULL)
+		{
+			DBGPRINTF(DEBUG_ERROR, "Unable to allocate memory for BVH pair buffers.\n");
+			BVH_ParallelTestDestroy(test);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void BVH_ParallelTestDestroy(BVHParallelTest_t *test)
+{
+	for(uint32_t i=0;i<BVH_MAX_TEST_BUFFERS;i++)
+		Zone_Free(zone, test->buffers[i].pairs);
 
-#define TEST_STACK_MAX (MAX_ENTITY*4)
-static BVHPairStackObj_t testStack[TEST_STACK_MAX];
+	memset(test, 0, sizeof(BVHParallelTest_t));
+}
 
-void BVH_Test(BVH_t *bvh, EntityList_t *entityList, BVHLeafCallback_t callback)
+// Splits the self test of the whole tree into independent node pairs.
+// The root's self pair is expanded a level at a time with the same rules as the traversal (culled pairs drop out, leaf pairs stay
+//   as they are), until there are at least targetTasks or the next level wouldn't fit.
+// Must be called from one thread before any BVH_ParallelTestRun.
+void BVH_ParallelTestBegin(BVHParallelTest_t *test, const BVH_t *bvh, uint32_t targetTasks)
 {
-	if(bvh->numNodes==0||entityList->entityCount==0)
+	BVHPairStackObj_t tasks[2][BVH_MAX_TEST_TASKS];
+	uint32_t numTasks=0, current=0;
+
+	for(uint32_t i=0;i<test->numBuffers;i++)
+	{
+		test->buffers[i].numPairs=0;
+		test->buffers[i].overflow=0;
+	}
+
+	atomic_store(&test->nextTask, 0);
+	test->numTasks=0;
+
+	if(bvh->numNodes==0)
 		return;
 
-	int32_t stackTop=0;
+	targetTasks=min(max(targetTasks, 1), BVH_MAX_TEST_TASKS);
+	tasks[current][numTasks++]=(BVHPairStackObj_t) { 0, 0 };
 
-	testStack[stackTop++]=(BVHPairStackObj_t) { 0, 0 };
+	while(numTasks<targetTasks)
+	{
+		BVHPairStackObj_t *next=tasks[current^1];
+		uint32_t numNext=0;
+		bool expanded=false, full=false;
 
-	while(stackTop>0)
+		for(uint32_t i=0;i<numTasks;i++)
+		{
+			BVHPairStackObj_t children[BVH4_MAX_PAIR_CHILDREN];
+			bool leafPair;
+			const uint32_t numChildren=ExpandPair(bvh, tasks[current][i], children, &leafPair);
+
+			if(numNext+max(numChildren, 1)>BVH_MAX_TEST_TASKS)
+			{
+				full=true;
+				break;
+			}
+
+			if(leafPair)
+				next[numNext++]=tasks[current][i];
+
+			for(uint32_t j=0;j<numChildren;j++)
+				next[numNext++]=children[j];
+
+			expanded|=(numChildren>0||!leafPair);
+		}
+
+		// Nothing left to split, or the next level has too many tasks
+		if(!expanded||full)
+			break;
+
+		current^=1;
+		numTasks=numNext;
+	}
+
+	for(uint32_t i=0;i<numTasks;i++)
+		test->tasks[i]=(BVHTestTask_t) { tasks[current][i].a, tasks[current][i].b, 0, 0, 0 };
+
+	test->numTasks=numTasks;
+}
+
+// Runs tasks into one pair buffer until there are none left, each calling thread needs its own buffer index.
+// Tasks are handed out first come first served, only the merge order is fixed.
+void BVH_ParallelTestRun(BVHParallelTest_t *test, const BVH_t *bvh, uint32_t buffer)
+{
+	if(buffer>=test->numBuffers)
+		return;
+
+	BVHPairBuffer_t *pairBuffer=&test->buffers[buffer];
+
+	for(;;)
 	{
-		BVHPairStackObj_t pair=testStack[--stackTop];
+		const uint32_t taskIndex=atomic_fetch_add(&test->nextTask, 1);
 
-		const BVHNode_t *a=&bvh->nodes[pair.a];
-		const BVHNode_t *b=&bvh->nodes[pair.b];
+		if(taskIndex>=test->numTasks)
+			break;
 
-		if(!((a->bounds.min.x<=b->bounds.max.x)&
-			 (a->bounds.max.x>=b->bounds.min.x)&
-			 (a->bounds.min.y<=b->bounds.max.y)&
-			 (a->bounds.max.y>=b->bounds.min.y)&
-			 (a->bounds.min.z<=b->bounds.max.z)&
-			 (a->bounds.max.z>=b->bounds.min.z)))
-			continue;
+		BVHTestTask_t *task=&test->tasks[taskIndex];
+
+		task->buffer=buffer;
+		task->firstPair=pairBuffer->numPairs;
+		task->numPairs=BVHTestNodePair(bvh, (BVHPairStackObj_t) { task->a, task->b }, NULL, NULL, pairBuffer);
+	}
+}
+
+// Calls back for every pair found, task by task in task order, so the result doesn't depend on which thread ran what.
+// Returns the number of pairs dropped because a buffer was full.
+uint32_t BVH_ParallelTestMerge(const BVHParallelTest_t *test, EntityList_t *entityList, BVHLeafCallback_t callback)
+{
+	uint32_t overflow=0;
 
-		int leafA=(a->left==-1);
-		int leafB=(b->left==-1);
+	for(uint32_t i=0;i<test->numTasks;i++)
+	{
+		const BVHTestTask_t *task=&test->tasks[i];
+		const BVHPairBuffer_t *buffer=&test->buffers[task->buffer];
 
-		if(leafA&&leafB)
+		for(uint32_t j=0;j<task->numPairs;j++)
 		{
-			if(a->objectIndex!=b->objectIndex)
-				callback(&entityList->entities[a->objectIndex], &entityList->entities[b->objectIndex]);
+			const uint32_t *pair=buffer->pairs[task->firstPair+j];
+			callback(&entityList->entities[pair[0]], &entityList->entities[pair[1]]);
 		}
-		else if(pair.a==pair.b)
-		{
-			int32_t l=a->left;
-			int32_t r=a->right;
+	}
 
-			assert(stackTop+3<=TEST_STACK_MAX&&"BVH test stack overflow");
+	for(uint32_t i=0;i<test->numBuffers;i++)
+		overflow+=test->buffers[i].overflow;
 
-			testStack[stackTop++]=(BVHPairStackObj_t) { l, l };
-			testStack[stackTop++]=(BVHPairStackObj_t) { r, r };
-			testStack[stackTop++]=(BVHPairStackObj_t) { l, r };
-		}
-		else if(leafA)
-		{
-			assert(stackTop+2<=TEST_STACK_MAX&&"BVH test stack overflow");
+	return overflow;
+}
 
-			testStack[stackTop++]=(BVHPairStackObj_t) { pair.a, b->left };
-			testStack[stackTop++]=(BVHPairStackObj_t) { pair.a, b->right };
-		}
-		else if(leafB)
+#define QUERY_STACK_MAX 64
+
+typedef enum
+{
+	BVH_QUERY_SPHERE,
+	BVH_QUERY_AABB,
+	BVH_QUERY_RAY,
+} BVHQueryType_e;
+
+typedef struct
+{
+	BVHQueryType_e type;
+
+	vec3 point;
+	float radius;
+
+	aabb bounds;
+
+	vec3 origin, invDirection;
+	float maxDistance, padding;
+} BVHQuery_t;
+
+static inline bool QueryOverlap(const BVHQuery_t *query, const aabb bounds)
+{
+	switch(query->type)
+	{
+		case BVH_QUERY_SPHERE:	return SphereAABBOverlap(query->point, query->radius, bounds);
+		case BVH_QUERY_AABB:	return AABBAABBOverlap(query->bounds, bounds);
+		case BVH_QUERY_RAY:		return RayAABBOverlap(query->origin, query->invDirection, query->maxDistance, query->padding, bounds);
+	}
+
+	return false;
+}
+
+static inline uint32_t QueryOverlap4(const BVHQuery_t *query, const float boxes[6][4])
+{
+	switch(query->type)
+	{
+		case BVH_QUERY_SPHERE:	return BVH4TestSphere(boxes, query->point, query->radius);
+		case BVH_QUERY_AABB:	return BVH4TestAABB(boxes, query->bounds);
+		case BVH_QUERY_RAY:		return BVH4TestRay(boxes, query->origin, query->invDirection, query->maxDistance, query->padding);
+	}
+
+	return 0;
+}
+
+// Calls back for every entity whose bounds pass the query.
+// With the wide layout children are tested 4 at a time against their quantized bounds, leaves are checked again against their
+//   real bounds so both layouts give the same answer.
+static void BVHQuery(const BVH_t *bvh, EntityList_t *entityList, const BVHQuery_t *query, BVHQueryCallback_t callback, void *userdata)
+{
+	if(bvh->numNodes==0||entityList->entityCount==0)
+		return;
+
+	if(bvh->numWideNodes>0)
+	{
+		// Each step replaces a node with up to 4 children
+		int32_t stack[QUERY_STACK_MAX*4];
+		int32_t stackTop=0;
+		stack[stackTop++]=0; // Start at root
+
+		while(stackTop>0)
 		{
-			assert(stackTop+2<=TEST_STACK_MAX&&"BVH test stack overflow");
+			const BVH4Node_t *node=&bvh->wideNodes[stack[--stackTop]];
+			float boxes[6][4];
+
+			BVH4DecodeBounds(node, boxes);
+
+			const uint32_t mask=QueryOverlap4(query, boxes)&node->childMask;
 
-			testStack[stackTop++]=(BVHPairStackObj_t) { a->left, pair.b };
-			testStack[stackTop++]=(BVHPairStackObj_t) { a->right, pair.b };
+			for(uint32_t i=0;i<4;i++)
+			{
+				if(!(mask&(1u<<i)))
+					continue;
+
+				if(node->child[i]<0)
+				{
+					const BVHNode_t *leaf=&bvh->nodes[~node->child[i]];
+
+					if(QueryOverlap(query, leaf->bounds))
+						callback(&entityList->entities[leaf->objectIndex], userdata);
+				}
+				else
+				{
+					assert(stackTop+1<=QUERY_STACK_MAX*4&&"BVH query stack overflow");
+					stack[stackTop++]=node->child[i];
+				}
+			}
 		}
+
+		return;
+	}
+
+	int32_t stack[QUERY_STACK_MAX];
+	int32_t stackTop=0;
+	stack[stackTop++]=0; // Start at root
+
+	while(stackTop>0)
+	{
+		int32_t nodeIndex=stack[--stackTop];
+		const BVHNode_t *node=&bvh->nodes[nodeIndex];
+
+		// Cull this node if the query doesn't overlap its bounds
+		if(!QueryOverlap(query, node->bounds))
+			continue;
+
+		// If leaf, run callback, otherwise descend into children
+		if(node->left==-1)
+			callback(&entityList->entities[node->objectIndex], userdata);
 		else
 		{
-			assert(stackTop+2<=TEST_STACK_MAX&&"BVH test stack overflow – increase TEST_STACK_MAX");
+			assert(stackTop+2<=QUERY_STACK_MAX&&"BVH query stack overflow");
+			stack[stackTop++]=node->left;
+			stack[stackTop++]=node->right;
+		}
+	}
+}
+
+void BVH_QuerySphere(BVH_t *bvh, EntityList_t *entityList, vec3 point, float radius, BVHQueryCallback_t callback, void *userdata)
+{
+	BVHQuery(bvh, entityList, &(BVHQuery_t) { .type=BVH_QUERY_SPHERE, .point=point, .radius=radius }, callback, userdata);
+}
+
+void BVH_QueryAABB(BVH_t *bvh, EntityList_t *entityList, aabb bounds, BVHQueryCallback_t callback, void *userdata)
+{
+	BVHQuery(bvh, entityList, &(BVHQuery_t) { .type=BVH_QUERY_AABB, .bounds=bounds }, callback, userdata);
+}
+
+// Calls back for every entity whose bounds, grown by padding, the ray passes through within maxDistance of its origin.
+// Bounds are only what the tree was built from, the caller still needs its own exact test.
+void BVH_QueryRay(BVH_t *bvh, EntityList_t *entityList, vec3 origin, vec3 direction, float maxDistance, float padding, BVHQueryCallback_t callback, void *userdata)
+{
+	BVHQuery(bvh, entityList, &(BVHQuery_t)
+	{
+		.type=BVH_QUERY_RAY,
+		.origin=origin,
+		.invDirection=RayInverseDirection(direction),
+		.maxDistance=maxDistance,
+		.padding=padding
+	}, callback, userdata);
+}
+
+typedef struct
+{
+	int32_t nodeIndex;
+	uint32_t mask;
+} BVHQueryBatchStackObj_t;
+
+// Answers queries in packets of 32, each packet walks the tree once carrying a mask of the queries still overlapping the node.
+// Either spheres (points and radii) or boxes are given.
+static uint32_t BVHQueryBatch(const BVH_t *bvh, const vec3 *points, const float *radii, const aabb *bounds, uint32_t numQueries, BVHQueryHit_t *hits, uint32_t maxHits)
+{
+	uint32_t numHits=0;
+
+	if(bvh->numNodes==0)
+		return 0;
+
+	for(uint32_t first=0;first<numQueries;first+=BVH_QUERY_PACKET_SIZE)
+	{
+		const uint32_t count=min(numQueries-first, BVH_QUERY_PACKET_SIZE);
+
+		BVHQueryBatchStackObj_t stack[QUERY_STACK_MAX];
+		int32_t stackTop=0;
+
+		stack[stackTop++]=(BVHQueryBatchStackObj_t) { 0, (count==32)?0xFFFFFFFFu:((1u<<count)-1) };
+
+		while(stackTop>0)
+		{
+			const BVHQueryBatchStackObj_t work=stack[--stackTop];
+			const BVHNode_t *node=&bvh->nodes[work.nodeIndex];
+			uint32_t mask=0;
+
+			// Only the queries that overlapped the parent can overlap its children
+			for(uint32_t i=0;i<count;i++)
+			{
+				if(!(work.mask&(1u<<i)))
+					continue;
+
+				const uint32_t query=first+i;
+				const bool overlap=(bounds!=NULL)?AABBAABBOverlap(bounds[query], node->bounds):SphereAABBOverlap(points[query], radii[query], node->bounds);
+
+				if(overlap)
+					mask|=1u<<i;
+			}
 
-			if((2.0f*Vec3_LengthSq(Vec3_Subv(a->bounds.max, a->bounds.min)))>=(2.0f*Vec3_LengthSq(Vec3_Subv(b->bounds.max, b->bounds.min))))
+			if(mask==0)
+				continue;
+
+			if(node->left==-1)
 			{
-				testStack[stackTop++]=(BVHPairStackObj_t) { a->left, pair.b };
-				testStack[stackTop++]=(BVHPairStackObj_t) { a->right, pair.b };
+				for(uint32_t i=0;i<count;i++)
+				{
+					if(!(mask&(1u<<i)))
+						continue;
+
+					if(numHits<maxHits)
+						hits[numHits]=(BVHQueryHit_t) { first+i, (uint32_t)node->objectIndex };
+
+					numHits++;
+				}
 			}
 			else
 			{
-				testStack[stackTop++]=(BVHPairStackObj_t) { pair.a, b->left };
-				testStack[stackTop++]=(BVHPairStackObj_t) { pair.a, b->right };
+				assert(stackTop+2<=QUERY_STACK_MAX&&"BVH query stack overflow");
+				stack[stackTop++]=(BVHQueryBatchStackObj_t) { node->left, mask };
+				stack[stackTop++]=(BVHQueryBatchStackObj_t) { node->right, mask };
 			}
 		}
 	}
+
+	return numHits;
 }
 
-#define QUERY_STACK_MAX 64
-static int32_t BVHQueryStackObj[QUERY_STACK_MAX];
+// Many sphere queries in one go, hits are entity indices tagged with the query they came from.
+// Returns the number of hits found, which can be more than maxHits, only the first maxHits are written.
+uint32_t BVH_QuerySphereBatch(const BVH_t *bvh, const vec3 *points, const float *radii, uint32_t numQueries, BVHQueryHit_t *hits, uint32_t maxHits)
+{
+	return BVHQueryBatch(bvh, points, radii, NULL, numQueries, hits, maxHits);
+}
 
-static inline bool SphereAABBOverlap(vec3 point, float radius, aabb bounds)
+// Same as BVH_QuerySphereBatch, with boxes
+uint32_t BVH_QueryAABBBatch(const BVH_t *bvh, const aabb *bounds, uint32_t numQueries, BVHQueryHit_t *hits, uint32_t maxHits)
 {
-	float distSq=0.0f;
+	return BVHQueryBatch(bvh, NULL, NULL, bounds, numQueries, hits, maxHits);
+}
 
-	for(uint32_t i=0;i<3;i++)
+// Plane test for a box against a frustum, like Frustum_TestAABB this skips the far plane.
+// Returns false if the box is entirely outside any plane, padding grows the box on all sides.
+static inline bool FrustumAABBOverlap(const frustum *f, const aabb bounds, float padding)
+{
+	for(uint32_t i=0;i<5;i++)
 	{
-		float v=point.v[i];
+		const vec4 *p=&f->planes[i];
 
-		if(v<bounds.min.v[i])
-		{
-			float d=bounds.min.v[i]-v;
-			distSq+=d*d;
-		}
-		else if(v>bounds.max.v[i])
-		{
-			float d=v-bounds.max.v[i];
-			distSq+=d*d;
-		}
+		float px=(p->x>=0.0f)?bounds.max.x:bounds.min.x;
+		float py=(p->y>=0.0f)?bounds.max.y:bounds.min.y;
+		float pz=(p->z>=0.0f)?bounds.max.z:bounds.min.z;
+
+		if((p->x*px+p->y*py+p->z*pz+p->w)<-padding)
+			return false;
 	}
 
-	return distSq<=(radius*radius);
+	return true;
 }
 
-void BVH_QuerySphere(BVH_t *bvh, EntityList_t *entityList, vec3 point, float radius, BVHQueryCallback_t callback, void *userdata)
+typedef struct
 {
-	if(bvh->numNodes==0||entityList->entityCount==0)
-		return;
+	int32_t nodeIndex;
+	uint32_t mask;
+} BVHFrustumStackObj_t;
+
+// Culls the BVH against several frustums in one traversal, bit N of masks[entity index] gets set if that entity is in frustum N.
+// Run from the render side on the tree the physics thread handed over, which isn't touched again until the next swap.
+// Padding covers objects that have moved since the BVH was built.
+// Returns false if the tree is stale (built before the entity list last changed) or too deep to walk, masks are then incomplete.
+bool BVH_QueryFrustums(BVH_t *bvh, EntityList_t *entityList, const frustum *frustums, uint32_t numFrustums, float padding, uint8_t *masks)
+{
+	if(bvh->numNodes==0||bvh->version!=entityList->version||entityList->entityCount==0||numFrustums==0||numFrustums>8)
+		return false;
+
+	bool complete=true;
 
+	BVHFrustumStackObj_t stack[QUERY_STACK_MAX];
 	int32_t stackTop=0;
-	BVHQueryStackObj[stackTop++]=0; // Start at root
+
+	stack[stackTop++]=(BVHFrustumStackObj_t){ 0, (1u<<numFrustums)-1 };
 
 	while(stackTop>0)
 	{
-		int32_t nodeIndex=BVHQueryStackObj[--stackTop];
-		const BVHNode_t *node=&bvh->nodes[nodeIndex];
+		BVHFrustumStackObj_t work=stack[--stackTop];
+		const BVHNode_t *node=&bvh->nodes[work.nodeIndex];
+		uint32_t mask=0;
+
+		// Only test the frustums the parent was in, the rest can't contain any children
+		for(uint32_t i=0;i<numFrustums;i++)
+		{
+			if((work.mask&(1u<<i))&&FrustumAABBOverlap(&frustums[i], node->bounds, padding))
+				mask|=1u<<i;
+		}
 
-		// Cull this node if query sphere doesn't overlap its bounds
-		if(!SphereAABBOverlap(point, radius, node->bounds))
+		if(mask==0)
 			continue;
 
-		// If leaf, run callback, otherwise descend into children
 		if(node->left==-1)
-			callback(&entityList->entities[node->objectIndex], userdata);
+			masks[node->objectIndex]|=(uint8_t)mask;
 		else
 		{
-			assert(stackTop+2<=QUERY_STACK_MAX&&"BVH query stack overflow");
-			BVHQueryStackObj[stackTop++]=node->left;
-			BVHQueryStackObj[stackTop++]=node->right;
+			if(stackTop+2>QUERY_STACK_MAX)
+			{
+				complete=false;
+				continue;
+			}
+
+			stack[stackTop++]=(BVHFrustumStackObj_t){ node->left, mask };
+			stack[stackTop++]=(BVHFrustumStackObj_t){ node->right, mask };
 		}
 	}
+
+	return complete;
 }
 
-static inline bool AABBAABBOverlap(aabb a, aabb b)
+// Tests 4 boxes, stored as min x/y/z then max x/y/z lanes, against the frustum planes set in planeMask.
+// Returns bit N set if box N is inside all of them.
+static uint32_t FrustumTest4AABB(const frustum *f, uint32_t planeMask, const float boxes[6][4])
 {
-	return (a.min.v[0]<=b.max.v[0]&&a.max.v[0]>=b.min.v[0])&&
-	       (a.min.v[1]<=b.max.v[1]&&a.max.v[1]>=b.min.v[1])&&
-	       (a.min.v[2]<=b.max.v[2]&&a.max.v[2]>=b.min.v[2]);
+#if defined(SIMD_SSE)
+	__m128 outside=_mm_setzero_ps();
+
+	for(uint32_t i=0;i<5;i++)
+	{
+		if(!(planeMask&(1u<<i)))
+			continue;
+
+		const vec4 *p=&f->planes[i];
+
+		// The plane is the same for all 4 boxes, so the positive vertex selection is just a choice of rows
+		const __m128 px=_mm_loadu_ps(boxes[(p->x>=0.0f)?3:0]);
+		const __m128 py=_mm_loadu_ps(boxes[(p->y>=0.0f)?4:1]);
+		const __m128 pz=_mm_loadu_ps(boxes[(p->z>=0.0f)?5:2]);
+
+		__m128 d=_mm_add_ps(_mm_mul_ps(_mm_set1_ps(p->x), px), _mm_set1_ps(p->w));
+		d=_mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(p->y), py));
+		d=_mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(p->z), pz));
+
+		outside=_mm_or_ps(outside, _mm_cmplt_ps(d, _mm_setzero_ps()));
+	}
+
+	return ~(uint32_t)_mm_movemask_ps(outside)&0xF;
+#elif defined(SIMD_NEON)
+	uint32x4_t outside=vdupq_n_u32(0);
+
+	for(uint32_t i=0;i<5;i++)
+	{
+		if(!(planeMask&(1u<<i)))
+			continue;
+
+		const vec4 *p=&f->planes[i];
+
+		const float32x4_t px=vld1q_f32(boxes[(p->x>=0.0f)?3:0]);
+		const float32x4_t py=vld1q_f32(boxes[(p->y>=0.0f)?4:1]);
+		const float32x4_t pz=vld1q_f32(boxes[(p->z>=0.0f)?5:2]);
+
+		float32x4_t d=vmlaq_n_f32(vdupq_n_f32(p->w), px, p->x);
+		d=vmlaq_n_f32(d, py, p->y);
+		d=vmlaq_n_f32(d, pz, p->z);
+
+		outside=vorrq_u32(outside, vcltq_f32(d, vdupq_n_f32(0.0f)));
+	}
+
+	return ((vgetq_lane_u32(outside, 0)?0:1)|
+			(vgetq_lane_u32(outside, 1)?0:2)|
+			(vgetq_lane_u32(outside, 2)?0:4)|
+			(vgetq_lane_u32(outside, 3)?0:8));
+#else
+	uint32_t result=0;
+
+	for(uint32_t j=0;j<4;j++)
+	{
+		bool inside=true;
+
+		for(uint32_t i=0;i<5&&inside;i++)
+		{
+			if(!(planeMask&(1u<<i)))
+				continue;
+
+			const vec4 *p=&f->planes[i];
+
+			const float px=boxes[(p->x>=0.0f)?3:0][j];
+			const float py=boxes[(p->y>=0.0f)?4:1][j];
+			const float pz=boxes[(p->z>=0.0f)?5:2][j];
+
+			inside=(p->x*px+p->y*py+p->z*pz+p->w)>=0.0f;
+		}
+
+		if(inside)
+			result|=1u<<j;
+	}
+
+	return result;
+#endif
 }
 
-void BVH_QueryAABB(BVH_t *bvh, EntityList_t *entityList, aabb bounds, BVHQueryCallback_t callback, void *userdata)
+typedef struct
 {
-	if(bvh->numNodes==0||entityList->entityCount==0)
+	int32_t objectIndex[4];
+	uint32_t planeMask;
+	uint32_t count;
+	float boxes[6][4];
+} BVHLeafBatch_t;
+
+static void FlushLeafBatch(BVHLeafBatch_t *batch, const frustum *f, bool *visible)
+{
+	if(batch->count==0)
 		return;
 
+	// Pad out unused lanes with the first box, their results are ignored anyway
+	for(uint32_t j=batch->count;j<4;j++)
+	{
+		for(uint32_t k=0;k<6;k++)
+			batch->boxes[k][j]=batch->boxes[k][0];
+	}
+
+	const uint32_t inside=FrustumTest4AABB(f, batch->planeMask, (const float (*)[4])batch->boxes);
+
+	for(uint32_t j=0;j<batch->count;j++)
+		visible[batch->objectIndex[j]]=(inside>>j)&1;
+
+	batch->count=0;
+	batch->planeMask=0;
+}
+
+// Camera frustum cull through the BVH, sets visible[entity index] for every entity.
+// Planes a node is entirely inside of aren't tested again below it, so subtrees fully in view are accepted without any more tests,
+//   and subtrees fully out of view are rejected at their root.
+// The tree may be from the previous physics step, so internal nodes are grown by padding, leaves test the entity's current bounds
+//   4 at a time.
+// Returns false if the tree is stale or too deep to walk, visible is then incomplete and the caller should test entities directly.
+bool BVH_CullFrustum(const BVH_t *bvh, const EntityList_t *entityList, const frustum *frustum, float padding, bool *visible)
+{
+	if(bvh->numNodes==0||bvh->version!=entityList->version)
+		return false;
+
+	memset(visible, 0, sizeof(bool)*entityList->entityCount);
+
+	BVHFrustumStackObj_t stack[QUERY_STACK_MAX];
 	int32_t stackTop=0;
-	BVHQueryStackObj[stackTop++]=0; // Start at root
+
+	BVHLeafBatch_t leaves={ 0 };
+
+	// Far plane is infinite, so only the first 5
+	stack[stackTop++]=(BVHFrustumStackObj_t){ 0, 0x1F };
 
 	while(stackTop>0)
 	{
-		int32_t nodeIndex=BVHQueryStackObj[--stackTop];
-		const BVHNode_t *node=&bvh->nodes[nodeIndex];
+		BVHFrustumStackObj_t work=stack[--stackTop];
 
-		// Cull this node if query AABB doesn't overlap its bounds
-		if(!AABBAABBOverlap(bounds, node->bounds))
+		if(work.nodeIndex<0||(uint32_t)work.nodeIndex>=bvh->numNodes)
 			continue;
 
-		// If leaf, run callback, otherwise descend into children
+		const BVHNode_t *node=&bvh->nodes[work.nodeIndex];
+
 		if(node->left==-1)
-			callback(&entityList->entities[node->objectIndex], userdata);
-		else
 		{
-			assert(stackTop+2<=QUERY_STACK_MAX&&"BVH query stack overflow");
-			BVHQueryStackObj[stackTop++]=node->left;
-			BVHQueryStackObj[stackTop++]=node->right;
+			if(node->objectIndex<0||(uint32_t)node->objectIndex>=entityList->entityCount)
+				continue;
+
+			// Already fully inside every plane
+			if(work.mask==0)
+			{
+				visible[node->objectIndex]=true;
+				continue;
+			}
+
+			const aabb *bounds=&entityList->entities[node->objectIndex].bounds;
+
+			leaves.objectIndex[leaves.count]=node->objectIndex;
+			leaves.boxes[0][leaves.count]=bounds->min.x;
+			leaves.boxes[1][leaves.count]=bounds->min.y;
+			leaves.boxes[2][leaves.count]=bounds->min.z;
+			leaves.boxes[3][leaves.count]=bounds->max.x;
+			leaves.boxes[4][leaves.count]=bounds->max.y;
+			leaves.boxes[5][leaves.count]=bounds->max.z;
+			leaves.planeMask|=work.mask;
+
+			if(++leaves.count==4)
+				FlushLeafBatch(&leaves, frustum, visible);
+
+			continue;
 		}
+
+		uint32_t mask=work.mask;
+		bool outside=false;
+
+		for(uint32_t i=0;i<5;i++)
+		{
+			if(!(mask&(1u<<i)))
+				continue;
+
+			const vec4 *p=&frustum->planes[i];
+
+			// Distance to the corners furthest along and furthest against the plane normal
+			const float dMax=p->x*((p->x>=0.0f)?node->bounds.max.x:node->bounds.min.x)+
+							 p->y*((p->y>=0.0f)?node->bounds.max.y:node->bounds.min.y)+
+							 p->z*((p->z>=0.0f)?node->bounds.max.z:node->bounds.min.z)+p->w;
+			const float dMin=p->x*((p->x>=0.0f)?node->bounds.min.x:node->bounds.max.x)+
+							 p->y*((p->y>=0.0f)?node->bounds.min.y:node->bounds.max.y)+
+							 p->z*((p->z>=0.0f)?node->bounds.min.z:node->bounds.max.z)+p->w;
+
+			if(dMax<-padding)
+			{
+				outside=true;
+				break;
+			}
+
+			if(dMin>=padding)
+				mask&=~(1u<<i);
+		}
+
+		if(outside)
+			continue;
+
+		if(stackTop+2>QUERY_STACK_MAX||node->left<=work.nodeIndex||node->right<=work.nodeIndex)
+			return false;
+
+		stack[stackTop++]=(BVHFrustumStackObj_t){ node->left, mask };
+		stack[stackTop++]=(BVHFrustumStackObj_t){ node->right, mask };
 	}
+
+	FlushLeafBatch(&leaves, frustum, visible);
+
+	return true;
 }
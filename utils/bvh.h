@@ -1,6 +1,7 @@
 #ifndef __BVH_H__
 #define __BVH_H__
 
+#include <stdatomic.h>
 #include "../math/math.h"
 #include "../entitylist.h"
 
@@ -11,20 +12,91 @@ typedef struct
     aabb    bounds;
     int32_t left, right;
     int32_t objectIndex;
+    bool    asleep;         // Every body under this node is asleep, pairs of these can't produce new contacts
 } BVHNode_t;
 
+// 4 wide nodes collapsed from the binary tree, there's at most one for each internal binary node
+#define BVH4_MAX_NODES MAX_ENTITY
+
+typedef struct
+{
+    vec3     origin, scale;     // Child bounds are origin+q*scale, origin is this node's minimum
+    uint16_t bounds[6][4];      // Quantized child bounds, min x/y/z then max x/y/z, a lane per child
+    int32_t  child[4];          // Wide node index, or ~binary node index for a leaf
+    uint8_t  childMask;         // Child slots in use
+    uint8_t  asleepMask;        // Children with every body under them asleep
+} BVH4Node_t;
+
 typedef struct
 {
     uint32_t  numNodes;
+    uint32_t  version;      // Entity list version the tree was built from, node object indices are only valid while it matches
     BVHNode_t nodes[BVH_MAX_NODES];
+
+    // Entity bounds by entity index, filled in before BVH_Build and built from instead of the entities' own
+    aabb      bounds[MAX_ENTITY];
+
+    // Optional 4 wide copy of the tree, the pair test and the queries other than the frustum ones use it when it's built
+    uint32_t   numWideNodes;
+    BVH4Node_t wideNodes[BVH4_MAX_NODES];
 } BVH_t;
 
 typedef void (*BVHLeafCallback_t)(Entity_t *a, Entity_t *b);
 typedef void (*BVHQueryCallback_t)(Entity_t *entity, void *userdata);
 
+// Most node pairs the self test is split into, and most threads that can share it
+#define BVH_MAX_TEST_TASKS 256
+#define BVH_MAX_TEST_BUFFERS 16
+
+// Queries answered per tree walk by the batch queries
+#define BVH_QUERY_PACKET_SIZE 32
+
+typedef struct
+{
+    int32_t  a, b;                  // Node pair, a==b tests a subtree against itself
+    uint32_t buffer;                // Pair buffer the task was run into
+    uint32_t firstPair, numPairs;
+} BVHTestTask_t;
+
+typedef struct
+{
+    uint32_t numPairs, maxPairs;
+    uint32_t (*pairs)[2];           // Entity indices
+    uint32_t overflow;              // Pairs dropped because the buffer was full
+} BVHPairBuffer_t;
+
+// Self test split into independent node pair tasks, run by any number of threads each into their own pair buffer,
+//   then merged back in task order.
+typedef struct
+{
+    uint32_t        numTasks;
+    atomic_uint     nextTask;
+    BVHTestTask_t   tasks[BVH_MAX_TEST_TASKS];
+
+    uint32_t        numBuffers;
+    BVHPairBuffer_t buffers[BVH_MAX_TEST_BUFFERS];
+} BVHParallelTest_t;
+
+typedef struct
+{
+    uint32_t query;                 // Index into the batch
+    uint32_t object;                // Entity index
+} BVHQueryHit_t;
+
 void BVH_Build(BVH_t *bvh, EntityList_t *entityList);
+void BVH_BuildWide(BVH_t *bvh);
 void BVH_Test(BVH_t *bvh, EntityList_t *entityList, BVHLeafCallback_t callback);
+bool BVH_ParallelTestCreate(BVHParallelTest_t *test, uint32_t numBuffers, uint32_t maxPairsPerBuffer);
+void BVH_ParallelTestDestroy(BVHParallelTest_t *test);
+void BVH_ParallelTestBegin(BVHParallelTest_t *test, const BVH_t *bvh, uint32_t targetTasks);
+void BVH_ParallelTestRun(BVHParallelTest_t *test, const BVH_t *bvh, uint32_t buffer);
+uint32_t BVH_ParallelTestMerge(const BVHParallelTest_t *test, EntityList_t *entityList, BVHLeafCallback_t callback);
 void BVH_QuerySphere(BVH_t *bvh, EntityList_t *entityList, vec3 point, float radius, BVHQueryCallback_t callback, void *userdata);
 void BVH_QueryAABB(BVH_t *bvh, EntityList_t *entityList, aabb bounds, BVHQueryCallback_t callback, void *userdata);
+void BVH_QueryRay(BVH_t *bvh, EntityList_t *entityList, vec3 origin, vec3 direction, float maxDistance, float padding, BVHQueryCallback_t callback, void *userdata);
+uint32_t BVH_QuerySphereBatch(const BVH_t *bvh, const vec3 *points, const float *radii, uint32_t numQueries, BVHQueryHit_t *hits, uint32_t maxHits);
+uint32_t BVH_QueryAABBBatch(const BVH_t *bvh, const aabb *bounds, uint32_t numQueries, BVHQueryHit_t *hits, uint32_t maxHits);
+bool BVH_QueryFrustums(BVH_t *bvh, EntityList_t *entityList, const frustum *frustums, uint32_t numFrustums, float padding, uint8_t *masks);
+bool BVH_CullFrustum(const BVH_t *bvh, const EntityList_t *entityList, const frustum *frustum, float padding, bool *visible);
 
 #endif
@@ -8,7 +8,7 @@
 #include "tokenizer.h"
 #include "config.h"
 
-Config_t config={ .windowWidth=1920, .windowHeight=1080, .msaaSamples=4, .deviceIndex=0 };
+Config_t config={ .windowWidth=1920, .windowHeight=1080, .msaaSamples=4, .deviceIndex=0, .gpuCulling=true, .hostHeapSize=0, .deviceHeapSize=0, .velocityIterations=8, .positionIterations=3 };
 
 static const char *keywords[]=
 {
@@ -16,7 +16,7 @@ static const char *keywords[]=
 	"config",
 
 	// Subsection definitions
-	"windowSize", "msaaSamples", "deviceIndex", "vsync"
+	"windowSize", "msaaSamples", "deviceIndex", "vsync", "gpuCulling", "hostHeapSize", "deviceHeapSize", "physicsIterations", "gridBroadphase"
 };
 
 bool Config_ReadINI(Config_t *config, const char *filename)
@@ -28,6 +28,12 @@ bool Config_ReadINI(Config_t *config, const char *filename)
 	config->windowHeight=1080;
 	config->deviceIndex=0;
 	config->msaaSamples=2;
+	config->gpuCulling=true;
+	config->hostHeapSize=0;
+	config->deviceHeapSize=0;
+	config->velocityIterations=8;
+	config->positionIterations=3;
+	config->gridBroadphase=false;
 
 	// System state
 	config->renderWidth=1920;
@@ -167,6 +173,64 @@ bool Config_ReadINI(Config_t *config, const char *filename)
 							if(!Tokenizer_ArgumentHelper(&tokenizer, "b", &config->vsync))
 								return false;
 						}
+						else if(strcmp(token->string, "gpuCulling")==0)
+						{
+							config->gpuCulling=true;
+
+							if(!Tokenizer_ArgumentHelper(&tokenizer, "b", &config->gpuCulling))
+								return false;
+						}
+						else if(strcmp(token->string, "hostHeapSize")==0||strcmp(token->string, "deviceHeapSize")==0)
+						{
+							const bool host=strcmp(token->string, "hostHeapSize")==0;
+							int32_t heapSize=0;
+
+							if(!Tokenizer_ArgumentHelper(&tokenizer, "i", &heapSize))
+								return false;
+
+							if(heapSize>=0&&heapSize<=4096)
+							{
+								if(host)
+									config->hostHeapSize=heapSize;
+								else
+									config->deviceHeapSize=heapSize;
+							}
+							else
+							{
+								DBGPRINTF(DEBUG_ERROR, "Config heap size out of range (%d).\n", heapSize);
+								return false;
+							}
+						}
+						else if(strcmp(token->string, "physicsIterations")==0)
+						{
+							int32_t velocityIterations=0, positionIterations=0;
+
+							if(!Tokenizer_ArgumentHelper(&tokenizer, "ii", &velocityIterations, &positionIterations))
+								return false;
+
+							if(velocityIterations>=1&&velocityIterations<=64)
+								config->velocityIterations=velocityIterations;
+							else
+							{
+								DBGPRINTF(DEBUG_ERROR, "Config physics velocity iterations out of range (%d).\n", velocityIterations);
+								return false;
+							}
+
+							if(positionIterations>=0&&positionIterations<=64)
+								config->positionIterations=positionIterations;
+							else
+							{
+								DBGPRINTF(DEBUG_ERROR, "Config physics position iterations out of range (%d).\n", positionIterations);
+								return false;
+							}
+						}
+						else if(strcmp(token->string, "gridBroadphase")==0)
+						{
+							config->gridBroadphase=false;
+
+							if(!Tokenizer_ArgumentHelper(&tokenizer, "b", &config->gridBroadphase))
+								return false;
+						}
 						else
 						{
 							Tokenizer_PrintToken("Unknown token ", token);
@@ -13,6 +13,18 @@ typedef struct
 	uint32_t msaaSamples;
 	uint32_t deviceIndex;
 	bool vsync;
+	bool gpuCulling;
+
+	// Vulkan heap chunk sizes in MB, 0 sizes from the device
+	uint32_t hostHeapSize;
+	uint32_t deviceHeapSize;
+
+	// Contact solver iterations per physics step
+	uint32_t velocityIterations;
+	uint32_t positionIterations;
+
+	// Broad phase pairs from the uniform grid instead of the BVH
+	bool gridBroadphase;
 
 	// System config states
 	uint32_t renderWidth;
@@ -95,7 +95,7 @@ void FireParticleEmitter(vec3 position, vec3 direction)
 			emitters[i].life=15.0f;
 
 			// Add particle emitter to physics list
-			emitters[i].entityID=EntityList_Add(&entityList, &emitters[i].body, true, 0, 0, 0, ENTITYOBJECTTYPE_PROJECTILE, NULL);
+			emitters[i].entityID=EntityList_Add(&entityList, &emitters[i].body, true, 0, 0, 0, ENTITYOBJECTTYPE_PROJECTILE, ENTITY_TRANSFORM_IDENTITY);
 
 			break;
 		}
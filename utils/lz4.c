@@ -1,5 +1,6 @@
 #include <stdint.h>
 #include <string.h>
+#include "lz4.h"
 
 #define PADDING_LITERALS 5
 
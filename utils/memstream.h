@@ -0,0 +1,77 @@
+#ifndef __MEMSTREAM_H__
+#define __MEMSTREAM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+
+// Bounds checked read cursor over a block of memory, stands in for a FILE * when parsing files
+// that have already been loaded or mapped into memory.
+typedef struct
+{
+	const uint8_t *data;
+	size_t size;
+	size_t position;
+} MemStream_t;
+
+static inline void MemStream_Init(MemStream_t *stream, const uint8_t *data, size_t size)
+{
+	stream->data=data;
+	stream->size=size;
+	stream->position=0;
+}
+
+// fread equivalent, returns number of whole elements read
+static inline size_t MemStream_Read(MemStream_t *stream, void *out, size_t size, size_t count)
+{
+	if(size==0||count==0)
+		return 0;
+
+	const size_t available=(stream->size-stream->position)/size;
+
+	if(count>available)
+		count=available;
+
+	memcpy(out, stream->data+stream->position, size*count);
+	stream->position+=size*count;
+
+	return count;
+}
+
+// fgetc equivalent, returns EOF when out of data
+static inline int MemStream_GetC(MemStream_t *stream)
+{
+	if(stream->position>=stream->size)
+		return EOF;
+
+	return stream->data[stream->position++];
+}
+
+// Moves the cursor relative to the current position, fails if it would end up out of bounds
+static inline bool MemStream_Skip(MemStream_t *stream, size_t count)
+{
+	if(count>stream->size-stream->position)
+		return false;
+
+	stream->position+=count;
+
+	return true;
+}
+
+// Returns a pointer to the current position if there's at least size bytes left, for zero-copy access
+static inline const uint8_t *MemStream_Pointer(MemStream_t *stream, size_t size)
+{
+	if(size>stream->size-stream->position)
+		return NULL;
+
+	return stream->data+stream->position;
+}
+
+static inline bool MemStream_EOF(MemStream_t *stream)
+{
+	return stream->position>=stream->size;
+}
+
+#endif
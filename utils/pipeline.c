@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <limits.h>
 #include "../system/system.h"
 #include "../vulkan/vulkan.h"
@@ -53,6 +54,292 @@ static const char *keywords[]=
 	"base64",
 };
 
+// Creates the pipeline layout and assembles the final pipeline, common to both text and binary descriptions
+static bool FinishPipeline(VkuContext_t *context, Pipeline_t *pipeline, VkRenderPass renderPass, const char *filename)
+{
+	if(vkCreatePipelineLayout(context->device, &(VkPipelineLayoutCreateInfo)
+	{
+		.sType=VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.setLayoutCount=pipeline->descriptorSet.descriptorSetLayout?1u:0u,
+		.pSetLayouts=&pipeline->descriptorSet.descriptorSetLayout,
+		.pushConstantRangeCount=pipeline->pushConstant.size?1u:0u,
+		.pPushConstantRanges=&pipeline->pushConstant,
+	}, 0, &pipeline->pipelineLayout)!=VK_SUCCESS)
+	{
+		DBGPRINTF(DEBUG_ERROR, "Unable to create pipeline layout.\n");
+		return false;
+	}
+
+	vkuPipeline_SetPipelineLayout(&pipeline->pipeline, pipeline->pipelineLayout);
+	vkuPipeline_SetRenderPass(&pipeline->pipeline, renderPass);
+
+	// Probably should do validation checks on this?
+	if(rasterizationSamplesOverride<VK_SAMPLE_COUNT_FLAG_BITS_MAX_ENUM)
+		pipeline->pipeline.rasterizationSamples=rasterizationSamplesOverride;
+
+	// If the first stage shader is compute, then this must be a compute pipeline
+	if(pipeline->pipeline.stages[0].stage&VK_SHADER_STAGE_COMPUTE_BIT)
+	{
+		if(!vkuAssembleComputePipeline(&pipeline->pipeline, VK_NULL_HANDLE))
+		{
+			DBGPRINTF(DEBUG_ERROR, "Unable to assemble compute pipe: %s", filename);
+			return false;
+		}
+	}
+	else
+	{
+		if(!vkuAssemblePipeline(&pipeline->pipeline, VK_NULL_HANDLE))
+		{
+			DBGPRINTF(DEBUG_ERROR, "Unable to assemble pipe: %s", filename);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Binary pipeline blobs, baked at build time by bakePipeline.py from the text description.
+// All fields are little-endian uint32, see bakePipeline.py for the layout.
+#define PIPELINE_BLOB_MAGIC ('V'|('K'<<8)|('P'<<16)|('B'<<24))
+#define PIPELINE_BLOB_VERSION 2
+
+#define PIPELINE_BLOB_DESCRIPTORSET 0x1
+#define PIPELINE_BLOB_PIPELINE 0x2
+
+typedef struct
+{
+	uint32_t magic, version, sourceHash, flags;
+	uint32_t numBindings, numVertexBindings, numVertexAttributes, numStates, numStages;
+	uint32_t pushConstantOffset, pushConstantSize, pushConstantStages;
+} PipelineBlobHeader_t;
+
+// Blob state field IDs index into this, order must match STATE_FIELDS in bakePipeline.py.
+// Every one of these is a 32bit enum/flag/uint/float, so values are copied in raw.
+static const size_t pipelineStateOffsets[]=
+{
+	offsetof(VkuPipeline_t, subpass),
+	offsetof(VkuPipeline_t, topology),
+	offsetof(VkuPipeline_t, primitiveRestart),
+	offsetof(VkuPipeline_t, depthClamp),
+	offsetof(VkuPipeline_t, rasterizerDiscard),
+	offsetof(VkuPipeline_t, polygonMode),
+	offsetof(VkuPipeline_t, cullMode),
+	offsetof(VkuPipeline_t, frontFace),
+	offsetof(VkuPipeline_t, depthBias),
+	offsetof(VkuPipeline_t, depthBiasConstantFactor),
+	offsetof(VkuPipeline_t, depthBiasClamp),
+	offsetof(VkuPipeline_t, depthBiasSlopeFactor),
+	offsetof(VkuPipeline_t, lineWidth),
+	offsetof(VkuPipeline_t, depthTest),
+	offsetof(VkuPipeline_t, depthWrite),
+	offsetof(VkuPipeline_t, depthCompareOp),
+	offsetof(VkuPipeline_t, depthBoundsTest),
+	offsetof(VkuPipeline_t, stencilTest),
+	offsetof(VkuPipeline_t, minDepthBounds),
+	offsetof(VkuPipeline_t, maxDepthBounds),
+	offsetof(VkuPipeline_t, frontStencilFailOp),
+	offsetof(VkuPipeline_t, frontStencilPassOp),
+	offsetof(VkuPipeline_t, frontStencilDepthFailOp),
+	offsetof(VkuPipeline_t, frontStencilCompareOp),
+	offsetof(VkuPipeline_t, frontStencilCompareMask),
+	offsetof(VkuPipeline_t, frontStencilWriteMask),
+	offsetof(VkuPipeline_t, frontStencilReference),
+	offsetof(VkuPipeline_t, backStencilFailOp),
+	offsetof(VkuPipeline_t, backStencilPassOp),
+	offsetof(VkuPipeline_t, backStencilDepthFailOp),
+	offsetof(VkuPipeline_t, backStencilCompareOp),
+	offsetof(VkuPipeline_t, backStencilCompareMask),
+	offsetof(VkuPipeline_t, backStencilWriteMask),
+	offsetof(VkuPipeline_t, backStencilReference),
+	offsetof(VkuPipeline_t, rasterizationSamples),
+	offsetof(VkuPipeline_t, sampleShading),
+	offsetof(VkuPipeline_t, minSampleShading),
+	offsetof(VkuPipeline_t, alphaToCoverage),
+	offsetof(VkuPipeline_t, alphaToOne),
+	offsetof(VkuPipeline_t, blendLogicOp),
+	offsetof(VkuPipeline_t, blendLogicOpState),
+	offsetof(VkuPipeline_t, blend),
+	offsetof(VkuPipeline_t, srcColorBlendFactor),
+	offsetof(VkuPipeline_t, dstColorBlendFactor),
+	offsetof(VkuPipeline_t, colorBlendOp),
+	offsetof(VkuPipeline_t, srcAlphaBlendFactor),
+	offsetof(VkuPipeline_t, dstAlphaBlendFactor),
+	offsetof(VkuPipeline_t, alphaBlendOp),
+	offsetof(VkuPipeline_t, colorWriteMask),
+};
+
+#define PIPELINE_BLOB_NUM_STATES (sizeof(pipelineStateOffsets)/sizeof(pipelineStateOffsets[0]))
+
+// 32bit FNV-1a, must match source_hash in bakePipeline.py
+static uint32_t PipelineSourceHash(const char *buffer, size_t length)
+{
+	uint32_t hash=0x811C9DC5;
+
+	for(size_t i=0;i<length;i++)
+		hash=(hash^(uint8_t)buffer[i])*0x01000193;
+
+	return hash;
+}
+
+// Reads "<filename>.bin" and checks that it's a complete blob of the current version, baked from the text description that hashes to sourceHash.
+// Returns NULL if there is no usable blob, so the caller can fall back to the text description.
+static uint32_t *LoadPipelineBlob(const char *filename, uint32_t sourceHash)
+{
+	char blobFilename[1024];
+	FILE *stream=NULL;
+
+	snprintf(blobFilename, sizeof(blobFilename), "%s.bin", filename);
+
+	if((stream=fopen(blobFilename, "rb"))==NULL)
+		return NULL;
+
+	fseek(stream, 0, SEEK_END);
+	size_t length=ftell(stream);
+	fseek(stream, 0, SEEK_SET);
+
+	if(length<sizeof(PipelineBlobHeader_t)||(length&3))
+	{
+		DBGPRINTF(DEBUG_WARNING, "Pipeline blob %s is truncated, using text description.\n", blobFilename);
+		fclose(stream);
+		return NULL;
+	}
+
+	uint32_t *blob=(uint32_t *)Zone_Malloc(zone, length);
+
+	if(blob==NULL)
+	{
+		fclose(stream);
+		return NULL;
+	}
+
+	size_t bytesRead=fread(blob, 1, length, stream);
+	fclose(stream);
+
+	// Walk the whole thing up front, so a bad blob is rejected before any Vulkan objects are created
+	const PipelineBlobHeader_t *header=(const PipelineBlobHeader_t *)blob;
+	const size_t numWords=length/sizeof(uint32_t);
+	bool valid=bytesRead==length&&header->magic==PIPELINE_BLOB_MAGIC&&header->version==PIPELINE_BLOB_VERSION&&header->sourceHash==sourceHash;
+
+	if(valid)
+	{
+		size_t word=sizeof(PipelineBlobHeader_t)/sizeof(uint32_t);
+
+		word+=(size_t)header->numBindings*3+(size_t)header->numVertexBindings*3+(size_t)header->numVertexAttributes*4;
+
+		for(uint32_t i=0;valid&&i<header->numStates;i++)
+		{
+			valid=word+i*2+1<numWords&&blob[word+i*2]<PIPELINE_BLOB_NUM_STATES;
+		}
+
+		word+=(size_t)header->numStates*2;
+
+		for(uint32_t i=0;valid&&i<header->numStages;i++)
+		{
+			valid=word+2<=numWords&&(blob[word+1]&3)==0;
+
+			if(valid)
+			{
+				word+=2+blob[word+1]/sizeof(uint32_t);
+				valid=word<=numWords;
+			}
+		}
+
+		valid=valid&&word==numWords;
+	}
+
+	if(!valid)
+	{
+		DBGPRINTF(DEBUG_WARNING, "Pipeline blob %s is invalid or out of date, using text description.\n", blobFilename);
+		Zone_Free(zone, blob);
+		return NULL;
+	}
+
+	return blob;
+}
+
+// Builds the descriptor set and pipeline state from an already validated blob
+static bool CreatePipelineFromBlob(VkuContext_t *context, Pipeline_t *pipeline, const uint32_t *blob)
+{
+	const PipelineBlobHeader_t *header=(const PipelineBlobHeader_t *)blob;
+	const uint32_t *data=blob+sizeof(PipelineBlobHeader_t)/sizeof(uint32_t);
+
+	memset(pipeline, 0, sizeof(Pipeline_t));
+
+	if(header->flags&PIPELINE_BLOB_DESCRIPTORSET)
+	{
+		if(!vkuInitDescriptorSet(&pipeline->descriptorSet, context->device))
+		{
+			DBGPRINTF(DEBUG_ERROR, "Unable to initialize descriptor set.\n");
+			return false;
+		}
+
+		for(uint32_t i=0;i<header->numBindings;i++, data+=3)
+		{
+			if(!vkuDescriptorSet_AddBinding(&pipeline->descriptorSet, data[0], (VkDescriptorType)data[1], (VkShaderStageFlags)data[2]))
+			{
+				DBGPRINTF(DEBUG_ERROR, "Unable to add descriptor set binding %d.\n", data[0]);
+				return false;
+			}
+		}
+
+		if(!vkuAssembleDescriptorSetLayout(&pipeline->descriptorSet))
+		{
+			DBGPRINTF(DEBUG_ERROR, "Unable to assemble descriptor set layout.\n");
+			return false;
+		}
+	}
+	else
+		data+=header->numBindings*3;
+
+	if(!vkuInitPipeline(&pipeline->pipeline, context->device, context->pipelineCache))
+	{
+		DBGPRINTF(DEBUG_ERROR, "Unable to initialize pipeline.\n");
+		return false;
+	}
+
+	for(uint32_t i=0;i<header->numVertexBindings;i++, data+=3)
+	{
+		if(!vkuPipeline_AddVertexBinding(&pipeline->pipeline, data[0], data[1], (VkVertexInputRate)data[2]))
+		{
+			DBGPRINTF(DEBUG_ERROR, "Unable to add vertex binding.\n");
+			return false;
+		}
+	}
+
+	for(uint32_t i=0;i<header->numVertexAttributes;i++, data+=4)
+	{
+		if(!vkuPipeline_AddVertexAttribute(&pipeline->pipeline, data[0], data[1], (VkFormat)data[2], data[3]))
+		{
+			DBGPRINTF(DEBUG_ERROR, "Unable to add vertex attribute.\n");
+			return false;
+		}
+	}
+
+	// State overrides on top of the vkuInitPipeline defaults
+	for(uint32_t i=0;i<header->numStates;i++, data+=2)
+		memcpy((uint8_t *)&pipeline->pipeline+pipelineStateOffsets[data[0]], &data[1], sizeof(uint32_t));
+
+	for(uint32_t i=0;i<header->numStages;i++)
+	{
+		const VkShaderStageFlagBits stage=(VkShaderStageFlagBits)data[0];
+		const uint32_t size=data[1];
+
+		if(!vkuPipeline_AddStageMemory(&pipeline->pipeline, &data[2], size, stage))
+		{
+			DBGPRINTF(DEBUG_ERROR, "Unable to add shader stage %d to pipeline.\n", i);
+			return false;
+		}
+
+		data+=2+size/sizeof(uint32_t);
+	}
+
+	pipeline->pushConstant.offset=header->pushConstantOffset;
+	pipeline->pushConstant.size=header->pushConstantSize;
+	pipeline->pushConstant.stageFlags=header->pushConstantStages;
+
+	return true;
+}
+
 bool CreatePipeline(VkuContext_t *context, Pipeline_t *pipeline, VkRenderPass renderPass, const char *filename)
 {
 	FILE *stream=NULL;
@@ -67,11 +354,34 @@ bool CreatePipeline(VkuContext_t *context, Pipeline_t *pipeline, VkRenderPass re
 	char *buffer=(char *)Zone_Malloc(zone, length+1);
 
 	if(buffer==NULL)
+	{
+		fclose(stream);
 		return false;
+	}
 
 	fread(buffer, 1, length, stream);
 	buffer[length]='\0';
 
+	fclose(stream);
+
+	// Prefer the baked binary blob, it's just a memory walk instead of tokenizing the text description.
+	// The text is still read to hash it, so a blob that wasn't rebaked after the description changed isn't used.
+	uint32_t *blob=LoadPipelineBlob(filename, PipelineSourceHash(buffer, length));
+
+	if(blob)
+	{
+		Zone_Free(zone, buffer);
+
+		bool result=CreatePipelineFromBlob(context, pipeline, blob);
+
+		Zone_Free(zone, blob);
+
+		if(!result)
+			return false;
+
+		return FinishPipeline(context, pipeline, renderPass, filename);
+	}
+
 	memset(pipeline, 0, sizeof(Pipeline_t));
 
 	Tokenizer_t tokenizer;
@@ -972,9 +1282,9 @@ bool CreatePipeline(VkuContext_t *context, Pipeline_t *pipeline, VkRenderPass re
 							if(token->type==TOKEN_STRING)
 							{
 								if(strcmp(token->string, "ccw")==0)
-									pipeline->pipeline.cullMode=VK_FRONT_FACE_COUNTER_CLOCKWISE;
+									pipeline->pipeline.frontFace=VK_FRONT_FACE_COUNTER_CLOCKWISE;
 								else if(strcmp(token->string, "cw")==0)
-									pipeline->pipeline.cullMode=VK_FRONT_FACE_CLOCKWISE;
+									pipeline->pipeline.frontFace=VK_FRONT_FACE_CLOCKWISE;
 								else
 								{
 									Tokenizer_PrintToken("Unknown parameter ", token);
@@ -2908,45 +3218,7 @@ bool CreatePipeline(VkuContext_t *context, Pipeline_t *pipeline, VkRenderPass re
 
 	Zone_Free(zone, buffer);
 
-	if(vkCreatePipelineLayout(context->device, &(VkPipelineLayoutCreateInfo)
-	{
-		.sType=VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-		.setLayoutCount=pipeline->descriptorSet.descriptorSetLayout?1u:0u,
-		.pSetLayouts=&pipeline->descriptorSet.descriptorSetLayout,
-		.pushConstantRangeCount=pipeline->pushConstant.size?1u:0u,
-		.pPushConstantRanges=&pipeline->pushConstant,
-	}, 0, &pipeline->pipelineLayout)!=VK_SUCCESS)
-	{
-		DBGPRINTF(DEBUG_ERROR, "Unable to create pipeline layout.\n");
-		return false;
-	}
-
-	vkuPipeline_SetPipelineLayout(&pipeline->pipeline, pipeline->pipelineLayout);
-	vkuPipeline_SetRenderPass(&pipeline->pipeline, renderPass);
-
-	// Probably should do validation checks on this?
-	if(rasterizationSamplesOverride<VK_SAMPLE_COUNT_FLAG_BITS_MAX_ENUM)
-		pipeline->pipeline.rasterizationSamples=rasterizationSamplesOverride;
-
-	// If the first stage shader is compute, then this must be a compute pipeline
-	if(pipeline->pipeline.stages[0].stage&VK_SHADER_STAGE_COMPUTE_BIT)
-	{
-		if(!vkuAssembleComputePipeline(&pipeline->pipeline, VK_NULL_HANDLE))
-		{
-			DBGPRINTF(DEBUG_ERROR, "Unable to assemble compute pipe: %s", filename);
-			return false;
-		}
-	}
-	else
-	{
-		if(!vkuAssemblePipeline(&pipeline->pipeline, VK_NULL_HANDLE))
-		{
-			DBGPRINTF(DEBUG_ERROR, "Unable to assemble pipe: %s", filename);
-			return false;
-		}
-	}
-
-	return true;
+	return FinishPipeline(context, pipeline, renderPass, filename);
 }
 
 void DestroyPipeline(VkuContext_t *context, Pipeline_t *pipeline)
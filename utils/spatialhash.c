@@ -5,27 +5,42 @@
 #include "../system/system.h"
 #include "spatialhash.h"
 
-bool SpatialHash_Create(SpatialHash_t *spatialHash, const uint32_t tableSize, const float gridSize)
+bool SpatialHash_Create(SpatialHash_t *spatialHash, const uint32_t maxObjects, const float gridSize)
 {
 	if(spatialHash==NULL)
 		return false;
 
-	if(!tableSize)
+	if(!maxObjects)
 		return false;
 
-	if(gridSize<=0.0f)
+	if(gridSize<0.0f)
 		return false;
 
+	memset(spatialHash, 0, sizeof(SpatialHash_t));
+
+	spatialHash->maxObjects=maxObjects;
 	spatialHash->gridSize=gridSize;
-	spatialHash->invGridSize=1.0f/gridSize;
 
-	spatialHash->hashTableSize=tableSize;
+	// Power of two with at least twice as many slots as objects, keeps cells sharing a slot rare
+	spatialHash->tableSize=1;
+
+	while(spatialHash->tableSize<maxObjects*2)
+		spatialHash->tableSize<<=1;
 
-	spatialHash->hashTable=(Cell_t *)Zone_Malloc(zone, sizeof(Cell_t)*tableSize);
+	spatialHash->maxEntries=maxObjects*SPATIALHASH_ENTRIES_PER_OBJECT;
 
-	if(spatialHash->hashTable==NULL)
+	spatialHash->bounds=(aabb *)Zone_Malloc(zone, sizeof(aabb)*maxObjects);
+	spatialHash->cells=(SpatialHashCellRange_t *)Zone_Malloc(zone, sizeof(SpatialHashCellRange_t)*maxObjects);
+	spatialHash->cellStart=(uint32_t *)Zone_Malloc(zone, sizeof(uint32_t)*(spatialHash->tableSize+1));
+	spatialHash->entries=(SpatialHashEntry_t *)Zone_Malloc(zone, sizeof(SpatialHashEntry_t)*spatialHash->maxEntries);
+	spatialHash->large=(uint32_t *)Zone_Malloc(zone, sizeof(uint32_t)*maxObjects);
+	spatialHash->isLarge=(bool *)Zone_Malloc(zone, sizeof(bool)*maxObjects);
+
+	if(spatialHash->bounds==NULL||spatialHash->cells==NULL||spatialHash->cellStart==NULL||
+	   spatialHash->entries==NULL||spatialHash->large==NULL||spatialHash->isLarge==NULL)
 	{
-		DBGPRINTF(DEBUG_ERROR, "Unable to allocate memory for hash table.\n");
+		DBGPRINTF(DEBUG_ERROR, "Unable to allocate memory for spatial hash.\n");
+		SpatialHash_Destroy(spatialHash);
 		return false;
 	}
 
@@ -34,90 +49,248 @@ bool SpatialHash_Create(SpatialHash_t *spatialHash, const uint32_t tableSize, co
 
 void SpatialHash_Destroy(SpatialHash_t *spatialHash)
 {
-	Zone_Free(zone, spatialHash->hashTable);
+	Zone_Free(zone, spatialHash->bounds);
+	Zone_Free(zone, spatialHash->cells);
+	Zone_Free(zone, spatialHash->cellStart);
+	Zone_Free(zone, spatialHash->entries);
+	Zone_Free(zone, spatialHash->large);
+	Zone_Free(zone, spatialHash->isLarge);
 	memset(spatialHash, 0, sizeof(SpatialHash_t));
 }
 
 static inline uint32_t hashFunction(const int32_t hx, const int32_t hy, const int32_t hz, const uint32_t tableSize)
 {
-	return (uint32_t)((hx*73856093)^(hy*19349663)^(hz*83492791))%tableSize;
+	return (((uint32_t)hx*73856093u)^((uint32_t)hy*19349663u)^((uint32_t)hz*83492791u))&(tableSize-1);
 }
 
-// Clear hash table
-void SpatialHash_Clear(SpatialHash_t *spatialHash)
+static inline int32_t CellCoord(const float value, const float invCellSize)
 {
-	memset(spatialHash->hashTable, 0, sizeof(Cell_t)*spatialHash->hashTableSize);
+	return (int32_t)floorf(value*invCellSize);
 }
 
-// Add object to table
-bool SpatialHash_AddObject(SpatialHash_t *spatialHash, const vec3 value, void *object)
+static inline bool AABBOverlap(const aabb a, const aabb b)
 {
-	const int32_t hx=(const int32_t)floorf(value.x*spatialHash->invGridSize);
-	const int32_t hy=(const int32_t)floorf(value.y*spatialHash->invGridSize);
-	const int32_t hz=(const int32_t)floorf(value.z*spatialHash->invGridSize);
-	const uint32_t index=hashFunction(hx, hy, hz, spatialHash->hashTableSize);
+	return (a.min.x<=b.max.x)&(a.max.x>=b.min.x)&
+		   (a.min.y<=b.max.y)&(a.max.y>=b.min.y)&
+		   (a.min.z<=b.max.z)&(a.max.z>=b.min.z);
+}
+
+// Only resets the counts, everything is rewritten by the next build
+void SpatialHash_Clear(SpatialHash_t *spatialHash)
+{
+	spatialHash->numObjects=0;
+	spatialHash->numEntries=0;
+	spatialHash->numLarge=0;
+}
 
-	if(index>=spatialHash->hashTableSize)
+// Add object by its bounds, objects are numbered in the order they're added
+bool SpatialHash_AddObject(SpatialHash_t *spatialHash, const aabb bounds)
+{
+	if(spatialHash->numObjects>=spatialHash->maxObjects)
 	{
-		DBGPRINTF(DEBUG_ERROR, "Invalid hash index.\n");
+		DBGPRINTF(DEBUG_ERROR, "Spatial hash is full.\n");
 		return false;
 	}
 
-	if(spatialHash->hashTable[index].numObjects<MAX_SPATIALHASH_CELL_OBJECTS)
+	spatialHash->bounds[spatialHash->numObjects++]=bounds;
+
+	return true;
+}
+
+// Counting sort of the objects' cell entries: count per slot, prefix sum, then scatter into the entry array.
+// Objects that cover too many cells, or don't fit in the entry array, go on the oversize list instead of being dropped.
+void SpatialHash_Build(SpatialHash_t *spatialHash)
+{
+	const uint32_t tableSize=spatialHash->tableSize;
+	uint32_t *cellStart=spatialHash->cellStart;
+
+	spatialHash->numEntries=0;
+	spatialHash->numLarge=0;
+
+	// Cells about twice the average object size, most objects then land in one to eight cells
+	float cellSize=spatialHash->gridSize;
+
+	if(cellSize<=0.0f)
+	{
+		float totalSize=0.0f;
+
+		for(uint32_t i=0;i<spatialHash->numObjects;i++)
+		{
+			const vec3 size=Vec3_Subv(spatialHash->bounds[i].max, spatialHash->bounds[i].min);
+			totalSize+=fmaxf(fmaxf(size.x, size.y), size.z);
+		}
+
+		cellSize=spatialHash->numObjects?2.0f*totalSize/spatialHash->numObjects:1.0f;
+	}
+
+	spatialHash->cellSize=fmaxf(cellSize, 0.001f);
+	spatialHash->invCellSize=1.0f/spatialHash->cellSize;
+
+	memset(cellStart, 0, sizeof(uint32_t)*(tableSize+1));
+
+	// Count entries per slot
+	for(uint32_t i=0;i<spatialHash->numObjects;i++)
 	{
-		spatialHash->hashTable[index].objects[spatialHash->hashTable[index].numObjects++]=object;
-		return true;
+		const aabb bounds=spatialHash->bounds[i];
+		SpatialHashCellRange_t *range=&spatialHash->cells[i];
+
+		for(uint32_t j=0;j<3;j++)
+		{
+			range->min[j]=CellCoord(bounds.min.v[j], spatialHash->invCellSize);
+			range->max[j]=CellCoord(bounds.max.v[j], spatialHash->invCellSize);
+		}
+
+		const uint64_t numCells=(uint64_t)(range->max[0]-range->min[0]+1)*(range->max[1]-range->min[1]+1)*(range->max[2]-range->min[2]+1);
+
+		if(numCells>MAX_SPATIALHASH_OBJECT_CELLS||spatialHash->numEntries+numCells>spatialHash->maxEntries)
+		{
+			spatialHash->isLarge[i]=true;
+			spatialHash->large[spatialHash->numLarge++]=i;
+			continue;
+		}
+
+		spatialHash->isLarge[i]=false;
+		spatialHash->numEntries+=(uint32_t)numCells;
+
+		for(int32_t z=range->min[2];z<=range->max[2];z++)
+		{
+			for(int32_t y=range->min[1];y<=range->max[1];y++)
+			{
+				for(int32_t x=range->min[0];x<=range->max[0];x++)
+					cellStart[hashFunction(x, y, z, tableSize)]++;
+			}
+		}
 	}
 
-	DBGPRINTF(DEBUG_ERROR, "Ran out of bucket space.\n");
-	return false;
+	// Running totals, each slot's count becomes the end of its range
+	for(uint32_t i=1;i<=tableSize;i++)
+		cellStart[i]+=cellStart[i-1];
+
+	// Scatter, counting back down leaves each slot's start behind
+	for(uint32_t i=0;i<spatialHash->numObjects;i++)
+	{
+		if(spatialHash->isLarge[i])
+			continue;
+
+		const SpatialHashCellRange_t *range=&spatialHash->cells[i];
+
+		for(int32_t z=range->min[2];z<=range->max[2];z++)
+		{
+			for(int32_t y=range->min[1];y<=range->max[1];y++)
+			{
+				for(int32_t x=range->min[0];x<=range->max[0];x++)
+					spatialHash->entries[--cellStart[hashFunction(x, y, z, tableSize)]]=(SpatialHashEntry_t) { i, { x, y, z } };
+			}
+		}
+	}
 }
 
-void SpatialHash_TestObjects(SpatialHash_t *spatialHash, vec3 value, void *a, void (*testFunc)(void *a, void *b))
+// Calls back once for every pair of objects with overlapping bounds.
+// A pair sharing several cells is only reported from the first cell of the overlap of their cell ranges.
+void SpatialHash_TestPairs(const SpatialHash_t *spatialHash, SpatialHashPairCallback_t callback, void *userdata)
 {
-	// Neighbor cell offsets
-	const int32_t offsets[27][3]=
+	for(uint32_t slot=0;slot<spatialHash->tableSize;slot++)
 	{
-		{-1,-1,-1 }, {-1,-1, 0 }, {-1,-1, 1 },
-		{-1, 0,-1 }, {-1, 0, 0 }, {-1, 0, 1 },
-		{-1, 1,-1 }, {-1, 1, 0 }, {-1, 1, 1 },
-		{ 0,-1,-1 }, { 0,-1, 0 }, { 0,-1, 1 },
-		{ 0, 0,-1 }, { 0, 0, 0 }, { 0, 0, 1 },
-		{ 0, 1,-1 }, { 0, 1, 0 }, { 0, 1, 1 },
-		{ 1,-1,-1 }, { 1,-1, 0 }, { 1,-1, 1 },
-		{ 1, 0,-1 }, { 1, 0, 0 }, { 1, 0, 1 },
-		{ 1, 1,-1 }, { 1, 1, 0 }, { 1, 1, 1 }
-	};
-
-	// Object hash position
-	const int32_t hx=(const int32_t)(value.x*spatialHash->invGridSize);
-	const int32_t hy=(const int32_t)(value.y*spatialHash->invGridSize);
-	const int32_t hz=(const int32_t)(value.z*spatialHash->invGridSize);
-
-	// Iterate over cell offsets
-	for(uint32_t j=0;j<27;j++)
+		const uint32_t start=spatialHash->cellStart[slot], end=spatialHash->cellStart[slot+1];
+
+		for(uint32_t i=start;i<end;i++)
+		{
+			const SpatialHashEntry_t *a=&spatialHash->entries[i];
+			const SpatialHashCellRange_t *rangeA=&spatialHash->cells[a->object];
+
+			for(uint32_t j=i+1;j<end;j++)
+			{
+				const SpatialHashEntry_t *b=&spatialHash->entries[j];
+
+				// Different cell in the same slot
+				if(a->cell[0]!=b->cell[0]||a->cell[1]!=b->cell[1]||a->cell[2]!=b->cell[2])
+					continue;
+
+				const SpatialHashCellRange_t *rangeB=&spatialHash->cells[b->object];
+
+				if(max(rangeA->min[0], rangeB->min[0])!=a->cell[0]||
+				   max(rangeA->min[1], rangeB->min[1])!=a->cell[1]||
+				   max(rangeA->min[2], rangeB->min[2])!=a->cell[2])
+					continue;
+
+				if(AABBOverlap(spatialHash->bounds[a->object], spatialHash->bounds[b->object]))
+					callback(a->object, b->object, userdata);
+			}
+		}
+	}
+
+	// Oversize objects against everything, pairs of them only once
+	for(uint32_t i=0;i<spatialHash->numLarge;i++)
 	{
-		const uint32_t hashIndex=hashFunction(hx+offsets[j][0], hy+offsets[j][1], hz+offsets[j][2], spatialHash->hashTableSize);
+		const uint32_t a=spatialHash->large[i];
 
-		if(hashIndex>=spatialHash->hashTableSize)
+		for(uint32_t b=0;b<spatialHash->numObjects;b++)
 		{
-			DBGPRINTF(DEBUG_ERROR, "Invalid hash index.\n");
-			return;
+			if(b==a||(spatialHash->isLarge[b]&&b<a))
+				continue;
+
+			if(AABBOverlap(spatialHash->bounds[a], spatialHash->bounds[b]))
+				callback(a, b, userdata);
 		}
+	}
+}
 
-		Cell_t *neighborCell=&spatialHash->hashTable[hashIndex];
+// Calls back once for every object whose bounds overlap the query bounds
+void SpatialHash_QueryAABB(const SpatialHash_t *spatialHash, const aabb bounds, SpatialHashQueryCallback_t callback, void *userdata)
+{
+	SpatialHashCellRange_t query;
+
+	for(uint32_t j=0;j<3;j++)
+	{
+		query.min[j]=CellCoord(bounds.min.v[j], spatialHash->invCellSize);
+		query.max[j]=CellCoord(bounds.max.v[j], spatialHash->invCellSize);
+	}
+
+	const uint64_t numCells=(uint64_t)(query.max[0]-query.min[0]+1)*(query.max[1]-query.min[1]+1)*(query.max[2]-query.min[2]+1);
 
-		// Iterate over objects in the neighbor cell
-		for(uint32_t k=0;k<neighborCell->numObjects;k++)
+	// Walking that many cells would cost more than checking every object
+	if(numCells>spatialHash->numObjects)
+	{
+		for(uint32_t i=0;i<spatialHash->numObjects;i++)
 		{
-			// Object 'B'
-			void *b=neighborCell->objects[k];
+			if(AABBOverlap(spatialHash->bounds[i], bounds))
+				callback(i, userdata);
+		}
 
-			if(a==b)
-				continue;
+		return;
+	}
 
-			if(testFunc)
-				testFunc(a, b);
+	for(int32_t z=query.min[2];z<=query.max[2];z++)
+	{
+		for(int32_t y=query.min[1];y<=query.max[1];y++)
+		{
+			for(int32_t x=query.min[0];x<=query.max[0];x++)
+			{
+				const uint32_t slot=hashFunction(x, y, z, spatialHash->tableSize);
+
+				for(uint32_t i=spatialHash->cellStart[slot];i<spatialHash->cellStart[slot+1];i++)
+				{
+					const SpatialHashEntry_t *entry=&spatialHash->entries[i];
+
+					if(entry->cell[0]!=x||entry->cell[1]!=y||entry->cell[2]!=z)
+						continue;
+
+					// Only from the first cell the object and the query share
+					const SpatialHashCellRange_t *range=&spatialHash->cells[entry->object];
+
+					if(max(range->min[0], query.min[0])!=x||max(range->min[1], query.min[1])!=y||max(range->min[2], query.min[2])!=z)
+						continue;
+
+					if(AABBOverlap(spatialHash->bounds[entry->object], bounds))
+						callback(entry->object, userdata);
+				}
+			}
 		}
 	}
+
+	for(uint32_t i=0;i<spatialHash->numLarge;i++)
+	{
+		if(AABBOverlap(spatialHash->bounds[spatialHash->large[i]], bounds))
+			callback(spatialHash->large[i], userdata);
+	}
 }
@@ -5,27 +5,61 @@
 #include <stdint.h>
 #include "../math/math.h"
 
-#ifndef MAX_SPATIALHASH_CELL_OBJECTS
-#define MAX_SPATIALHASH_CELL_OBJECTS 1000
+// Objects covering more cells than this skip the grid and get tested against everything instead
+#ifndef MAX_SPATIALHASH_OBJECT_CELLS
+#define MAX_SPATIALHASH_OBJECT_CELLS 64
+#endif
+
+// Grid entries per object, on average, before objects start going to the oversize list
+#ifndef SPATIALHASH_ENTRIES_PER_OBJECT
+#define SPATIALHASH_ENTRIES_PER_OBJECT 8
 #endif
 
 typedef struct
 {
-	uint32_t numObjects;
-	void *objects[MAX_SPATIALHASH_CELL_OBJECTS];
-} Cell_t;
+	uint32_t object;
+	int32_t cell[3];	// Kept to tell apart cells that hash to the same slot
+} SpatialHashEntry_t;
+
+typedef struct
+{
+	int32_t min[3], max[3];
+} SpatialHashCellRange_t;
 
+// Uniform grid rebuilt from scratch each tick with a counting sort.
+// Objects are added by bounds, and entered into every cell their bounds touch. Cells are hashed into a table of
+//   start offsets into one contiguous entry array, so memory goes with the object count and not the world size.
 typedef struct
 {
-	uint32_t hashTableSize;
-	float gridSize, invGridSize;
-	Cell_t *hashTable;
+	uint32_t maxObjects;
+	float gridSize;			// Cell size, 0 picks one from the objects on every build
+	float cellSize, invCellSize;
+
+	uint32_t numObjects;
+	aabb *bounds;
+	SpatialHashCellRange_t *cells;
+
+	// Entries for table slot i are entries[cellStart[i]..cellStart[i+1])
+	uint32_t tableSize;
+	uint32_t *cellStart;
+	uint32_t numEntries, maxEntries;
+	SpatialHashEntry_t *entries;
+
+	// Objects too big for the grid
+	uint32_t numLarge;
+	uint32_t *large;
+	bool *isLarge;
 } SpatialHash_t;
 
-bool SpatialHash_Create(SpatialHash_t *spatialHash, const uint32_t tableSize, const float gridSize);
+typedef void (*SpatialHashPairCallback_t)(uint32_t a, uint32_t b, void *userdata);
+typedef void (*SpatialHashQueryCallback_t)(uint32_t object, void *userdata);
+
+bool SpatialHash_Create(SpatialHash_t *spatialHash, const uint32_t maxObjects, const float gridSize);
 void SpatialHash_Destroy(SpatialHash_t *spatialHash);
 void SpatialHash_Clear(SpatialHash_t *spatialHash);
-bool SpatialHash_AddObject(SpatialHash_t *spatialHash, const vec3 value, void *object);
-void SpatialHash_TestObjects(SpatialHash_t *spatialHash, vec3 value, void *a, void (*testFunc)(void *a, void *b));
+bool SpatialHash_AddObject(SpatialHash_t *spatialHash, const aabb bounds);
+void SpatialHash_Build(SpatialHash_t *spatialHash);
+void SpatialHash_TestPairs(const SpatialHash_t *spatialHash, SpatialHashPairCallback_t callback, void *userdata);
+void SpatialHash_QueryAABB(const SpatialHash_t *spatialHash, const aabb bounds, SpatialHashQueryCallback_t callback, void *userdata);
 
 #endif
@@ -31,6 +31,9 @@ extern PFN_vkDestroyDebugUtilsMessengerEXT _vkDestroyDebugUtilsMessengerEXT;
 #define vkCmdPushDescriptorSetKHR _vkCmdPushDescriptorSetKHR
 extern PFN_vkCmdPushDescriptorSetKHR _vkCmdPushDescriptorSetKHR;
 
+#define vkCmdDrawIndexedIndirectCountKHR _vkCmdDrawIndexedIndirectCountKHR
+extern PFN_vkCmdDrawIndexedIndirectCountKHR _vkCmdDrawIndexedIndirectCountKHR;
+
 #define VKU_MAX_PIPELINE_VERTEX_BINDINGS 4
 #define VKU_MAX_PIPELINE_VERTEX_ATTRIBUTES 16
 #define VKU_MAX_PIPELINE_SHADER_STAGES 4
@@ -46,6 +49,12 @@ extern PFN_vkCmdPushDescriptorSetKHR _vkCmdPushDescriptorSetKHR;
 
 #define VKU_MIN_DEVICE_ALLOCATION_SIZE (256*1024)
 
+#define VKU_UPLOAD_MAX_SUBMITS 8
+
+#define VKU_RENDERGRAPH_MAX_RESOURCES 32
+#define VKU_RENDERGRAPH_MAX_PASSES 32
+#define VKU_RENDERGRAPH_MAX_PASS_ACCESSES 8
+
 typedef struct
 {
 #ifdef WIN32
@@ -70,6 +79,10 @@ typedef struct
 	VkBool32 getPhysicalDeviceProperties2Extension;
 	VkBool32 depthStencilResolveExtension;
 	VkBool32 createRenderPass2Extension;
+	VkBool32 drawIndirectCountExtension;
+	VkBool32 memoryBudgetExtension;
+
+	VkPhysicalDeviceFeatures deviceFeatures;
 
 	VkPhysicalDeviceProperties2 deviceProperties;
 	VkPhysicalDeviceMaintenance3Properties deviceProperties2;
@@ -199,6 +212,26 @@ typedef struct
 	VkDescriptorBufferInfo bufferInfo[VKU_MAX_DESCRIPTORSET_BINDINGS];
 } VkuDescriptorSet_t;
 
+// TLSF sub-allocator parameters, all offsets and block sizes are multiples of the minimum block size
+#define VKU_MEM_MIN_BLOCK_SIZE 256
+#define VKU_MEM_SL_LOG2 4
+#define VKU_MEM_SL_COUNT (1<<VKU_MEM_SL_LOG2)
+#define VKU_MEM_FL_COUNT 32
+#define VKU_MEM_NODE_CHUNK_SIZE 256
+
+// What an allocation is used for, tracked for per-category budget reporting
+typedef enum
+{
+	VKU_MEM_CATEGORY_TEXTURE=0,
+	VKU_MEM_CATEGORY_RENDERTARGET,
+	VKU_MEM_CATEGORY_MESH,
+	VKU_MEM_CATEGORY_INSTANCE,
+	VKU_MEM_CATEGORY_UNIFORM,
+	VKU_MEM_CATEGORY_STAGING,
+	VKU_MEM_CATEGORY_OTHER,
+	VKU_MEM_CATEGORY_COUNT
+} VkuMemCategory;
+
 typedef struct VkuMemBlock_s
 {
 	size_t offset;
@@ -206,17 +239,61 @@ typedef struct VkuMemBlock_s
 	bool free;
 	VkDeviceMemory deviceMemory;
 	void *mappedPointer;
+
+	// Allocator internals
+	size_t blockSize;
+	VkImageTiling tiling;
+	VkuMemCategory category;
+	struct VkuMemZone_s *vkZone;
 	struct VkuMemBlock_s *next, *prev;
+	struct VkuMemBlock_s *nextFree, *prevFree;
 } VkuMemBlock_t;
 
-typedef struct
+typedef struct VkuMemZone_s
 {
 	size_t size;
 	VkuMemBlock_t *blocks;
 	VkDeviceMemory deviceMemory;
 	void *mappedPointer;
+	size_t granularity;
+
+	// Two level segregated free lists
+	uint32_t flBitmap;
+	uint32_t slBitmap[VKU_MEM_FL_COUNT];
+	VkuMemBlock_t *freeLists[VKU_MEM_FL_COUNT][VKU_MEM_SL_COUNT];
+
+	// Block node pool
+	struct VkuMemNodeChunk_s *nodeChunks;
+	VkuMemBlock_t *freeNodes;
+
+	size_t used, peakUsed;
+	uint32_t numAllocations, numFreeBlocks;
 } VkuMemZone_t;
 
+typedef struct
+{
+	size_t size;
+	size_t used, peakUsed;
+	size_t largestFree;
+	uint32_t numAllocations, numFreeBlocks;
+
+	// 0 when all free space is one block, approaching 1 as it's scattered
+	float fragmentation;
+} VkuMemStats_t;
+
+typedef struct
+{
+	VkDeviceSize categoryUsed[VKU_MEM_CATEGORY_COUNT];
+	VkDeviceSize categoryPeak[VKU_MEM_CATEGORY_COUNT];
+
+	// Memory reserved by the allocator's chunks
+	VkDeviceSize hostReserved, localReserved;
+
+	// Process wide heap budget and usage from VK_EXT_memory_budget, otherwise heap size and reserved
+	VkDeviceSize hostBudget, hostUsage;
+	VkDeviceSize localBudget, localUsage;
+} VkuMemBudget_t;
+
 typedef struct
 {
 	VkBuffer buffer;
@@ -234,6 +311,38 @@ typedef struct
 	VkImageView imageView;
 } VkuImage_t;
 
+// Serial of the submission that carries an upload's copies, tickets complete in order
+typedef uint64_t VkuUploadTicket_t;
+
+typedef struct
+{
+	VkFence fence;
+	VkCommandBuffer commandBuffer;
+	VkDeviceSize end;
+	VkuUploadTicket_t ticket;
+} VkuUploadSubmit_t;
+
+typedef struct
+{
+	VkuContext_t *context;
+
+	// Persistently mapped staging ring
+	VkuBuffer_t stagingBuffer;
+	uint8_t *mappedPointer;
+	VkDeviceSize size, head, tail;
+
+	// Command buffer currently being recorded into, VK_NULL_HANDLE when idle
+	VkCommandPool commandPool;
+	VkCommandBuffer commandBuffer;
+
+	// In-flight submissions, oldest first
+	uint32_t numSubmits;
+	VkuUploadSubmit_t submits[VKU_UPLOAD_MAX_SUBMITS];
+
+	// Ticket the recording command buffer will be submitted as, and the last one known complete
+	VkuUploadTicket_t nextTicket, completedTicket;
+} VkuUploadBatch_t;
+
 typedef struct
 {
 	VkSwapchainKHR swapchain;
@@ -291,6 +400,86 @@ typedef struct
 	VkSubpassDependency subpassDependencies[VKU_MAX_RENDERPASS_SUBPASS_DEPENDENCIES];
 } VkuRenderPass_t;
 
+typedef enum
+{
+	VKU_RENDERGRAPH_ACCESS_SAMPLED=0,	// Sampled in a fragment shader
+	VKU_RENDERGRAPH_ACCESS_COLOR,		// Written as a color or resolve attachment
+	VKU_RENDERGRAPH_ACCESS_DEPTH,		// Written as a depth attachment
+	VKU_RENDERGRAPH_ACCESS_EXTERNAL,	// Written by a render pass that does its own layout transitions and sync, only tracked for ordering
+} VkuRenderGraphAccessType;
+
+typedef void (*VkuRenderGraphPassFunc_t)(VkCommandBuffer commandBuffer, void *passData, void *frameData);
+
+typedef struct
+{
+	uint32_t resource;
+	VkuRenderGraphAccessType type;
+	VkImageLayout finalLayout;		// Layout the pass's render pass leaves the image in, UNDEFINED if it stays in the access layout
+} VkuRenderGraphAccess_t;
+
+typedef struct
+{
+	const char *name;
+	VkuRenderGraphPassFunc_t function;
+	void *data;
+
+	uint32_t numAccesses;
+	VkuRenderGraphAccess_t accesses[VKU_RENDERGRAPH_MAX_PASS_ACCESSES];
+
+	bool culled;
+} VkuRenderGraphPass_t;
+
+typedef struct
+{
+	VkuImage_t *image;				// NULL for images the graph never touches (swapchain images), only used to keep passes alive
+	bool transient, output;
+
+	// Transient description
+	uint32_t width, height;
+	VkFormat format;
+	VkSampleCountFlagBits samples;
+
+	VkImageAspectFlags aspectMask;
+	uint32_t layerCount;
+
+	// Filled by compile, first and last pass to use it and the memory slot it lives in
+	uint32_t firstPass, lastPass;
+	uint32_t slot;
+
+	// Current state, carried from frame to frame
+	VkImageLayout layout;
+	VkPipelineStageFlags stageMask;
+	VkAccessFlags accessMask;
+} VkuRenderGraphResource_t;
+
+// Memory shared by transients whose lifetimes don't overlap
+typedef struct
+{
+	VkuMemBlock_t *memory;
+	VkDeviceSize size, alignment;
+	uint32_t busyUntil;
+
+	// Last use by whichever transient was in it, the next one has to wait on it
+	VkPipelineStageFlags stageMask;
+	VkAccessFlags accessMask;
+} VkuRenderGraphSlot_t;
+
+typedef struct
+{
+	VkuContext_t *context;
+
+	uint32_t numResources;
+	VkuRenderGraphResource_t resources[VKU_RENDERGRAPH_MAX_RESOURCES];
+
+	uint32_t numPasses;
+	VkuRenderGraphPass_t passes[VKU_RENDERGRAPH_MAX_PASSES];
+
+	uint32_t numSlots;
+	VkuRenderGraphSlot_t slots[VKU_RENDERGRAPH_MAX_RESOURCES];
+
+	bool compiled;
+} VkuRenderGraph_t;
+
 uint32_t vkuMemoryTypeFromProperties(VkPhysicalDeviceMemoryProperties memory_properties, uint32_t typeBits, VkFlags requirements_mask);
 
 VkBool32 vkuCreateImageBuffer(VkuContext_t* Context, VkuImage_t* image, VkImageType imageType, VkFormat format, uint32_t mipLevels, uint32_t layers, uint32_t width, uint32_t height, uint32_t depth, VkSampleCountFlagBits samples, VkImageTiling tiling, VkBufferUsageFlags flags, VkFlags requirementsMask, VkImageCreateFlags createFlags);
@@ -308,6 +497,17 @@ VkCommandBuffer vkuOneShotCommandBufferBegin(VkuContext_t *context);
 VkBool32 vkuOneShotCommandBufferFlush(VkuContext_t *context, VkCommandBuffer commandBuffer);
 VkBool32 vkuOneShotCommandBufferEnd(VkuContext_t *context, VkCommandBuffer commandBuffer);
 
+VkBool32 vkuUploadBatch_Init(VkuContext_t *context, VkuUploadBatch_t *batch, VkDeviceSize size);
+void *vkuUploadBatch_Alloc(VkuUploadBatch_t *batch, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize *offset);
+VkCommandBuffer vkuUploadBatch_GetCommandBuffer(VkuUploadBatch_t *batch);
+VkBool32 vkuUploadBatch_Submit(VkuUploadBatch_t *batch);
+VkBool32 vkuUploadBatch_Finish(VkuUploadBatch_t *batch);
+VkBool32 vkuUploadBatch_Flush(VkuUploadBatch_t *batch);
+VkuUploadTicket_t vkuUploadBatch_GetTicket(VkuUploadBatch_t *batch);
+VkBool32 vkuUploadBatch_IsComplete(VkuUploadBatch_t *batch, VkuUploadTicket_t ticket);
+VkBool32 vkuUploadBatch_Wait(VkuUploadBatch_t *batch, VkuUploadTicket_t ticket);
+void vkuUploadBatch_Destroy(VkuUploadBatch_t *batch);
+
 VkShaderModule vkuCreateShaderModuleMemory(VkDevice device, const uint32_t *data, const uint32_t size);
 VkShaderModule vkuCreateShaderModule(VkDevice device, const char *shaderFile);
 
@@ -331,7 +531,8 @@ VkBool32 vkuAllocateUpdateDescriptorSet(VkuDescriptorSet_t *descriptorSet, VkDes
 bool vkuMem_Init(VkuContext_t *context, VkuMemZone_t *zone, uint32_t typeIndex, size_t size);
 void vkuMem_Destroy(VkuContext_t *context, VkuMemZone_t *vkZone);
 void vkuMem_Free(VkuMemZone_t *vkZone, VkuMemBlock_t *ptr);
-VkuMemBlock_t *vkuMem_Malloc(VkuMemZone_t *vkZone, VkMemoryRequirements requirements);
+VkuMemBlock_t *vkuMem_Malloc(VkuMemZone_t *vkZone, VkMemoryRequirements requirements, VkImageTiling tiling);
+void vkuMem_GetStats(VkuMemZone_t *vkZone, VkuMemStats_t *stats);
 void vkuMem_Print(VkuMemZone_t *vkZone);
 
 VkBool32 vkuCreateInstance(VkInstance *instance, const char *extensions[], const uint32_t extensionCount);
@@ -352,10 +553,22 @@ VkBool32 vkuRenderPass_AddSubpassDependency(VkuRenderPass_t *renderPass, uint32_
 VkBool32 vkuInitRenderPass(VkuContext_t *context, VkuRenderPass_t *renderPass);
 VkBool32 vkuCreateRenderPass(VkuRenderPass_t *renderPass);
 
-bool vkuMemAllocator_Init(VkuContext_t *context);
+VkBool32 vkuRenderGraph_Init(VkuContext_t *context, VkuRenderGraph_t *graph);
+uint32_t vkuRenderGraph_ImportImage(VkuRenderGraph_t *graph, VkuImage_t *image, VkImageAspectFlags aspectMask, uint32_t layerCount, VkImageLayout layout, bool output);
+uint32_t vkuRenderGraph_AddTransientImage(VkuRenderGraph_t *graph, VkuImage_t *image, uint32_t width, uint32_t height, VkFormat format, VkSampleCountFlagBits samples);
+uint32_t vkuRenderGraph_AddPass(VkuRenderGraph_t *graph, const char *name, VkuRenderGraphPassFunc_t function, void *data);
+VkBool32 vkuRenderGraph_PassRead(VkuRenderGraph_t *graph, uint32_t pass, uint32_t resource);
+VkBool32 vkuRenderGraph_PassWrite(VkuRenderGraph_t *graph, uint32_t pass, uint32_t resource, VkuRenderGraphAccessType type, VkImageLayout finalLayout);
+VkBool32 vkuRenderGraph_Compile(VkuRenderGraph_t *graph);
+void vkuRenderGraph_Execute(VkuRenderGraph_t *graph, VkCommandBuffer commandBuffer, void *frameData);
+void vkuRenderGraph_Destroy(VkuRenderGraph_t *graph);
+
+bool vkuMemAllocator_Init(VkuContext_t *context, VkDeviceSize hostChunkSize, VkDeviceSize localChunkSize);
 void vkuMemAllocator_Destroy(void);
-VkuMemBlock_t *vkuMemAllocator_Malloc(VkMemoryRequirements memoryRequirements);
+VkuMemBlock_t *vkuMemAllocator_Malloc(VkMemoryRequirements memoryRequirements, VkImageTiling tiling, VkuMemCategory category);
 void vkuMemAllocator_Free(VkuMemBlock_t *block);
+uint32_t vkuMemAllocator_GetStats(VkuMemStats_t *stats, uint32_t maxStats);
+void vkuMemAllocator_GetBudget(VkuMemBudget_t *budget);
 void vkuMemAllocator_Print(void);
 
 #endif
@@ -28,6 +28,33 @@ uint32_t vkuMemoryTypeFromProperties(VkPhysicalDeviceMemoryProperties memoryProp
 	return 0;
 }
 
+// Rough category from how the resource is used, for memory budget reporting
+static VkuMemCategory ImageCategory(VkImageUsageFlags usage)
+{
+	if(usage&(VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT|VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT))
+		return VKU_MEM_CATEGORY_RENDERTARGET;
+
+	return VKU_MEM_CATEGORY_TEXTURE;
+}
+
+static VkuMemCategory BufferCategory(VkBufferUsageFlags usage, bool host)
+{
+	if(usage&VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT)
+		return VKU_MEM_CATEGORY_UNIFORM;
+
+	if(host&&!(usage&~(VK_BUFFER_USAGE_TRANSFER_SRC_BIT|VK_BUFFER_USAGE_TRANSFER_DST_BIT)))
+		return VKU_MEM_CATEGORY_STAGING;
+
+	// Static geometry gets uploaded into device local memory
+	if((usage&VK_BUFFER_USAGE_INDEX_BUFFER_BIT)||(!host&&(usage&VK_BUFFER_USAGE_VERTEX_BUFFER_BIT)&&(usage&VK_BUFFER_USAGE_TRANSFER_DST_BIT)))
+		return VKU_MEM_CATEGORY_MESH;
+
+	if(usage&(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT|VK_BUFFER_USAGE_STORAGE_BUFFER_BIT|VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT))
+		return VKU_MEM_CATEGORY_INSTANCE;
+
+	return VKU_MEM_CATEGORY_OTHER;
+}
+
 VkBool32 vkuCreateImageBuffer(VkuContext_t *context, VkuImage_t *image,
 	VkImageType imageType, VkFormat format, uint32_t mipLevels, uint32_t layers, uint32_t width, uint32_t height, uint32_t depth, 
 	VkSampleCountFlagBits samples, VkImageTiling tiling, VkBufferUsageFlags flags, VkFlags requirementsMask, VkImageCreateFlags createFlags)
@@ -61,7 +88,7 @@ VkBool32 vkuCreateImageBuffer(VkuContext_t *context, VkuImage_t *image,
 
 	memoryRequirements.memoryTypeBits=requirementsMask;
 
-	image->memory=vkuMemAllocator_Malloc(memoryRequirements);
+	image->memory=vkuMemAllocator_Malloc(memoryRequirements, tiling, ImageCategory(flags));
 
 	if(image->memory==NULL)
 		return VK_FALSE;
@@ -250,7 +277,7 @@ VkBool32 vkuCreateHostBuffer(VkuContext_t *context, VkuBuffer_t *buffer, uint32_
 	//if(memoryRequirements.size<VKU_MIN_DEVICE_ALLOCATION_SIZE)
 	//	memoryRequirements.size=VKU_MIN_DEVICE_ALLOCATION_SIZE;
 
-	buffer->memory=vkuMemAllocator_Malloc(memoryRequirements);
+	buffer->memory=vkuMemAllocator_Malloc(memoryRequirements, VK_IMAGE_TILING_LINEAR, BufferCategory(flags, true));
 
 	if(buffer->memory==NULL)
 		return VK_FALSE;
@@ -287,7 +314,7 @@ VkBool32 vkuCreateGPUBuffer(VkuContext_t *context, VkuBuffer_t *buffer, uint32_t
 
 	memoryRequirements.memoryTypeBits=VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
 
-	buffer->memory=vkuMemAllocator_Malloc(memoryRequirements);
+	buffer->memory=vkuMemAllocator_Malloc(memoryRequirements, VK_IMAGE_TILING_LINEAR, BufferCategory(flags, false));
 
 	if(buffer->memory==NULL)
 		return VK_FALSE;
@@ -8,6 +8,7 @@
 #include "vulkan.h"
 
 PFN_vkCmdPushDescriptorSetKHR _vkCmdPushDescriptorSetKHR=VK_NULL_HANDLE;
+PFN_vkCmdDrawIndexedIndirectCountKHR _vkCmdDrawIndexedIndirectCountKHR=VK_NULL_HANDLE;
 
 void PrintMemoryTypeFlags(VkMemoryPropertyFlags propertyFlags)
 {
@@ -240,9 +241,11 @@ VkBool32 vkuCreateContext(VkInstance instance, VkuContext_t *context, const char
 	context->getPhysicalDeviceProperties2Extension=VK_FALSE;
 	context->depthStencilResolveExtension=VK_FALSE;
 	context->createRenderPass2Extension=VK_FALSE;
+	context->drawIndirectCountExtension=VK_FALSE;
+	context->memoryBudgetExtension=VK_FALSE;
 
 	// Enable extensions that are supported
-	const char **enabledExtensions=(const char **)Zone_Malloc(zone, sizeof(const char **)*(extensionCount+6));
+	const char **enabledExtensions=(const char **)Zone_Malloc(zone, sizeof(const char **)*(extensionCount+8));
 	uint32_t numEnabledExtensions=0;
 
 	for(uint32_t i=0;i<extensionPropertyCount;i++)
@@ -300,6 +303,27 @@ VkBool32 vkuCreateContext(VkInstance instance, VkuContext_t *context, const char
 			continue;
 		}
 
+		if(strcmp(extensionProperties[i].extensionName, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME)==0)
+		{
+			if((_vkCmdDrawIndexedIndirectCountKHR=(PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetInstanceProcAddr(instance, "vkCmdDrawIndexedIndirectCountKHR"))==VK_NULL_HANDLE)
+				DBGPRINTF(DEBUG_ERROR, "vkGetInstanceProcAddr failed on vkCmdDrawIndexedIndirectCountKHR.\n");
+			else
+			{
+				DBGPRINTF(DEBUG_INFO, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME" extension is supported!\n");
+				enabledExtensions[numEnabledExtensions++]=VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME;
+				context->drawIndirectCountExtension=VK_TRUE;
+				continue;
+			}
+		}
+
+		if(strcmp(extensionProperties[i].extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)==0)
+		{
+			DBGPRINTF(DEBUG_INFO, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME" extension is supported!\n");
+			context->memoryBudgetExtension=VK_TRUE;
+			enabledExtensions[numEnabledExtensions++]=VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+			continue;
+		}
+
 		for(uint32_t j=0;j<extensionCount;j++)
 		{
 			if(strcmp(extensionProperties[i].extensionName, extensions[j])==0)
@@ -391,6 +415,9 @@ VkBool32 vkuCreateContext(VkInstance instance, VkuContext_t *context, const char
 
 	features.robustBufferAccess=false;
 
+	// Everything supported is enabled, keep a copy so optional paths can check for what they need
+	context->deviceFeatures=features;
+
 	void *pNext=VK_NULL_HANDLE;
 	VkPhysicalDeviceDynamicRenderingFeatures deviceDynamicRenderingFeatures={ 0 };
 
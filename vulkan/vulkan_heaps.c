@@ -3,67 +3,228 @@
 #include "../system/system.h"
 #include "vulkan.h"
 
-// Max number of device local heap slices
-#define VKU_MAX_LOCAL_HEAPS 8
+// Max number of memory chunks per heap
+#define VKU_MAX_HEAP_CHUNKS 32
 
-// 2GB for each local device heap
-// TODO: Is there a better way to figure out this value?
-//			Can't allocate *all* the VRAM that the GPU has, if it's a low RAM device...
-//			Allocating the memory divided by the max number of heaps works, but will
-//				really limit the largest memory block size.
-//			Should this just be a user defined configuration that is passed to Init? (probably best bet)
-#define VKU_LOCAL_HEAP_SIZE (2048ull*1024*1024)
+// Chunk sizes are rounded to this
+#define VKU_HEAP_CHUNK_GRANULARITY (1024ull*1024)
 
-// 1GB for host data (staging buffers, UBOs, etc)
-#define VKU_HOST_HEAP_SIZE (1024ull*1024*1024)
+// Limits for automatic chunk sizing, when not set by the caller
+#define VKU_LOCAL_CHUNK_MIN (64ull*1024*1024)
+#define VKU_LOCAL_CHUNK_MAX (512ull*1024*1024)
+#define VKU_HOST_CHUNK_MIN (32ull*1024*1024)
+#define VKU_HOST_CHUNK_MAX (256ull*1024*1024)
+
+typedef struct
+{
+	const char *name;
+	uint32_t typeIndex;
+	VkDeviceSize chunkSize;
+
+	// Chunks are never moved, blocks keep a pointer to the zone they came from.
+	// Empty chunks are released, unused slots have a NULL device memory handle.
+	VkuMemZone_t chunks[VKU_MAX_HEAP_CHUNKS];
+
+	VkDeviceSize reserved, peakReserved;
+} VkuMemHeap_t;
 
 typedef struct
 {
 	bool initialized;
 	VkuContext_t *context;
 
-	uint32_t numDeviceLocal;
-	VkDeviceSize localHeapSize;
-	VkuMemZone_t deviceLocal[VKU_MAX_LOCAL_HEAPS];
-	VkuMemZone_t hostLocal;
+	VkuMemHeap_t deviceLocal;
+	VkuMemHeap_t hostLocal;
+
+	VkDeviceSize categoryUsed[VKU_MEM_CATEGORY_COUNT];
+	VkDeviceSize categoryPeak[VKU_MEM_CATEGORY_COUNT];
 } VkuMemAllocator_t;
 
 static VkuMemAllocator_t vkHeaps;
 
-bool vkuMemAllocator_Init(VkuContext_t *context)
+static const char *categoryNames[VKU_MEM_CATEGORY_COUNT]=
+{
+	"Textures", "Render targets", "Meshes", "Instance buffers", "Uniforms", "Staging", "Other"
+};
+
+static inline VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+	return (value+alignment-1)&~(alignment-1);
+}
+
+static VkDeviceSize ClampChunkSize(VkDeviceSize size, VkDeviceSize minSize, VkDeviceSize maxSize)
+{
+	if(size<minSize)
+		size=minSize;
+
+	if(size>maxSize)
+		size=maxSize;
+
+	return size;
+}
+
+// Budget and usage for a memory heap, from VK_EXT_memory_budget if we have it
+static void GetHeapBudget(const VkuMemHeap_t *heap, VkDeviceSize *budget, VkDeviceSize *usage)
+{
+	const uint32_t heapIndex=vkHeaps.context->deviceMemProperties.memoryTypes[heap->typeIndex].heapIndex;
+
+	if(vkHeaps.context->memoryBudgetExtension)
+	{
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties=
+		{
+			.sType=VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT,
+		};
+
+		VkPhysicalDeviceMemoryProperties2 memoryProperties=
+		{
+			.sType=VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+			.pNext=&budgetProperties,
+		};
+
+		vkGetPhysicalDeviceMemoryProperties2(vkHeaps.context->physicalDevice, &memoryProperties);
+
+		*budget=budgetProperties.heapBudget[heapIndex];
+		*usage=budgetProperties.heapUsage[heapIndex];
+	}
+	else
+	{
+		*budget=vkHeaps.context->deviceMemProperties.memoryHeaps[heapIndex].size;
+		*usage=heap->reserved;
+	}
+}
+
+static VkuMemZone_t *AddChunk(VkuMemHeap_t *heap, VkDeviceSize size)
+{
+	for(uint32_t i=0;i<VKU_MAX_HEAP_CHUNKS;i++)
+	{
+		VkuMemZone_t *chunk=&heap->chunks[i];
+
+		if(chunk->deviceMemory)
+			continue;
+
+		VkDeviceSize budget=0, usage=0;
+		GetHeapBudget(heap, &budget, &usage);
+
+		if(usage+size>budget)
+			DBGPRINTF(DEBUG_WARNING, "%s heap chunk of %0.1fMB goes over budget (usage: %0.1fMB budget: %0.1fMB).\n", heap->name, (float)size/1000.0f/1000.0f, (float)usage/1000.0f/1000.0f, (float)budget/1000.0f/1000.0f);
+
+		if(!vkuMem_Init(vkHeaps.context, chunk, heap->typeIndex, size))
+		{
+			DBGPRINTF(DEBUG_ERROR, "Failed to allocate %s Vulkan memory chunk.\n", heap->name);
+			return NULL;
+		}
+
+		heap->reserved+=size;
+
+		if(heap->reserved>heap->peakReserved)
+			heap->peakReserved=heap->reserved;
+
+		DBGPRINTF(DEBUG_INFO, "Added %s heap chunk - Total reserved: %0.3fMB\n", heap->name, (float)heap->reserved/1000.0f/1000.0f);
+
+		return chunk;
+	}
+
+	DBGPRINTF(DEBUG_ERROR, "Out of %s heap chunks.\n", heap->name);
+	return NULL;
+}
+
+static void ReleaseChunk(VkuMemHeap_t *heap, VkuMemZone_t *chunk)
+{
+	heap->reserved-=chunk->size;
+	vkuMem_Destroy(vkHeaps.context, chunk);
+
+	DBGPRINTF(DEBUG_INFO, "Released %s heap chunk - Total reserved: %0.3fMB\n", heap->name, (float)heap->reserved/1000.0f/1000.0f);
+}
+
+static VkuMemBlock_t *HeapMalloc(VkuMemHeap_t *heap, VkMemoryRequirements memoryRequirements, VkImageTiling tiling)
+{
+	// Try the existing chunks first
+	for(uint32_t i=0;i<VKU_MAX_HEAP_CHUNKS;i++)
+	{
+		if(heap->chunks[i].deviceMemory==VK_NULL_HANDLE||heap->chunks[i].size<memoryRequirements.size)
+			continue;
+
+		VkuMemBlock_t *block=vkuMem_Malloc(&heap->chunks[i], memoryRequirements, tiling);
+
+		if(block)
+			return block;
+	}
+
+	// Otherwise grow, allocations larger than a chunk get a chunk sized to fit
+	VkDeviceSize size=heap->chunkSize;
+
+	if(memoryRequirements.size+memoryRequirements.alignment>size)
+		size=AlignUp(memoryRequirements.size+memoryRequirements.alignment, VKU_HEAP_CHUNK_GRANULARITY);
+
+	VkuMemZone_t *chunk=AddChunk(heap, size);
+
+	if(chunk==NULL)
+		return NULL;
+
+	return vkuMem_Malloc(chunk, memoryRequirements, tiling);
+}
+
+static void HeapInit(VkuMemHeap_t *heap, const char *name, uint32_t typeIndex, VkDeviceSize chunkSize)
+{
+	memset(heap, 0, sizeof(VkuMemHeap_t));
+
+	heap->name=name;
+	heap->typeIndex=typeIndex;
+
+	// Cap to max allowed memory allocation size
+	if(chunkSize>vkHeaps.context->deviceProperties2.maxMemoryAllocationSize)
+		chunkSize=vkHeaps.context->deviceProperties2.maxMemoryAllocationSize;
+
+	heap->chunkSize=AlignUp(chunkSize, VKU_HEAP_CHUNK_GRANULARITY);
+}
+
+static void HeapDestroy(VkuMemHeap_t *heap)
+{
+	for(uint32_t i=0;i<VKU_MAX_HEAP_CHUNKS;i++)
+	{
+		if(heap->chunks[i].deviceMemory)
+			vkuMem_Destroy(vkHeaps.context, &heap->chunks[i]);
+	}
+
+	heap->reserved=0;
+}
+
+// Chunk sizes of 0 pick a size from the device's heap sizes
+bool vkuMemAllocator_Init(VkuContext_t *context, VkDeviceSize hostChunkSize, VkDeviceSize localChunkSize)
 {
 	if(context)
 	{
+		memset(&vkHeaps, 0, sizeof(VkuMemAllocator_t));
+
 		// Save a pointer to the current vulkan context for later use
 		vkHeaps.context=context;
 
-		// Allocate host local memory heap (used for UBO/SSBO/staging/etc)
-		if(!vkuMem_Init(context, &vkHeaps.hostLocal, context->hostMemIndex, VKU_HOST_HEAP_SIZE))
+		if(hostChunkSize==0)
+			hostChunkSize=ClampChunkSize(context->hostMemSize/64, VKU_HOST_CHUNK_MIN, VKU_HOST_CHUNK_MAX);
+
+		if(localChunkSize==0)
+			localChunkSize=ClampChunkSize(context->localMemSize/32, VKU_LOCAL_CHUNK_MIN, VKU_LOCAL_CHUNK_MAX);
+
+		HeapInit(&vkHeaps.hostLocal, "host", context->hostMemIndex, hostChunkSize);
+		HeapInit(&vkHeaps.deviceLocal, "device local", context->localMemIndex, localChunkSize);
+
+		// Allocate the initial chunks, host local is used for UBO/SSBO/staging/etc
+		if(AddChunk(&vkHeaps.hostLocal, vkHeaps.hostLocal.chunkSize)==NULL)
 		{
 			DBGPRINTF(DEBUG_ERROR, "Failed to allocate host local Vulkan memory.\n");
 			return false;
 		}
 
-		DBGPRINTF(DEBUG_INFO, "Host heap size: %0.3fGB\n", (float)VKU_HOST_HEAP_SIZE/1000.0f/1000.0f/1000.0f);
-
-		// Set the largest size of each device local memory heap.
-		// This will also be used for subsequent heap allocations.
-		vkHeaps.localHeapSize=VKU_LOCAL_HEAP_SIZE;//context->localMemSize/VKU_MAX_LOCAL_HEAPS;
-
-		// Cap to max allowed memory allocation size
-		if(vkHeaps.localHeapSize>context->deviceProperties2.maxMemoryAllocationSize)
-			vkHeaps.localHeapSize=context->deviceProperties2.maxMemoryAllocationSize;
-
-		// Allocate an initial device local heap.
-		if(!vkuMem_Init(context, &vkHeaps.deviceLocal[0], context->localMemIndex, vkHeaps.localHeapSize))
+		if(AddChunk(&vkHeaps.deviceLocal, vkHeaps.deviceLocal.chunkSize)==NULL)
 		{
 			DBGPRINTF(DEBUG_ERROR, "Failed to allocate device local Vulkan memory.\n");
 			return false;
 		}
 
-		vkHeaps.numDeviceLocal=1;
+		DBGPRINTF(DEBUG_INFO, "Host heap chunk size: %0.3fMB\n", (float)vkHeaps.hostLocal.chunkSize/1000.0f/1000.0f);
+		DBGPRINTF(DEBUG_INFO, "Local heap chunk size: %0.3fMB\n", (float)vkHeaps.deviceLocal.chunkSize/1000.0f/1000.0f);
 
-		DBGPRINTF(DEBUG_INFO, "Local heap size: %0.3fGB\n", (float)(vkHeaps.localHeapSize*vkHeaps.numDeviceLocal)/1000.0f/1000.0f/1000.0f);
+		vkHeaps.initialized=true;
 	}
 	else
 		return false; // bad context pointer
@@ -73,13 +234,13 @@ bool vkuMemAllocator_Init(VkuContext_t *context)
 
 void vkuMemAllocator_Destroy(void)
 {
-	vkuMem_Destroy(vkHeaps.context, &vkHeaps.hostLocal);
+	HeapDestroy(&vkHeaps.hostLocal);
+	HeapDestroy(&vkHeaps.deviceLocal);
 
-	for(uint32_t i=0;i<vkHeaps.numDeviceLocal;i++)
-		vkuMem_Destroy(vkHeaps.context, &vkHeaps.deviceLocal[i]);
+	vkHeaps.initialized=false;
 }
 
-VkuMemBlock_t *vkuMemAllocator_Malloc(VkMemoryRequirements memoryRequirements)
+VkuMemBlock_t *vkuMemAllocator_Malloc(VkMemoryRequirements memoryRequirements, VkImageTiling tiling, VkuMemCategory category)
 {
 	VkuMemBlock_t *block=NULL;
 
@@ -87,80 +248,124 @@ VkuMemBlock_t *vkuMemAllocator_Malloc(VkMemoryRequirements memoryRequirements)
 
 	// device local heap:
 	if(memoryRequirements.memoryTypeBits&VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+		block=HeapMalloc(&vkHeaps.deviceLocal, memoryRequirements, tiling);
+	// host local heap:
+	else if(memoryRequirements.memoryTypeBits&(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT|VK_MEMORY_PROPERTY_HOST_COHERENT_BIT|VK_MEMORY_PROPERTY_HOST_CACHED_BIT))
+		block=HeapMalloc(&vkHeaps.hostLocal, memoryRequirements, tiling);
+
+	if(block)
 	{
-		uint32_t heap=0;
+		if(category>=VKU_MEM_CATEGORY_COUNT)
+			category=VKU_MEM_CATEGORY_OTHER;
 
-		while(1)
-		{
-			// If the selected heap is valid
-			if(vkHeaps.deviceLocal[heap].deviceMemory)
-			{
-				// Attempt to allocate the memory
-				block=vkuMem_Malloc(&vkHeaps.deviceLocal[heap], memoryRequirements);
-
-				// If it fails, try the next heap
-				if(block==NULL)
-				{
-					heap++;
-					continue;
-				}
-
-				break;
-			}
-			// Otherwise allocate a new heap and try again
-			else
-			{
-				if(!vkuMem_Init(vkHeaps.context, &vkHeaps.deviceLocal[heap], vkHeaps.context->localMemIndex, vkHeaps.localHeapSize))
-				{
-					DBGPRINTF(DEBUG_ERROR, "Failed to allocate device local Vulkan memory.\n");
-					return NULL;
-				}
-				else
-				{
-					vkHeaps.numDeviceLocal++;
-					DBGPRINTF(DEBUG_INFO, "Added local device heap - Local heap total size: %0.3fGB\n", (float)(vkHeaps.localHeapSize*vkHeaps.numDeviceLocal)/1000.0f/1000.0f/1000.0f);
-				}
-			}
-		}
+		block->category=category;
+		vkHeaps.categoryUsed[category]+=block->blockSize;
 
+		if(vkHeaps.categoryUsed[category]>vkHeaps.categoryPeak[category])
+			vkHeaps.categoryPeak[category]=vkHeaps.categoryUsed[category];
 	}
-	// host local heap:
-	else if(memoryRequirements.memoryTypeBits&(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT|VK_MEMORY_PROPERTY_HOST_COHERENT_BIT|VK_MEMORY_PROPERTY_HOST_CACHED_BIT))
-		block=vkuMem_Malloc(&vkHeaps.hostLocal, memoryRequirements);
 
 	return block;
 }
 
 void vkuMemAllocator_Free(VkuMemBlock_t *block)
 {
-	// Search device local heaps for the block
-	for(uint32_t i=0;i<vkHeaps.numDeviceLocal;i++)
+	if(block==NULL||block->free)
+		return;
+
+	// Blocks know which zone they came from
+	VkuMemZone_t *chunk=block->vkZone;
+	VkuMemHeap_t *heap=(chunk>=vkHeaps.hostLocal.chunks&&chunk<vkHeaps.hostLocal.chunks+VKU_MAX_HEAP_CHUNKS)?&vkHeaps.hostLocal:&vkHeaps.deviceLocal;
+
+	vkHeaps.categoryUsed[block->category]-=block->blockSize;
+	vkuMem_Free(chunk, block);
+
+	if(chunk->numAllocations)
+		return;
+
+	// Release empty chunks, but keep the first one and a single empty spare to avoid thrashing
+	if(chunk==&heap->chunks[0])
+		return;
+
+	for(uint32_t i=1;i<VKU_MAX_HEAP_CHUNKS;i++)
 	{
-		VkuMemBlock_t *current=vkHeaps.deviceLocal[i].blocks;
+		VkuMemZone_t *other=&heap->chunks[i];
 
-		while(current!=NULL)
+		if(other!=chunk&&other->deviceMemory&&other->numAllocations==0)
 		{
-			if(current==block)
-			{
-				vkuMem_Free(&vkHeaps.deviceLocal[i], block);
-				return;
-			}
+			ReleaseChunk(heap, chunk);
+			return;
+		}
+	}
+}
+
+// Fills out stats for each chunk, host heap first then device local heap, returns number of chunks filled
+uint32_t vkuMemAllocator_GetStats(VkuMemStats_t *stats, uint32_t maxStats)
+{
+	VkuMemHeap_t *heaps[]={ &vkHeaps.hostLocal, &vkHeaps.deviceLocal };
+	uint32_t count=0;
 
-			current=current->next;
+	if(stats==NULL)
+		return 0;
+
+	for(uint32_t i=0;i<2;i++)
+	{
+		for(uint32_t j=0;j<VKU_MAX_HEAP_CHUNKS&&count<maxStats;j++)
+		{
+			if(heaps[i]->chunks[j].deviceMemory)
+				vkuMem_GetStats(&heaps[i]->chunks[j], &stats[count++]);
 		}
 	}
 
-	// Didn't find it in device local, try host local:
-	vkuMem_Free(&vkHeaps.hostLocal, block);
+	return count;
+}
+
+void vkuMemAllocator_GetBudget(VkuMemBudget_t *budget)
+{
+	if(budget==NULL)
+		return;
+
+	memset(budget, 0, sizeof(VkuMemBudget_t));
+
+	if(!vkHeaps.initialized)
+		return;
+
+	for(uint32_t i=0;i<VKU_MEM_CATEGORY_COUNT;i++)
+	{
+		budget->categoryUsed[i]=vkHeaps.categoryUsed[i];
+		budget->categoryPeak[i]=vkHeaps.categoryPeak[i];
+	}
+
+	budget->hostReserved=vkHeaps.hostLocal.reserved;
+	budget->localReserved=vkHeaps.deviceLocal.reserved;
+
+	GetHeapBudget(&vkHeaps.hostLocal, &budget->hostBudget, &budget->hostUsage);
+	GetHeapBudget(&vkHeaps.deviceLocal, &budget->localBudget, &budget->localUsage);
 }
 
 // Just prints out all vulkan heap allocations
 void vkuMemAllocator_Print(void)
 {
-	DBGPRINTF(DEBUG_INFO, "Host vulkan allocations:\n");
-	vkuMem_Print(&vkHeaps.hostLocal);
+	VkuMemHeap_t *heaps[]={ &vkHeaps.hostLocal, &vkHeaps.deviceLocal };
+
+	for(uint32_t i=0;i<2;i++)
+	{
+		DBGPRINTF(DEBUG_INFO, "%s vulkan allocations (reserved: %0.3fMB peak: %0.3fMB):\n", heaps[i]->name, (float)heaps[i]->reserved/1000.0f/1000.0f, (float)heaps[i]->peakReserved/1000.0f/1000.0f);
 
-	DBGPRINTF(DEBUG_INFO, "Device local vulkan allocations:\n");
-	for(uint32_t i=0;i<vkHeaps.numDeviceLocal;i++)
-		vkuMem_Print(&vkHeaps.deviceLocal[i]);
-}
\ No newline at end of file
+		for(uint32_t j=0;j<VKU_MAX_HEAP_CHUNKS;j++)
+		{
+			if(heaps[i]->chunks[j].deviceMemory)
+				vkuMem_Print(&heaps[i]->chunks[j]);
+		}
+	}
+
+	VkuMemBudget_t budget;
+	vkuMemAllocator_GetBudget(&budget);
+
+	DBGPRINTF(DEBUG_INFO, "Vulkan memory budget%s:\n", vkHeaps.context->memoryBudgetExtension?" (VK_EXT_memory_budget)":"");
+	DBGPRINTF(DEBUG_INFO, "\tHost: %0.3fMB of %0.3fMB\n", (float)budget.hostUsage/1000.0f/1000.0f, (float)budget.hostBudget/1000.0f/1000.0f);
+	DBGPRINTF(DEBUG_INFO, "\tDevice local: %0.3fMB of %0.3fMB\n", (float)budget.localUsage/1000.0f/1000.0f, (float)budget.localBudget/1000.0f/1000.0f);
+
+	for(uint32_t i=0;i<VKU_MEM_CATEGORY_COUNT;i++)
+		DBGPRINTF(DEBUG_INFO, "\t%s: %0.3fMB (peak: %0.3fMB)\n", categoryNames[i], (float)budget.categoryUsed[i]/1000.0f/1000.0f, (float)budget.categoryPeak[i]/1000.0f/1000.0f);
+}
@@ -7,8 +7,298 @@
 #include "../math/math.h"
 #include "vulkan.h"
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Two level segregated fit allocator (TLSF) over a single VkDeviceMemory.
+// Free blocks are binned by size into first level (power of two) and second level (linear subdivision)
+//   lists, with a bitmap for each level so finding a suitable free block is constant time.
+// Block nodes come out of a per-zone pool that grows in chunks, rather than a zone allocation each.
+
+typedef struct VkuMemNodeChunk_s
+{
+	struct VkuMemNodeChunk_s *next;
+	VkuMemBlock_t nodes[VKU_MEM_NODE_CHUNK_SIZE];
+} VkuMemNodeChunk_t;
+
+static inline uint32_t BitScanForward(uint32_t value)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, value);
+	return (uint32_t)index;
+#else
+	return (uint32_t)__builtin_ctz(value);
+#endif
+}
+
+static inline uint32_t BitScanReverse(uint32_t value)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse(&index, value);
+	return (uint32_t)index;
+#else
+	return 31-(uint32_t)__builtin_clz(value);
+#endif
+}
+
+static inline uint32_t BitScanReverse64(uint64_t value)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64(&index, value);
+	return (uint32_t)index;
+#else
+	return 63-(uint32_t)__builtin_clzll(value);
+#endif
+}
+
+static inline size_t AlignUp(size_t value, size_t alignment)
+{
+	return (value+alignment-1)&~(alignment-1);
+}
+
+static inline size_t AlignDown(size_t value, size_t alignment)
+{
+	return value&~(alignment-1);
+}
+
+// Map a block size to its free list indices
+static void MappingInsert(size_t size, uint32_t *fl, uint32_t *sl)
+{
+	const uint64_t units=size/VKU_MEM_MIN_BLOCK_SIZE;
+
+	if(units<VKU_MEM_SL_COUNT)
+	{
+		*fl=0;
+		*sl=(uint32_t)units;
+	}
+	else
+	{
+		const uint32_t msb=BitScanReverse64(units);
+
+		*sl=(uint32_t)(units>>(msb-VKU_MEM_SL_LOG2))^VKU_MEM_SL_COUNT;
+		*fl=msb-VKU_MEM_SL_LOG2+1;
+	}
+}
+
+// Same as above, but rounds up to the next list so any block found there is large enough
+static void MappingSearch(size_t size, uint32_t *fl, uint32_t *sl)
+{
+	const uint64_t units=size/VKU_MEM_MIN_BLOCK_SIZE;
+
+	if(units>=VKU_MEM_SL_COUNT)
+	{
+		const uint32_t msb=BitScanReverse64(units);
+		size+=((size_t)1<<(msb-VKU_MEM_SL_LOG2))*VKU_MEM_MIN_BLOCK_SIZE-VKU_MEM_MIN_BLOCK_SIZE;
+	}
+
+	MappingInsert(size, fl, sl);
+}
+
+static VkuMemBlock_t *FindFreeBlock(VkuMemZone_t *vkZone, size_t size)
+{
+	uint32_t fl, sl;
+
+	MappingSearch(size, &fl, &sl);
+
+	if(fl>=VKU_MEM_FL_COUNT)
+		return NULL;
+
+	uint32_t slMap=vkZone->slBitmap[fl]&(~0u<<sl);
+
+	// Nothing in this first level, go to the next larger one that has anything
+	if(!slMap)
+	{
+		const uint32_t flMap=(fl+1<VKU_MEM_FL_COUNT)?vkZone->flBitmap&(~0u<<(fl+1)):0;
+
+		if(!flMap)
+			return NULL;
+
+		fl=BitScanForward(flMap);
+		slMap=vkZone->slBitmap[fl];
+	}
+
+	sl=BitScanForward(slMap);
+
+	return vkZone->freeLists[fl][sl];
+}
+
+static void InsertFreeBlock(VkuMemZone_t *vkZone, VkuMemBlock_t *block)
+{
+	uint32_t fl, sl;
+
+	MappingInsert(block->blockSize, &fl, &sl);
+
+	block->free=true;
+	block->size=block->blockSize;
+	block->prevFree=NULL;
+	block->nextFree=vkZone->freeLists[fl][sl];
+
+	if(block->nextFree)
+		block->nextFree->prevFree=block;
+
+	vkZone->freeLists[fl][sl]=block;
+	vkZone->flBitmap|=1u<<fl;
+	vkZone->slBitmap[fl]|=1u<<sl;
+	vkZone->numFreeBlocks++;
+}
+
+static void RemoveFreeBlock(VkuMemZone_t *vkZone, VkuMemBlock_t *block)
+{
+	uint32_t fl, sl;
+
+	MappingInsert(block->blockSize, &fl, &sl);
+
+	if(block->prevFree)
+		block->prevFree->nextFree=block->nextFree;
+	else
+		vkZone->freeLists[fl][sl]=block->nextFree;
+
+	if(block->nextFree)
+		block->nextFree->prevFree=block->prevFree;
+
+	block->nextFree=NULL;
+	block->prevFree=NULL;
+
+	if(vkZone->freeLists[fl][sl]==NULL)
+	{
+		vkZone->slBitmap[fl]&=~(1u<<sl);
+
+		if(!vkZone->slBitmap[fl])
+			vkZone->flBitmap&=~(1u<<fl);
+	}
+
+	vkZone->numFreeBlocks--;
+}
+
+static bool GrowNodePool(VkuMemZone_t *vkZone)
+{
+	VkuMemNodeChunk_t *chunk=(VkuMemNodeChunk_t *)Zone_Malloc(zone, sizeof(VkuMemNodeChunk_t));
+
+	if(chunk==NULL)
+	{
+		DBGPRINTF(DEBUG_ERROR, "Failed to allocate memory for memory block nodes.\n");
+		return false;
+	}
+
+	chunk->next=vkZone->nodeChunks;
+	vkZone->nodeChunks=chunk;
+
+	for(uint32_t i=0;i<VKU_MEM_NODE_CHUNK_SIZE;i++)
+	{
+		chunk->nodes[i].next=vkZone->freeNodes;
+		vkZone->freeNodes=&chunk->nodes[i];
+	}
+
+	return true;
+}
+
+// Splitting a block needs at most two nodes (front padding and the remainder), reserve them up front
+static bool ReserveNodes(VkuMemZone_t *vkZone)
+{
+	if(vkZone->freeNodes&&vkZone->freeNodes->next)
+		return true;
+
+	return GrowNodePool(vkZone);
+}
+
+static VkuMemBlock_t *NewNode(VkuMemZone_t *vkZone)
+{
+	VkuMemBlock_t *node=vkZone->freeNodes;
+
+	if(node==NULL)
+		return NULL;
+
+	vkZone->freeNodes=node->next;
+
+	memset(node, 0, sizeof(VkuMemBlock_t));
+	node->deviceMemory=vkZone->deviceMemory;
+	node->vkZone=vkZone;
+
+	return node;
+}
+
+static void ReleaseNode(VkuMemZone_t *vkZone, VkuMemBlock_t *node)
+{
+	node->vkZone=NULL;
+	node->next=vkZone->freeNodes;
+	vkZone->freeNodes=node;
+}
+
+static void SetMappedPointer(VkuMemZone_t *vkZone, VkuMemBlock_t *block)
+{
+	if(vkZone->mappedPointer)
+		block->mappedPointer=(void *)((uint8_t *)vkZone->mappedPointer+block->offset);
+	else
+		block->mappedPointer=NULL;
+}
+
+// Link a new block physically after an existing one
+static void InsertAfter(VkuMemBlock_t *block, VkuMemBlock_t *newBlock)
+{
+	newBlock->prev=block;
+	newBlock->next=block->next;
+
+	if(block->next)
+		block->next->prev=newBlock;
+
+	block->next=newBlock;
+}
+
+static void Unlink(VkuMemZone_t *vkZone, VkuMemBlock_t *block)
+{
+	if(block->prev)
+		block->prev->next=block->next;
+	else
+		vkZone->blocks=block->next;
+
+	if(block->next)
+		block->next->prev=block->prev;
+}
+
+// Linear and optimal resources can't share a bufferImageGranularity sized page
+static inline bool GranularityConflict(const VkuMemBlock_t *neighbor, VkImageTiling tiling)
+{
+	return neighbor&&!neighbor->free&&neighbor->tiling!=tiling;
+}
+
+// Find the offset an allocation would land at inside of a free block, or false if it doesn't fit
+static bool FitBlock(const VkuMemZone_t *vkZone, const VkuMemBlock_t *block, size_t size, size_t alignment, VkImageTiling tiling, size_t *offset)
+{
+	const size_t blockEnd=block->offset+block->blockSize;
+	size_t start=AlignUp(block->offset, alignment);
+
+	// Granularities at or under the minimum block size can never straddle two blocks
+	if(vkZone->granularity>VKU_MEM_MIN_BLOCK_SIZE)
+	{
+		const VkuMemBlock_t *prev=block->prev;
+
+		if(GranularityConflict(prev, tiling)&&AlignDown(prev->offset+prev->blockSize-1, vkZone->granularity)==AlignDown(start, vkZone->granularity))
+			start=AlignUp(start, vkZone->granularity);
+
+		const VkuMemBlock_t *next=block->next;
+
+		if(GranularityConflict(next, tiling)&&start+size>AlignDown(next->offset, vkZone->granularity))
+			return false;
+	}
+
+	if(start+size>blockEnd)
+		return false;
+
+	*offset=start;
+
+	return true;
+}
+
 bool vkuMem_Init(VkuContext_t *context, VkuMemZone_t *vkZone, uint32_t typeIndex, size_t size)
 {
+	memset(vkZone, 0, sizeof(VkuMemZone_t));
+
+	size=AlignDown(size, VKU_MEM_MIN_BLOCK_SIZE);
+
 	// Set up create info with slab size
 	VkMemoryAllocateInfo allocateInfo=
 	{
@@ -28,26 +318,15 @@ bool vkuMem_Init(VkuContext_t *context, VkuMemZone_t *vkZone, uint32_t typeIndex
 		return false;
 	}
 
-	vkZone->blocks=(VkuMemBlock_t *)Zone_Malloc(zone, sizeof(VkuMemBlock_t));
-
-	if(vkZone->blocks==NULL)
+	if(!GrowNodePool(vkZone))
 	{
 		vkFreeMemory(context->device, vkZone->deviceMemory, VK_NULL_HANDLE);
-
-		DBGPRINTF(DEBUG_ERROR, "Failed to allocate memory for memory block.\n");
+		vkZone->deviceMemory=VK_NULL_HANDLE;
 		return false;
 	}
 
-	// Set up the initial free block
-	vkZone->blocks->offset=0;
-	vkZone->blocks->size=size;
-	vkZone->blocks->free=true;
-	vkZone->blocks->deviceMemory=vkZone->deviceMemory;
-	vkZone->blocks->mappedPointer=NULL;
-	vkZone->blocks->prev=NULL;
-	vkZone->blocks->next=NULL;
-
 	vkZone->size=size;
+	vkZone->granularity=context->deviceProperties.properties.limits.bufferImageGranularity;
 
 	// If this is a host memory heap, map a pointer to it
 	if(context->deviceMemProperties.memoryTypes[typeIndex].propertyFlags&(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT|VK_MEMORY_PROPERTY_HOST_COHERENT_BIT|VK_MEMORY_PROPERTY_HOST_CACHED_BIT))
@@ -59,11 +338,15 @@ bool vkuMem_Init(VkuContext_t *context, VkuMemZone_t *vkZone, uint32_t typeIndex
 			DBGPRINTF(DEBUG_ERROR, "Failed to map vulakn device memory (Result=%d).\n", result);
 			vkZone->mappedPointer=NULL;
 		}
-
-		if(vkZone->mappedPointer!=NULL)
-			vkZone->blocks->mappedPointer=vkZone->mappedPointer;
 	}
 
+	// Set up the initial free block
+	vkZone->blocks=NewNode(vkZone);
+	vkZone->blocks->offset=0;
+	vkZone->blocks->blockSize=size;
+	SetMappedPointer(vkZone, vkZone->blocks);
+	InsertFreeBlock(vkZone, vkZone->blocks);
+
 	DBGPRINTF(DEBUG_INFO, "Vulakn memory zone allocated (OBJ: 0x%p), size: %0.3fMB\n", vkZone->deviceMemory, (float)size/1000.0f/1000.0f);
 
 	return true;
@@ -71,14 +354,19 @@ bool vkuMem_Init(VkuContext_t *context, VkuMemZone_t *vkZone, uint32_t typeIndex
 
 void vkuMem_Destroy(VkuContext_t *context, VkuMemZone_t *vkZone)
 {
-	if(vkZone->blocks)
+	if(vkZone->deviceMemory)
 	{
-		VkuMemBlock_t *block=vkZone->blocks;
+		if(vkZone->numAllocations)
+			DBGPRINTF(DEBUG_WARNING, "vkuMem_Destroy: %u allocations still live in zone.\n", vkZone->numAllocations);
 
-		while(block!=NULL)
+		// Nodes live in the pool chunks, so only the chunks need freeing
+		VkuMemNodeChunk_t *chunk=vkZone->nodeChunks;
+
+		while(chunk!=NULL)
 		{
-			Zone_Free(zone, block);
-			block=block->next;
+			VkuMemNodeChunk_t *next=chunk->next;
+			Zone_Free(zone, chunk);
+			chunk=next;
 		}
 
 		if(vkZone->mappedPointer)
@@ -86,6 +374,8 @@ void vkuMem_Destroy(VkuContext_t *context, VkuMemZone_t *vkZone)
 
 		vkFreeMemory(context->device, vkZone->deviceMemory, VK_NULL_HANDLE);
 	}
+
+	memset(vkZone, 0, sizeof(VkuMemZone_t));
 }
 
 void vkuMem_Free(VkuMemZone_t *vkZone, VkuMemBlock_t *block)
@@ -102,117 +392,179 @@ void vkuMem_Free(VkuMemZone_t *vkZone, VkuMemBlock_t *block)
 		return;
 	}
 
-	block->free=true;
-
-	if(block->prev&&block->prev->free)
+	if(block->vkZone!=vkZone)
 	{
-		VkuMemBlock_t *Last=block->prev;
-
-		Last->size+=block->size;
-		Last->next=block->next;
+		DBGPRINTF(DEBUG_WARNING, "VkuMem_Free: Block does not belong to this zone.\n");
+		return;
+	}
 
-		if(Last->next)
-			Last->next->prev=Last;
+	vkZone->used-=block->blockSize;
+	vkZone->numAllocations--;
 
-		if(block==vkZone->blocks)
-			vkZone->blocks=Last;
+	// Merge with the previous block
+	if(block->prev&&block->prev->free)
+	{
+		VkuMemBlock_t *prev=block->prev;
 
-		Zone_Free(zone, block);
-		block=Last;
+		RemoveFreeBlock(vkZone, prev);
+		prev->blockSize+=block->blockSize;
+		Unlink(vkZone, block);
+		ReleaseNode(vkZone, block);
+		block=prev;
 	}
 
+	// And the next block
 	if(block->next&&block->next->free)
 	{
 		VkuMemBlock_t *next=block->next;
 
-		block->size+=next->size;
-		block->next=next->next;
-
-		if(block->next)
-			block->next->prev=block;
-
-		if(next==vkZone->blocks)
-			vkZone->blocks=block;
-
-		Zone_Free(zone, next);
+		RemoveFreeBlock(vkZone, next);
+		block->blockSize+=next->blockSize;
+		Unlink(vkZone, next);
+		ReleaseNode(vkZone, next);
 	}
-}
 
-static inline size_t AlignUp(size_t value, size_t alignment)
-{
-	return (value+alignment-1)&~(alignment-1);
+	InsertFreeBlock(vkZone, block);
 }
 
-VkuMemBlock_t *vkuMem_Malloc(VkuMemZone_t *vkZone, VkMemoryRequirements memoryRequirements)
+VkuMemBlock_t *vkuMem_Malloc(VkuMemZone_t *vkZone, VkMemoryRequirements memoryRequirements, VkImageTiling tiling)
 {
-	const size_t minimumBlockSize=memoryRequirements.alignment;
+	if(memoryRequirements.size==0)
+		return NULL;
+
+	const size_t alignment=memoryRequirements.alignment>VKU_MEM_MIN_BLOCK_SIZE?memoryRequirements.alignment:VKU_MEM_MIN_BLOCK_SIZE;
+	const size_t size=AlignUp(memoryRequirements.size, alignment);
 
-	// Align size to the memory requirements
-	const size_t alignedSize=AlignUp(memoryRequirements.size, memoryRequirements.alignment);
+	if(!ReserveNodes(vkZone))
+		return NULL;
 
-	VkuMemBlock_t *baseBlock=vkZone->blocks;
+	// Search for a block that can take the worst case alignment padding
+	size_t searchSize=size+alignment-VKU_MEM_MIN_BLOCK_SIZE;
+	size_t offset=0;
 
-	while(baseBlock!=NULL)
+	VkuMemBlock_t *block=FindFreeBlock(vkZone, searchSize);
+
+	// If it doesn't fit due to granularity conflicts with its neighbors, search again with a page of slack on each side
+	if(block&&!FitBlock(vkZone, block, size, alignment, tiling, &offset))
 	{
-		if(baseBlock->free&&baseBlock->size>=alignedSize)
-		{
-			const size_t remainingSize=baseBlock->size-alignedSize;
+		searchSize+=2*AlignUp(vkZone->granularity, VKU_MEM_MIN_BLOCK_SIZE);
+		block=FindFreeBlock(vkZone, searchSize);
+
+		if(block&&!FitBlock(vkZone, block, size, alignment, tiling, &offset))
+			block=NULL;
+	}
 
-			// Check if we can split the block and ensure alignment for the new block
-			if(remainingSize>=minimumBlockSize)
-			{
-				// Create a new free space block from the extra space
-				VkuMemBlock_t *newBlock=(VkuMemBlock_t *)Zone_Malloc(zone, sizeof(VkuMemBlock_t));
+	if(block==NULL)
+	{
+		DBGPRINTF(DEBUG_WARNING, "Vulkan mem: Unable to find large enough free block.\n");
+		return NULL;
+	}
 
-				// Align the new block's offset
-				newBlock->offset=baseBlock->offset+alignedSize;
-				newBlock->size=remainingSize;
-				newBlock->free=true;
-				newBlock->deviceMemory=vkZone->deviceMemory;
+	RemoveFreeBlock(vkZone, block);
 
-				if(vkZone->mappedPointer)
-					newBlock->mappedPointer=(void *)((uint8_t *)vkZone->mappedPointer+newBlock->offset);
+	// Split off any front padding as its own free block
+	if(offset>block->offset)
+	{
+		VkuMemBlock_t *padding=NewNode(vkZone);
 
-				newBlock->prev=baseBlock;
-				newBlock->next=baseBlock->next;
+		padding->offset=block->offset;
+		padding->blockSize=offset-block->offset;
+		SetMappedPointer(vkZone, padding);
 
-				if(baseBlock->next)
-					baseBlock->next->prev=newBlock;
+		padding->prev=block->prev;
+		padding->next=block;
 
-				baseBlock->next=newBlock;
-				baseBlock->size=alignedSize;
-			}
+		if(block->prev)
+			block->prev->next=padding;
+		else
+			vkZone->blocks=padding;
 
-			// Mark the base block as used and readjust offset and mapped pointer as needed
-			baseBlock->free=false;
-			baseBlock->offset=AlignUp(baseBlock->offset, memoryRequirements.alignment);
+		block->prev=padding;
 
-			if(vkZone->mappedPointer)
-				baseBlock->mappedPointer=(void *)((uint8_t *)vkZone->mappedPointer+baseBlock->offset);
+		block->offset=offset;
+		block->blockSize-=padding->blockSize;
+
+		InsertFreeBlock(vkZone, padding);
+	}
+
+	// And the remainder off the end
+	if(block->blockSize>size)
+	{
+		VkuMemBlock_t *remainder=NewNode(vkZone);
+
+		remainder->offset=block->offset+size;
+		remainder->blockSize=block->blockSize-size;
+		SetMappedPointer(vkZone, remainder);
+		InsertAfter(block, remainder);
+
+		block->blockSize=size;
+
+		InsertFreeBlock(vkZone, remainder);
+	}
+
+	block->free=false;
+	block->size=memoryRequirements.alignment?AlignUp(memoryRequirements.size, memoryRequirements.alignment):memoryRequirements.size;
+	block->tiling=tiling;
+	SetMappedPointer(vkZone, block);
+
+	vkZone->used+=block->blockSize;
+	vkZone->numAllocations++;
+
+	if(vkZone->used>vkZone->peakUsed)
+		vkZone->peakUsed=vkZone->used;
 
 #ifdef _DEBUG
-			DBGPRINTF(DEBUG_WARNING, "Vulkan mem allocate block - Location offset: %zu Size: %0.3fKB\n",
-					  baseBlock->offset, (float)baseBlock->size/1000.0f);
+	DBGPRINTF(DEBUG_WARNING, "Vulkan mem allocate block - Location offset: %zu Size: %0.3fKB\n", block->offset, (float)block->size/1000.0f);
 #endif
-			return baseBlock;
-		}
 
-		baseBlock=baseBlock->next;
+	return block;
+}
+
+void vkuMem_GetStats(VkuMemZone_t *vkZone, VkuMemStats_t *stats)
+{
+	memset(stats, 0, sizeof(VkuMemStats_t));
+
+	stats->size=vkZone->size;
+	stats->used=vkZone->used;
+	stats->peakUsed=vkZone->peakUsed;
+	stats->numAllocations=vkZone->numAllocations;
+	stats->numFreeBlocks=vkZone->numFreeBlocks;
+
+	// Largest free block lives in the highest non-empty free list
+	if(vkZone->flBitmap)
+	{
+		const uint32_t fl=BitScanReverse(vkZone->flBitmap);
+		const uint32_t sl=BitScanReverse(vkZone->slBitmap[fl]);
+
+		for(VkuMemBlock_t *block=vkZone->freeLists[fl][sl];block!=NULL;block=block->nextFree)
+		{
+			if(block->blockSize>stats->largestFree)
+				stats->largestFree=block->blockSize;
+		}
 	}
 
-	DBGPRINTF(DEBUG_WARNING, "Vulkan mem: Unable to find large enough free block.\n");
-	return NULL;
+	const size_t totalFree=vkZone->size-vkZone->used;
+
+	if(totalFree)
+		stats->fragmentation=1.0f-(float)((double)stats->largestFree/(double)totalFree);
 }
 
 void vkuMem_Print(VkuMemZone_t *vkZone)
 {
+	VkuMemStats_t stats;
+
+	vkuMem_GetStats(vkZone, &stats);
+
 	DBGPRINTF(DEBUG_WARNING, "Vulkan zone size: %0.2fMB  Location: 0x%p (Vulkan Object Address)\n", (float)(vkZone->size/1000.0f/1000.0f), vkZone->deviceMemory);
+	DBGPRINTF(DEBUG_WARNING, "\tUsed: %0.2fMB Peak: %0.2fMB Allocations: %u Free blocks: %u Largest free: %0.2fMB Fragmentation: %0.1f%%\n",
+			  (float)stats.used/1000.0f/1000.0f, (float)stats.peakUsed/1000.0f/1000.0f, stats.numAllocations, stats.numFreeBlocks,
+			  (float)stats.largestFree/1000.0f/1000.0f, stats.fragmentation*100.0f);
 
 	VkuMemBlock_t *block=vkZone->blocks;
 
 	while(block!=NULL)
 	{
-		DBGPRINTF(DEBUG_WARNING, "\tOffset: %0.4fMB Size: %0.4fMB Block free: %s\n", (float)block->offset/1000.0f/1000.0f, (float)block->size/1000.0f/1000.0f, block->free?"yes":"no");
+		DBGPRINTF(DEBUG_WARNING, "\tOffset: %0.4fMB Size: %0.4fMB Block free: %s\n", (float)block->offset/1000.0f/1000.0f, (float)block->blockSize/1000.0f/1000.0f, block->free?"yes":"no");
 		block=block->next;
 	}
 }
@@ -17,9 +17,12 @@ VkShaderModule vkuCreateShaderModuleMemory(VkDevice device, const uint32_t *data
 	VkShaderModuleCreateInfo CreateInfo={ VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO, NULL, 0, size, data };
 	VkResult Result=vkCreateShaderModule(device, &CreateInfo, VK_NULL_HANDLE, &shaderModule);
 
+#ifdef _DEBUG
+	// Reflection dump is only useful while developing, skip the extra SPIR-V walk for release loads
 	SpvReflectionInfo_t reflectionInfo={ 0 };
 	parseSpv(data, size, &reflectionInfo);
 	spvReflectDump(&reflectionInfo);
+#endif
 
 	if(Result==VK_SUCCESS)
 		return shaderModule;
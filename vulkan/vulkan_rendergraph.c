@@ -0,0 +1,594 @@
+// Render graph
+// Passes declare which images they read and write, compiling the graph culls passes nothing depends on,
+// works out when each transient image is alive and packs transients that are never alive at the same
+// time into the same memory. Executing it records the passes in order with only the barriers the declared
+// accesses need, tracking each image's layout from pass to pass and frame to frame.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "../system/system.h"
+#include "vulkan.h"
+
+#define VKU_RENDERGRAPH_WRITE_ACCESS (VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT|VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT|VK_ACCESS_SHADER_WRITE_BIT|VK_ACCESS_TRANSFER_WRITE_BIT)
+
+static void vkuRenderGraph_AccessState(VkuRenderGraphAccessType type, VkImageLayout *layout, VkPipelineStageFlags *stageMask, VkAccessFlags *accessMask)
+{
+	switch(type)
+	{
+		case VKU_RENDERGRAPH_ACCESS_COLOR:
+			*layout=VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+			*stageMask=VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			*accessMask=VK_ACCESS_COLOR_ATTACHMENT_READ_BIT|VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			break;
+
+		case VKU_RENDERGRAPH_ACCESS_DEPTH:
+			*layout=VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+			*stageMask=VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT|VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			*accessMask=VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT|VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			break;
+
+		case VKU_RENDERGRAPH_ACCESS_SAMPLED:
+			*layout=VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			*stageMask=VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+			*accessMask=VK_ACCESS_SHADER_READ_BIT;
+			break;
+
+		case VKU_RENDERGRAPH_ACCESS_EXTERNAL:
+		default:
+			*layout=VK_IMAGE_LAYOUT_UNDEFINED;
+			*stageMask=0;
+			*accessMask=0;
+			break;
+	}
+}
+
+VkBool32 vkuRenderGraph_Init(VkuContext_t *context, VkuRenderGraph_t *graph)
+{
+	if(context==NULL||graph==NULL)
+		return VK_FALSE;
+
+	memset(graph, 0, sizeof(VkuRenderGraph_t));
+	graph->context=context;
+
+	return VK_TRUE;
+}
+
+// Adds an image the graph doesn't own (persistent images, swapchain images as NULL), returns the resource index or UINT32_MAX on failure.
+// layout is the layout the image is in right now, output images are what keeps passes from being culled.
+uint32_t vkuRenderGraph_ImportImage(VkuRenderGraph_t *graph, VkuImage_t *image, VkImageAspectFlags aspectMask, uint32_t layerCount, VkImageLayout layout, bool output)
+{
+	if(graph==NULL||graph->compiled)
+		return UINT32_MAX;
+
+	if(graph->numResources>=VKU_RENDERGRAPH_MAX_RESOURCES)
+	{
+		DBGPRINTF(DEBUG_ERROR, "vkuRenderGraph_ImportImage: Out of resources.\n");
+		return UINT32_MAX;
+	}
+
+	graph->resources[graph->numResources]=(VkuRenderGraphResource_t)
+	{
+		.image=image,
+		.transient=false,
+		.output=output,
+		.aspectMask=aspectMask,
+		.layerCount=layerCount,
+		.layout=layout,
+	};
+
+	return graph->numResources++;
+}
+
+// Adds an image that only has to live between the passes that use it, it's created into image on compile and may share memory with other transients.
+// Returns the resource index or UINT32_MAX on failure.
+uint32_t vkuRenderGraph_AddTransientImage(VkuRenderGraph_t *graph, VkuImage_t *image, uint32_t width, uint32_t height, VkFormat format, VkSampleCountFlagBits samples)
+{
+	if(graph==NULL||image==NULL||graph->compiled)
+		return UINT32_MAX;
+
+	if(graph->numResources>=VKU_RENDERGRAPH_MAX_RESOURCES)
+	{
+		DBGPRINTF(DEBUG_ERROR, "vkuRenderGraph_AddTransientImage: Out of resources.\n");
+		return UINT32_MAX;
+	}
+
+	VkImageAspectFlags aspectMask=VK_IMAGE_ASPECT_COLOR_BIT;
+
+	if(format>=VK_FORMAT_D16_UNORM&&format<=VK_FORMAT_D32_SFLOAT_S8_UINT)
+	{
+		aspectMask=VK_IMAGE_ASPECT_DEPTH_BIT;
+
+		if(format>=VK_FORMAT_S8_UINT)
+			aspectMask|=VK_IMAGE_ASPECT_STENCIL_BIT;
+	}
+
+	memset(image, 0, sizeof(VkuImage_t));
+
+	graph->resources[graph->numResources]=(VkuRenderGraphResource_t)
+	{
+		.image=image,
+		.transient=true,
+		.output=false,
+		.width=width,
+		.height=height,
+		.format=format,
+		.samples=samples,
+		.aspectMask=aspectMask,
+		.layerCount=1,
+		.layout=VK_IMAGE_LAYOUT_UNDEFINED,
+	};
+
+	return graph->numResources++;
+}
+
+// Passes are executed in the order they're added, returns the pass index or UINT32_MAX on failure
+uint32_t vkuRenderGraph_AddPass(VkuRenderGraph_t *graph, const char *name, VkuRenderGraphPassFunc_t function, void *data)
+{
+	if(graph==NULL||function==NULL||graph->compiled)
+		return UINT32_MAX;
+
+	if(graph->numPasses>=VKU_RENDERGRAPH_MAX_PASSES)
+	{
+		DBGPRINTF(DEBUG_ERROR, "vkuRenderGraph_AddPass: Out of passes.\n");
+		return UINT32_MAX;
+	}
+
+	graph->passes[graph->numPasses]=(VkuRenderGraphPass_t)
+	{
+		.name=name,
+		.function=function,
+		.data=data,
+		.numAccesses=0,
+		.culled=false,
+	};
+
+	return graph->numPasses++;
+}
+
+static VkBool32 vkuRenderGraph_AddAccess(VkuRenderGraph_t *graph, uint32_t pass, uint32_t resource, VkuRenderGraphAccessType type, VkImageLayout finalLayout)
+{
+	if(graph==NULL||graph->compiled||pass>=graph->numPasses||resource>=graph->numResources)
+		return VK_FALSE;
+
+	VkuRenderGraphPass_t *graphPass=&graph->passes[pass];
+
+	if(graphPass->numAccesses>=VKU_RENDERGRAPH_MAX_PASS_ACCESSES)
+	{
+		DBGPRINTF(DEBUG_ERROR, "vkuRenderGraph: Pass \"%s\" is out of accesses.\n", graphPass->name);
+		return VK_FALSE;
+	}
+
+	graphPass->accesses[graphPass->numAccesses++]=(VkuRenderGraphAccess_t)
+	{
+		.resource=resource,
+		.type=type,
+		.finalLayout=finalLayout,
+	};
+
+	return VK_TRUE;
+}
+
+VkBool32 vkuRenderGraph_PassRead(VkuRenderGraph_t *graph, uint32_t pass, uint32_t resource)
+{
+	return vkuRenderGraph_AddAccess(graph, pass, resource, VKU_RENDERGRAPH_ACCESS_SAMPLED, VK_IMAGE_LAYOUT_UNDEFINED);
+}
+
+// finalLayout is the layout the pass's render pass leaves the image in, or UNDEFINED if it ends in the layout it was written in
+VkBool32 vkuRenderGraph_PassWrite(VkuRenderGraph_t *graph, uint32_t pass, uint32_t resource, VkuRenderGraphAccessType type, VkImageLayout finalLayout)
+{
+	if(type==VKU_RENDERGRAPH_ACCESS_SAMPLED)
+		return VK_FALSE;
+
+	return vkuRenderGraph_AddAccess(graph, pass, resource, type, finalLayout);
+}
+
+static VkBool32 vkuRenderGraph_CreateTransient(VkuRenderGraph_t *graph, VkuRenderGraphResource_t *resource)
+{
+	VkImageUsageFlags usageFlags=VK_IMAGE_USAGE_SAMPLED_BIT|VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+
+	if(resource->aspectMask&VK_IMAGE_ASPECT_DEPTH_BIT)
+		usageFlags|=VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	else
+		usageFlags|=VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+
+	if(vkCreateImage(graph->context->device, &(VkImageCreateInfo)
+	{
+		.sType=VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+		.imageType=VK_IMAGE_TYPE_2D,
+		.format=resource->format,
+		.mipLevels=1,
+		.arrayLayers=1,
+		.samples=resource->samples,
+		.tiling=VK_IMAGE_TILING_OPTIMAL,
+		.usage=usageFlags,
+		.sharingMode=VK_SHARING_MODE_EXCLUSIVE,
+		.initialLayout=VK_IMAGE_LAYOUT_UNDEFINED,
+		.extent.width=resource->width,
+		.extent.height=resource->height,
+		.extent.depth=1,
+	}, VK_NULL_HANDLE, &resource->image->image)!=VK_SUCCESS)
+		return VK_FALSE;
+
+	resource->image->width=resource->width;
+	resource->image->height=resource->height;
+	resource->image->depth=1;
+
+	return VK_TRUE;
+}
+
+static VkBool32 vkuRenderGraph_CreateTransientViews(VkuRenderGraph_t *graph, VkuRenderGraphResource_t *resource)
+{
+	if(vkCreateImageView(graph->context->device, &(VkImageViewCreateInfo)
+	{
+		.sType=VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+		.image=resource->image->image,
+		.viewType=VK_IMAGE_VIEW_TYPE_2D,
+		.format=resource->format,
+		.components={ VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A },
+		.subresourceRange.aspectMask=resource->aspectMask&~VK_IMAGE_ASPECT_STENCIL_BIT,
+		.subresourceRange.baseMipLevel=0,
+		.subresourceRange.levelCount=1,
+		.subresourceRange.baseArrayLayer=0,
+		.subresourceRange.layerCount=1,
+	}, VK_NULL_HANDLE, &resource->image->imageView)!=VK_SUCCESS)
+		return VK_FALSE;
+
+	if(vkCreateSampler(graph->context->device, &(VkSamplerCreateInfo)
+	{
+		.sType=VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+		.magFilter=VK_FILTER_LINEAR,
+		.minFilter=VK_FILTER_LINEAR,
+		.mipmapMode=VK_SAMPLER_MIPMAP_MODE_LINEAR,
+		.addressModeU=VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		.addressModeV=VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		.addressModeW=VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		.mipLodBias=0.0f,
+		.maxAnisotropy=1.0f,
+		.compareOp=VK_COMPARE_OP_NEVER,
+		.minLod=0.0f,
+		.maxLod=VK_LOD_CLAMP_NONE,
+		.borderColor=VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE,
+	}, VK_NULL_HANDLE, &resource->image->sampler)!=VK_SUCCESS)
+		return VK_FALSE;
+
+	return VK_TRUE;
+}
+
+// Culls passes, assigns transient memory and creates the transient images, the graph can't be changed after this
+VkBool32 vkuRenderGraph_Compile(VkuRenderGraph_t *graph)
+{
+	if(graph==NULL||graph->compiled)
+		return VK_FALSE;
+
+	// Walk back from the outputs, a pass is only kept if something kept (or an output) uses what it writes
+	bool needed[VKU_RENDERGRAPH_MAX_RESOURCES];
+
+	for(uint32_t i=0;i<graph->numResources;i++)
+		needed[i]=graph->resources[i].output;
+
+	for(int32_t i=graph->numPasses-1;i>=0;i--)
+	{
+		VkuRenderGraphPass_t *pass=&graph->passes[i];
+		bool alive=false;
+
+		for(uint32_t j=0;j<pass->numAccesses;j++)
+		{
+			if(pass->accesses[j].type!=VKU_RENDERGRAPH_ACCESS_SAMPLED&&needed[pass->accesses[j].resource])
+			{
+				alive=true;
+				break;
+			}
+		}
+
+		pass->culled=!alive;
+
+		if(!alive)
+		{
+			DBGPRINTF(DEBUG_INFO, "vkuRenderGraph_Compile: Culled pass \"%s\", nothing uses its output.\n", pass->name);
+			continue;
+		}
+
+		for(uint32_t j=0;j<pass->numAccesses;j++)
+		{
+			if(pass->accesses[j].type==VKU_RENDERGRAPH_ACCESS_SAMPLED)
+				needed[pass->accesses[j].resource]=true;
+		}
+	}
+
+	// Lifetimes over the passes that are left
+	for(uint32_t i=0;i<graph->numResources;i++)
+	{
+		graph->resources[i].firstPass=UINT32_MAX;
+		graph->resources[i].lastPass=0;
+		graph->resources[i].slot=UINT32_MAX;
+	}
+
+	for(uint32_t i=0;i<graph->numPasses;i++)
+	{
+		if(graph->passes[i].culled)
+			continue;
+
+		for(uint32_t j=0;j<graph->passes[i].numAccesses;j++)
+		{
+			VkuRenderGraphResource_t *resource=&graph->resources[graph->passes[i].accesses[j].resource];
+
+			if(resource->firstPass==UINT32_MAX)
+				resource->firstPass=i;
+
+			resource->lastPass=i;
+		}
+	}
+
+	// Create the transients that are still used and sort them by when they're first needed
+	uint32_t order[VKU_RENDERGRAPH_MAX_RESOURCES];
+	VkMemoryRequirements requirements[VKU_RENDERGRAPH_MAX_RESOURCES];
+	uint32_t numTransients=0;
+
+	for(uint32_t i=0;i<graph->numResources;i++)
+	{
+		VkuRenderGraphResource_t *resource=&graph->resources[i];
+
+		if(!resource->transient||resource->firstPass==UINT32_MAX)
+			continue;
+
+		if(!vkuRenderGraph_CreateTransient(graph, resource))
+		{
+			DBGPRINTF(DEBUG_ERROR, "vkuRenderGraph_Compile: Failed to create transient image.\n");
+			return VK_FALSE;
+		}
+
+		vkGetImageMemoryRequirements(graph->context->device, resource->image->image, &requirements[i]);
+
+		uint32_t j=numTransients++;
+
+		for(;j>0&&graph->resources[order[j-1]].firstPass>resource->firstPass;j--)
+			order[j]=order[j-1];
+
+		order[j]=i;
+	}
+
+	// Greedy interval packing, each transient goes in the smallest free slot it fits, or grows the largest free one
+	VkDeviceSize unaliasedSize=0;
+
+	for(uint32_t i=0;i<numTransients;i++)
+	{
+		VkuRenderGraphResource_t *resource=&graph->resources[order[i]];
+		const VkMemoryRequirements *requirement=&requirements[order[i]];
+		uint32_t fit=UINT32_MAX, largest=UINT32_MAX;
+
+		unaliasedSize+=requirement->size;
+
+		for(uint32_t j=0;j<graph->numSlots;j++)
+		{
+			const VkuRenderGraphSlot_t *slot=&graph->slots[j];
+
+			if(slot->busyUntil>=resource->firstPass)
+				continue;
+
+			if(slot->size>=requirement->size&&(fit==UINT32_MAX||slot->size<graph->slots[fit].size))
+				fit=j;
+
+			if(largest==UINT32_MAX||slot->size>graph->slots[largest].size)
+				largest=j;
+		}
+
+		if(fit==UINT32_MAX)
+			fit=largest;
+
+		if(fit==UINT32_MAX)
+		{
+			fit=graph->numSlots++;
+			graph->slots[fit]=(VkuRenderGraphSlot_t){ 0 };
+		}
+
+		VkuRenderGraphSlot_t *slot=&graph->slots[fit];
+
+		if(requirement->size>slot->size)
+			slot->size=requirement->size;
+
+		if(requirement->alignment>slot->alignment)
+			slot->alignment=requirement->alignment;
+
+		slot->busyUntil=resource->lastPass;
+		resource->slot=fit;
+	}
+
+	VkDeviceSize aliasedSize=0;
+
+	for(uint32_t i=0;i<graph->numSlots;i++)
+	{
+		VkuRenderGraphSlot_t *slot=&graph->slots[i];
+
+		// Memory type bits is the heap selection for the allocator, not the real type bits
+		slot->memory=vkuMemAllocator_Malloc((VkMemoryRequirements)
+		{
+			.size=slot->size,
+			.alignment=slot->alignment,
+			.memoryTypeBits=VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		}, VK_IMAGE_TILING_OPTIMAL, VKU_MEM_CATEGORY_RENDERTARGET);
+
+		if(slot->memory==NULL)
+		{
+			DBGPRINTF(DEBUG_ERROR, "vkuRenderGraph_Compile: Failed to allocate transient memory.\n");
+			return VK_FALSE;
+		}
+
+		aliasedSize+=slot->size;
+	}
+
+	for(uint32_t i=0;i<numTransients;i++)
+	{
+		VkuRenderGraphResource_t *resource=&graph->resources[order[i]];
+		const VkuRenderGraphSlot_t *slot=&graph->slots[resource->slot];
+
+		if(vkBindImageMemory(graph->context->device, resource->image->image, slot->memory->deviceMemory, slot->memory->offset)!=VK_SUCCESS)
+		{
+			DBGPRINTF(DEBUG_ERROR, "vkuRenderGraph_Compile: Failed to bind transient memory.\n");
+			return VK_FALSE;
+		}
+
+		if(!vkuRenderGraph_CreateTransientViews(graph, resource))
+		{
+			DBGPRINTF(DEBUG_ERROR, "vkuRenderGraph_Compile: Failed to create transient image view.\n");
+			return VK_FALSE;
+		}
+
+		// Memory belongs to the graph, not the image
+		resource->image->memory=NULL;
+	}
+
+	DBGPRINTF(DEBUG_INFO, "vkuRenderGraph_Compile: %d transients in %d slots, %0.3fMB instead of %0.3fMB.\n",
+			  numTransients, graph->numSlots, (float)aliasedSize/1000.0f/1000.0f, (float)unaliasedSize/1000.0f/1000.0f);
+
+	graph->compiled=true;
+
+	return VK_TRUE;
+}
+
+void vkuRenderGraph_Execute(VkuRenderGraph_t *graph, VkCommandBuffer commandBuffer, void *frameData)
+{
+	if(graph==NULL||!graph->compiled)
+		return;
+
+	for(uint32_t i=0;i<graph->numPasses;i++)
+	{
+		VkuRenderGraphPass_t *pass=&graph->passes[i];
+
+		if(pass->culled)
+			continue;
+
+		VkImageMemoryBarrier barriers[VKU_RENDERGRAPH_MAX_PASS_ACCESSES];
+		bool barrierEmitted[VKU_RENDERGRAPH_MAX_PASS_ACCESSES];
+		uint32_t numBarriers=0;
+		VkPipelineStageFlags srcStageMask=0, dstStageMask=0;
+
+		for(uint32_t j=0;j<pass->numAccesses;j++)
+		{
+			const VkuRenderGraphAccess_t *access=&pass->accesses[j];
+			VkuRenderGraphResource_t *resource=&graph->resources[access->resource];
+
+			barrierEmitted[j]=false;
+
+			// The pass's render pass handles these itself
+			if(access->type==VKU_RENDERGRAPH_ACCESS_EXTERNAL||resource->image==NULL)
+				continue;
+
+			VkImageLayout layout;
+			VkPipelineStageFlags stageMask;
+			VkAccessFlags accessMask;
+
+			vkuRenderGraph_AccessState(access->type, &layout, &stageMask, &accessMask);
+
+			VkImageLayout oldLayout=resource->layout;
+			VkPipelineStageFlags oldStageMask=resource->stageMask;
+			VkAccessFlags oldAccessMask=resource->accessMask;
+
+			// A transient's first use this frame discards whatever was there, but still has to wait on the last image that used its memory
+			if(resource->transient&&i==resource->firstPass)
+			{
+				oldLayout=VK_IMAGE_LAYOUT_UNDEFINED;
+				oldStageMask=graph->slots[resource->slot].stageMask;
+				oldAccessMask=graph->slots[resource->slot].accessMask;
+			}
+
+			// Reading something that's already readable in the right layout needs nothing
+			if(oldLayout==layout&&access->type==VKU_RENDERGRAPH_ACCESS_SAMPLED&&!(oldAccessMask&VKU_RENDERGRAPH_WRITE_ACCESS))
+				continue;
+
+			barriers[numBarriers++]=(VkImageMemoryBarrier)
+			{
+				.sType=VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+				.srcAccessMask=oldAccessMask&VKU_RENDERGRAPH_WRITE_ACCESS,
+				.dstAccessMask=accessMask,
+				.oldLayout=oldLayout,
+				.newLayout=layout,
+				.srcQueueFamilyIndex=VK_QUEUE_FAMILY_IGNORED,
+				.dstQueueFamilyIndex=VK_QUEUE_FAMILY_IGNORED,
+				.image=resource->image->image,
+				.subresourceRange.aspectMask=resource->aspectMask,
+				.subresourceRange.baseMipLevel=0,
+				.subresourceRange.levelCount=1,
+				.subresourceRange.baseArrayLayer=0,
+				.subresourceRange.layerCount=resource->layerCount,
+			};
+
+			srcStageMask|=oldStageMask;
+			dstStageMask|=stageMask;
+			barrierEmitted[j]=true;
+		}
+
+		if(numBarriers)
+			vkCmdPipelineBarrier(commandBuffer, srcStageMask?srcStageMask:VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStageMask, 0, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE, numBarriers, barriers);
+
+		pass->function(commandBuffer, pass->data, frameData);
+
+		// Track where everything ended up
+		for(uint32_t j=0;j<pass->numAccesses;j++)
+		{
+			const VkuRenderGraphAccess_t *access=&pass->accesses[j];
+			VkuRenderGraphResource_t *resource=&graph->resources[access->resource];
+
+			VkImageLayout layout;
+			VkPipelineStageFlags stageMask;
+			VkAccessFlags accessMask;
+
+			vkuRenderGraph_AccessState(access->type, &layout, &stageMask, &accessMask);
+
+			if(access->finalLayout!=VK_IMAGE_LAYOUT_UNDEFINED)
+				layout=access->finalLayout;
+
+			if(access->type==VKU_RENDERGRAPH_ACCESS_EXTERNAL)
+			{
+				// The render pass's own outgoing dependency already made the writes available
+				if(layout!=VK_IMAGE_LAYOUT_UNDEFINED)
+					resource->layout=layout;
+
+				resource->stageMask=0;
+				resource->accessMask=0;
+			}
+			else if(barrierEmitted[j]||access->type!=VKU_RENDERGRAPH_ACCESS_SAMPLED)
+			{
+				resource->layout=layout;
+				resource->stageMask=stageMask;
+				resource->accessMask=accessMask;
+			}
+			else
+			{
+				// More readers of the same data, a later write has to wait on all of them
+				resource->stageMask|=stageMask;
+				resource->accessMask|=accessMask;
+			}
+
+			if(resource->transient)
+			{
+				graph->slots[resource->slot].stageMask=resource->stageMask;
+				graph->slots[resource->slot].accessMask=resource->accessMask;
+			}
+		}
+	}
+}
+
+void vkuRenderGraph_Destroy(VkuRenderGraph_t *graph)
+{
+	if(graph==NULL||graph->context==NULL)
+		return;
+
+	for(uint32_t i=0;i<graph->numResources;i++)
+	{
+		if(graph->resources[i].transient)
+			vkuDestroyImageBuffer(graph->context, graph->resources[i].image);
+	}
+
+	for(uint32_t i=0;i<graph->numSlots;i++)
+	{
+		if(graph->slots[i].memory)
+			vkuMemAllocator_Free(graph->slots[i].memory);
+	}
+
+	graph->numResources=0;
+	graph->numPasses=0;
+	graph->numSlots=0;
+	graph->compiled=false;
+}
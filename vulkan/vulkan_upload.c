@@ -0,0 +1,326 @@
+// Batched staging uploads
+// One persistently mapped host buffer used as a ring, uploads are sub-allocated from it and their
+// copies recorded into a shared command buffer. Command buffers are only submitted when the ring
+// runs out of space, when flushed (once a frame) or on finish, and only the oldest submission is waited on
+// to reclaim space. Flushing reclaims space from any submissions whose fences have signaled without blocking.
+// Each submission is numbered, the ticket for an upload can be polled or waited on for just that upload.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "../system/system.h"
+#include "vulkan.h"
+
+static inline VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+	return (value+alignment-1)&~(alignment-1);
+}
+
+static VkBool32 vkuUploadBatch_CreateStaging(VkuUploadBatch_t *batch, VkDeviceSize size)
+{
+	if(!vkuCreateHostBuffer(batch->context, &batch->stagingBuffer, (uint32_t)size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT))
+	{
+		DBGPRINTF(DEBUG_ERROR, "vkuUploadBatch: Unable to create %llu byte staging buffer.\n", (unsigned long long)size);
+		return VK_FALSE;
+	}
+
+	batch->mappedPointer=(uint8_t *)batch->stagingBuffer.memory->mappedPointer;
+	batch->size=size;
+	batch->head=0;
+	batch->tail=0;
+
+	return VK_TRUE;
+}
+
+// Waits on the oldest in-flight submission and releases its part of the ring
+static VkBool32 vkuUploadBatch_Retire(VkuUploadBatch_t *batch)
+{
+	if(batch->numSubmits==0)
+		return VK_FALSE;
+
+	VkuUploadSubmit_t *submit=&batch->submits[0];
+
+	if(vkWaitForFences(batch->context->device, 1, &submit->fence, VK_TRUE, UINT64_MAX)!=VK_SUCCESS)
+		return VK_FALSE;
+
+	vkDestroyFence(batch->context->device, submit->fence, VK_NULL_HANDLE);
+	vkFreeCommandBuffers(batch->context->device, batch->commandPool, 1, &submit->commandBuffer);
+
+	batch->tail=submit->end;
+	batch->completedTicket=submit->ticket;
+
+	batch->numSubmits--;
+	memmove(&batch->submits[0], &batch->submits[1], sizeof(VkuUploadSubmit_t)*batch->numSubmits);
+
+	// Nothing in flight and nothing recorded, start back at the beginning
+	if(batch->numSubmits==0&&batch->commandBuffer==VK_NULL_HANDLE)
+		batch->head=batch->tail=0;
+
+	return VK_TRUE;
+}
+
+// Releases every submission that has already completed, without blocking
+static VkBool32 vkuUploadBatch_RetireCompleted(VkuUploadBatch_t *batch)
+{
+	while(batch->numSubmits&&vkGetFenceStatus(batch->context->device, batch->submits[0].fence)==VK_SUCCESS)
+	{
+		if(!vkuUploadBatch_Retire(batch))
+			return VK_FALSE;
+	}
+
+	return VK_TRUE;
+}
+
+VkBool32 vkuUploadBatch_Init(VkuContext_t *context, VkuUploadBatch_t *batch, VkDeviceSize size)
+{
+	if(context==NULL||batch==NULL)
+		return VK_FALSE;
+
+	memset(batch, 0, sizeof(VkuUploadBatch_t));
+	batch->context=context;
+	batch->nextTicket=1;
+
+	if(vkCreateCommandPool(context->device, &(VkCommandPoolCreateInfo)
+	{
+		.sType=VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.flags=VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+		.queueFamilyIndex=context->graphicsQueueIndex,
+	}, VK_NULL_HANDLE, &batch->commandPool)!=VK_SUCCESS)
+	{
+		DBGPRINTF(DEBUG_ERROR, "vkuUploadBatch_Init: Unable to create command pool.\n");
+		return VK_FALSE;
+	}
+
+	if(!vkuUploadBatch_CreateStaging(batch, size))
+	{
+		vkDestroyCommandPool(context->device, batch->commandPool, VK_NULL_HANDLE);
+		return VK_FALSE;
+	}
+
+	return VK_TRUE;
+}
+
+// Returns the command buffer that copies for the last allocation should be recorded into.
+// Must be called *after* vkuUploadBatch_Alloc, as allocating may submit the previous command buffer.
+VkCommandBuffer vkuUploadBatch_GetCommandBuffer(VkuUploadBatch_t *batch)
+{
+	if(batch->commandBuffer!=VK_NULL_HANDLE)
+		return batch->commandBuffer;
+
+	if(vkAllocateCommandBuffers(batch->context->device, &(VkCommandBufferAllocateInfo)
+	{
+		.sType=VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool=batch->commandPool,
+		.level=VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount=1,
+	}, &batch->commandBuffer)!=VK_SUCCESS)
+	{
+		batch->commandBuffer=VK_NULL_HANDLE;
+		return VK_NULL_HANDLE;
+	}
+
+	if(vkBeginCommandBuffer(batch->commandBuffer, &(VkCommandBufferBeginInfo)
+	{
+		.sType=VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags=VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	})!=VK_SUCCESS)
+	{
+		vkFreeCommandBuffers(batch->context->device, batch->commandPool, 1, &batch->commandBuffer);
+		batch->commandBuffer=VK_NULL_HANDLE;
+		return VK_NULL_HANDLE;
+	}
+
+	return batch->commandBuffer;
+}
+
+// Sub-allocates staging space from the ring, returns a host pointer to write to and the buffer offset to copy from.
+void *vkuUploadBatch_Alloc(VkuUploadBatch_t *batch, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize *offset)
+{
+	if(batch==NULL||size==0)
+		return NULL;
+
+	// Too big to ever fit, drain everything and grow the ring
+	if(size>batch->size)
+	{
+		VkDeviceSize newSize=batch->size?batch->size:VKU_MIN_DEVICE_ALLOCATION_SIZE;
+
+		while(newSize<size)
+			newSize*=2;
+
+		DBGPRINTF(DEBUG_WARNING, "vkuUploadBatch_Alloc: Growing staging ring to %llu bytes.\n", (unsigned long long)newSize);
+
+		if(!vkuUploadBatch_Finish(batch))
+			return NULL;
+
+		vkuDestroyBuffer(batch->context, &batch->stagingBuffer);
+
+		if(!vkuUploadBatch_CreateStaging(batch, newSize))
+			return NULL;
+	}
+
+	for(;;)
+	{
+		const bool empty=batch->numSubmits==0&&batch->commandBuffer==VK_NULL_HANDLE;
+
+		if(empty)
+			batch->head=batch->tail=0;
+
+		VkDeviceSize start=AlignUp(batch->head, alignment);
+		bool found=false;
+
+		if(empty||batch->head>batch->tail)
+		{
+			// Free space is from the head to the end, then wraps around from the start to the tail
+			if(start+size<=batch->size)
+				found=true;
+			else if(size<=batch->tail)
+			{
+				start=0;
+				found=true;
+			}
+		}
+		else if(batch->head<batch->tail)
+		{
+			// Wrapped, free space is between the head and the tail
+			if(start+size<=batch->tail)
+				found=true;
+		}
+		// head==tail while not empty means the ring is full
+
+		if(found)
+		{
+			if(vkuUploadBatch_GetCommandBuffer(batch)==VK_NULL_HANDLE)
+				return NULL;
+
+			batch->head=start+size;
+
+			if(offset)
+				*offset=start;
+
+			return batch->mappedPointer+start;
+		}
+
+		// Out of room, kick off what's been recorded so far and reclaim the oldest submission
+		if(!vkuUploadBatch_Submit(batch))
+			return NULL;
+
+		if(!vkuUploadBatch_Retire(batch))
+			return NULL;
+	}
+}
+
+// Submits the currently recording command buffer without waiting on it
+VkBool32 vkuUploadBatch_Submit(VkuUploadBatch_t *batch)
+{
+	if(batch->commandBuffer==VK_NULL_HANDLE)
+		return VK_TRUE;
+
+	if(batch->numSubmits>=VKU_UPLOAD_MAX_SUBMITS)
+	{
+		if(!vkuUploadBatch_Retire(batch))
+			return VK_FALSE;
+	}
+
+	VkuUploadSubmit_t *submit=&batch->submits[batch->numSubmits];
+
+	if(vkEndCommandBuffer(batch->commandBuffer)!=VK_SUCCESS)
+		return VK_FALSE;
+
+	if(vkCreateFence(batch->context->device, &(VkFenceCreateInfo) {.sType=VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, .flags=0 }, VK_NULL_HANDLE, &submit->fence)!=VK_SUCCESS)
+		return VK_FALSE;
+
+	if(vkQueueSubmit(batch->context->graphicsQueue, 1, &(VkSubmitInfo)
+	{
+		.sType=VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.commandBufferCount=1,
+		.pCommandBuffers=&batch->commandBuffer,
+	}, submit->fence)!=VK_SUCCESS)
+	{
+		vkDestroyFence(batch->context->device, submit->fence, VK_NULL_HANDLE);
+		return VK_FALSE;
+	}
+
+	submit->commandBuffer=batch->commandBuffer;
+	submit->end=batch->head;
+	submit->ticket=batch->nextTicket++;
+	batch->numSubmits++;
+
+	batch->commandBuffer=VK_NULL_HANDLE;
+
+	return VK_TRUE;
+}
+
+// Submits anything outstanding and waits for all uploads to complete
+VkBool32 vkuUploadBatch_Finish(VkuUploadBatch_t *batch)
+{
+	if(!vkuUploadBatch_Submit(batch))
+		return VK_FALSE;
+
+	while(batch->numSubmits)
+	{
+		if(!vkuUploadBatch_Retire(batch))
+			return VK_FALSE;
+	}
+
+	return VK_TRUE;
+}
+
+// Submits anything recorded and reclaims finished submissions without waiting, meant to be called once a frame
+VkBool32 vkuUploadBatch_Flush(VkuUploadBatch_t *batch)
+{
+	if(!vkuUploadBatch_Submit(batch))
+		return VK_FALSE;
+
+	return vkuUploadBatch_RetireCompleted(batch);
+}
+
+// Ticket covering every upload recorded so far
+VkuUploadTicket_t vkuUploadBatch_GetTicket(VkuUploadBatch_t *batch)
+{
+	if(batch->commandBuffer!=VK_NULL_HANDLE)
+		return batch->nextTicket;
+
+	return batch->nextTicket-1;
+}
+
+VkBool32 vkuUploadBatch_IsComplete(VkuUploadBatch_t *batch, VkuUploadTicket_t ticket)
+{
+	if(ticket<=batch->completedTicket)
+		return VK_TRUE;
+
+	vkuUploadBatch_RetireCompleted(batch);
+
+	return ticket<=batch->completedTicket;
+}
+
+// Blocks until the uploads covered by a ticket are complete, submitting them first if they're still recording
+VkBool32 vkuUploadBatch_Wait(VkuUploadBatch_t *batch, VkuUploadTicket_t ticket)
+{
+	if(ticket<=batch->completedTicket)
+		return VK_TRUE;
+
+	if(ticket>=batch->nextTicket&&!vkuUploadBatch_Submit(batch))
+		return VK_FALSE;
+
+	while(batch->completedTicket<ticket&&batch->numSubmits)
+	{
+		if(!vkuUploadBatch_Retire(batch))
+			return VK_FALSE;
+	}
+
+	return ticket<=batch->completedTicket;
+}
+
+void vkuUploadBatch_Destroy(VkuUploadBatch_t *batch)
+{
+	if(batch==NULL||batch->context==NULL)
+		return;
+
+	vkuUploadBatch_Finish(batch);
+
+	vkuDestroyBuffer(batch->context, &batch->stagingBuffer);
+	vkDestroyCommandPool(batch->context->device, batch->commandPool, VK_NULL_HANDLE);
+
+	memset(batch, 0, sizeof(VkuUploadBatch_t));
+}